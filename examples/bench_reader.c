@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "cnpy.h"
+
+/*
+ * Compare reading a whole array through the mapping (cnpy_read_range()) and with pread() (cnpy_reader_read_range()) at several block sizes.
+ * Usage: bench_reader [size in MiB] [file name]
+ * Before each run, the file is dropped from the page cache with posix_fadvise() (as far as the kernel allows), so the numbers are for a cold cache.
+ */
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double) t.tv_sec + 1e-9 * (double) t.tv_nsec;
+}
+
+static void drop_cache(const char *fn) {
+  int fd = open(fn, O_RDONLY);
+  if (fd != -1) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+static double sum(const double *x, size_t n) {
+  double s = 0;
+  for (size_t i = 0; i < n; i += 1) {
+    s += x[i];
+  }
+  return s;
+}
+
+int main(int argc, char **argv) {
+  size_t mib = (argc > 1)? (size_t) atol(argv[1]) : 256;
+  const char *fn = (argc > 2)? argv[2] : "bench_reader.npy";
+  size_t dims[] = { (mib << 20) / sizeof(double) };
+  size_t block_sizes[] = { 1 << 16, 1 << 18, 1 << 20, 1 << 22, 1 << 24 };
+  size_t n_block_sizes = sizeof(block_sizes) / sizeof(block_sizes[0]);
+
+  cnpy_array a;
+  unlink(fn);
+  if (cnpy_create(fn, CNPY_LE, CNPY_F8, CNPY_C_ORDER, 1, dims, &a) != CNPY_SUCCESS) {
+    cnpy_perror("Unable to create file");
+    abort();
+  }
+  for (size_t i = 0; i < dims[0]; i += 1) {
+    double x = (double) (i % 1000);
+    cnpy_write_range(a, i, 1, &x);
+  }
+  if (cnpy_close(&a) != CNPY_SUCCESS) {
+    cnpy_perror("Unable to close file");
+    abort();
+  }
+
+  double *buf = (double *) malloc(block_sizes[n_block_sizes - 1]);
+  if (buf == NULL) {
+    abort();
+  }
+
+  printf("%-8s %10s %10s %12s\n", "method", "block", "seconds", "MiB/s");
+  for (size_t b = 0; b < n_block_sizes; b += 1) {
+    size_t n_block = block_sizes[b] / sizeof(double);
+
+    drop_cache(fn);
+    double t = now();
+    if (cnpy_open(fn, false, &a) != CNPY_SUCCESS) {
+      cnpy_perror("Unable to open file");
+      abort();
+    }
+    double s = 0;
+    for (size_t i = 0; i < dims[0]; i += n_block) {
+      size_t n = (dims[0] - i < n_block)? dims[0] - i : n_block;
+      cnpy_read_range(a, i, n, buf);
+      s += sum(buf, n);
+    }
+    cnpy_close(&a);
+    t = now() - t;
+    printf("%-8s %10zu %10.3f %12.1f  (sum %g)\n", "mmap", block_sizes[b], t, (double) mib / t, s);
+
+    drop_cache(fn);
+    t = now();
+    cnpy_reader r;
+    if (cnpy_reader_open(fn, block_sizes[b], &r) != CNPY_SUCCESS) {
+      cnpy_perror("Unable to open file");
+      abort();
+    }
+    s = 0;
+    for (size_t i = 0; i < dims[0]; i += n_block) {
+      size_t n = (dims[0] - i < n_block)? dims[0] - i : n_block;
+      if (cnpy_reader_read_range(&r, i, n, buf) != CNPY_SUCCESS) {
+        cnpy_perror("Unable to read file");
+        abort();
+      }
+      s += sum(buf, n);
+    }
+    cnpy_reader_close(&r);
+    t = now() - t;
+    printf("%-8s %10zu %10.3f %12.1f  (sum %g)\n", "pread", block_sizes[b], t, (double) mib / t, s);
+  }
+
+  free(buf);
+  unlink(fn);
+  return EXIT_SUCCESS;
+}
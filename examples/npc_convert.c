@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cnpy.h"
+
+/*
+ * Convert a .npy file to a compressed .npc file and back.
+ * Usage: npc_convert [-f none|shuffle|bitshuffle] [-b block size in bytes] [-t threads] in.npy out.npc
+ *        npc_convert -d [-t threads] in.npc out.npy
+ * The output file must not exist. Decompressed arrays are written in host byte order.
+ */
+
+static void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-f none|shuffle|bitshuffle] [-b block size] [-t threads] in.npy out.npc\n", name);
+  fprintf(stderr, "       %s -d [-t threads] in.npc out.npy\n", name);
+  exit(EXIT_FAILURE);
+}
+
+static int compress(const char *in, const char *out, cnpy_npc_filter filter, size_t block_size, size_t n_threads) {
+  cnpy_array a;
+  if (cnpy_open(in, false, &a) != CNPY_SUCCESS) {
+    cnpy_perror("Input file not opened");
+    return EXIT_FAILURE;
+  }
+  cnpy_status status = cnpy_npc_write(out, a, block_size, filter, n_threads);
+  if (status != CNPY_SUCCESS) {
+    cnpy_perror("Output file not written");
+  }
+  cnpy_close(&a);
+  return (status == CNPY_SUCCESS)? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int decompress(const char *in, const char *out, size_t n_threads) {
+  cnpy_npc npc;
+  if (cnpy_npc_open(in, n_threads, &npc) != CNPY_SUCCESS) {
+    cnpy_perror("Input file not opened");
+    return EXIT_FAILURE;
+  }
+  cnpy_byte_order host = cnpy_is_host_byte_order(CNPY_LE)? CNPY_LE : CNPY_BE;
+  cnpy_array a;
+  cnpy_status status = cnpy_create(out, host, npc.arr.dtype, npc.arr.order, npc.arr.n_dim, npc.arr.dims, &a);
+  if (status != CNPY_SUCCESS) {
+    cnpy_perror("Output file not created");
+  }
+  else {
+    /* whole blocks are decompressed straight into the mapping of the output */
+    status = cnpy_npc_read_range(&npc, 0, cnpy_n_elements(a), a.raw_data + a.data_begin);
+    if (status != CNPY_SUCCESS) {
+      cnpy_perror("Input file not read");
+    }
+    if (cnpy_close(&a) != CNPY_SUCCESS && status == CNPY_SUCCESS) {
+      cnpy_perror("Output file not written");
+      status = CNPY_ERROR_FILE;
+    }
+    if (status != CNPY_SUCCESS) {
+      unlink(out);
+    }
+  }
+  cnpy_npc_close(&npc);
+  return (status == CNPY_SUCCESS)? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[]) {
+  bool to_npy = false;
+  cnpy_npc_filter filter = CNPY_NPC_SHUFFLE;
+  size_t block_size = 0;
+  size_t n_threads = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "df:b:t:")) != -1) {
+    switch (opt) {
+      case 'd':
+        to_npy = true;
+        break;
+      case 'f':
+        if (strcmp(optarg, "none") == 0) {
+          filter = CNPY_NPC_NO_FILTER;
+        }
+        else if (strcmp(optarg, "shuffle") == 0) {
+          filter = CNPY_NPC_SHUFFLE;
+        }
+        else if (strcmp(optarg, "bitshuffle") == 0) {
+          filter = CNPY_NPC_BITSHUFFLE;
+        }
+        else {
+          usage(argv[0]);
+        }
+        break;
+      case 'b':
+        block_size = (size_t) strtoull(optarg, NULL, 10);
+        break;
+      case 't':
+        n_threads = (size_t) strtoull(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (argc - optind != 2) {
+    usage(argv[0]);
+  }
+  const char *in = argv[optind];
+  const char *out = argv[optind + 1];
+  return to_npy? decompress(in, out, n_threads) : compress(in, out, filter, block_size, n_threads);
+}
@@ -19,6 +19,7 @@
 #pragma once
 
 #include <stdbool.h> /* bool */
+#include <stddef.h> /* ptrdiff_t */
 #include <limits.h> /* CHAR_BITS */
 #include <stdint.h> /* exact width integers */
 #include <fcntl.h> /* open, read */
@@ -28,14 +29,49 @@
 #include <ctype.h> /* isdigit */
 #include <assert.h> /* assert, static_assert */
 #include <stdio.h> /* fprintf, stderr */
-#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS) && !defined(__clang__) /* TODO: check for clang version */
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define CNPY_THREADSAFE /* thread_local is a keyword in C++11 */
+#elif __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS) && !defined(__clang__) /* TODO: check for clang version */
 #define CNPY_THREADSAFE
 #include <threads.h> /* thread_local */
 #endif
 #include <errno.h> /* strerror, errno */
 #include <stdarg.h> /* va_list, va_begin, va_end */
-#include <math.h> /* log10 */
+#include <math.h> /* fabs, INFINITY, NAN */
+#ifdef __cplusplus
+#include <complex> /* std::complex */
+#else
 #include <complex.h> /* complex, creal, crealf, imag, imagf */
+#endif
+#if defined(_POSIX_THREADS) && _POSIX_THREADS > 0 && !defined(CNPY_NO_THREADS)
+#define CNPY_PTHREADS
+#include <pthread.h> /* pthread_create, pthread_join */
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) && !defined(CNPY_NO_SIMD)
+#define CNPY_SIMD_X86
+#include <immintrin.h> /* _mm_shuffle_epi8, _mm256_shuffle_epi8 */
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(CNPY_NO_SIMD)
+#define CNPY_SIMD_NEON
+#include <arm_neon.h> /* vrev16q_u8, vrev32q_u8, vrev64q_u8 */
+#endif
+#include <sys/uio.h> /* struct iovec */
+#if defined(__linux__) && defined(__has_include) && !defined(CNPY_NO_IO_URING)
+#if __has_include(<linux/io_uring.h>)
+#define CNPY_IO_URING
+#include <sys/syscall.h> /* SYS_io_uring_setup, SYS_io_uring_enter, SYS_io_uring_register */
+#include <linux/io_uring.h> /* struct io_uring_params, struct io_uring_sqe, struct io_uring_cqe */
+#endif
+#endif
+#include <sys/stat.h> /* fstat */
+#include <dirent.h> /* opendir, readdir */
+#include <time.h> /* clock_gettime, nanosleep */
+#include <poll.h> /* poll */
+#if defined(__linux__) && defined(__has_include) && !defined(CNPY_NO_INOTIFY)
+#if __has_include(<sys/inotify.h>)
+#define CNPY_INOTIFY
+#include <sys/inotify.h> /* inotify_init1, inotify_add_watch */
+#endif
+#endif
 
 
 #if __STDC_VERSION__ >= 201112L
@@ -46,11 +82,32 @@ _Static_assert(sizeof(size_t) >= 4, "This code assumes that size_t is at least 3
 #endif
 
 
+/*
+ * C++ compatibility.
+ * cnpy.h can also be compiled as C++ (C++11 or newer); see cnpy.hpp for a C++ interface.
+ * C99 complex numbers are layout compatible with std::complex.
+ */
+#ifdef __cplusplus
+typedef std::complex<float> cnpy_complex_float;
+typedef std::complex<double> cnpy_complex_double;
+#define CNPY_RESTRICT __restrict
+#else
+typedef complex float cnpy_complex_float;
+typedef complex double cnpy_complex_double;
+#define CNPY_RESTRICT restrict
+#endif
+
+
 #ifndef CNPY_MAX_DIM
 #define CNPY_MAX_DIM 4 /* maximum number of dimensions; four ought to be enough for everybody... If not, just increase it with a -D flag. */
 #endif
 
 
+#ifndef CNPY_MAX_THREADS
+#define CNPY_MAX_THREADS 64 /* maximum number of threads used by a single call; the thread handles live on the stack. */
+#endif
+
+
 typedef enum {
   CNPY_LE, /* little endian (least significant byte to most significant byte) */
   CNPY_BE, /* big endian (most significant byte to least significant byte) */
@@ -134,6 +191,9 @@ typedef struct {
   char *raw_data; /* pointer to the raw data, including header. */
   size_t data_begin; /* offset where the actual data starts (first byte after header). */
   size_t raw_data_size; /* size of the whole data, including the full header */
+  size_t map_size; /* size of the mapping at raw_data; at least raw_data_size (larger e. g. for huge pages, or room to grow) */
+  int fd; /* the file, kept open for growing the array (see cnpy_open_options), or -1 */
+  bool read_only; /* the data is mapped read-only (e. g. CNPY_MAP_READ_ONLY); writing to it crashes the program */
 } cnpy_array;
 
 
@@ -158,7 +218,7 @@ thread_local
 char cnpy_error_str[CNPY_ERROR_STR_SIZE] = "cnpy successful";
 
 
-static void cnpy_perror(char *str) {
+static void cnpy_perror(const char *str) {
   if (str != NULL && str[0] != '\0') {
     fprintf(stderr, "%s: ", str);
   }
@@ -166,7 +226,7 @@ static void cnpy_perror(char *str) {
 }
 
 
-static cnpy_status cnpy_error(cnpy_status s, char *str, ...) {
+static cnpy_status cnpy_error(cnpy_status s, const char *str, ...) {
   va_list args;
   va_start(args, str);
   vsnprintf(cnpy_error_str, CNPY_ERROR_STR_SIZE, str, args);
@@ -175,84 +235,326 @@ static cnpy_status cnpy_error(cnpy_status s, char *str, ...) {
 }
 
 
+/* As cnpy_error(), but write the message to error_str (CNPY_ERROR_STR_SIZE bytes) instead of cnpy_error_str, unless it is NULL. */
+static cnpy_status cnpy_error_to(char *error_str, cnpy_status s, const char *str, ...) {
+  va_list args;
+  va_start(args, str);
+  vsnprintf((error_str != NULL)? error_str : cnpy_error_str, CNPY_ERROR_STR_SIZE, str, args);
+  va_end(args);
+  return s;
+}
+
+
 static void cnpy_error_reset(void) {
   cnpy_error(CNPY_SUCCESS, "cnpy successful");
 }
 
 
 /*
- * Reader function
+ * Threads
+ *
+ * Some bulk operations split their work across threads.
+ * Worker threads never touch cnpy_error_str; only the calling thread reports errors.
  */
 
 
-/* Forward declaration of header parser */
-static cnpy_status cnpy_parse(const char * const, size_t, cnpy_array*);
+/* Number of threads to use if the user asks for n_threads; 0 means one per online CPU. */
+static size_t cnpy_n_threads(size_t n_threads) {
+#ifdef CNPY_PTHREADS
+  if (n_threads == 0) {
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    n_threads = (n_cpus > 0)? (size_t) n_cpus : 1;
+  }
+  return (n_threads < CNPY_MAX_THREADS)? n_threads : CNPY_MAX_THREADS;
+#else
+  (void) n_threads;
+  return 1;
+#endif
+}
+
+
+typedef struct {
+  void (*fn)(void *, size_t, size_t);
+  void *arg;
+  size_t i;
+  size_t n;
+} cnpy_thread_task;
+
+
+static void *cnpy_thread_main(void *task) {
+  cnpy_thread_task *t = (cnpy_thread_task *) task;
+  t->fn(t->arg, t->i, t->n);
+  return NULL;
+}
 
 
 /*
- * Open an existing npy file.
- * Arguments:
- * fn - The name of the file.
- * writable - If true, then writing to the cnpy_array will cause the file to be changed.
- * arr - The resulting cnpy_array will be written to this address.
- * returns:
- * cnpy_status - CNPY_SUCCESS on success, something else on failure. In the case of a failure, *arr will not be changed.
+ * Call fn(arg, i, n_threads) for each i < n_threads, each call in its own thread.
+ * The calling thread does the work for i = 0.
+ * If a thread cannot be started, its work is done by the calling thread instead, so this cannot fail.
  */
-cnpy_status cnpy_open(const char * const fn, bool writable, cnpy_array *arr) {
+static void cnpy_parallel_for(size_t n_threads, void (*fn)(void *, size_t, size_t), void *arg) {
+  assert(n_threads >= 1 && n_threads <= CNPY_MAX_THREADS);
+  cnpy_thread_task tasks[CNPY_MAX_THREADS];
+#ifdef CNPY_PTHREADS
+  pthread_t threads[CNPY_MAX_THREADS];
+  bool started[CNPY_MAX_THREADS];
+#endif
+  for (size_t i = 0; i < n_threads; i += 1) {
+    tasks[i].fn = fn;
+    tasks[i].arg = arg;
+    tasks[i].i = i;
+    tasks[i].n = n_threads;
+#ifdef CNPY_PTHREADS
+    started[i] = (i > 0) && pthread_create(&threads[i], NULL, cnpy_thread_main, &tasks[i]) == 0;
+#endif
+  }
+  for (size_t i = 0; i < n_threads; i += 1) {
+#ifdef CNPY_PTHREADS
+    if (started[i]) {
+      pthread_join(threads[i], NULL);
+      continue;
+    }
+#endif
+    cnpy_thread_main(&tasks[i]);
+  }
+}
+
+
+/*
+ * Reader function
+ */
+
+
+/* Forward declaration of header parser */
+static cnpy_status cnpy_parse_to(const char * const, size_t, cnpy_array*, char *);
+
+
+/* How an existing file is mapped. */
+typedef enum {
+  CNPY_MAP_PRIVATE, /* readable and writable; changes are not written to the file (copy on write) */
+  CNPY_MAP_WRITABLE, /* readable and writable; changes are written to the file */
+  CNPY_MAP_READ_ONLY, /* read only and shared with other processes; writing to the array crashes the program */
+} cnpy_map_mode;
+
+
+/* Expected access pattern; passed to madvise() and posix_fadvise(). */
+typedef enum {
+  CNPY_ADVICE_NORMAL, /* no hint */
+  CNPY_ADVICE_SEQUENTIAL, /* read ahead aggressively, drop pages soon after they were read */
+  CNPY_ADVICE_RANDOM, /* do not read ahead */
+  CNPY_ADVICE_WILLNEED, /* start reading the whole array in the background */
+} cnpy_advice;
+
+
+typedef enum {
+  CNPY_HUGE_PAGES_NONE, /* normal pages */
+  CNPY_HUGE_PAGES_TRANSPARENT, /* ask for transparent huge pages (madvise(MADV_HUGEPAGE)); ignored if unsupported */
+  CNPY_HUGE_PAGES_EXPLICIT, /* map with MAP_HUGETLB; needs reserved huge pages and only works for anonymous arrays and files on hugetlbfs */
+} cnpy_huge_pages;
+
+
+typedef struct {
+  cnpy_map_mode mode; /* ignored by cnpy_create_ex(), which always maps writable */
+  cnpy_advice advice;
+  bool populate; /* prefault the whole mapping (MAP_POPULATE) */
+  bool lock; /* lock the mapping into memory (mlock()) */
+  cnpy_huge_pages huge_pages;
+  bool growable; /* keep the file open, so that rows can be appended (cnpy_append_rows()); needs CNPY_MAP_WRITABLE (other modes fail with CNPY_ERROR_FORMAT), or cnpy_create_ex() with a file */
+} cnpy_open_options;
+
+
+#ifndef CNPY_HUGE_PAGE_SIZE
+#define CNPY_HUGE_PAGE_SIZE (1 << 21) /* mappings with explicit huge pages are rounded up to a multiple of this */
+#endif
+
+
+/* Set *opts to the defaults, which are what cnpy_open(fn, false, ...) and cnpy_create() use. */
+void cnpy_open_options_init(cnpy_open_options *opts) {
+  assert(opts != NULL);
+  opts->mode = CNPY_MAP_PRIVATE;
+  opts->advice = CNPY_ADVICE_NORMAL;
+  opts->populate = false;
+  opts->lock = false;
+  opts->huge_pages = CNPY_HUGE_PAGES_NONE;
+  opts->growable = false;
+}
+
+
+/* mmap() flags for opts, except for MAP_SHARED / MAP_PRIVATE and MAP_ANONYMOUS. */
+static int cnpy_map_flags(const cnpy_open_options *opts) {
+  int flags = 0;
+#ifdef MAP_POPULATE
+  if (opts->populate) {
+    flags |= MAP_POPULATE;
+  }
+#endif
+#ifdef MAP_HUGETLB
+  if (opts->huge_pages == CNPY_HUGE_PAGES_EXPLICIT) {
+    flags |= MAP_HUGETLB;
+  }
+#endif
+  return flags;
+}
+
+
+/* Size of the mapping for raw_data_size bytes with the options opts. */
+static size_t cnpy_map_size(size_t raw_data_size, const cnpy_open_options *opts) {
+  if (opts->huge_pages != CNPY_HUGE_PAGES_EXPLICIT || raw_data_size > SIZE_MAX - CNPY_HUGE_PAGE_SIZE) {
+    return raw_data_size;
+  }
+  return (raw_data_size + CNPY_HUGE_PAGE_SIZE - 1) / CNPY_HUGE_PAGE_SIZE * CNPY_HUGE_PAGE_SIZE;
+}
+
+
+/* Pass the access pattern hint to the kernel; the hints are only advisory, so errors are ignored. */
+static void cnpy_fadvise(int fd, const cnpy_open_options *opts) {
+#ifdef POSIX_FADV_SEQUENTIAL
+  switch (opts->advice) {
+    case CNPY_ADVICE_SEQUENTIAL: posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL); break;
+    case CNPY_ADVICE_RANDOM: posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM); break;
+    case CNPY_ADVICE_WILLNEED: posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED); break;
+    default: break;
+  }
+#else
+  (void) fd;
+  (void) opts;
+#endif
+}
+
+
+/* Apply the hints and the locking of opts to a fresh mapping. */
+static cnpy_status cnpy_apply_map_options(char *raw_data, size_t map_size, const cnpy_open_options *opts, char *error_str) {
+#ifdef MADV_SEQUENTIAL
+  switch (opts->advice) {
+    case CNPY_ADVICE_SEQUENTIAL: madvise(raw_data, map_size, MADV_SEQUENTIAL); break;
+    case CNPY_ADVICE_RANDOM: madvise(raw_data, map_size, MADV_RANDOM); break;
+    case CNPY_ADVICE_WILLNEED: madvise(raw_data, map_size, MADV_WILLNEED); break;
+    default: break;
+  }
+#endif
+#ifdef MADV_HUGEPAGE
+  if (opts->huge_pages == CNPY_HUGE_PAGES_TRANSPARENT) {
+    madvise(raw_data, map_size, MADV_HUGEPAGE);
+  }
+#endif
+#ifndef MAP_POPULATE
+#ifdef MADV_WILLNEED
+  if (opts->populate) {
+    madvise(raw_data, map_size, MADV_WILLNEED);
+  }
+#endif
+#endif
+  if (opts->lock && mlock(raw_data, map_size) != 0) {
+    return cnpy_error_to(error_str, CNPY_ERROR_MMAP, "mlock() failed: %s", strerror(errno));
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/* As cnpy_open_ex(), with fn relative to the directory dir_fd (as for openat()), reporting errors to error_str (NULL: cnpy_error_str). */
+static cnpy_status cnpy_open_to(int dir_fd, const char * const fn, const cnpy_open_options *opts, cnpy_array *arr, char *error_str) {
   assert(arr != NULL);
+  assert(opts != NULL);
 
   cnpy_array tmp_arr;
 
+  if (opts->growable && opts->mode != CNPY_MAP_WRITABLE) {
+    return cnpy_error_to(error_str, CNPY_ERROR_FORMAT, "Growable arrays need CNPY_MAP_WRITABLE");
+  }
+
   /* open, mmap, and close the file */
-  int fd = open(fn, writable? O_RDWR : O_RDONLY);
+  int fd = openat(dir_fd, fn, (opts->mode == CNPY_MAP_WRITABLE)? O_RDWR : O_RDONLY);
   if (fd == -1) {
-    return cnpy_error(CNPY_ERROR_FILE, "Could not open file: %s", strerror(errno));
+    return cnpy_error_to(error_str, CNPY_ERROR_FILE, "Could not open file: %s", strerror(errno));
   }
   size_t raw_data_size = (size_t) lseek(fd, 0, SEEK_END);
   lseek(fd, 0, SEEK_SET);
 
   if (raw_data_size == 0) {
     close(fd); /* no point in checking for errors */
-    return cnpy_error(CNPY_ERROR_FORMAT, "Empty file");
+    return cnpy_error_to(error_str, CNPY_ERROR_FORMAT, "Empty file");
   }
   if (raw_data_size == SIZE_MAX) {
     /* This is just because the author is too lazy to check for overflow on every pos+1 calculation. */
     close(fd);
-    return cnpy_error(CNPY_ERROR_FORMAT, "File size is SIZE_MAX = %zu, should be at least one byte smaller", SIZE_MAX);
+    return cnpy_error_to(error_str, CNPY_ERROR_FORMAT, "File size is SIZE_MAX = %zu, should be at least one byte smaller", SIZE_MAX);
   }
 
+  cnpy_fadvise(fd, opts);
+
+  size_t map_size = cnpy_map_size(raw_data_size, opts);
   void *raw_data = mmap(
     NULL, /* addr */
-    raw_data_size, /* map size*/
-    PROT_READ | PROT_WRITE, /* protection flags */
-    writable? MAP_SHARED : MAP_PRIVATE, /* private/shared flag */
+    map_size, /* map size*/
+    (opts->mode == CNPY_MAP_READ_ONLY)? PROT_READ : PROT_READ | PROT_WRITE, /* protection flags */
+    ((opts->mode == CNPY_MAP_PRIVATE)? MAP_PRIVATE : MAP_SHARED) | cnpy_map_flags(opts), /* private/shared flag */
     fd, /* file */
     0 /* file offset */
   );
 
   if (raw_data == MAP_FAILED) {
     close(fd);
-    return cnpy_error(CNPY_ERROR_MMAP, "mmap() of file failed: %s", strerror(errno));
+    return cnpy_error_to(error_str, CNPY_ERROR_MMAP, "mmap() of file failed: %s", strerror(errno));
   }
 
-  /* It is ok to close the file; the file descriptor will be released once the raw_data is munmap()ed. */
-  if (close(fd) != 0) {
-    munmap(raw_data, raw_data_size);
-    return cnpy_error(CNPY_ERROR_FILE, "Could not close file after mmap(): %s", strerror(errno));
+  /* It is ok to close the file; the file descriptor will be released once the raw_data is munmap()ed.
+   * Growable arrays keep it, to resize the file. */
+  bool keep_fd = opts->growable;
+  if (!keep_fd && close(fd) != 0) {
+    munmap(raw_data, map_size);
+    return cnpy_error_to(error_str, CNPY_ERROR_FILE, "Could not close file after mmap(): %s", strerror(errno));
   }
 
   /* parse the file */
-  cnpy_status status = cnpy_parse(raw_data, raw_data_size, &tmp_arr);
+  cnpy_status status = cnpy_parse_to((const char *) raw_data, raw_data_size, &tmp_arr, error_str);
+  if (status == CNPY_SUCCESS) {
+    status = cnpy_apply_map_options((char *) raw_data, map_size, opts, error_str);
+  }
   if (status != CNPY_SUCCESS) {
-    munmap(raw_data, raw_data_size);
+    munmap(raw_data, map_size);
+    if (keep_fd) {
+      close(fd);
+    }
     return status;
   }
+  tmp_arr.map_size = map_size;
+  tmp_arr.fd = keep_fd? fd : -1;
+  tmp_arr.read_only = opts->mode == CNPY_MAP_READ_ONLY;
   *arr = tmp_arr;
 
   return CNPY_SUCCESS;
 }
 
 
+/*
+ * Open an existing npy file with the mapping options *opts (see cnpy_open_options_init() for the defaults).
+ * With CNPY_MAP_READ_ONLY, the data is mapped PROT_READ and MAP_SHARED, so that several processes share the page cache.
+ * Growable arrays must be mapped with CNPY_MAP_WRITABLE; otherwise CNPY_ERROR_FORMAT is returned.
+ * Returns CNPY_SUCCESS on success, something else on failure. In the case of a failure, *arr will not be changed.
+ */
+cnpy_status cnpy_open_ex(const char * const fn, const cnpy_open_options *opts, cnpy_array *arr) {
+  return cnpy_open_to(AT_FDCWD, fn, opts, arr, NULL);
+}
+
+
+/*
+ * Open an existing npy file.
+ * Arguments:
+ * fn - The name of the file.
+ * writable - If true, then writing to the cnpy_array will cause the file to be changed.
+ * arr - The resulting cnpy_array will be written to this address.
+ * returns:
+ * cnpy_status - CNPY_SUCCESS on success, something else on failure. In the case of a failure, *arr will not be changed.
+ */
+cnpy_status cnpy_open(const char * const fn, bool writable, cnpy_array *arr) {
+  cnpy_open_options opts;
+  cnpy_open_options_init(&opts);
+  opts.mode = writable? CNPY_MAP_WRITABLE : CNPY_MAP_PRIVATE;
+  return cnpy_open_ex(fn, &opts, arr);
+}
+
+
 /*
  * Parsing the header.
  */
@@ -271,6 +573,7 @@ typedef struct {
   bool read_shape;
   size_t n_dim;
   size_t dims[CNPY_MAX_DIM];
+  char *error_str; /* where errors are reported (NULL: cnpy_error_str) */
 } cnpy_parser_state;
 
 
@@ -281,28 +584,40 @@ typedef struct {
 
 static cnpy_status cnpy_parse_pre_header(cnpy_parser_state *);
 static cnpy_status cnpy_parse_header(cnpy_parser_state *);
+static bool cnpy_parse_canonical_dict(cnpy_parser_state *);
+static cnpy_status cnpy_parse_dict(cnpy_parser_state *);
 static void cnpy_parse_skip_whitespace(cnpy_parser_state *);
 static cnpy_status cnpy_parse_key_value_pair(cnpy_parser_state *);
 static cnpy_status cnpy_parse_value_descr(cnpy_parser_state *);
 static cnpy_status cnpy_parse_value_shape(cnpy_parser_state *);
 static cnpy_status cnpy_parse_value_fortran_order(cnpy_parser_state *);
-static cnpy_status cnpy_parse_check_data_size(const cnpy_array);
+static cnpy_status cnpy_parse_check_data_size(const cnpy_array, char *);
 static size_t cnpy_atonz(const char * const, size_t, size_t *);
 
 
-static cnpy_status cnpy_parse(const char * const raw_data, size_t raw_data_size, cnpy_array *arr) {
+/*
+ * Parse the header into *arr, without checking that the size of the data matches raw_data_size.
+ * Errors are reported to error_str (CNPY_ERROR_STR_SIZE bytes), or to cnpy_error_str if it is NULL.
+ */
+static cnpy_status cnpy_parse_metadata_to(const char * const raw_data, size_t raw_data_size, cnpy_array *arr, char *error_str) {
   assert(raw_data != NULL);
   assert(arr != NULL);
 
+  /* Positional initialisation, because C++ has no designated initializers for all members (at least before C++20). */
   cnpy_parser_state s = {
-    .raw_data = raw_data,
-    .raw_data_size = raw_data_size,
-    .pos = 0,
-    .full_header_size = ~0,
-    .read_descr = false,
-    .read_fortran_order = false,
-    .read_shape = false,
-    .n_dim = 0,
+    raw_data, /* raw_data */
+    raw_data_size, /* raw_data_size */
+    0, /* pos */
+    SIZE_MAX, /* full_header_size */
+    false, /* read_descr */
+    CNPY_LE, /* byte_order */
+    CNPY_B, /* dtype */
+    false, /* read_fortran_order */
+    CNPY_C_ORDER, /* order */
+    false, /* read_shape */
+    0, /* n_dim */
+    { 0 }, /* dims */
+    error_str, /* error_str */
   };
   cnpy_status status = CNPY_SUCCESS;
 
@@ -317,38 +632,56 @@ static cnpy_status cnpy_parse(const char * const raw_data, size_t raw_data_size,
     size_t size = 1;
     for (size_t i = 0; i < s.n_dim; i += 1) {
       if (__builtin_mul_overflow(size, s.dims[i], &size)) {
-        return cnpy_error(CNPY_ERROR_FORMAT, "Size of data overflows");
+        return cnpy_error_to(error_str, CNPY_ERROR_FORMAT, "Size of data overflows");
       }
     }
     arr->byte_order = s.byte_order;
     arr->dtype = s.dtype;
     arr->order = s.order;
     arr->n_dim = s.n_dim;
-    arr->raw_data = (void *) raw_data;
+    arr->raw_data = (char *) raw_data;
     arr->data_begin = s.full_header_size;
     arr->raw_data_size = raw_data_size;
+    arr->map_size = raw_data_size;
+    arr->fd = -1;
+    arr->read_only = false;
     for (size_t i = 0; i < arr->n_dim; i += 1) {
       arr->dims[i] = s.dims[i];
     }
   }
+  return status;
+}
+
+
+static cnpy_status cnpy_parse_metadata(const char * const raw_data, size_t raw_data_size, cnpy_array *arr) {
+  return cnpy_parse_metadata_to(raw_data, raw_data_size, arr, NULL);
+}
+
+
+static cnpy_status cnpy_parse_to(const char * const raw_data, size_t raw_data_size, cnpy_array *arr, char *error_str) {
+  cnpy_status status = cnpy_parse_metadata_to(raw_data, raw_data_size, arr, error_str);
   if (status == CNPY_SUCCESS) {
-    status = cnpy_parse_check_data_size(*arr);
+    status = cnpy_parse_check_data_size(*arr, error_str);
   }
-
   return status;
 }
 
 
+static cnpy_status cnpy_parse(const char * const raw_data, size_t raw_data_size, cnpy_array *arr) {
+  return cnpy_parse_to(raw_data, raw_data_size, arr, NULL);
+}
+
+
 static cnpy_status cnpy_parse_pre_header(cnpy_parser_state *s) {
   if (s->raw_data_size < 16) {
     /* The header is aligned to 16 bytes, so a valid file is least this large. */
-    return cnpy_error(CNPY_ERROR_FORMAT, "File is too short to contain a header.");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "File is too short to contain a header.");
   }
 
   char magic_str[6] = { '\x93', 'N', 'U', 'M', 'P', 'Y' };
   const size_t magic_str_len = 6;
   if (memcmp(s->raw_data, magic_str, magic_str_len) != 0) {
-    return cnpy_error(CNPY_ERROR_FORMAT, "File does not start with magic string");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "File does not start with magic string");
   }
   s->pos += magic_str_len;
 
@@ -376,37 +709,131 @@ static cnpy_status cnpy_parse_pre_header(cnpy_parser_state *s) {
     s->pos = 12;
   }
   else {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Unsupported file format version %u.%u", version_major, version_minor);
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Unsupported file format version %u.%u", version_major, version_minor);
   }
 
   /* Compare header and file size */
   if (__builtin_add_overflow(s->pos, header_size, &(s->full_header_size))) {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Claimed header size overflows");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Claimed header size overflows");
   }
   if (!(s->full_header_size <= s->raw_data_size)) { /* For size 0 arrays, it should be <=. */
-    return cnpy_error(CNPY_ERROR_FORMAT, "Claimed header size %zu is larger than the file size %zu", s->full_header_size, s->raw_data_size);
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Claimed header size %zu is larger than the file size %zu", s->full_header_size, s->raw_data_size);
   }
 
   /* Check alignment */
   if (s->full_header_size % 16 != 0) {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Data start %zu is not an integer multiple of 16", s->full_header_size);
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Data start %zu is not an integer multiple of 16", s->full_header_size);
   }
 
   return CNPY_SUCCESS;
 }
 
 
-static cnpy_status cnpy_parse_header(cnpy_parser_state *s) {
-  assert(s != NULL);
-  assert(s->raw_data != NULL);
+/*
+ * Match the header dictionary in the form numpy writes it, e. g. {'descr': '<f8', 'fortran_order': False, 'shape': (3, 4), }
+ * (or this library: 'shape': (3,4,)}), comparing it to fixed strings instead of parsing it key by key.
+ * Returns false, with *s unchanged, if the dictionary has any other form; it is then left to the general parser.
+ */
+static bool cnpy_parse_canonical_dict(cnpy_parser_state *s) {
+  const char *p = s->raw_data;
+  const size_t end = s->full_header_size;
+  size_t pos = s->pos;
+
+  /* descr, e. g. '<f8' */
+  if (end - pos < 13 || memcmp(p + pos, "{'descr': '", 11) != 0) {
+    return false;
+  }
+  pos += 11;
+  char c_endianness = p[pos];
+  pos += 1;
+  size_t len = 0;
+  while (len < 4 && pos + len < end && p[pos + len] != '\'') {
+    len += 1;
+  }
+  size_t dtype = CNPY_B;
+  while (dtype <= CNPY_C16 && !(cnpy_dtype_str[dtype][0] == p[pos] && strncmp(cnpy_dtype_str[dtype], p + pos, len) == 0 && cnpy_dtype_str[dtype][len] == '\0')) {
+    dtype += 1;
+  }
+  if (dtype > CNPY_C16 || pos + len == end) {
+    return false;
+  }
+  pos += len + 1;
+  bool single_byte = cnpy_dtype_sizes[dtype] == 1;
+  if (!(c_endianness == '<' || c_endianness == '>' || (c_endianness == '|' && single_byte))) {
+    return false;
+  }
+
+  /* fortran_order */
+  cnpy_flat_order order;
+  if (end - pos >= 24 && memcmp(p + pos, ", 'fortran_order': False", 24) == 0) {
+    order = CNPY_C_ORDER;
+    pos += 24;
+  }
+  else if (end - pos >= 23 && memcmp(p + pos, ", 'fortran_order': True", 23) == 0) {
+    order = CNPY_FORTRAN_ORDER;
+    pos += 23;
+  }
+  else {
+    return false;
+  }
+
+  /* shape; numpy separates the dimensions by ", " (and ends a single one with ","), this library puts "," after each */
+  if (end - pos < 12 || memcmp(p + pos, ", 'shape': (", 12) != 0) {
+    return false;
+  }
+  pos += 12;
+  size_t n_dim = 0;
+  size_t dims[CNPY_MAX_DIM] = { 0 };
+  while (pos < end && p[pos] != ')') {
+    size_t read = (n_dim < CNPY_MAX_DIM)? cnpy_atonz(p + pos, end - pos, dims + n_dim) : 0;
+    if (read == 0) {
+      return false;
+    }
+    pos += read;
+    n_dim += 1;
+    if (pos < end && p[pos] == ',') {
+      pos += (end - pos > 1 && p[pos + 1] == ' ')? 2 : 1;
+    }
+    else if (!(pos < end && p[pos] == ')')) {
+      return false;
+    }
+  }
+  if (end - pos >= 2 && memcmp(p + pos, ")}", 2) == 0) {
+    pos += 2;
+  }
+  else if (end - pos >= 4 && memcmp(p + pos, "), }", 4) == 0) {
+    pos += 4;
+  }
+  else {
+    return false;
+  }
+  /* the padding */
+  while (pos < end && p[pos] == ' ') {
+    pos += 1;
+  }
+
+  s->pos = pos;
+  s->byte_order = single_byte? CNPY_NE : (c_endianness == '<')? CNPY_LE : CNPY_BE;
+  s->dtype = (cnpy_dtype) dtype;
+  s->order = order;
+  s->n_dim = n_dim;
+  for (size_t i = 0; i < n_dim; i += 1) {
+    s->dims[i] = dims[i];
+  }
+  s->read_descr = s->read_fortran_order = s->read_shape = true;
+  return true;
+}
 
+
+/* Parse the header dictionary key by key. */
+static cnpy_status cnpy_parse_dict(cnpy_parser_state *s) {
   /* read opening bracket */
   cnpy_parse_skip_whitespace(s);
   if (s->pos < s->full_header_size && s->raw_data[s->pos] == '{') {
     s->pos += 1;
   }
   else {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Missing '{' while parsing header");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Missing '{' while parsing header");
   }
 
   /* read up to three key-value pairs (there should be exactly three). */
@@ -426,7 +853,7 @@ static cnpy_status cnpy_parse_header(cnpy_parser_state *s) {
       /* It's ok, we don't need a comma after the last key value pair. */
     }
     else {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Missing ',' after %s key-value pair", (i == 0)? "first" : "second");
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Missing ',' after %s key-value pair", (i == 0)? "first" : "second");
     }
 
   }
@@ -439,14 +866,35 @@ static cnpy_status cnpy_parse_header(cnpy_parser_state *s) {
     s->pos += 1;
   }
 
-  /* parse padding spaces and a final '\n' */
+  return CNPY_SUCCESS;
+}
+
+
+static cnpy_status cnpy_parse_header(cnpy_parser_state *s) {
+  assert(s != NULL);
+  assert(s->raw_data != NULL);
+
+  if (!cnpy_parse_canonical_dict(s)) {
+    cnpy_status status = cnpy_parse_dict(s);
+    if (status != CNPY_SUCCESS) {
+      return status;
+    }
+  }
+
+  /* parse padding spaces, an optional comment (e. g. the state of a ring buffer), and a final '\n' */
   cnpy_parse_skip_whitespace(s);
+  if (s->pos < s->full_header_size && s->raw_data[s->pos] == '#') {
+    while (s->pos < s->full_header_size && s->raw_data[s->pos] != '\n') {
+      s->pos += 1;
+    }
+    cnpy_parse_skip_whitespace(s);
+  }
 
   if (s->pos != s->full_header_size) {
-    return cnpy_error(CNPY_ERROR_FORMAT, "junk after end of header dictionary at position %zu (reported end is %zu)", s->pos, s->full_header_size);
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "junk after end of header dictionary at position %zu (reported end is %zu)", s->pos, s->full_header_size);
   }
   if (s->raw_data[s->full_header_size - 1] != '\n') {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Missing \\n at end of header");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Missing \\n at end of header");
   }
 
   return CNPY_SUCCESS;
@@ -467,11 +915,11 @@ static cnpy_status cnpy_parse_key_value_pair(cnpy_parser_state *s) {
     c = s->raw_data[s->pos];
     s->pos += 1;
     if (c != '\'' && c != '"') {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Expected a string delimiter, got '%c'", c);
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected a string delimiter, got '%c'", c);
     }
   }
   else {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Expected a string delimiter, got nothing");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected a string delimiter, got nothing");
   }
 
   /*
@@ -489,7 +937,7 @@ static cnpy_status cnpy_parse_key_value_pair(cnpy_parser_state *s) {
     s->pos += 1;
   }
   else {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Unterminated key-string");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Unterminated key-string");
   }
 
   /* We postpone the key, and first read a colon, which seperates key from value. */
@@ -498,7 +946,7 @@ static cnpy_status cnpy_parse_key_value_pair(cnpy_parser_state *s) {
     s->pos += 1;
   }
   else {
-    return cnpy_error(CNPY_ERROR_FORMAT, "expected ':' after key");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "expected ':' after key");
   }
   cnpy_parse_skip_whitespace(s);
 
@@ -510,27 +958,27 @@ static cnpy_status cnpy_parse_key_value_pair(cnpy_parser_state *s) {
   cnpy_status status;
   if (key_len == 5 && memcmp(s->raw_data + key_start, "descr", key_len) == 0) {
     if (s->read_descr) {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Key 'descr' appears twice");
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Key 'descr' appears twice");
     }
     status = cnpy_parse_value_descr(s);
     s->read_descr = true;
   }
   else if (key_len == 5 && memcmp(s->raw_data + key_start, "shape", key_len) == 0) {
     if (s->read_shape) {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Key 'shape' appears twice");
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Key 'shape' appears twice");
     }
     status = cnpy_parse_value_shape(s);
     s->read_shape = true;
   }
   else if (key_len == 13 && memcmp(s->raw_data + key_start, "fortran_order", key_len) == 0) {
     if (s->read_fortran_order) {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Key 'fortran_order' appears twice");
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Key 'fortran_order' appears twice");
     }
     status = cnpy_parse_value_fortran_order(s);
     s->read_fortran_order = true;
   }
   else {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Unknown key in header");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Unknown key in header");
   }
 
   return status;
@@ -552,11 +1000,11 @@ static cnpy_status cnpy_parse_value_descr(cnpy_parser_state *s) {
       s->pos += 1;
     }
     else {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Expected a string delimiter, got '%c'", c_str);
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected a string delimiter, got '%c'", c_str);
     }
   }
   else {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Expected a string delimiter, got nothing");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected a string delimiter, got nothing");
   }
 
   /* Read an endianness character. */
@@ -565,7 +1013,7 @@ static cnpy_status cnpy_parse_value_descr(cnpy_parser_state *s) {
     s->pos += 1;
   }
   else {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Expected an endianness character, got nothing");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected an endianness character, got nothing");
   }
   switch (c_endianness) {
     case '<':
@@ -579,9 +1027,9 @@ static cnpy_status cnpy_parse_value_descr(cnpy_parser_state *s) {
       break;
     case '=':
       /* host byte order is intentionally unsupported. */
-      return cnpy_error(CNPY_ERROR_FORMAT, "Host byte order '=' is intentionally unsupported");
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Host byte order '=' is intentionally unsupported");
     default:
-      return cnpy_error(CNPY_ERROR_FORMAT, "Invalid byte_order '%c'", c_endianness);
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Invalid byte_order '%c'", c_endianness);
   }
 
   /* Read a datatype character (we check the result later). */
@@ -590,7 +1038,7 @@ static cnpy_status cnpy_parse_value_descr(cnpy_parser_state *s) {
     s->pos += 1;
   }
   else {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Expected an datatype character, got nothing");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected an datatype character, got nothing");
   }
 
   /* Read the number of bytes which the datatype occupies (we check the result later). */
@@ -600,11 +1048,11 @@ static cnpy_status cnpy_parse_value_descr(cnpy_parser_state *s) {
       s->pos += read;
     }
     else {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Expected a datatype width, got something else");
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected a datatype width, got something else");
     }
   }
   else {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Expected a datatype width, got nothing");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected a datatype width, got nothing");
   }
 
   /* Read the closing string delimiter. */
@@ -613,11 +1061,11 @@ static cnpy_status cnpy_parse_value_descr(cnpy_parser_state *s) {
       s->pos += 1;
     }
     else {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Expected closing string delimiter '%c', got '%c'", c_str, s->raw_data[s->pos]);
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected closing string delimiter '%c', got '%c'", c_str, s->raw_data[s->pos]);
     }
   }
   else {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Expected closing string delimiter '%c', got nothing", c_str);
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected closing string delimiter '%c', got nothing", c_str);
   }
 
   /* Now we interpret the results. */
@@ -631,7 +1079,7 @@ static cnpy_status cnpy_parse_value_descr(cnpy_parser_state *s) {
       s->dtype = CNPY_B;
     }
     else {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Unsupported byte width %zu for bool", n_bytes);
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Unsupported byte width %zu for bool", n_bytes);
     }
   }
   else if (c_type == 'i') {
@@ -648,7 +1096,7 @@ static cnpy_status cnpy_parse_value_descr(cnpy_parser_state *s) {
       s->dtype = CNPY_I8;
     }
     else {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Unsupported byte width %zu for ints", n_bytes);
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Unsupported byte width %zu for ints", n_bytes);
     }
   }
   else if (c_type == 'u') {
@@ -665,7 +1113,7 @@ static cnpy_status cnpy_parse_value_descr(cnpy_parser_state *s) {
       s->dtype = CNPY_U8;
     }
     else {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Unsupported byte width %zu for uints", n_bytes);
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Unsupported byte width %zu for uints", n_bytes);
     }
   }
   else if (c_type == 'f') {
@@ -676,7 +1124,7 @@ static cnpy_status cnpy_parse_value_descr(cnpy_parser_state *s) {
       s->dtype = CNPY_F8;
     }
     else {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Unsupported byte width %zu for floats", n_bytes);
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Unsupported byte width %zu for floats", n_bytes);
     }
   }
   else if (c_type == 'c') {
@@ -687,15 +1135,15 @@ static cnpy_status cnpy_parse_value_descr(cnpy_parser_state *s) {
       s->dtype = CNPY_C16;
     }
     else {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Unsupported byte width %zu for complex", n_bytes);
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Unsupported byte width %zu for complex", n_bytes);
     }
   }
   else {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Unsupported datatype '%c'", c_type);
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Unsupported datatype '%c'", c_type);
   }
 
   if (cnpy_dtype_sizes[s->dtype] > 1 && s->byte_order == CNPY_NE) {
-    return cnpy_error(CNPY_ERROR_FORMAT, "dtype size > 1 but no endianness given");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "dtype size > 1 but no endianness given");
   }
 
   return CNPY_SUCCESS;
@@ -713,11 +1161,11 @@ static cnpy_status cnpy_parse_value_shape(cnpy_parser_state *s) {
       s->pos += 1;
     }
     else {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Expected opening parenthesis, got '%c'", c);
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected opening parenthesis, got '%c'", c);
     }
   }
   else {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Expected opening paranthesis, got nothing");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected opening paranthesis, got nothing");
   }
 
   /* read many numbers, followed by commas (the last one being optional) */
@@ -751,14 +1199,14 @@ static cnpy_status cnpy_parse_value_shape(cnpy_parser_state *s) {
       s->pos += 1;
     }
     else if (isdigit(s->raw_data[s->pos])) { /* This must be because the npy file has too many dimensions. */
-      return cnpy_error(CNPY_ERROR_FORMAT, "File has too many dimensions. Please recompile with larger CNPY_MAX_DIM");
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "File has too many dimensions. Please recompile with larger CNPY_MAX_DIM");
     }
     else {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Expected closing bracket, got '%c'", c);
+      return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected closing bracket, got '%c'", c);
     }
   }
   else {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Expected closing bracket, got nothing");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected closing bracket, got nothing");
   }
 
   return CNPY_SUCCESS;
@@ -770,7 +1218,7 @@ static cnpy_status cnpy_parse_value_fortran_order(cnpy_parser_state *s) {
 
   size_t tmp = 0;
   if (__builtin_add_overflow(s->pos, 4, &tmp)) {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Overflow while reading 'True' or 'False'");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Overflow while reading 'True' or 'False'");
   }
   if (tmp < s->full_header_size && strncmp(s->raw_data + s->pos, "True", 4) == 0) {
     s->order = CNPY_FORTRAN_ORDER;
@@ -779,7 +1227,7 @@ static cnpy_status cnpy_parse_value_fortran_order(cnpy_parser_state *s) {
   }
 
   if (__builtin_add_overflow(s->pos, 5, &tmp)) {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Overflow while reading 'True' or 'False'");
+    return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Overflow while reading 'True' or 'False'");
   }
   if (tmp < s->full_header_size && strncmp(s->raw_data + s->pos, "False", 5) == 0) {
     s->order = CNPY_C_ORDER;
@@ -787,26 +1235,26 @@ static cnpy_status cnpy_parse_value_fortran_order(cnpy_parser_state *s) {
     return CNPY_SUCCESS;
   }
 
-  return cnpy_error(CNPY_ERROR_FORMAT, "Expected 'True' or 'False', got something else");
+  return cnpy_error_to(s->error_str, CNPY_ERROR_FORMAT, "Expected 'True' or 'False', got something else");
 }
 
 
-static cnpy_status cnpy_parse_check_data_size(cnpy_array arr) {
+static cnpy_status cnpy_parse_check_data_size(cnpy_array arr, char *error_str) {
   size_t data_size = cnpy_dtype_sizes[arr.dtype];
   size_t tmp = 0;
   for (size_t i = 0; i < arr.n_dim; i += 1) {
     if (__builtin_mul_overflow(data_size, arr.dims[i], &data_size)) {
-      return cnpy_error(CNPY_ERROR_FORMAT, "Total claimed size of the data overflows");
+      return cnpy_error_to(error_str, CNPY_ERROR_FORMAT, "Total claimed size of the data overflows");
     }
   }
   if (arr.n_dim == 0 || data_size == 0) {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Empty data unsupported");
+    return cnpy_error_to(error_str, CNPY_ERROR_FORMAT, "Empty data unsupported");
   }
   if (__builtin_add_overflow(arr.data_begin, data_size, &tmp)) {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Total claimed size of the data file overflows");
+    return cnpy_error_to(error_str, CNPY_ERROR_FORMAT, "Total claimed size of the data file overflows");
   }
   if (tmp != arr.raw_data_size) {
-    return cnpy_error(CNPY_ERROR_FORMAT, "Claimed size of the data %zu does not match header size %zu and file size %zu", data_size, arr.data_begin, arr.raw_data_size);
+    return cnpy_error_to(error_str, CNPY_ERROR_FORMAT, "Claimed size of the data %zu does not match header size %zu and file size %zu", data_size, arr.data_begin, arr.raw_data_size);
   }
   return CNPY_SUCCESS;
 }
@@ -836,6 +1284,16 @@ static size_t cnpy_atonz(const char * const s, size_t n, size_t *result) {
  */
 
 
+/* Number of decimal digits of n (exact, unlike log10() for large n). */
+static size_t cnpy_n_digits(size_t n) {
+  size_t digits = 1;
+  for (; n >= 10; n /= 10) {
+    digits += 1;
+  }
+  return digits;
+}
+
+
 /*
  * How large is the serialized full header of a cnpy array with the given metadata?
  */
@@ -845,7 +1303,7 @@ _Static_assert((3 * sizeof(size_t) + 1) * CNPY_MAX_DIM < 65535 - (57 + 3 + 5), "
 size_t cnpy_predict_full_header_size(cnpy_dtype dtype, cnpy_flat_order order, size_t n_dim, const size_t * const dims) {
   size_t full_header_size = 57 + strlen(cnpy_dtype_str[dtype]) + 1 * n_dim + ((order == CNPY_FORTRAN_ORDER)? 4 : 5);
   for (size_t i = 0; i < n_dim; i += 1) {
-    full_header_size += (size_t) log10((double) dims[i]) + 1;
+    full_header_size += cnpy_n_digits(dims[i]);
   }
   if (full_header_size % 16 > 0) {
     full_header_size += 16 - (full_header_size % 16);
@@ -854,29 +1312,47 @@ size_t cnpy_predict_full_header_size(cnpy_dtype dtype, cnpy_flat_order order, si
 }
 
 
-/* data needs to be at least maxsize + 1 long. */
-void cnpy_write_header(char *data, size_t maxsize, cnpy_byte_order byte_order, cnpy_dtype dtype, cnpy_flat_order order, size_t n_dim, const size_t * const dims) {
-  assert(maxsize > 0);
-  assert(maxsize < SIZE_MAX - 1);
-  size_t predicted_full_header_size = cnpy_predict_full_header_size(dtype, order, n_dim, dims);
-  assert(predicted_full_header_size <= maxsize);
+/*
+ * Size of the header of a new growable array: like cnpy_predict_full_header_size(), but with room for the growth axis
+ * (the first one in C order, the last one in Fortran order) to reach any length, so that the shape can be rewritten in place.
+ * numpy pads its headers the same way.
+ */
+static size_t cnpy_growable_header_size(cnpy_dtype dtype, cnpy_flat_order order, size_t n_dim, const size_t * const dims) {
+  size_t tmp[CNPY_MAX_DIM];
+  for (size_t i = 0; i < n_dim; i += 1) {
+    tmp[i] = dims[i];
+  }
+  if (n_dim > 0) {
+    tmp[(order == CNPY_C_ORDER)? 0 : n_dim - 1] = SIZE_MAX;
+  }
+  return cnpy_predict_full_header_size(dtype, order, n_dim, tmp);
+}
+
+
+/*
+ * Write a header of full_header_size bytes (a multiple of 16, at least the predicted size), padding it with spaces.
+ * data needs to be at least full_header_size + 1 long.
+ */
+static void cnpy_write_padded_header(char *data, size_t full_header_size, cnpy_byte_order byte_order, cnpy_dtype dtype, cnpy_flat_order order, size_t n_dim, const size_t * const dims) {
+  assert(full_header_size % 16 == 0 && full_header_size - 10 <= 65535);
+  assert(full_header_size >= cnpy_predict_full_header_size(dtype, order, n_dim, dims));
   size_t written = 0;
   size_t tmp;
 
-  /* NOTE: We need (maxsize + 1 - written) everywhere because snprintf writes a final \0!
+  /* NOTE: We need (full_header_size + 1 - written) everywhere because snprintf writes a final \0!
    * This also means that the final snprintf() may write beyond the header.
    * This is ok, because we require prod(dims) > 1, so there is at least 1 byte of data after the header. */
 
   /* magic string */
-  written += tmp = snprintf(data + written, maxsize + 1 - written, "\x93NUMPY");
+  written += tmp = snprintf(data + written, full_header_size + 1 - written, "\x93NUMPY");
   assert(tmp == 6);
   /* numpy format version */
   data[written] = 1;
   data[written + 1] = 0;
   written += 2;
   /* size of the header (excluding format string */
-  data[written]     = (uint8_t)  (predicted_full_header_size - 10);
-  data[written + 1] = (uint8_t) ((predicted_full_header_size - 10) << 8);
+  data[written]     = (uint8_t)  (full_header_size - 10);
+  data[written + 1] = (uint8_t) ((full_header_size - 10) >> 8);
   written += 2;
 
   /* descr */
@@ -894,28 +1370,27 @@ void cnpy_write_header(char *data, size_t maxsize, cnpy_byte_order byte_order, c
     default:
       assert(false);
   }
-  written += tmp = snprintf(data + written, maxsize + 1 - written, "{'descr': '%c%s', ", byte_order_char, cnpy_dtype_str[dtype]);
+  written += tmp = snprintf(data + written, full_header_size + 1 - written, "{'descr': '%c%s', ", byte_order_char, cnpy_dtype_str[dtype]);
   assert(tmp == 15 + strlen(cnpy_dtype_str[dtype]));
 
   /* fortran_order */
-  written += tmp = snprintf(data + written, maxsize + 1 - written, "'fortran_order': %s, ", (order == CNPY_FORTRAN_ORDER)? "True" : "False");
+  written += tmp = snprintf(data + written, full_header_size + 1 - written, "'fortran_order': %s, ", (order == CNPY_FORTRAN_ORDER)? "True" : "False");
   assert(tmp == 19 + ((order == CNPY_FORTRAN_ORDER)? 4 : 5));
 
   /* shape */
-  written += tmp = snprintf(data + written, maxsize + 1 - written, "'shape': (");
+  written += tmp = snprintf(data + written, full_header_size + 1 - written, "'shape': (");
   assert(tmp == 10);
   for (size_t i = 0; i < n_dim; i += 1) {
-    written += tmp = snprintf(data + written, maxsize + 1 - written, "%zu", dims[i]);
-    assert(tmp == (size_t) log10(dims[i]) + 1);
-    written += tmp = snprintf(data + written, maxsize + 1 - written, ",");
+    written += tmp = snprintf(data + written, full_header_size + 1 - written, "%zu", dims[i]);
+    assert(tmp == cnpy_n_digits(dims[i]));
+    written += tmp = snprintf(data + written, full_header_size + 1 - written, ",");
     assert(tmp == 1);
   }
-  written += tmp = snprintf(data + written, maxsize + 1 - written, ")}");
+  written += tmp = snprintf(data + written, full_header_size + 1 - written, ")}");
   assert(tmp == 2);
 
   /* padding */
-  assert(predicted_full_header_size - written - 1 < 16);
-  for (; written < predicted_full_header_size - 1; written += 1) {
+  for (; written < full_header_size - 1; written += 1) {
    data[written] = ' ';
   }
 
@@ -923,16 +1398,24 @@ void cnpy_write_header(char *data, size_t maxsize, cnpy_byte_order byte_order, c
   data[written] = '\n';
   written += 1;
 
-  assert(written == predicted_full_header_size);
+  assert(written == full_header_size);
 }
 
 
-/*
- * Create a new .npy array (possibly backed by a file).
- * If fn is NULL, an anonymous mapping will be created.
- */
-cnpy_status cnpy_create(const char * const fn, cnpy_byte_order byte_order, cnpy_dtype dtype, cnpy_flat_order order, size_t n_dim, const size_t * const dims, cnpy_array *arr) {
+/* data needs to be at least maxsize + 1 long. */
+void cnpy_write_header(char *data, size_t maxsize, cnpy_byte_order byte_order, cnpy_dtype dtype, cnpy_flat_order order, size_t n_dim, const size_t * const dims) {
+  assert(maxsize > 0);
+  assert(maxsize < SIZE_MAX - 1);
+  size_t predicted_full_header_size = cnpy_predict_full_header_size(dtype, order, n_dim, dims);
+  assert(predicted_full_header_size <= maxsize);
+  cnpy_write_padded_header(data, predicted_full_header_size, byte_order, dtype, order, n_dim, dims);
+}
+
+
+/* As cnpy_create_ex(), with at least header_slack bytes of additional padding in the header. */
+static cnpy_status cnpy_create_padded(const char * const fn, cnpy_byte_order byte_order, cnpy_dtype dtype, cnpy_flat_order order, size_t n_dim, const size_t * const dims, size_t header_slack, const cnpy_open_options *opts, cnpy_array *arr) {
   assert(arr != NULL);
+  assert(opts != NULL);
 
 #ifndef MAP_ANONYMOUS
   if (fn == NULL) {
@@ -941,13 +1424,15 @@ cnpy_status cnpy_create(const char * const fn, cnpy_byte_order byte_order, cnpy_
 #endif
 
   /* clean up and check the data passed by the user */
-  assert(n_dim <= CNPY_MAX_DIM);
+  assert(n_dim >= 1 && n_dim <= CNPY_MAX_DIM); /* zero-dimensional arrays are unsupported, like empty ones */
   if (cnpy_dtype_sizes[dtype] == 1) {
     byte_order = CNPY_NE;
   }
 
   /* Predict file size */
-  size_t full_header_size = cnpy_predict_full_header_size(dtype, order, n_dim, dims);
+  assert(header_slack < 1024);
+  size_t full_header_size = opts->growable? cnpy_growable_header_size(dtype, order, n_dim, dims) : cnpy_predict_full_header_size(dtype, order, n_dim, dims);
+  full_header_size += (header_slack + 15) / 16 * 16;
   size_t data_size = cnpy_dtype_sizes[dtype];
   for (size_t i = 0; i < n_dim; i += 1) {
     if (__builtin_mul_overflow(data_size, dims[i], &data_size)) {
@@ -968,19 +1453,21 @@ cnpy_status cnpy_create(const char * const fn, cnpy_byte_order byte_order, cnpy_
       return cnpy_error(CNPY_ERROR_FILE, "Could not open file: %s", strerror(errno));
     }
     if (ftruncate(fd, raw_data_size) != 0) {
+      close(fd); /* No point checking for error */
       return cnpy_error(CNPY_ERROR_FILE, "Could not resize file: %s", strerror(errno));
     }
   }
 
   /* mmap() */
-  char *raw_data = mmap(
+  size_t map_size = cnpy_map_size(raw_data_size, opts);
+  char *raw_data = (char *) mmap(
     NULL, /* addr */
-    raw_data_size, /* map size*/
+    map_size, /* map size*/
     PROT_READ | PROT_WRITE, /* protection flags */
 #ifdef MAP_ANONYMOUS
-    MAP_SHARED | ((fn == NULL) ? MAP_ANONYMOUS : 0), /* private/shared flag */
+    MAP_SHARED | ((fn == NULL) ? MAP_ANONYMOUS : 0) | cnpy_map_flags(opts), /* private/shared flag */
 #else
-    MAP_SHARED, /* private/shared flag */
+    MAP_SHARED | cnpy_map_flags(opts), /* private/shared flag */
 #endif
     fd, /* file */
     0 /* file offset */
@@ -994,34 +1481,51 @@ cnpy_status cnpy_create(const char * const fn, cnpy_byte_order byte_order, cnpy_
   }
 
   /* Close the file, if necessary. */
-  if (fd != -1 && close(fd) != 0) {
-    munmap(raw_data, raw_data_size); /* No point checking for error */
-    return cnpy_error(CNPY_ERROR_FILE, "Could not close file after mmap(): %s", strerror(errno));
+  bool keep_fd = fd != -1 && opts->growable;
+  if (fd != -1) {
+    cnpy_fadvise(fd, opts);
+    if (!keep_fd && close(fd) != 0) {
+      munmap(raw_data, map_size); /* No point checking for error */
+      return cnpy_error(CNPY_ERROR_FILE, "Could not close file after mmap(): %s", strerror(errno));
+    }
+  }
+
+  cnpy_status status = cnpy_apply_map_options(raw_data, map_size, opts, NULL);
+  if (status != CNPY_SUCCESS) {
+    munmap(raw_data, map_size); /* No point checking for error */
+    if (keep_fd) {
+      close(fd);
+    }
+    return status;
   }
 
   /* Write the header */
-  cnpy_write_header(raw_data, full_header_size, byte_order, dtype, order, n_dim, dims);
+  cnpy_write_padded_header(raw_data, full_header_size, byte_order, dtype, order, n_dim, dims);
 
   /* Set all entries to zero.
    * memset() works because the binary representation of (positive) 0 is all 0-bytes. */
   memset(raw_data + full_header_size, 0, raw_data_size - full_header_size);
 
   /* Prepare the array structure */
-  cnpy_array tmp = {
-    .byte_order = byte_order,
-    .dtype = dtype,
-    .order = order,
-    .n_dim = n_dim,
-    .raw_data = raw_data,
-    .data_begin = full_header_size,
-    .raw_data_size = raw_data_size,
-  };
+  cnpy_array tmp;
+  tmp.byte_order = byte_order;
+  tmp.dtype = dtype;
+  tmp.order = order;
+  tmp.n_dim = n_dim;
+  tmp.raw_data = raw_data;
+  tmp.data_begin = full_header_size;
+  tmp.raw_data_size = raw_data_size;
+  tmp.map_size = map_size;
+  tmp.fd = keep_fd? fd : -1;
+  tmp.read_only = false;
   for (size_t i = 0; i < n_dim; i += 1) {
     tmp.dims[i] = dims[i];
   }
 
   /* Final check for correctness */
-  cnpy_parse_check_data_size(tmp);
+  cnpy_status check = cnpy_parse_check_data_size(tmp, NULL);
+  assert(check == CNPY_SUCCESS);
+  (void) check;
 
   *arr = tmp;
 
@@ -1030,19 +1534,48 @@ cnpy_status cnpy_create(const char * const fn, cnpy_byte_order byte_order, cnpy_
 
 
 /*
- * Close a cnpy_array.
+ * As cnpy_create(), but with the mapping options *opts (see cnpy_open_options_init() for the defaults).
+ * The mode member of *opts is ignored; the new array is always writable.
+ * Only growable arrays get a header with room for the growth axis to reach any length; otherwise data_begin is cnpy_predict_full_header_size().
+ * Explicit huge pages need reserved huge pages; if there are none, mmap() fails.
  */
+cnpy_status cnpy_create_ex(const char * const fn, cnpy_byte_order byte_order, cnpy_dtype dtype, cnpy_flat_order order, size_t n_dim, const size_t * const dims, const cnpy_open_options *opts, cnpy_array *arr) {
+  return cnpy_create_padded(fn, byte_order, dtype, order, n_dim, dims, 0, opts, arr);
+}
 
 
-static cnpy_status cnpy_close(cnpy_array *arr) {
-  assert(arr != NULL);
-  assert(arr->raw_data != NULL);
-
-  /* just munmap() the data. */
-  if (munmap(arr->raw_data, arr->raw_data_size)) {
-    return cnpy_error(CNPY_ERROR_MMAP, "munmap() failed: %s", strerror(errno));
-  }
+/*
+ * Create a new .npy array (possibly backed by a file).
+ * If fn is NULL, an anonymous mapping will be created.
+ */
+cnpy_status cnpy_create(const char * const fn, cnpy_byte_order byte_order, cnpy_dtype dtype, cnpy_flat_order order, size_t n_dim, const size_t * const dims, cnpy_array *arr) {
+  cnpy_open_options opts;
+  cnpy_open_options_init(&opts);
+  return cnpy_create_ex(fn, byte_order, dtype, order, n_dim, dims, &opts, arr);
+}
+
+
+/*
+ * Close a cnpy_array.
+ */
+
+
+static cnpy_status cnpy_close(cnpy_array *arr) {
+  assert(arr != NULL);
+  assert(arr->raw_data != NULL);
+
+  /* just munmap() the data (and close the file of a growable array). */
+  if (munmap(arr->raw_data, arr->map_size)) {
+    return cnpy_error(CNPY_ERROR_MMAP, "munmap() failed: %s", strerror(errno));
+  }
   arr->raw_data = NULL;
+  if (arr->fd != -1) {
+    int fd = arr->fd;
+    arr->fd = -1;
+    if (close(fd) != 0) {
+      return cnpy_error(CNPY_ERROR_FILE, "Could not close file: %s", strerror(errno));
+    }
+  }
   return CNPY_SUCCESS;
 }
 
@@ -1096,7 +1629,7 @@ static size_t cnpy_flatten_index(cnpy_array arr, const size_t * const index) {
 
 
 /* Copy n bytes from src to dst in the same order (forwards) */
-static void cnpy_cpy_f(size_t n, const char * const restrict src, char * restrict dst) {
+static void cnpy_cpy_f(size_t n, const char * const CNPY_RESTRICT src, char * CNPY_RESTRICT dst) {
   for (size_t i = 0; i < n; i += 1) {
     dst[i] = src[i];
   }
@@ -1104,7 +1637,7 @@ static void cnpy_cpy_f(size_t n, const char * const restrict src, char * restric
 
 
 /* Copy n bytes from src to dst in reverse byte order */
-static void cnpy_cpy_r(size_t n, const char * const restrict src, char *restrict dst) {
+static void cnpy_cpy_r(size_t n, const char * const CNPY_RESTRICT src, char * CNPY_RESTRICT dst) {
   for (size_t i = 0; i < n; i += 1) {
     dst[i] = src[n - 1 - i];
   }
@@ -1112,7 +1645,7 @@ static void cnpy_cpy_r(size_t n, const char * const restrict src, char *restrict
 
 
 /* Copy n bytes from src to dst, changing byte order to / from byte_order */
-static void cnpy_cpy(const cnpy_array arr, const char * const restrict src, char * restrict dst) {
+static void cnpy_cpy(const cnpy_array arr, const char * const CNPY_RESTRICT src, char * CNPY_RESTRICT dst) {
   assert(arr.dtype != CNPY_C8 && arr.dtype != CNPY_C16);
   switch (arr.byte_order) {
     case CNPY_NE:
@@ -1143,7 +1676,7 @@ static void cnpy_cpy(const cnpy_array arr, const char * const restrict src, char
 
 
 /* Copy n bytes from src to dst, changing byte order to / from byte_order; version for complex numbers */
-static void cnpy_cpy_complex(const cnpy_array arr, const char * const restrict src, char * restrict dst) {
+static void cnpy_cpy_complex(const cnpy_array arr, const char * const CNPY_RESTRICT src, char * CNPY_RESTRICT dst) {
   assert(arr.dtype == CNPY_C8 || arr.dtype == CNPY_C16);
   size_t n = cnpy_dtype_sizes[arr.dtype];
   switch (arr.byte_order) {
@@ -1313,31 +1846,8092 @@ void cnpy_set_f8(cnpy_array arr, const size_t * const index, double x) {
   cnpy_cpy(arr, (char*) &x, cnpy_get_addr(arr, index));
 }
 
-complex float cnpy_get_c8(const cnpy_array arr, const size_t * const index) {
+cnpy_complex_float cnpy_get_c8(const cnpy_array arr, const size_t * const index) {
   assert(arr.dtype == CNPY_C8);
-  complex float ret;
+  cnpy_complex_float ret;
   cnpy_cpy_complex(arr, cnpy_get_addr(arr, index), (char*) &ret);
   return ret;
 }
 
-void cnpy_set_c8(const cnpy_array arr, const size_t * const index, complex float x) {
+void cnpy_set_c8(const cnpy_array arr, const size_t * const index, cnpy_complex_float x) {
   assert(arr.dtype == CNPY_C8);
   cnpy_cpy_complex(arr, (char*) &x, cnpy_get_addr(arr, index));
 }
 
-complex double cnpy_get_c16(const cnpy_array arr, const size_t * const index) {
+cnpy_complex_double cnpy_get_c16(const cnpy_array arr, const size_t * const index) {
   assert(arr.dtype == CNPY_C16);
-  complex double ret;
+  cnpy_complex_double ret;
   cnpy_cpy_complex(arr, cnpy_get_addr(arr, index), (char*) &ret);
   return ret;
 }
 
-void cnpy_set_c16(const cnpy_array arr, const size_t * const index, complex double x) {
+void cnpy_set_c16(const cnpy_array arr, const size_t * const index, cnpy_complex_double x) {
   assert(arr.dtype == CNPY_C16);
   cnpy_cpy_complex(arr, (char*) &x, cnpy_get_addr(arr, index));
 }
 
 
+/*
+ * Bulk byte order conversion
+ */
+
+
+/* Is data with the given byte order stored in host byte order? */
+static bool cnpy_is_host_byte_order(cnpy_byte_order byte_order) {
+  switch (byte_order) {
+    case CNPY_NE:
+      return true;
+    case CNPY_BE:
+#if BYTE_ORDER == LITTLE_ENDIAN
+      return false;
+#elif BYTE_ORDER == BIG_ENDIAN
+      return true;
+#else
+#error "Unsupported byte order."
+#endif
+    case CNPY_LE:
+#if BYTE_ORDER == LITTLE_ENDIAN
+      return true;
+#elif BYTE_ORDER == BIG_ENDIAN
+      return false;
+#else
+#error "Unsupported byte order."
+#endif
+    default:
+      assert(false);
+      return true;
+  }
+}
+
+
+/* Width of the scalars whose bytes have to be reversed; complex numbers are a pair of floats. */
+static size_t cnpy_swap_width(cnpy_dtype dtype) {
+  if (dtype == CNPY_C8 || dtype == CNPY_C16) {
+    return cnpy_dtype_sizes[dtype] / 2;
+  }
+  return cnpy_dtype_sizes[dtype];
+}
+
+
+/*
+ * Reverse the byte order of n scalars of the given width, reading from src and writing to dst.
+ * src and dst may be identical (for conversion in place), but must not overlap otherwise.
+ * There is a plain C kernel, which gcc and clang vectorise with the baseline instruction set,
+ * and hand-written SSSE3 / AVX2 / NEON kernels; the best one is chosen at runtime.
+ */
+static void cnpy_swap_kernel_c(size_t width, size_t n, const char *src, char *dst) {
+  switch (width) {
+    case 1:
+      if (src != dst) {
+        memcpy(dst, src, n);
+      }
+      break;
+    case 2:
+      for (size_t i = 0; i < n; i += 1) {
+        uint16_t x;
+        memcpy(&x, src + 2 * i, 2);
+        x = __builtin_bswap16(x);
+        memcpy(dst + 2 * i, &x, 2);
+      }
+      break;
+    case 4:
+      for (size_t i = 0; i < n; i += 1) {
+        uint32_t x;
+        memcpy(&x, src + 4 * i, 4);
+        x = __builtin_bswap32(x);
+        memcpy(dst + 4 * i, &x, 4);
+      }
+      break;
+    case 8:
+      for (size_t i = 0; i < n; i += 1) {
+        uint64_t x;
+        memcpy(&x, src + 8 * i, 8);
+        x = __builtin_bswap64(x);
+        memcpy(dst + 8 * i, &x, 8);
+      }
+      break;
+    default:
+      assert(false);
+  }
+}
+
+
+#ifdef CNPY_SIMD_X86
+/* pshufb masks reversing each 2, 4, and 8 byte group of a 16 byte lane */
+static const uint8_t cnpy_swap_masks[3][16] = {
+  { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+  { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+  { 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 },
+};
+
+
+static const uint8_t *cnpy_swap_mask(size_t width) {
+  return cnpy_swap_masks[(width == 2)? 0 : (width == 4)? 1 : 2];
+}
+
+
+__attribute__((target("ssse3")))
+static void cnpy_swap_kernel_ssse3(size_t width, size_t n, const char *src, char *dst) {
+  const __m128i mask = _mm_loadu_si128((const __m128i *) cnpy_swap_mask(width));
+  size_t n_bytes = width * n;
+  size_t i = 0;
+  for (; i + 16 <= n_bytes; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *) (src + i));
+    _mm_storeu_si128((__m128i *) (dst + i), _mm_shuffle_epi8(x, mask));
+  }
+  cnpy_swap_kernel_c(width, (n_bytes - i) / width, src + i, dst + i);
+}
+
+
+__attribute__((target("avx2")))
+static void cnpy_swap_kernel_avx2(size_t width, size_t n, const char *src, char *dst) {
+  const __m128i mask_128 = _mm_loadu_si128((const __m128i *) cnpy_swap_mask(width));
+  const __m256i mask = _mm256_broadcastsi128_si256(mask_128);
+  size_t n_bytes = width * n;
+  size_t i = 0;
+  for (; i + 64 <= n_bytes; i += 64) {
+    __m256i x0 = _mm256_loadu_si256((const __m256i *) (src + i));
+    __m256i x1 = _mm256_loadu_si256((const __m256i *) (src + i + 32));
+    _mm256_storeu_si256((__m256i *) (dst + i), _mm256_shuffle_epi8(x0, mask));
+    _mm256_storeu_si256((__m256i *) (dst + i + 32), _mm256_shuffle_epi8(x1, mask));
+  }
+  for (; i + 32 <= n_bytes; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *) (src + i));
+    _mm256_storeu_si256((__m256i *) (dst + i), _mm256_shuffle_epi8(x, mask));
+  }
+  cnpy_swap_kernel_c(width, (n_bytes - i) / width, src + i, dst + i);
+}
+#endif
+
+
+#ifdef CNPY_SIMD_NEON
+static void cnpy_swap_kernel_neon(size_t width, size_t n, const char *src, char *dst) {
+  size_t n_bytes = width * n;
+  size_t i = 0;
+  for (; i + 16 <= n_bytes; i += 16) {
+    uint8x16_t x = vld1q_u8((const uint8_t *) (src + i));
+    switch (width) {
+      case 2:
+        x = vrev16q_u8(x);
+        break;
+      case 4:
+        x = vrev32q_u8(x);
+        break;
+      default:
+        x = vrev64q_u8(x);
+    }
+    vst1q_u8((uint8_t *) (dst + i), x);
+  }
+  cnpy_swap_kernel_c(width, (n_bytes - i) / width, src + i, dst + i);
+}
+#endif
+
+
+static void cnpy_cpy_swap_n(size_t width, size_t n, const char *src, char *dst) {
+  if (width == 1) {
+    cnpy_swap_kernel_c(width, n, src, dst);
+    return;
+  }
+#if defined(CNPY_SIMD_X86)
+  if (__builtin_cpu_supports("avx2")) {
+    cnpy_swap_kernel_avx2(width, n, src, dst);
+    return;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    cnpy_swap_kernel_ssse3(width, n, src, dst);
+    return;
+  }
+  cnpy_swap_kernel_c(width, n, src, dst);
+#elif defined(CNPY_SIMD_NEON)
+  cnpy_swap_kernel_neon(width, n, src, dst);
+#else
+  cnpy_swap_kernel_c(width, n, src, dst);
+#endif
+}
+
+
+/* Copy n elements of type arr.dtype from src to dst, changing byte order to / from arr.byte_order */
+static void cnpy_cpy_n(const cnpy_array arr, size_t n, const char * CNPY_RESTRICT src, char * CNPY_RESTRICT dst) {
+  size_t size = cnpy_dtype_sizes[arr.dtype];
+  if (cnpy_is_host_byte_order(arr.byte_order)) {
+    memcpy(dst, src, n * size);
+  }
+  else {
+    size_t width = cnpy_swap_width(arr.dtype);
+    cnpy_cpy_swap_n(width, n * (size / width), src, dst);
+  }
+}
+
+
+/*
+ * Bulk accessors
+ *
+ * These copy count consecutive elements, starting at the flat index flat_start, between the array and a buffer.
+ * Flat indices count elements in serialization order (arr.order), i. e. in the order in which they are stored.
+ * The buffer holds count elements in host byte order.
+ */
+
+
+/* Total number of elements of arr */
+size_t cnpy_n_elements(const cnpy_array arr) {
+  size_t n = 1;
+  for (size_t i = 0; i < arr.n_dim; i += 1) {
+    n *= arr.dims[i]; /* cannot overflow, this was checked when the array was opened or created. */
+  }
+  return n;
+}
+
+
+void cnpy_read_range(const cnpy_array arr, size_t flat_start, size_t count, void *out) {
+  assert(out != NULL || count == 0);
+  assert(flat_start <= cnpy_n_elements(arr) && count <= cnpy_n_elements(arr) - flat_start);
+  cnpy_cpy_n(arr, count, arr.raw_data + arr.data_begin + cnpy_dtype_sizes[arr.dtype] * flat_start, (char *) out);
+}
+
+
+void cnpy_write_range(cnpy_array arr, size_t flat_start, size_t count, const void *in) {
+  assert(in != NULL || count == 0);
+  assert(flat_start <= cnpy_n_elements(arr) && count <= cnpy_n_elements(arr) - flat_start);
+  cnpy_cpy_n(arr, count, (const char *) in, arr.raw_data + arr.data_begin + cnpy_dtype_sizes[arr.dtype] * flat_start);
+}
+
+
+/*
+ * Type specific bulk accessors
+ */
+
+void cnpy_read_b_range(const cnpy_array arr, size_t flat_start, size_t count, bool *out) {
+  assert(arr.dtype == CNPY_B);
+  cnpy_read_range(arr, flat_start, count, out);
+}
+
+void cnpy_write_b_range(cnpy_array arr, size_t flat_start, size_t count, const bool *in) {
+  assert(arr.dtype == CNPY_B);
+  cnpy_write_range(arr, flat_start, count, in);
+}
+
+void cnpy_read_i1_range(const cnpy_array arr, size_t flat_start, size_t count, int8_t *out) {
+  assert(arr.dtype == CNPY_I1);
+  cnpy_read_range(arr, flat_start, count, out);
+}
+
+void cnpy_write_i1_range(cnpy_array arr, size_t flat_start, size_t count, const int8_t *in) {
+  assert(arr.dtype == CNPY_I1);
+  cnpy_write_range(arr, flat_start, count, in);
+}
+
+void cnpy_read_i2_range(const cnpy_array arr, size_t flat_start, size_t count, int16_t *out) {
+  assert(arr.dtype == CNPY_I2);
+  cnpy_read_range(arr, flat_start, count, out);
+}
+
+void cnpy_write_i2_range(cnpy_array arr, size_t flat_start, size_t count, const int16_t *in) {
+  assert(arr.dtype == CNPY_I2);
+  cnpy_write_range(arr, flat_start, count, in);
+}
+
+void cnpy_read_i4_range(const cnpy_array arr, size_t flat_start, size_t count, int32_t *out) {
+  assert(arr.dtype == CNPY_I4);
+  cnpy_read_range(arr, flat_start, count, out);
+}
+
+void cnpy_write_i4_range(cnpy_array arr, size_t flat_start, size_t count, const int32_t *in) {
+  assert(arr.dtype == CNPY_I4);
+  cnpy_write_range(arr, flat_start, count, in);
+}
+
+void cnpy_read_i8_range(const cnpy_array arr, size_t flat_start, size_t count, int64_t *out) {
+  assert(arr.dtype == CNPY_I8);
+  cnpy_read_range(arr, flat_start, count, out);
+}
+
+void cnpy_write_i8_range(cnpy_array arr, size_t flat_start, size_t count, const int64_t *in) {
+  assert(arr.dtype == CNPY_I8);
+  cnpy_write_range(arr, flat_start, count, in);
+}
+
+void cnpy_read_u1_range(const cnpy_array arr, size_t flat_start, size_t count, uint8_t *out) {
+  assert(arr.dtype == CNPY_U1);
+  cnpy_read_range(arr, flat_start, count, out);
+}
+
+void cnpy_write_u1_range(cnpy_array arr, size_t flat_start, size_t count, const uint8_t *in) {
+  assert(arr.dtype == CNPY_U1);
+  cnpy_write_range(arr, flat_start, count, in);
+}
+
+void cnpy_read_u2_range(const cnpy_array arr, size_t flat_start, size_t count, uint16_t *out) {
+  assert(arr.dtype == CNPY_U2);
+  cnpy_read_range(arr, flat_start, count, out);
+}
+
+void cnpy_write_u2_range(cnpy_array arr, size_t flat_start, size_t count, const uint16_t *in) {
+  assert(arr.dtype == CNPY_U2);
+  cnpy_write_range(arr, flat_start, count, in);
+}
+
+void cnpy_read_u4_range(const cnpy_array arr, size_t flat_start, size_t count, uint32_t *out) {
+  assert(arr.dtype == CNPY_U4);
+  cnpy_read_range(arr, flat_start, count, out);
+}
+
+void cnpy_write_u4_range(cnpy_array arr, size_t flat_start, size_t count, const uint32_t *in) {
+  assert(arr.dtype == CNPY_U4);
+  cnpy_write_range(arr, flat_start, count, in);
+}
+
+void cnpy_read_u8_range(const cnpy_array arr, size_t flat_start, size_t count, uint64_t *out) {
+  assert(arr.dtype == CNPY_U8);
+  cnpy_read_range(arr, flat_start, count, out);
+}
+
+void cnpy_write_u8_range(cnpy_array arr, size_t flat_start, size_t count, const uint64_t *in) {
+  assert(arr.dtype == CNPY_U8);
+  cnpy_write_range(arr, flat_start, count, in);
+}
+
+void cnpy_read_f4_range(const cnpy_array arr, size_t flat_start, size_t count, float *out) {
+  assert(arr.dtype == CNPY_F4);
+  cnpy_read_range(arr, flat_start, count, out);
+}
+
+void cnpy_write_f4_range(cnpy_array arr, size_t flat_start, size_t count, const float *in) {
+  assert(arr.dtype == CNPY_F4);
+  cnpy_write_range(arr, flat_start, count, in);
+}
+
+void cnpy_read_f8_range(const cnpy_array arr, size_t flat_start, size_t count, double *out) {
+  assert(arr.dtype == CNPY_F8);
+  cnpy_read_range(arr, flat_start, count, out);
+}
+
+void cnpy_write_f8_range(cnpy_array arr, size_t flat_start, size_t count, const double *in) {
+  assert(arr.dtype == CNPY_F8);
+  cnpy_write_range(arr, flat_start, count, in);
+}
+
+void cnpy_read_c8_range(const cnpy_array arr, size_t flat_start, size_t count, cnpy_complex_float *out) {
+  assert(arr.dtype == CNPY_C8);
+  cnpy_read_range(arr, flat_start, count, out);
+}
+
+void cnpy_write_c8_range(cnpy_array arr, size_t flat_start, size_t count, const cnpy_complex_float *in) {
+  assert(arr.dtype == CNPY_C8);
+  cnpy_write_range(arr, flat_start, count, in);
+}
+
+void cnpy_read_c16_range(const cnpy_array arr, size_t flat_start, size_t count, cnpy_complex_double *out) {
+  assert(arr.dtype == CNPY_C16);
+  cnpy_read_range(arr, flat_start, count, out);
+}
+
+void cnpy_write_c16_range(cnpy_array arr, size_t flat_start, size_t count, const cnpy_complex_double *in) {
+  assert(arr.dtype == CNPY_C16);
+  cnpy_write_range(arr, flat_start, count, in);
+}
+
+
+/*
+ * In-place byte order conversion of a whole array
+ */
+
+
+#define CNPY_MIN_BYTES_PER_THREAD (1 << 22) /* Do not bother starting threads for less work than this. */
+
+
+typedef struct {
+  char *data;
+  size_t width;
+  size_t n; /* number of scalars */
+} cnpy_swap_job;
+
+
+static void cnpy_swap_worker(void *arg, size_t i, size_t n_threads) {
+  const cnpy_swap_job *job = (const cnpy_swap_job *) arg;
+  size_t begin = job->n / n_threads * i;
+  size_t end = (i + 1 == n_threads)? job->n : job->n / n_threads * (i + 1);
+  cnpy_cpy_swap_n(job->width, end - begin, job->data + job->width * begin, job->data + job->width * begin);
+}
+
+
+/* Position of the byte order character of the 'descr' value in the header, or 0 if there is none. */
+static size_t cnpy_find_descr_byte_order(const cnpy_array arr) {
+  for (size_t i = 0; i + 5 < arr.data_begin; i += 1) {
+    if (memcmp(arr.raw_data + i, "descr", 5) == 0) {
+      for (size_t j = i + 5; j < arr.data_begin; j += 1) {
+        char c = arr.raw_data[j];
+        if (c == '<' || c == '>' || c == '|') {
+          return j;
+        }
+      }
+      return 0;
+    }
+  }
+  return 0;
+}
+
+
+/*
+ * Convert the data of *arr to the byte order target (CNPY_LE or CNPY_BE) in place, and patch the header accordingly.
+ * If *arr is backed by a writable mapping of a file, the file is changed; read-only mappings are rejected with CNPY_ERROR_MMAP.
+ * Large arrays are converted by several threads.
+ */
+cnpy_status cnpy_convert_byte_order(cnpy_array *arr, cnpy_byte_order target) {
+  assert(arr != NULL);
+  assert(arr->raw_data != NULL);
+  assert(target == CNPY_LE || target == CNPY_BE);
+
+  if (arr->byte_order == CNPY_NE || arr->byte_order == target) {
+    return CNPY_SUCCESS; /* nothing to do */
+  }
+  if (arr->read_only) {
+    return cnpy_error(CNPY_ERROR_MMAP, "The array is mapped read-only");
+  }
+
+  size_t pos = cnpy_find_descr_byte_order(*arr);
+  if (pos == 0) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Could not find the byte order in the header");
+  }
+
+  cnpy_swap_job job;
+  job.data = arr->raw_data + arr->data_begin;
+  job.width = cnpy_swap_width(arr->dtype);
+  size_t n_bytes = arr->raw_data_size - arr->data_begin;
+  job.n = n_bytes / job.width;
+
+  size_t n_threads = cnpy_n_threads(0);
+  if (n_threads > n_bytes / CNPY_MIN_BYTES_PER_THREAD) {
+    n_threads = n_bytes / CNPY_MIN_BYTES_PER_THREAD + 1;
+  }
+  cnpy_parallel_for(n_threads, cnpy_swap_worker, &job);
+
+  arr->raw_data[pos] = (target == CNPY_LE)? '<' : '>';
+  arr->byte_order = target;
+
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Accessors
+ *
+ * A cnpy_accessor is built once from an array and then passed by pointer.
+ * It caches the per-axis strides in bytes, the address of the first element, and the copy routine for the byte order,
+ * so a single-element access is a dot product and an indirect call.
+ * An accessor stays valid as long as the array it was built from is open.
+ */
+
+
+typedef struct {
+  char *data; /* address of the first element */
+  cnpy_dtype dtype; /* type of stored data */
+  size_t n_dim; /* number of dimensions */
+  size_t dims[CNPY_MAX_DIM]; /* size along each of the dimensions */
+  size_t strides[CNPY_MAX_DIM]; /* distance in bytes between neighbouring elements along each of the dimensions */
+  void (*cpy)(const char *src, char *dst); /* copies one element, changing the byte order if necessary; works in both directions */
+} cnpy_accessor;
+
+
+static void cnpy_acc_cpy_1(const char *src, char *dst) {
+  memcpy(dst, src, 1);
+}
+
+static void cnpy_acc_cpy_2(const char *src, char *dst) {
+  memcpy(dst, src, 2);
+}
+
+static void cnpy_acc_cpy_4(const char *src, char *dst) {
+  memcpy(dst, src, 4);
+}
+
+static void cnpy_acc_cpy_8(const char *src, char *dst) {
+  memcpy(dst, src, 8);
+}
+
+static void cnpy_acc_cpy_16(const char *src, char *dst) {
+  memcpy(dst, src, 16);
+}
+
+static void cnpy_acc_swap_2(const char *src, char *dst) {
+  uint16_t x;
+  memcpy(&x, src, 2);
+  x = __builtin_bswap16(x);
+  memcpy(dst, &x, 2);
+}
+
+static void cnpy_acc_swap_4(const char *src, char *dst) {
+  uint32_t x;
+  memcpy(&x, src, 4);
+  x = __builtin_bswap32(x);
+  memcpy(dst, &x, 4);
+}
+
+static void cnpy_acc_swap_8(const char *src, char *dst) {
+  uint64_t x;
+  memcpy(&x, src, 8);
+  x = __builtin_bswap64(x);
+  memcpy(dst, &x, 8);
+}
+
+static void cnpy_acc_swap_c8(const char *src, char *dst) {
+  cnpy_acc_swap_4(src, dst);
+  cnpy_acc_swap_4(src + 4, dst + 4);
+}
+
+static void cnpy_acc_swap_c16(const char *src, char *dst) {
+  cnpy_acc_swap_8(src, dst);
+  cnpy_acc_swap_8(src + 8, dst + 8);
+}
+
+
+/* The routine which copies one element of type dtype stored with byte order byte_order to / from host byte order. */
+static void (*cnpy_resolve_cpy(cnpy_dtype dtype, cnpy_byte_order byte_order))(const char *, char *) {
+  size_t size = cnpy_dtype_sizes[dtype];
+  if (cnpy_is_host_byte_order(byte_order)) {
+    switch (size) {
+      case 1:
+        return cnpy_acc_cpy_1;
+      case 2:
+        return cnpy_acc_cpy_2;
+      case 4:
+        return cnpy_acc_cpy_4;
+      case 8:
+        return cnpy_acc_cpy_8;
+      case 16:
+        return cnpy_acc_cpy_16;
+      default:
+        assert(false);
+    }
+  }
+  else {
+    switch (dtype) {
+      case CNPY_I2:
+      case CNPY_U2:
+        return cnpy_acc_swap_2;
+      case CNPY_I4:
+      case CNPY_U4:
+      case CNPY_F4:
+        return cnpy_acc_swap_4;
+      case CNPY_I8:
+      case CNPY_U8:
+      case CNPY_F8:
+        return cnpy_acc_swap_8;
+      case CNPY_C8:
+        return cnpy_acc_swap_c8;
+      case CNPY_C16:
+        return cnpy_acc_swap_c16;
+      default:
+        assert(false);
+    }
+  }
+  return NULL;
+}
+
+
+/* Build an accessor for arr. */
+void cnpy_acc_init(const cnpy_array *arr, cnpy_accessor *acc) {
+  assert(arr != NULL);
+  assert(acc != NULL);
+  assert(arr->raw_data != NULL);
+
+  size_t size = cnpy_dtype_sizes[arr->dtype];
+  acc->data = arr->raw_data + arr->data_begin;
+  acc->dtype = arr->dtype;
+  acc->n_dim = arr->n_dim;
+
+  /* strides; these cannot overflow because the total size was checked when the array was opened or created. */
+  size_t stride = size;
+  for (size_t i = 0; i < arr->n_dim; i += 1) {
+    size_t j = (arr->order == CNPY_C_ORDER)? arr->n_dim - 1 - i : i;
+    acc->dims[j] = arr->dims[j];
+    acc->strides[j] = stride;
+    stride *= arr->dims[j];
+  }
+
+  acc->cpy = cnpy_resolve_cpy(arr->dtype, arr->byte_order);
+}
+
+
+/* Address of the element at index; no checks. */
+static inline char *cnpy_acc_addr(const cnpy_accessor *acc, const size_t * const index) {
+  size_t off = 0;
+  for (size_t i = 0; i < acc->n_dim; i += 1) {
+    off += index[i] * acc->strides[i];
+  }
+  return acc->data + off;
+}
+
+
+/* Address of the element at index; index must be in range. */
+static char *cnpy_acc_addr_checked(const cnpy_accessor *acc, const size_t * const index) {
+  assert(acc != NULL);
+  assert(index != NULL);
+  for (size_t i = 0; i < acc->n_dim; i += 1) {
+    assert(index[i] < acc->dims[i]);
+  }
+  return cnpy_acc_addr(acc, index);
+}
+
+
+/*
+ * Type specific accessors.
+ *
+ * cnpy_acc_get_X() and cnpy_acc_set_X() check the dtype and the index with assert(), like cnpy_get_X() and cnpy_set_X().
+ * The _unchecked versions never check anything, not even in debug builds.
+ */
+
+#define CNPY_ACC_DEFINE(name, type, dtype_value) \
+  type cnpy_acc_get_##name(const cnpy_accessor *acc, const size_t * const index) { \
+    assert(acc->dtype == dtype_value); \
+    type ret; \
+    acc->cpy(cnpy_acc_addr_checked(acc, index), (char *) &ret); \
+    return ret; \
+  } \
+  \
+  void cnpy_acc_set_##name(const cnpy_accessor *acc, const size_t * const index, type x) { \
+    assert(acc->dtype == dtype_value); \
+    acc->cpy((const char *) &x, cnpy_acc_addr_checked(acc, index)); \
+  } \
+  \
+  type cnpy_acc_get_##name##_unchecked(const cnpy_accessor *acc, const size_t * const index) { \
+    type ret; \
+    acc->cpy(cnpy_acc_addr(acc, index), (char *) &ret); \
+    return ret; \
+  } \
+  \
+  void cnpy_acc_set_##name##_unchecked(const cnpy_accessor *acc, const size_t * const index, type x) { \
+    acc->cpy((const char *) &x, cnpy_acc_addr(acc, index)); \
+  }
+
+CNPY_ACC_DEFINE(b, bool, CNPY_B)
+CNPY_ACC_DEFINE(i1, int8_t, CNPY_I1)
+CNPY_ACC_DEFINE(i2, int16_t, CNPY_I2)
+CNPY_ACC_DEFINE(i4, int32_t, CNPY_I4)
+CNPY_ACC_DEFINE(i8, int64_t, CNPY_I8)
+CNPY_ACC_DEFINE(u1, uint8_t, CNPY_U1)
+CNPY_ACC_DEFINE(u2, uint16_t, CNPY_U2)
+CNPY_ACC_DEFINE(u4, uint32_t, CNPY_U4)
+CNPY_ACC_DEFINE(u8, uint64_t, CNPY_U8)
+CNPY_ACC_DEFINE(f4, float, CNPY_F4)
+CNPY_ACC_DEFINE(f8, double, CNPY_F8)
+CNPY_ACC_DEFINE(c8, cnpy_complex_float, CNPY_C8)
+CNPY_ACC_DEFINE(c16, cnpy_complex_double, CNPY_C16)
+
+#undef CNPY_ACC_DEFINE
+
+
+/*
+ * Views
+ *
+ * A cnpy_view describes a strided sub-region of an open array without copying any data.
+ * Views are derived from a full view of the array (cnpy_view_init()) by slicing, reversing, transposing, or dropping axes.
+ * Each derived view shares the mapping of the original array; it stays valid as long as that array is open.
+ * Writing through a view changes the array.
+ *
+ * Indices of a view count along the axes of the view, not the axes of the array.
+ */
+
+
+typedef struct {
+  char *data; /* address of the element with index (0, ..., 0) */
+  cnpy_dtype dtype; /* type of stored data */
+  cnpy_byte_order byte_order; /* byte order */
+  size_t n_dim; /* number of axes of the view */
+  size_t dims[CNPY_MAX_DIM]; /* size of the view along each of its axes */
+  ptrdiff_t strides[CNPY_MAX_DIM]; /* distance in bytes between neighbouring elements along each axis (negative for reversed axes) */
+  void (*cpy)(const char *src, char *dst); /* copies one element, changing the byte order if necessary; works in both directions */
+} cnpy_view;
+
+
+/* Full view of arr, with the same axes as arr. */
+void cnpy_view_init(const cnpy_array *arr, cnpy_view *view) {
+  assert(arr != NULL);
+  assert(view != NULL);
+  assert(arr->raw_data != NULL);
+
+  view->data = arr->raw_data + arr->data_begin;
+  view->dtype = arr->dtype;
+  view->byte_order = arr->byte_order;
+  view->n_dim = arr->n_dim;
+  size_t stride = cnpy_dtype_sizes[arr->dtype];
+  for (size_t i = 0; i < arr->n_dim; i += 1) {
+    size_t j = (arr->order == CNPY_C_ORDER)? arr->n_dim - 1 - i : i;
+    view->dims[j] = arr->dims[j];
+    view->strides[j] = (ptrdiff_t) stride;
+    stride *= arr->dims[j];
+  }
+  view->cpy = cnpy_resolve_cpy(arr->dtype, arr->byte_order);
+}
+
+
+/*
+ * Restrict axis of view to the elements start, start + step, ..., up to but excluding stop.
+ * Requires start < stop <= view->dims[axis] and step > 0.
+ * in and out may be the same view.
+ */
+void cnpy_view_slice(const cnpy_view *in, size_t axis, size_t start, size_t stop, size_t step, cnpy_view *out) {
+  assert(in != NULL && out != NULL);
+  assert(axis < in->n_dim);
+  assert(start < stop && stop <= in->dims[axis]);
+  assert(step > 0);
+
+  *out = *in;
+  out->data = in->data + (ptrdiff_t) start * in->strides[axis];
+  out->dims[axis] = (stop - start - 1) / step + 1;
+  out->strides[axis] = in->strides[axis] * (ptrdiff_t) step;
+}
+
+
+/* Reverse the direction of axis of view. in and out may be the same view. */
+void cnpy_view_reverse(const cnpy_view *in, size_t axis, cnpy_view *out) {
+  assert(in != NULL && out != NULL);
+  assert(axis < in->n_dim);
+
+  *out = *in;
+  out->data = in->data + (ptrdiff_t) (in->dims[axis] - 1) * in->strides[axis];
+  out->strides[axis] = -in->strides[axis];
+}
+
+
+/*
+ * Permute the axes of view: axis i of out is axis perm[i] of in.
+ * perm must be a permutation of 0, ..., in->n_dim - 1. in and out may be the same view.
+ */
+void cnpy_view_transpose(const cnpy_view *in, const size_t * const perm, cnpy_view *out) {
+  assert(in != NULL && out != NULL);
+  assert(perm != NULL);
+
+  cnpy_view tmp = *in;
+  for (size_t i = 0; i < in->n_dim; i += 1) {
+    assert(perm[i] < in->n_dim);
+    for (size_t j = 0; j < i; j += 1) {
+      assert(perm[i] != perm[j]);
+    }
+    tmp.dims[i] = in->dims[perm[i]];
+    tmp.strides[i] = in->strides[perm[i]];
+  }
+  *out = tmp;
+}
+
+
+/*
+ * Fix axis of view at position index and drop it; out has one axis less than in.
+ * Dropping the last remaining axis is not possible. in and out may be the same view.
+ */
+void cnpy_view_drop(const cnpy_view *in, size_t axis, size_t index, cnpy_view *out) {
+  assert(in != NULL && out != NULL);
+  assert(in->n_dim > 1);
+  assert(axis < in->n_dim);
+  assert(index < in->dims[axis]);
+
+  cnpy_view tmp = *in;
+  tmp.data = in->data + (ptrdiff_t) index * in->strides[axis];
+  for (size_t i = axis; i + 1 < in->n_dim; i += 1) {
+    tmp.dims[i] = in->dims[i + 1];
+    tmp.strides[i] = in->strides[i + 1];
+  }
+  tmp.n_dim = in->n_dim - 1;
+  *out = tmp;
+}
+
+
+/* Total number of elements of view */
+size_t cnpy_view_n_elements(const cnpy_view *view) {
+  assert(view != NULL);
+  size_t n = 1;
+  for (size_t i = 0; i < view->n_dim; i += 1) {
+    n *= view->dims[i];
+  }
+  return n;
+}
+
+
+/* Address of the element of view at index; index must be in range. */
+static char *cnpy_view_addr(const cnpy_view *view, const size_t * const index) {
+  assert(view != NULL);
+  assert(index != NULL);
+  ptrdiff_t off = 0;
+  for (size_t i = 0; i < view->n_dim; i += 1) {
+    assert(index[i] < view->dims[i]);
+    off += (ptrdiff_t) index[i] * view->strides[i];
+  }
+  return view->data + off;
+}
+
+
+/*
+ * Type specific view accessors, analogous to cnpy_get_X() and cnpy_set_X().
+ */
+
+#define CNPY_VIEW_DEFINE(name, type, dtype_value) \
+  type cnpy_view_get_##name(const cnpy_view *view, const size_t * const index) { \
+    assert(view->dtype == dtype_value); \
+    type ret; \
+    view->cpy(cnpy_view_addr(view, index), (char *) &ret); \
+    return ret; \
+  } \
+  \
+  void cnpy_view_set_##name(const cnpy_view *view, const size_t * const index, type x) { \
+    assert(view->dtype == dtype_value); \
+    view->cpy((const char *) &x, cnpy_view_addr(view, index)); \
+  }
+
+CNPY_VIEW_DEFINE(b, bool, CNPY_B)
+CNPY_VIEW_DEFINE(i1, int8_t, CNPY_I1)
+CNPY_VIEW_DEFINE(i2, int16_t, CNPY_I2)
+CNPY_VIEW_DEFINE(i4, int32_t, CNPY_I4)
+CNPY_VIEW_DEFINE(i8, int64_t, CNPY_I8)
+CNPY_VIEW_DEFINE(u1, uint8_t, CNPY_U1)
+CNPY_VIEW_DEFINE(u2, uint16_t, CNPY_U2)
+CNPY_VIEW_DEFINE(u4, uint32_t, CNPY_U4)
+CNPY_VIEW_DEFINE(u8, uint64_t, CNPY_U8)
+CNPY_VIEW_DEFINE(f4, float, CNPY_F4)
+CNPY_VIEW_DEFINE(f8, double, CNPY_F8)
+CNPY_VIEW_DEFINE(c8, cnpy_complex_float, CNPY_C8)
+CNPY_VIEW_DEFINE(c16, cnpy_complex_double, CNPY_C16)
+
+#undef CNPY_VIEW_DEFINE
+
+
+/* Set index to zero */
+void cnpy_view_reset_index(const cnpy_view *view, size_t *index) {
+  assert(view != NULL);
+  assert(index != NULL);
+  for (size_t i = 0; i < view->n_dim; i += 1) {
+    index[i] = 0;
+  }
+}
+
+
+/*
+ * Get next index of view if possible; the last axis varies fastest (C order with respect to the axes of the view).
+ * Returns false and leaves index unchanged if index is the last index.
+ */
+bool cnpy_view_next_index(const cnpy_view *view, size_t *index) {
+  assert(view != NULL);
+  assert(index != NULL);
+  for (size_t i = view->n_dim - 1; i < view->n_dim; i -= 1) {
+    assert(index[i] < view->dims[i]);
+    if (index[i] + 1 < view->dims[i]) {
+      index[i] += 1;
+      for (size_t j = i + 1; j < view->n_dim; j += 1) {
+        index[j] = 0;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/*
+ * Span iteration
+ *
+ * A span iterator runs through a view in storage order and yields maximal runs of elements which are contiguous in memory.
+ * For a full view of an array, this is a single span; for a sliced view, it is typically one span per row.
+ * Spans point directly into the mapping, so the elements are in the byte order of the array (see cnpy_span_read()).
+ */
+
+
+typedef struct {
+  char *data; /* address of the first element of the span */
+  size_t length; /* number of elements in the span */
+  size_t index[CNPY_MAX_DIM]; /* multi-index (with respect to the view) of the first element of the span */
+} cnpy_span;
+
+
+typedef struct {
+  cnpy_view view; /* copy of the view being iterated */
+  size_t axes[CNPY_MAX_DIM]; /* axes of the view, ordered from the largest to the smallest absolute stride */
+  size_t n_outer; /* number of leading entries of axes which are not part of a span */
+  size_t span_length; /* number of elements per span */
+  size_t index[CNPY_MAX_DIM]; /* multi-index of the next span */
+  bool done; /* true if there are no more spans */
+} cnpy_span_iter;
+
+
+static size_t cnpy_abs_stride(ptrdiff_t stride) {
+  return (stride < 0)? (size_t) -stride : (size_t) stride;
+}
+
+
+/* Prepare it for iterating through view; the view may be changed or discarded afterwards. */
+void cnpy_span_iter_init(const cnpy_view *view, cnpy_span_iter *it) {
+  assert(view != NULL);
+  assert(it != NULL);
+
+  it->view = *view;
+  size_t n_dim = view->n_dim;
+
+  /* sort axes by decreasing absolute stride (insertion sort; there are at most CNPY_MAX_DIM of them) */
+  for (size_t i = 0; i < n_dim; i += 1) {
+    size_t j = i;
+    for (; j > 0 && cnpy_abs_stride(view->strides[it->axes[j - 1]]) < cnpy_abs_stride(view->strides[i]); j -= 1) {
+      it->axes[j] = it->axes[j - 1];
+    }
+    it->axes[j] = i;
+  }
+
+  /* merge the innermost axes into spans as long as they are contiguous */
+  size_t expected = cnpy_dtype_sizes[view->dtype];
+  it->span_length = 1;
+  it->n_outer = n_dim;
+  while (it->n_outer > 0) {
+    size_t a = it->axes[it->n_outer - 1];
+    if (view->dims[a] != 1 && view->strides[a] != (ptrdiff_t) expected) {
+      break;
+    }
+    expected *= view->dims[a];
+    it->span_length *= view->dims[a];
+    it->n_outer -= 1;
+  }
+
+  for (size_t i = 0; i < n_dim; i += 1) {
+    it->index[i] = 0;
+  }
+  it->done = false;
+}
+
+
+/* Store the next span in *span and return true, or return false if there are no more spans. */
+bool cnpy_span_next(cnpy_span_iter *it, cnpy_span *span) {
+  assert(it != NULL);
+  assert(span != NULL);
+
+  if (it->done) {
+    return false;
+  }
+
+  ptrdiff_t off = 0;
+  for (size_t i = 0; i < it->view.n_dim; i += 1) {
+    off += (ptrdiff_t) it->index[i] * it->view.strides[i];
+    span->index[i] = it->index[i];
+  }
+  span->data = it->view.data + off;
+  span->length = it->span_length;
+
+  /* advance the outer axes, the one with the smallest stride first */
+  it->done = true;
+  for (size_t k = it->n_outer - 1; k < it->n_outer; k -= 1) {
+    size_t a = it->axes[k];
+    if (it->index[a] + 1 < it->view.dims[a]) {
+      it->index[a] += 1;
+      it->done = false;
+      break;
+    }
+    it->index[a] = 0;
+  }
+
+  return true;
+}
+
+
+/* Copy the elements of span to out, converting them to host byte order. */
+void cnpy_span_read(const cnpy_span_iter *it, const cnpy_span *span, void *out) {
+  assert(it != NULL && span != NULL);
+  size_t size = cnpy_dtype_sizes[it->view.dtype];
+  if (cnpy_is_host_byte_order(it->view.byte_order)) {
+    memcpy(out, span->data, span->length * size);
+  }
+  else {
+    size_t width = cnpy_swap_width(it->view.dtype);
+    cnpy_cpy_swap_n(width, span->length * (size / width), span->data, (char *) out);
+  }
+}
+
+
+/*
+ * Hyperslabs
+ *
+ * A hyperslab is the rectangular, possibly strided, region with elements
+ * (start[0] + k[0] * stride[0], ..., start[n_dim - 1] + k[n_dim - 1] * stride[n_dim - 1]) for k[i] < count[i].
+ * It is copied to / from a dense buffer of count[0] * ... * count[n_dim - 1] elements,
+ * which has its own data type and serialization order and is always in host byte order.
+ */
+
+
+/* x rounded toward zero and saturated to [lo, hi]; NaN becomes 0. A plain cast would be undefined outside of the range. */
+static int64_t cnpy_float_to_int(double x, int64_t lo, int64_t hi) {
+  if (x != x) {
+    return 0;
+  }
+  if (x <= (double) lo) {
+    return lo;
+  }
+  if (x >= (double) hi) {
+    return hi; /* (double) INT64_MAX rounds up to 2^63, so everything below it fits */
+  }
+  return (int64_t) x;
+}
+
+
+/* x rounded toward zero and saturated to [0, hi]; NaN becomes 0. */
+static uint64_t cnpy_float_to_uint(double x, uint64_t hi) {
+  if (x != x || x <= 0.0) {
+    return 0;
+  }
+  if (x >= (double) hi) {
+    return hi;
+  }
+  return (uint64_t) x;
+}
+
+
+/*
+ * Convert one element in host byte order from dtype from at src to dtype to at dst.
+ * Integers are converted as by C casts, wrapping around (two's complement). Floating-point values are rounded toward zero
+ * and saturated to the range of an integer target, with NaN becoming 0. For complex to real conversions, the imaginary part is discarded.
+ */
+static void cnpy_convert_element(cnpy_dtype from, const char *src, cnpy_dtype to, char *dst) {
+  if (from == to) {
+    memcpy(dst, src, cnpy_dtype_sizes[from]);
+    return;
+  }
+
+  /* decode */
+  bool is_signed = false;
+  bool is_unsigned = false;
+  int64_t i = 0;
+  uint64_t u = 0;
+  double re = 0.0;
+  double im = 0.0;
+  switch (from) {
+    case CNPY_B: {
+      bool x;
+      memcpy(&x, src, sizeof(x));
+      is_unsigned = true;
+      u = x;
+      break;
+    }
+    case CNPY_I1: {
+      int8_t x;
+      memcpy(&x, src, sizeof(x));
+      is_signed = true;
+      i = x;
+      break;
+    }
+    case CNPY_I2: {
+      int16_t x;
+      memcpy(&x, src, sizeof(x));
+      is_signed = true;
+      i = x;
+      break;
+    }
+    case CNPY_I4: {
+      int32_t x;
+      memcpy(&x, src, sizeof(x));
+      is_signed = true;
+      i = x;
+      break;
+    }
+    case CNPY_I8: {
+      memcpy(&i, src, sizeof(i));
+      is_signed = true;
+      break;
+    }
+    case CNPY_U1: {
+      uint8_t x;
+      memcpy(&x, src, sizeof(x));
+      is_unsigned = true;
+      u = x;
+      break;
+    }
+    case CNPY_U2: {
+      uint16_t x;
+      memcpy(&x, src, sizeof(x));
+      is_unsigned = true;
+      u = x;
+      break;
+    }
+    case CNPY_U4: {
+      uint32_t x;
+      memcpy(&x, src, sizeof(x));
+      is_unsigned = true;
+      u = x;
+      break;
+    }
+    case CNPY_U8: {
+      memcpy(&u, src, sizeof(u));
+      is_unsigned = true;
+      break;
+    }
+    case CNPY_F4: {
+      float x;
+      memcpy(&x, src, sizeof(x));
+      re = x;
+      break;
+    }
+    case CNPY_F8: {
+      memcpy(&re, src, sizeof(re));
+      break;
+    }
+    case CNPY_C8: {
+      float x[2];
+      memcpy(x, src, sizeof(x));
+      re = x[0];
+      im = x[1];
+      break;
+    }
+    case CNPY_C16: {
+      double x[2];
+      memcpy(x, src, sizeof(x));
+      re = x[0];
+      im = x[1];
+      break;
+    }
+    default:
+      assert(false);
+  }
+  if (is_signed) {
+    re = (double) i;
+  }
+  else if (is_unsigned) {
+    re = (double) u;
+  }
+
+  /* encode */
+  switch (to) {
+    case CNPY_B: {
+      bool x = is_signed? i != 0 : is_unsigned? u != 0 : (re != 0.0 || im != 0.0);
+      memcpy(dst, &x, sizeof(x));
+      break;
+    }
+    case CNPY_I1: {
+      int8_t x = is_signed? (int8_t) i : is_unsigned? (int8_t) u : (int8_t) cnpy_float_to_int(re, INT8_MIN, INT8_MAX);
+      memcpy(dst, &x, sizeof(x));
+      break;
+    }
+    case CNPY_I2: {
+      int16_t x = is_signed? (int16_t) i : is_unsigned? (int16_t) u : (int16_t) cnpy_float_to_int(re, INT16_MIN, INT16_MAX);
+      memcpy(dst, &x, sizeof(x));
+      break;
+    }
+    case CNPY_I4: {
+      int32_t x = is_signed? (int32_t) i : is_unsigned? (int32_t) u : (int32_t) cnpy_float_to_int(re, INT32_MIN, INT32_MAX);
+      memcpy(dst, &x, sizeof(x));
+      break;
+    }
+    case CNPY_I8: {
+      int64_t x = is_signed? i : is_unsigned? (int64_t) u : cnpy_float_to_int(re, INT64_MIN, INT64_MAX);
+      memcpy(dst, &x, sizeof(x));
+      break;
+    }
+    case CNPY_U1: {
+      uint8_t x = is_signed? (uint8_t) i : is_unsigned? (uint8_t) u : (uint8_t) cnpy_float_to_uint(re, UINT8_MAX);
+      memcpy(dst, &x, sizeof(x));
+      break;
+    }
+    case CNPY_U2: {
+      uint16_t x = is_signed? (uint16_t) i : is_unsigned? (uint16_t) u : (uint16_t) cnpy_float_to_uint(re, UINT16_MAX);
+      memcpy(dst, &x, sizeof(x));
+      break;
+    }
+    case CNPY_U4: {
+      uint32_t x = is_signed? (uint32_t) i : is_unsigned? (uint32_t) u : (uint32_t) cnpy_float_to_uint(re, UINT32_MAX);
+      memcpy(dst, &x, sizeof(x));
+      break;
+    }
+    case CNPY_U8: {
+      uint64_t x = is_signed? (uint64_t) i : is_unsigned? u : cnpy_float_to_uint(re, UINT64_MAX);
+      memcpy(dst, &x, sizeof(x));
+      break;
+    }
+    case CNPY_F4: {
+      float x = (float) re;
+      memcpy(dst, &x, sizeof(x));
+      break;
+    }
+    case CNPY_F8: {
+      memcpy(dst, &re, sizeof(re));
+      break;
+    }
+    case CNPY_C8: {
+      float x[2] = { (float) re, (float) im };
+      memcpy(dst, x, sizeof(x));
+      break;
+    }
+    case CNPY_C16: {
+      double x[2] = { re, im };
+      memcpy(dst, x, sizeof(x));
+      break;
+    }
+    default:
+      assert(false);
+  }
+}
+
+
+/*
+ * Copy the hyperslab between arr and buf, in the direction given by to_buf.
+ * The slab is traversed in the serialization order of arr, so the array is accessed as sequentially as possible,
+ * no matter which serialization order buf has.
+ */
+static void cnpy_slab_copy(const cnpy_array arr, const size_t * const start, const size_t * const count, const size_t * const stride, char *buf, cnpy_dtype buf_dtype, cnpy_flat_order buf_order, bool to_buf) {
+  assert(start != NULL && count != NULL);
+  assert(buf != NULL);
+
+  size_t n_dim = arr.n_dim;
+  size_t size = cnpy_dtype_sizes[arr.dtype];
+  size_t buf_size = cnpy_dtype_sizes[buf_dtype];
+
+  /* byte steps in the array and in the buffer per step of k[i] */
+  size_t arr_step[CNPY_MAX_DIM];
+  size_t buf_step[CNPY_MAX_DIM];
+  size_t arr_stride = size;
+  size_t buf_stride = buf_size;
+  char *base = arr.raw_data + arr.data_begin;
+  for (size_t m = 0; m < n_dim; m += 1) {
+    size_t i = (arr.order == CNPY_C_ORDER)? n_dim - 1 - m : m;
+    size_t s = (stride != NULL)? stride[i] : 1;
+    assert(count[i] > 0 && s > 0);
+    assert(start[i] < arr.dims[i] && (count[i] - 1) * s < arr.dims[i] - start[i]);
+    base += start[i] * arr_stride;
+    arr_step[i] = arr_stride * s;
+    arr_stride *= arr.dims[i];
+  }
+  for (size_t m = 0; m < n_dim; m += 1) {
+    size_t i = (buf_order == CNPY_C_ORDER)? n_dim - 1 - m : m;
+    buf_step[i] = buf_stride;
+    buf_stride *= count[i];
+  }
+
+  /* the innermost loop runs along the fastest axis of the array */
+  size_t f = (arr.order == CNPY_C_ORDER)? n_dim - 1 : 0;
+  bool bulk = buf_dtype == arr.dtype && arr_step[f] == size && buf_step[f] == buf_size;
+  void (*cpy)(const char *, char *) = cnpy_resolve_cpy(arr.dtype, arr.byte_order);
+
+  size_t k[CNPY_MAX_DIM] = { 0 };
+  size_t arr_off = 0;
+  size_t buf_off = 0;
+  for (;;) {
+    char *a = base + arr_off;
+    char *b = buf + buf_off;
+    if (bulk && to_buf) {
+      cnpy_cpy_n(arr, count[f], a, b);
+    }
+    else if (bulk) {
+      cnpy_cpy_n(arr, count[f], b, a);
+    }
+    else {
+      char tmp[16];
+      for (size_t j = 0; j < count[f]; j += 1) {
+        if (to_buf) {
+          cpy(a, tmp);
+          cnpy_convert_element(arr.dtype, tmp, buf_dtype, b);
+        }
+        else {
+          cnpy_convert_element(buf_dtype, b, arr.dtype, tmp);
+          cpy(tmp, a);
+        }
+        a += arr_step[f];
+        b += buf_step[f];
+      }
+    }
+
+    /* advance the remaining axes in serialization order of the array */
+    bool done = true;
+    for (size_t m = 1; m < n_dim; m += 1) {
+      size_t i = (arr.order == CNPY_C_ORDER)? n_dim - 1 - m : m;
+      k[i] += 1;
+      arr_off += arr_step[i];
+      buf_off += buf_step[i];
+      if (k[i] < count[i]) {
+        done = false;
+        break;
+      }
+      arr_off -= arr_step[i] * count[i];
+      buf_off -= buf_step[i] * count[i];
+      k[i] = 0;
+    }
+    if (done) {
+      break;
+    }
+  }
+}
+
+
+/*
+ * Copy the hyperslab given by start, count, and stride from arr into the dense buffer out.
+ * out receives count[0] * ... * count[arr.n_dim - 1] elements of type out_dtype in host byte order, serialized in out_order.
+ * stride may be NULL, which means a stride of 1 along each axis.
+ * The slab must lie within arr, and count[i] and stride[i] must be positive.
+ */
+void cnpy_read_slab(const cnpy_array arr, const size_t * const start, const size_t * const count, const size_t * const stride, void *out, cnpy_dtype out_dtype, cnpy_flat_order out_order) {
+  cnpy_slab_copy(arr, start, count, stride, (char *) out, out_dtype, out_order, true);
+}
+
+
+/* Copy the dense buffer in into the hyperslab given by start, count, and stride of arr; the counterpart to cnpy_read_slab(). */
+void cnpy_write_slab(cnpy_array arr, const size_t * const start, const size_t * const count, const size_t * const stride, const void *in, cnpy_dtype in_dtype, cnpy_flat_order in_order) {
+  cnpy_slab_copy(arr, start, count, stride, (char *) in, in_dtype, in_order, false);
+}
+
+
+/*
+ * Reductions
+ *
+ * cnpy_reduce() computes sums, extrema, and their positions over a whole array.
+ * The data is split into page-aligned chunks, one per thread.
+ * Each thread works through its chunk in small blocks, which are converted to host byte order (if necessary) and then reduced by loops simple enough for the compiler to vectorise.
+ * The partial results of the threads are combined in a fixed order, so the result only depends on the data and the number of threads.
+ */
+
+
+/* Operations for cnpy_reduce(); these may be combined with bitwise or. */
+typedef enum {
+  CNPY_OP_SUM = 1,
+  CNPY_OP_MIN = 2,
+  CNPY_OP_MAX = 4,
+  CNPY_OP_MEAN = 8,
+  CNPY_OP_ARGMIN = 16,
+  CNPY_OP_ARGMAX = 32,
+} cnpy_op;
+
+
+typedef struct {
+  size_t count; /* number of elements */
+  double sum; /* sum of all elements (real part for complex types) */
+  double sum_imag; /* imaginary part of the sum for complex types */
+  int64_t sum_i; /* exact sum (modulo 2^64) for booleans and signed integers */
+  uint64_t sum_u; /* exact sum (modulo 2^64) for booleans and unsigned integers */
+  double mean; /* arithmetic mean (real part for complex types); computed from sum, so it does not wrap around for integers */
+  double mean_imag; /* imaginary part of the mean for complex types */
+  double min; /* smallest element, or NaN if any element is NaN */
+  double max; /* largest element, or NaN if any element is NaN */
+  size_t argmin; /* flat index (in serialization order) of the first smallest element, or of the first NaN */
+  size_t argmax; /* flat index (in serialization order) of the first largest element, or of the first NaN */
+} cnpy_reduction;
+
+
+#define CNPY_REDUCE_BLOCK 2048 /* elements per block; a block of the largest type fills 32 KiB */
+
+
+/* Partial result of one thread. */
+typedef struct {
+  double sum, comp; /* compensated sum (real part) */
+  double sum_imag, comp_imag; /* compensated sum (imaginary part) */
+  uint64_t sum_u; /* integer sum, wrapping */
+  bool any; /* are the extrema valid? */
+  int64_t min_i, max_i;
+  uint64_t min_u, max_u;
+  double min_f, max_f;
+  size_t argmin, argmax;
+  bool nan; /* has a NaN been seen? */
+  size_t first_nan;
+} cnpy_reduce_partial;
+
+
+/* Neumaier's variant of Kahan summation: add x to *sum, keeping track of the rounding error in *comp. */
+static void cnpy_compensated_add(double *sum, double *comp, double x) {
+  double t = *sum + x;
+  if (fabs(*sum) >= fabs(x)) {
+    *comp += (*sum - t) + x;
+  }
+  else {
+    *comp += (x - t) + *sum;
+  }
+  *sum = t;
+}
+
+
+/*
+ * Block reductions for integer types; m selects the fields (i or u) of the partial result holding the extrema.
+ * Besides the wrapping sum, a compensated double sum is kept, which does not wrap around;
+ * the sum of a block of types narrower than 64 bits fits in the wrapping one, and is exact.
+ */
+#define CNPY_X_DEFINE(name, type, wide, m) \
+static void cnpy_reduce_block_##name(const type *x, size_t n, size_t base, bool do_sum, bool do_minmax, cnpy_reduce_partial *p) { \
+  if (do_sum) { \
+    uint64_t s = 0; \
+    for (size_t i = 0; i < n; i += 1) { \
+      s += (uint64_t) (wide) x[i]; \
+    } \
+    p->sum_u += s; \
+    if (sizeof(type) < sizeof(uint64_t)) { \
+      cnpy_compensated_add(&p->sum, &p->comp, (double) (wide) s); \
+    } \
+    else { \
+      for (size_t i = 0; i < n; i += 1) { \
+        cnpy_compensated_add(&p->sum, &p->comp, (double) x[i]); \
+      } \
+    } \
+  } \
+  if (do_minmax) { \
+    type lo = x[0], hi = x[0]; \
+    for (size_t i = 1; i < n; i += 1) { \
+      lo = (x[i] < lo)? x[i] : lo; \
+      hi = (x[i] > hi)? x[i] : hi; \
+    } \
+    if (!p->any || lo < p->min_##m) { \
+      size_t i = 0; \
+      while (x[i] != lo) { i += 1; } \
+      p->min_##m = lo; \
+      p->argmin = base + i; \
+    } \
+    if (!p->any || hi > p->max_##m) { \
+      size_t i = 0; \
+      while (x[i] != hi) { i += 1; } \
+      p->max_##m = hi; \
+      p->argmax = base + i; \
+    } \
+    p->any = true; \
+  } \
+}
+
+CNPY_X_DEFINE(b, uint8_t, uint64_t, u)
+CNPY_X_DEFINE(i1, int8_t, int64_t, i)
+CNPY_X_DEFINE(i2, int16_t, int64_t, i)
+CNPY_X_DEFINE(i4, int32_t, int64_t, i)
+CNPY_X_DEFINE(i8, int64_t, int64_t, i)
+CNPY_X_DEFINE(u1, uint8_t, uint64_t, u)
+CNPY_X_DEFINE(u2, uint16_t, uint64_t, u)
+CNPY_X_DEFINE(u4, uint32_t, uint64_t, u)
+CNPY_X_DEFINE(u8, uint64_t, uint64_t, u)
+
+#undef CNPY_X_DEFINE
+
+
+/*
+ * Block reductions for floating point types.
+ * Sums are computed pairwise (in double precision) within a block, and with compensation across blocks.
+ * Complex numbers are reduced as interleaved pairs of reals (stride 2); they have no extrema.
+ */
+#define CNPY_X_DEFINE(name, type) \
+static double cnpy_pairwise_sum_##name(const type *x, size_t n, size_t stride) { \
+  if (n <= 64) { \
+    double s[8] = { 0, 0, 0, 0, 0, 0, 0, 0 }; \
+    size_t i = 0; \
+    for (; i + 8 <= n; i += 8) { \
+      for (size_t j = 0; j < 8; j += 1) { \
+        s[j] += (double) x[(i + j) * stride]; \
+      } \
+    } \
+    for (; i < n; i += 1) { \
+      s[0] += (double) x[i * stride]; \
+    } \
+    return ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7])); \
+  } \
+  size_t half = n / 2; \
+  return cnpy_pairwise_sum_##name(x, half, stride) + cnpy_pairwise_sum_##name(x + half * stride, n - half, stride); \
+} \
+\
+static void cnpy_reduce_block_##name(const type *x, size_t n, size_t base, bool do_sum, bool do_minmax, cnpy_reduce_partial *p) { \
+  if (do_sum) { \
+    cnpy_compensated_add(&p->sum, &p->comp, cnpy_pairwise_sum_##name(x, n, 1)); \
+  } \
+  if (do_minmax) { \
+    type lo = (type) INFINITY, hi = (type) -INFINITY; \
+    bool nan = false; \
+    for (size_t i = 0; i < n; i += 1) { \
+      lo = (x[i] < lo)? x[i] : lo; \
+      hi = (x[i] > hi)? x[i] : hi; \
+      nan |= (x[i] != x[i]); \
+    } \
+    if (nan && !p->nan) { \
+      size_t i = 0; \
+      while (x[i] == x[i]) { i += 1; } \
+      p->nan = true; \
+      p->first_nan = base + i; \
+    } \
+    /* A block of NaNs leaves lo and hi at their initial values, which then need not occur in the block. */ \
+    for (size_t i = 0; i < n; i += 1) { \
+      if (x[i] == lo) { \
+        if (!p->any || lo < p->min_f) { \
+          p->min_f = lo; \
+          p->argmin = base + i; \
+        } \
+        break; \
+      } \
+    } \
+    for (size_t i = 0; i < n; i += 1) { \
+      if (x[i] == hi) { \
+        if (!p->any || hi > p->max_f) { \
+          p->max_f = hi; \
+          p->argmax = base + i; \
+        } \
+        break; \
+      } \
+    } \
+    p->any = p->any || (lo <= hi); \
+  } \
+} \
+\
+static void cnpy_reduce_block_complex_##name(const type *x, size_t n, cnpy_reduce_partial *p) { \
+  cnpy_compensated_add(&p->sum, &p->comp, cnpy_pairwise_sum_##name(x, n, 2)); \
+  cnpy_compensated_add(&p->sum_imag, &p->comp_imag, cnpy_pairwise_sum_##name(x + 1, n, 2)); \
+}
+
+CNPY_X_DEFINE(f4, float)
+CNPY_X_DEFINE(f8, double)
+
+#undef CNPY_X_DEFINE
+
+
+/* Reduce n elements of type dtype in host byte order at x, whose first element has the flat index base. */
+static void cnpy_reduce_block(cnpy_dtype dtype, const char *x, size_t n, size_t base, bool do_sum, bool do_minmax, cnpy_reduce_partial *p) {
+  switch (dtype) {
+    case CNPY_B: cnpy_reduce_block_b((const uint8_t *) x, n, base, do_sum, do_minmax, p); break;
+    case CNPY_I1: cnpy_reduce_block_i1((const int8_t *) x, n, base, do_sum, do_minmax, p); break;
+    case CNPY_I2: cnpy_reduce_block_i2((const int16_t *) x, n, base, do_sum, do_minmax, p); break;
+    case CNPY_I4: cnpy_reduce_block_i4((const int32_t *) x, n, base, do_sum, do_minmax, p); break;
+    case CNPY_I8: cnpy_reduce_block_i8((const int64_t *) x, n, base, do_sum, do_minmax, p); break;
+    case CNPY_U1: cnpy_reduce_block_u1((const uint8_t *) x, n, base, do_sum, do_minmax, p); break;
+    case CNPY_U2: cnpy_reduce_block_u2((const uint16_t *) x, n, base, do_sum, do_minmax, p); break;
+    case CNPY_U4: cnpy_reduce_block_u4((const uint32_t *) x, n, base, do_sum, do_minmax, p); break;
+    case CNPY_U8: cnpy_reduce_block_u8((const uint64_t *) x, n, base, do_sum, do_minmax, p); break;
+    case CNPY_F4: cnpy_reduce_block_f4((const float *) x, n, base, do_sum, do_minmax, p); break;
+    case CNPY_F8: cnpy_reduce_block_f8((const double *) x, n, base, do_sum, do_minmax, p); break;
+    case CNPY_C8: cnpy_reduce_block_complex_f4((const float *) x, n, p); break;
+    case CNPY_C16: cnpy_reduce_block_complex_f8((const double *) x, n, p); break;
+    default: assert(false);
+  }
+}
+
+
+typedef struct {
+  cnpy_array arr;
+  bool do_sum;
+  bool do_minmax;
+  size_t bounds[CNPY_MAX_THREADS + 1]; /* thread i reduces the elements bounds[i] <= k < bounds[i+1] */
+  cnpy_reduce_partial partials[CNPY_MAX_THREADS];
+} cnpy_reduce_job;
+
+
+static void cnpy_reduce_worker(void *arg, size_t t, size_t n_threads) {
+  (void) n_threads;
+  cnpy_reduce_job *job = (cnpy_reduce_job *) arg;
+  cnpy_dtype dtype = job->arr.dtype;
+  size_t size = cnpy_dtype_sizes[dtype];
+  const char *data = job->arr.raw_data + job->arr.data_begin;
+  bool direct = cnpy_is_host_byte_order(job->arr.byte_order) && ((uintptr_t) data % cnpy_swap_width(dtype)) == 0;
+  double buf[CNPY_REDUCE_BLOCK * 2]; /* CNPY_REDUCE_BLOCK elements of the largest type, suitably aligned */
+
+  cnpy_reduce_partial p;
+  memset(&p, 0, sizeof(p));
+  for (size_t b = job->bounds[t]; b < job->bounds[t + 1]; b += CNPY_REDUCE_BLOCK) {
+    size_t n = job->bounds[t + 1] - b;
+    n = (n < CNPY_REDUCE_BLOCK)? n : CNPY_REDUCE_BLOCK;
+    const char *x = data + size * b;
+    if (!direct) {
+      cnpy_cpy_n(job->arr, n, x, (char *) buf);
+      x = (const char *) buf;
+    }
+    cnpy_reduce_block(dtype, x, n, b, job->do_sum, job->do_minmax, &p);
+  }
+  job->partials[t] = p;
+}
+
+
+/* Combine the partial result q of a later chunk into *p. */
+static void cnpy_reduce_combine(cnpy_dtype dtype, cnpy_reduce_partial *p, const cnpy_reduce_partial *q) {
+  cnpy_compensated_add(&p->sum, &p->comp, q->sum);
+  cnpy_compensated_add(&p->sum, &p->comp, q->comp);
+  cnpy_compensated_add(&p->sum_imag, &p->comp_imag, q->sum_imag);
+  cnpy_compensated_add(&p->sum_imag, &p->comp_imag, q->comp_imag);
+  p->sum_u += q->sum_u;
+
+  if (q->nan && !p->nan) {
+    p->nan = true;
+    p->first_nan = q->first_nan;
+  }
+  if (!q->any) {
+    return;
+  }
+  bool lower, higher;
+  switch (dtype) {
+    case CNPY_I1: case CNPY_I2: case CNPY_I4: case CNPY_I8:
+      lower = q->min_i < p->min_i;
+      higher = q->max_i > p->max_i;
+      break;
+    case CNPY_F4: case CNPY_F8:
+      lower = q->min_f < p->min_f;
+      higher = q->max_f > p->max_f;
+      break;
+    default:
+      lower = q->min_u < p->min_u;
+      higher = q->max_u > p->max_u;
+  }
+  if (!p->any || lower) {
+    p->min_i = q->min_i;
+    p->min_u = q->min_u;
+    p->min_f = q->min_f;
+    p->argmin = q->argmin;
+  }
+  if (!p->any || higher) {
+    p->max_i = q->max_i;
+    p->max_u = q->max_u;
+    p->max_f = q->max_f;
+    p->argmax = q->argmax;
+  }
+  p->any = true;
+}
+
+
+/*
+ * Reduce the whole array arr with the operations ops (a combination of cnpy_op values), using up to n_threads threads (0: one per online CPU).
+ * Results of operations which were not asked for are unspecified.
+ * Extrema are not defined for complex types, so CNPY_OP_MIN, CNPY_OP_MAX, CNPY_OP_ARGMIN and CNPY_OP_ARGMAX must not be used with them.
+ * For an empty array, mean, min and max are NaN.
+ */
+void cnpy_reduce(const cnpy_array arr, unsigned ops, cnpy_reduction *result, size_t n_threads) {
+  assert(result != NULL);
+  bool is_complex = (arr.dtype == CNPY_C8 || arr.dtype == CNPY_C16);
+  bool do_minmax = (ops & (CNPY_OP_MIN | CNPY_OP_MAX | CNPY_OP_ARGMIN | CNPY_OP_ARGMAX)) != 0;
+  assert(!(is_complex && do_minmax));
+
+  cnpy_reduce_job job;
+  job.arr = arr;
+  job.do_sum = (ops & (CNPY_OP_SUM | CNPY_OP_MEAN)) != 0;
+  job.do_minmax = do_minmax;
+
+  size_t n = cnpy_n_elements(arr);
+  size_t size = cnpy_dtype_sizes[arr.dtype];
+  n_threads = cnpy_n_threads(n_threads);
+  if (n_threads > n * size / CNPY_MIN_BYTES_PER_THREAD) {
+    n_threads = n * size / CNPY_MIN_BYTES_PER_THREAD + 1;
+  }
+
+  /* move the boundaries between threads to page boundaries, so that no two threads touch the same page */
+  uintptr_t data = (uintptr_t) (arr.raw_data + arr.data_begin);
+  uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+  job.bounds[0] = 0;
+  for (size_t i = 1; i < n_threads; i += 1) {
+    uintptr_t addr = data + size * (n / n_threads * i);
+    addr = (addr + page - 1) / page * page;
+    size_t k = (addr - data + size - 1) / size;
+    k = (k < n)? k : n;
+    job.bounds[i] = (k > job.bounds[i - 1])? k : job.bounds[i - 1];
+  }
+  job.bounds[n_threads] = n;
+
+  cnpy_parallel_for(n_threads, cnpy_reduce_worker, &job);
+
+  cnpy_reduce_partial p = job.partials[0];
+  for (size_t i = 1; i < n_threads; i += 1) {
+    cnpy_reduce_combine(arr.dtype, &p, &job.partials[i]);
+  }
+
+  memset(result, 0, sizeof(*result));
+  result->count = n;
+  switch (arr.dtype) {
+    case CNPY_F4: case CNPY_F8: case CNPY_C8: case CNPY_C16:
+      result->sum = p.sum + p.comp;
+      result->sum_imag = p.sum_imag + p.comp_imag;
+      result->min = p.min_f;
+      result->max = p.max_f;
+      break;
+    case CNPY_I1: case CNPY_I2: case CNPY_I4: case CNPY_I8:
+      result->sum_i = (int64_t) p.sum_u;
+      result->sum = p.sum + p.comp;
+      result->min = (double) p.min_i;
+      result->max = (double) p.max_i;
+      break;
+    default:
+      result->sum_i = (int64_t) p.sum_u;
+      result->sum_u = p.sum_u;
+      result->sum = p.sum + p.comp;
+      result->min = (double) p.min_u;
+      result->max = (double) p.max_u;
+  }
+  result->mean = (n > 0)? result->sum / (double) n : NAN;
+  result->mean_imag = (n > 0)? result->sum_imag / (double) n : NAN;
+  result->argmin = p.argmin;
+  result->argmax = p.argmax;
+  if (p.nan) {
+    result->min = NAN;
+    result->max = NAN;
+    result->argmin = p.first_nan;
+    result->argmax = p.first_nan;
+  }
+  else if (!p.any) {
+    result->min = NAN;
+    result->max = NAN;
+  }
+}
+
+
+/*
+ * Axis reductions
+ *
+ * cnpy_reduce_axis() reduces an array along one axis and writes the result to a new array.
+ * In storage order, the source is a sequence of outer blocks, each consisting of dims[axis] rows of inner contiguous elements.
+ * The output holds outer * inner elements in the same order.
+ * Each row is cut into segments of at most CNPY_REDUCE_LANES elements; a segment of the output is accumulated over all rows of its outer block,
+ * so the source is always read in contiguous runs and the accumulators stay in the cache.
+ * If the reduced axis is the one varying fastest in storage, each output element reduces one contiguous run, which is done with the kernels of cnpy_reduce().
+ * Work is partitioned across threads over the non-reduced axes.
+ */
+
+
+#define CNPY_REDUCE_LANES 512
+
+
+/* Accumulators for one output segment; complex sums use two lanes per element. */
+typedef struct {
+  double sum[2 * CNPY_REDUCE_LANES];
+  double comp[2 * CNPY_REDUCE_LANES];
+  uint64_t sum_u[CNPY_REDUCE_LANES];
+  int64_t ext_i[CNPY_REDUCE_LANES];
+  uint64_t ext_u[CNPY_REDUCE_LANES];
+  double ext_f[CNPY_REDUCE_LANES];
+  size_t arg[CNPY_REDUCE_LANES];
+} cnpy_reduce_lanes;
+
+
+/*
+ * Accumulate n_rows rows of w elements each (the first one being row r0 along the reduced axis) into the lanes.
+ * Integer sums wrap around, so means are accumulated in double instead, with Kahan compensation;
+ * the extrema are kept in int64_t (m = i) or uint64_t (m = u).
+ */
+#define CNPY_X_DEFINE(name, type, wide, m) \
+static void cnpy_reduce_rows_##name(const type *x, size_t n_rows, size_t w, size_t r0, cnpy_op op, cnpy_reduce_lanes *l) { \
+  for (size_t k = 0; k < n_rows; k += 1) { \
+    const type *row = x + k * w; \
+    size_t r = r0 + k; \
+    switch (op) { \
+      case CNPY_OP_SUM: \
+        for (size_t j = 0; j < w; j += 1) { \
+          l->sum_u[j] += (uint64_t) (wide) row[j]; \
+        } \
+        break; \
+      case CNPY_OP_MEAN: \
+        for (size_t j = 0; j < w; j += 1) { \
+          double y = (double) row[j] - l->comp[j]; \
+          double t = l->sum[j] + y; \
+          l->comp[j] = (t - l->sum[j]) - y; \
+          l->sum[j] = t; \
+        } \
+        break; \
+      case CNPY_OP_MIN: case CNPY_OP_ARGMIN: \
+        for (size_t j = 0; j < w; j += 1) { \
+          if (r == 0 || row[j] < l->ext_##m[j]) { \
+            l->ext_##m[j] = row[j]; \
+            l->arg[j] = r; \
+          } \
+        } \
+        break; \
+      default: \
+        for (size_t j = 0; j < w; j += 1) { \
+          if (r == 0 || row[j] > l->ext_##m[j]) { \
+            l->ext_##m[j] = row[j]; \
+            l->arg[j] = r; \
+          } \
+        } \
+    } \
+  } \
+}
+
+CNPY_X_DEFINE(b, uint8_t, uint64_t, u)
+CNPY_X_DEFINE(i1, int8_t, int64_t, i)
+CNPY_X_DEFINE(i2, int16_t, int64_t, i)
+CNPY_X_DEFINE(i4, int32_t, int64_t, i)
+CNPY_X_DEFINE(i8, int64_t, int64_t, i)
+CNPY_X_DEFINE(u1, uint8_t, uint64_t, u)
+CNPY_X_DEFINE(u2, uint16_t, uint64_t, u)
+CNPY_X_DEFINE(u4, uint32_t, uint64_t, u)
+CNPY_X_DEFINE(u8, uint64_t, uint64_t, u)
+
+#undef CNPY_X_DEFINE
+
+
+/* As above for floating point types: sums are Kahan compensated per lane, and a NaN sticks as the extremum. */
+#define CNPY_X_DEFINE(name, type) \
+static void cnpy_reduce_rows_sum_##name(const type *x, size_t n_rows, size_t w, cnpy_reduce_lanes *l) { \
+  for (size_t k = 0; k < n_rows; k += 1) { \
+    const type *row = x + k * w; \
+    for (size_t j = 0; j < w; j += 1) { \
+      double y = (double) row[j] - l->comp[j]; \
+      double t = l->sum[j] + y; \
+      l->comp[j] = (t - l->sum[j]) - y; \
+      l->sum[j] = t; \
+    } \
+  } \
+} \
+\
+static void cnpy_reduce_rows_##name(const type *x, size_t n_rows, size_t w, size_t r0, cnpy_op op, cnpy_reduce_lanes *l) { \
+  if (op == CNPY_OP_SUM || op == CNPY_OP_MEAN) { \
+    cnpy_reduce_rows_sum_##name(x, n_rows, w, l); \
+    return; \
+  } \
+  bool min = (op == CNPY_OP_MIN || op == CNPY_OP_ARGMIN); \
+  for (size_t k = 0; k < n_rows; k += 1) { \
+    const type *row = x + k * w; \
+    size_t r = r0 + k; \
+    for (size_t j = 0; j < w; j += 1) { \
+      double v = row[j], e = l->ext_f[j]; \
+      if (r == 0 || (min? v < e : v > e) || (v != v && e == e)) { \
+        l->ext_f[j] = v; \
+        l->arg[j] = r; \
+      } \
+    } \
+  } \
+}
+
+CNPY_X_DEFINE(f4, float)
+CNPY_X_DEFINE(f8, double)
+
+#undef CNPY_X_DEFINE
+
+
+static void cnpy_reduce_rows(cnpy_dtype dtype, const char *x, size_t n_rows, size_t w, size_t r0, cnpy_op op, cnpy_reduce_lanes *l) {
+  switch (dtype) {
+    case CNPY_B: cnpy_reduce_rows_b((const uint8_t *) x, n_rows, w, r0, op, l); break;
+    case CNPY_I1: cnpy_reduce_rows_i1((const int8_t *) x, n_rows, w, r0, op, l); break;
+    case CNPY_I2: cnpy_reduce_rows_i2((const int16_t *) x, n_rows, w, r0, op, l); break;
+    case CNPY_I4: cnpy_reduce_rows_i4((const int32_t *) x, n_rows, w, r0, op, l); break;
+    case CNPY_I8: cnpy_reduce_rows_i8((const int64_t *) x, n_rows, w, r0, op, l); break;
+    case CNPY_U1: cnpy_reduce_rows_u1((const uint8_t *) x, n_rows, w, r0, op, l); break;
+    case CNPY_U2: cnpy_reduce_rows_u2((const uint16_t *) x, n_rows, w, r0, op, l); break;
+    case CNPY_U4: cnpy_reduce_rows_u4((const uint32_t *) x, n_rows, w, r0, op, l); break;
+    case CNPY_U8: cnpy_reduce_rows_u8((const uint64_t *) x, n_rows, w, r0, op, l); break;
+    case CNPY_F4: cnpy_reduce_rows_f4((const float *) x, n_rows, w, r0, op, l); break;
+    case CNPY_F8: cnpy_reduce_rows_f8((const double *) x, n_rows, w, r0, op, l); break;
+    case CNPY_C8: cnpy_reduce_rows_sum_f4((const float *) x, n_rows, 2 * w, l); break;
+    case CNPY_C16: cnpy_reduce_rows_sum_f8((const double *) x, n_rows, 2 * w, l); break;
+    default: assert(false);
+  }
+}
+
+
+/* Data type of the result of reducing an array of type dtype with op. */
+static cnpy_dtype cnpy_reduce_axis_dtype(cnpy_dtype dtype, cnpy_op op) {
+  bool is_signed = (dtype == CNPY_I1 || dtype == CNPY_I2 || dtype == CNPY_I4 || dtype == CNPY_I8);
+  bool is_float = (dtype == CNPY_F4 || dtype == CNPY_F8 || dtype == CNPY_C8 || dtype == CNPY_C16);
+  switch (op) {
+    case CNPY_OP_SUM:
+      return is_float? dtype : (is_signed? CNPY_I8 : CNPY_U8);
+    case CNPY_OP_MEAN:
+      return is_float? dtype : CNPY_F8;
+    case CNPY_OP_ARGMIN: case CNPY_OP_ARGMAX:
+      return CNPY_I8;
+    default:
+      return dtype;
+  }
+}
+
+
+/* Store the result of lane j, accumulated over n_rows rows, as an element of type out_dtype at dst. */
+static void cnpy_reduce_lane_store(cnpy_dtype dtype, cnpy_op op, const cnpy_reduce_lanes *l, size_t j, size_t n_rows, cnpy_dtype out_dtype, char *dst) {
+  bool is_signed = (dtype == CNPY_I1 || dtype == CNPY_I2 || dtype == CNPY_I4 || dtype == CNPY_I8);
+  bool is_float = (dtype == CNPY_F4 || dtype == CNPY_F8);
+  bool is_complex = (dtype == CNPY_C8 || dtype == CNPY_C16);
+  int64_t i;
+  uint64_t u;
+  double f[2];
+
+  if (op == CNPY_OP_ARGMIN || op == CNPY_OP_ARGMAX) {
+    i = (int64_t) l->arg[j];
+    cnpy_convert_element(CNPY_I8, (const char *) &i, out_dtype, dst);
+  }
+  else if (op == CNPY_OP_MIN || op == CNPY_OP_MAX) {
+    if (is_float) {
+      cnpy_convert_element(CNPY_F8, (const char *) &l->ext_f[j], out_dtype, dst);
+    }
+    else if (is_signed) {
+      cnpy_convert_element(CNPY_I8, (const char *) &l->ext_i[j], out_dtype, dst);
+    }
+    else {
+      cnpy_convert_element(CNPY_U8, (const char *) &l->ext_u[j], out_dtype, dst);
+    }
+  }
+  else if (is_complex) {
+    f[0] = l->sum[2 * j];
+    f[1] = l->sum[2 * j + 1];
+    if (op == CNPY_OP_MEAN) {
+      f[0] /= (double) n_rows;
+      f[1] /= (double) n_rows;
+    }
+    cnpy_convert_element(CNPY_C16, (const char *) f, out_dtype, dst);
+  }
+  else {
+    if (is_float || op == CNPY_OP_MEAN) {
+      f[0] = l->sum[j];
+    }
+    else if (is_signed) {
+      i = (int64_t) l->sum_u[j];
+      f[0] = (double) i;
+    }
+    else {
+      u = l->sum_u[j];
+      f[0] = (double) u;
+    }
+    if (op == CNPY_OP_MEAN) {
+      f[0] /= (double) n_rows;
+      cnpy_convert_element(CNPY_F8, (const char *) f, out_dtype, dst);
+    }
+    else if (is_float) {
+      cnpy_convert_element(CNPY_F8, (const char *) f, out_dtype, dst);
+    }
+    else if (is_signed) {
+      cnpy_convert_element(CNPY_I8, (const char *) &i, out_dtype, dst);
+    }
+    else {
+      cnpy_convert_element(CNPY_U8, (const char *) &u, out_dtype, dst);
+    }
+  }
+}
+
+
+typedef struct {
+  cnpy_array src;
+  cnpy_array out;
+  cnpy_op op;
+  size_t outer; /* number of outer blocks */
+  size_t n_rows; /* length of the reduced axis */
+  size_t inner; /* elements per row */
+  size_t n_segments; /* segments per row */
+  size_t n_items; /* outer * n_segments */
+} cnpy_reduce_axis_job;
+
+
+/* Reduce each of the contiguous runs begin <= o < end (inner == 1) into lane 0, and store the results. */
+static void cnpy_reduce_axis_runs(const cnpy_reduce_axis_job *job, size_t begin, size_t end, cnpy_reduce_lanes *l, double *buf) {
+  cnpy_dtype dtype = job->src.dtype;
+  size_t size = cnpy_dtype_sizes[dtype];
+  bool do_sum = (job->op == CNPY_OP_SUM || job->op == CNPY_OP_MEAN);
+  bool min = (job->op == CNPY_OP_MIN || job->op == CNPY_OP_ARGMIN);
+  char res[16];
+
+  for (size_t o = begin; o < end; o += 1) {
+    const char *run = job->src.raw_data + job->src.data_begin + size * job->n_rows * o;
+    cnpy_reduce_partial p;
+    memset(&p, 0, sizeof(p));
+    for (size_t b = 0; b < job->n_rows; b += CNPY_REDUCE_BLOCK) {
+      size_t n = job->n_rows - b;
+      n = (n < CNPY_REDUCE_BLOCK)? n : CNPY_REDUCE_BLOCK;
+      cnpy_cpy_n(job->src, n, run + size * b, (char *) buf);
+      cnpy_reduce_block(dtype, (const char *) buf, n, b, do_sum, !do_sum, &p);
+    }
+    l->sum_u[0] = p.sum_u;
+    l->sum[0] = p.sum + p.comp;
+    l->sum[1] = p.sum_imag + p.comp_imag;
+    l->ext_i[0] = min? p.min_i : p.max_i;
+    l->ext_u[0] = min? p.min_u : p.max_u;
+    l->ext_f[0] = p.nan? NAN : (min? p.min_f : p.max_f);
+    l->arg[0] = p.nan? p.first_nan : (min? p.argmin : p.argmax);
+    cnpy_reduce_lane_store(dtype, job->op, l, 0, job->n_rows, job->out.dtype, res);
+    cnpy_write_range(job->out, o, 1, res);
+  }
+}
+
+
+static void cnpy_reduce_axis_worker(void *arg, size_t t, size_t n_threads) {
+  const cnpy_reduce_axis_job *job = (const cnpy_reduce_axis_job *) arg;
+  size_t begin = job->n_items / n_threads * t;
+  size_t end = (t + 1 == n_threads)? job->n_items : job->n_items / n_threads * (t + 1);
+  cnpy_reduce_lanes l;
+  double buf[CNPY_REDUCE_BLOCK * 2]; /* CNPY_REDUCE_BLOCK source elements of the largest type, suitably aligned */
+
+  if (job->inner == 1) {
+    cnpy_reduce_axis_runs(job, begin, end, &l, buf);
+    return;
+  }
+
+  cnpy_dtype dtype = job->src.dtype;
+  size_t size = cnpy_dtype_sizes[dtype];
+  const char *data = job->src.raw_data + job->src.data_begin;
+  double res[CNPY_REDUCE_LANES * 2]; /* one output segment of the largest type */
+
+  for (size_t item = begin; item < end; item += 1) {
+    size_t o = item / job->n_segments;
+    size_t j0 = (item % job->n_segments) * CNPY_REDUCE_LANES;
+    size_t w = job->inner - j0;
+    w = (w < CNPY_REDUCE_LANES)? w : CNPY_REDUCE_LANES;
+    /* If a segment is a whole row, consecutive rows are contiguous and can be read together. */
+    size_t rows_per_read = (w == job->inner && w < CNPY_REDUCE_BLOCK)? CNPY_REDUCE_BLOCK / w : 1;
+
+    memset(l.sum, 0, sizeof(l.sum));
+    memset(l.comp, 0, sizeof(l.comp));
+    memset(l.sum_u, 0, sizeof(l.sum_u));
+    for (size_t r = 0; r < job->n_rows; r += rows_per_read) {
+      size_t k = job->n_rows - r;
+      k = (k < rows_per_read)? k : rows_per_read;
+      cnpy_cpy_n(job->src, k * w, data + size * ((o * job->n_rows + r) * job->inner + j0), (char *) buf);
+      cnpy_reduce_rows(dtype, (const char *) buf, k, w, r, job->op, &l);
+    }
+
+    size_t out_size = cnpy_dtype_sizes[job->out.dtype];
+    for (size_t j = 0; j < w; j += 1) {
+      cnpy_reduce_lane_store(dtype, job->op, &l, j, job->n_rows, job->out.dtype, (char *) res + out_size * j);
+    }
+    cnpy_write_range(job->out, o * job->inner + j0, w, res);
+  }
+}
+
+
+/*
+ * Reduce src along axis with the single operation op, and store the result in a new array *out with the axis removed, created with cnpy_create(out_fn, ...).
+ * If out_fn is NULL, *out is backed by an anonymous mapping.
+ * The result has the serialization order of src, and the following data type:
+ * sums of integers are int64 (or uint64 for booleans and unsigned integers), means of integers are double,
+ * argmin and argmax are int64 indices along axis; otherwise, the data type of src.
+ * Extrema are not defined for complex types, so only CNPY_OP_SUM and CNPY_OP_MEAN may be used with them.
+ * A one-dimensional src would give a zero-dimensional result, which is unsupported (CNPY_ERROR_FORMAT); use cnpy_reduce() instead.
+ * Uses up to n_threads threads (0: one per online CPU).
+ */
+cnpy_status cnpy_reduce_axis(const cnpy_array src, size_t axis, cnpy_op op, const char * const out_fn, cnpy_array *out, size_t n_threads) {
+  assert(out != NULL);
+  assert(axis < src.n_dim);
+  assert(op == CNPY_OP_SUM || op == CNPY_OP_MEAN || op == CNPY_OP_MIN || op == CNPY_OP_MAX || op == CNPY_OP_ARGMIN || op == CNPY_OP_ARGMAX);
+  assert(op == CNPY_OP_SUM || op == CNPY_OP_MEAN || !(src.dtype == CNPY_C8 || src.dtype == CNPY_C16));
+  if (src.n_dim == 1) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Zero-dimensional results are unsupported; reduce a one-dimensional array with cnpy_reduce()");
+  }
+
+  cnpy_reduce_axis_job job;
+  job.src = src;
+  job.op = op;
+  job.outer = 1;
+  job.inner = 1;
+  job.n_rows = src.dims[axis];
+
+  size_t out_dims[CNPY_MAX_DIM];
+  for (size_t i = 0, k = 0; i < src.n_dim; i += 1) {
+    if (i == axis) {
+      continue;
+    }
+    out_dims[k] = src.dims[i];
+    k += 1;
+    /* in storage order, the axes before axis (C order) or after it (Fortran order) are outer */
+    if ((i < axis) == (src.order == CNPY_C_ORDER)) {
+      job.outer *= src.dims[i];
+    }
+    else {
+      job.inner *= src.dims[i];
+    }
+  }
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+  cnpy_byte_order host = CNPY_LE;
+#else
+  cnpy_byte_order host = CNPY_BE;
+#endif
+  cnpy_byte_order byte_order = (src.byte_order == CNPY_NE)? host : src.byte_order;
+  cnpy_status status = cnpy_create(out_fn, byte_order, cnpy_reduce_axis_dtype(src.dtype, op), src.order, src.n_dim - 1, out_dims, &job.out);
+  if (status != CNPY_SUCCESS) {
+    return status;
+  }
+
+  job.n_segments = (job.inner + CNPY_REDUCE_LANES - 1) / CNPY_REDUCE_LANES;
+  job.n_items = (job.inner == 1)? job.outer : job.outer * job.n_segments;
+
+  size_t n_bytes = cnpy_n_elements(src) * cnpy_dtype_sizes[src.dtype];
+  n_threads = cnpy_n_threads(n_threads);
+  if (n_threads > n_bytes / CNPY_MIN_BYTES_PER_THREAD) {
+    n_threads = n_bytes / CNPY_MIN_BYTES_PER_THREAD + 1;
+  }
+  if (n_threads > job.n_items) {
+    n_threads = job.n_items;
+  }
+  if (n_threads > 0) {
+    cnpy_parallel_for(n_threads, cnpy_reduce_axis_worker, &job);
+  }
+
+  *out = job.out;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Streaming scans
+ *
+ * A scan hands out the data of an array in chunks of consecutive elements, in serialization order.
+ * It prefetches a window of pages ahead of the current chunk and releases the pages behind it,
+ * so that a single pass over a huge array keeps at most about budget bytes of it resident instead of filling the page cache.
+ */
+
+
+/* What happens to the pages behind the cursor of a scan. */
+typedef enum {
+  CNPY_RELEASE_NONE, /* nothing; they stay resident as usual */
+  CNPY_RELEASE_COLD, /* MADV_COLD: they are reclaimed first under memory pressure; never loses data */
+  CNPY_RELEASE_PAGEOUT, /* MADV_PAGEOUT: they are reclaimed right away; never loses data */
+  CNPY_RELEASE_DONTNEED, /* MADV_DONTNEED: they are unmapped at once; loses changes to private mappings and the contents of anonymous arrays */
+} cnpy_release;
+
+
+typedef struct {
+  size_t chunk_size; /* approximate size of a chunk in bytes; chunks end at page boundaries */
+  size_t budget; /* bytes of the array to keep resident: the current chunk and the prefetched pages ahead of it */
+  cnpy_release release;
+  const char *fn; /* if not NULL, the file of the array, which is then also advised with posix_fadvise(), dropping released pages from the page cache */
+} cnpy_scan_options;
+
+
+typedef struct {
+  cnpy_array arr;
+  cnpy_scan_options opts;
+  int fd; /* file descriptor for posix_fadvise(), or -1 */
+  size_t page; /* page size */
+  size_t next; /* flat index of the first element of the next chunk */
+  size_t released; /* offset into raw_data below which pages have been released */
+  size_t prefetched; /* offset into raw_data below which pages have been prefetched */
+} cnpy_scan;
+
+
+typedef struct {
+  char *data; /* address of the first element of the chunk; elements are in the byte order of the array */
+  size_t flat_start; /* flat index of the first element of the chunk */
+  size_t length; /* number of elements in the chunk */
+} cnpy_chunk;
+
+
+/* Set *opts to the defaults: chunks of 4 MiB, a budget of 64 MiB, MADV_COLD, and no file. */
+void cnpy_scan_options_init(cnpy_scan_options *opts) {
+  assert(opts != NULL);
+  opts->chunk_size = (size_t) 1 << 22;
+  opts->budget = (size_t) 1 << 26;
+  opts->release = CNPY_RELEASE_COLD;
+  opts->fn = NULL;
+}
+
+
+/* Release the mapped pages [addr, addr + len) as release says; addr is page-aligned. */
+static void cnpy_release_pages(char *addr, size_t len, cnpy_release release) {
+  /* These are only hints, so errors are ignored (e. g. MADV_COLD before Linux 5.4). */
+  switch (release) {
+#ifdef MADV_COLD
+    case CNPY_RELEASE_COLD: madvise(addr, len, MADV_COLD); break;
+#endif
+#ifdef MADV_PAGEOUT
+    case CNPY_RELEASE_PAGEOUT: madvise(addr, len, MADV_PAGEOUT); break;
+#endif
+#ifdef MADV_DONTNEED
+    case CNPY_RELEASE_DONTNEED: madvise(addr, len, MADV_DONTNEED); break;
+#endif
+    default: break;
+  }
+}
+
+
+/* Release the pages of the scanned array in [begin, end) (offsets into raw_data; begin is page-aligned). */
+static void cnpy_scan_release(const cnpy_scan *scan, size_t begin, size_t end) {
+  if (begin >= end) {
+    return;
+  }
+  size_t len = end - begin;
+  cnpy_release_pages(scan->arr.raw_data + begin, len, scan->opts.release);
+#ifdef POSIX_FADV_DONTNEED
+  if (scan->fd != -1 && scan->opts.release != CNPY_RELEASE_NONE) {
+    posix_fadvise(scan->fd, (off_t) begin, (off_t) len, POSIX_FADV_DONTNEED);
+  }
+#endif
+}
+
+
+/* Prefetch the pages of the scanned array in [begin, end) (offsets into raw_data). */
+static void cnpy_scan_prefetch(const cnpy_scan *scan, size_t begin, size_t end) {
+  if (begin >= end) {
+    return;
+  }
+#ifdef POSIX_FADV_WILLNEED
+  if (scan->fd != -1) {
+    posix_fadvise(scan->fd, (off_t) begin, (off_t) (end - begin), POSIX_FADV_WILLNEED);
+  }
+#endif
+#ifdef MADV_WILLNEED
+  madvise(scan->arr.raw_data + begin, end - begin, MADV_WILLNEED);
+#endif
+}
+
+
+/*
+ * Start a scan of arr with the options *opts (NULL for the defaults, see cnpy_scan_options_init()).
+ * arr must stay open until cnpy_scan_end().
+ * Fails only if opts->fn cannot be opened.
+ */
+cnpy_status cnpy_scan_begin(const cnpy_array arr, const cnpy_scan_options *opts, cnpy_scan *scan) {
+  assert(scan != NULL);
+  assert(arr.raw_data != NULL);
+
+  cnpy_scan tmp;
+  tmp.arr = arr;
+  if (opts != NULL) {
+    tmp.opts = *opts;
+  }
+  else {
+    cnpy_scan_options_init(&tmp.opts);
+  }
+  tmp.page = (size_t) sysconf(_SC_PAGESIZE);
+  if (tmp.opts.chunk_size < tmp.page) {
+    tmp.opts.chunk_size = tmp.page;
+  }
+  if (tmp.opts.budget < 2 * tmp.opts.chunk_size) {
+    tmp.opts.budget = 2 * tmp.opts.chunk_size;
+  }
+  tmp.fd = -1;
+  if (tmp.opts.fn != NULL) {
+    tmp.fd = open(tmp.opts.fn, O_RDONLY);
+    if (tmp.fd == -1) {
+      return cnpy_error(CNPY_ERROR_FILE, "Could not open file: %s", strerror(errno));
+    }
+  }
+  tmp.next = 0;
+  tmp.released = 0;
+  tmp.prefetched = 0;
+
+  *scan = tmp;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Store the next chunk in *chunk and return true, or return false at the end of the array.
+ * Pages before the new chunk are released, and pages up to budget bytes after its start are prefetched.
+ */
+bool cnpy_scan_next(cnpy_scan *scan, cnpy_chunk *chunk) {
+  assert(scan != NULL);
+  assert(chunk != NULL);
+
+  size_t n = cnpy_n_elements(scan->arr);
+  if (scan->next >= n) {
+    return false;
+  }
+
+  size_t size = cnpy_dtype_sizes[scan->arr.dtype];
+  size_t begin = scan->arr.data_begin + size * scan->next; /* offsets into raw_data */
+  size_t end = (begin + scan->opts.chunk_size) / scan->page * scan->page; /* > begin, as chunk_size >= page */
+  size_t last = (end - scan->arr.data_begin + size - 1) / size;
+  last = (last < n)? last : n;
+
+  /* release what lies wholly behind the new chunk */
+  size_t release_end = begin / scan->page * scan->page;
+  cnpy_scan_release(scan, scan->released, release_end);
+  scan->released = (release_end > scan->released)? release_end : scan->released;
+
+  /* prefetch up to the budget */
+  size_t prefetch_end = begin + scan->opts.budget;
+  prefetch_end = (prefetch_end < scan->arr.raw_data_size)? prefetch_end : scan->arr.raw_data_size;
+  size_t prefetch_begin = (scan->prefetched > release_end)? scan->prefetched : release_end;
+  /* issue prefetches in steps of at least one chunk, not for every page */
+  if (prefetch_end >= prefetch_begin + scan->opts.chunk_size || prefetch_end == scan->arr.raw_data_size) {
+    cnpy_scan_prefetch(scan, prefetch_begin, prefetch_end);
+    scan->prefetched = (prefetch_end > scan->prefetched)? prefetch_end : scan->prefetched;
+  }
+
+  chunk->data = scan->arr.raw_data + begin;
+  chunk->flat_start = scan->next;
+  chunk->length = last - scan->next;
+  scan->next = last;
+  return true;
+}
+
+
+/* Finish a scan, releasing the remaining pages it touched. */
+cnpy_status cnpy_scan_end(cnpy_scan *scan) {
+  assert(scan != NULL);
+
+  cnpy_scan_release(scan, scan->released, scan->arr.map_size);
+  scan->released = scan->arr.map_size;
+
+  if (scan->fd != -1) {
+    int fd = scan->fd;
+    scan->fd = -1;
+    if (close(fd) != 0) {
+      return cnpy_error(CNPY_ERROR_FILE, "Could not close file: %s", strerror(errno));
+    }
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * pread() reader
+ *
+ * A cnpy_reader reads an array from a file with pread() into caller buffers instead of mapping it.
+ * There are no page table costs for huge files, and an unreliable file system (e. g. NFS or FUSE) causes read errors instead of SIGBUS.
+ * Only the header is parsed when opening; it must fit into CNPY_READER_MAX_HEADER bytes.
+ */
+
+
+#ifndef CNPY_READER_MAX_HEADER
+#define CNPY_READER_MAX_HEADER (1 << 16)
+#endif
+
+
+typedef struct {
+  int fd;
+  cnpy_array arr; /* metadata of the array; raw_data is NULL */
+  size_t block_size; /* maximum number of bytes per pread() call */
+  char *buf; /* bounce buffer of block_size bytes for strided reads (an anonymous mapping) */
+} cnpy_reader;
+
+
+/* Read exactly n bytes at offset off of fd into dst, in calls of at most block_size bytes; errors are reported to error_str (NULL: cnpy_error_str). */
+static cnpy_status cnpy_pread_full_to(int fd, char *dst, size_t n, size_t off, size_t block_size, char *error_str) {
+  while (n > 0) {
+    size_t want = (n < block_size)? n : block_size;
+    ssize_t got = pread(fd, dst, want, (off_t) off);
+    if (got < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return cnpy_error_to(error_str, CNPY_ERROR_FILE, "pread() failed: %s", strerror(errno));
+    }
+    if (got == 0) {
+      return cnpy_error_to(error_str, CNPY_ERROR_FILE, "Unexpected end of file at offset %zu", off);
+    }
+    dst += got;
+    off += (size_t) got;
+    n -= (size_t) got;
+  }
+  return CNPY_SUCCESS;
+}
+
+
+static cnpy_status cnpy_pread_full(int fd, char *dst, size_t n, size_t off, size_t block_size) {
+  return cnpy_pread_full_to(fd, dst, n, off, block_size, NULL);
+}
+
+
+#define CNPY_HEADER_PROBE_SIZE 4096 /* bytes read first when only the header is needed; enough for the headers of almost all files */
+
+
+/*
+ * Read and parse the header of the .npy file fd into *arr (whose raw_data is set to NULL).
+ * Errors are reported to error_str (NULL: cnpy_error_str).
+ */
+static cnpy_status cnpy_pread_header_to(int fd, size_t block_size, cnpy_array *arr, char *error_str) {
+  off_t file_size = lseek(fd, 0, SEEK_END);
+  if (file_size < 0) {
+    return cnpy_error_to(error_str, CNPY_ERROR_FILE, "Could not determine file size: %s", strerror(errno));
+  }
+  size_t raw_data_size = (size_t) file_size;
+
+  /* read the first CNPY_HEADER_PROBE_SIZE bytes, then the rest of a longer header (up to CNPY_READER_MAX_HEADER bytes) */
+  char prefix[CNPY_READER_MAX_HEADER];
+  size_t n_prefix = (raw_data_size < CNPY_HEADER_PROBE_SIZE)? raw_data_size : CNPY_HEADER_PROBE_SIZE;
+  n_prefix = (n_prefix < sizeof(prefix))? n_prefix : sizeof(prefix);
+  cnpy_status status = cnpy_pread_full_to(fd, prefix, n_prefix, 0, block_size, error_str);
+  if (status == CNPY_SUCCESS && n_prefix >= 12) {
+    const uint8_t *p = (const uint8_t *) prefix;
+    size_t full_header_size = n_prefix; /* unknown versions are rejected by the parser before reading the header */
+    if (p[6] == 1) {
+      full_header_size = 10 + ((size_t) p[8] | (size_t) p[9] << 8);
+    }
+    else if (p[6] == 2) {
+      full_header_size = 12 + ((size_t) p[8] | (size_t) p[9] << 8 | (size_t) p[10] << 16 | (size_t) p[11] << 24);
+    }
+    if (full_header_size > sizeof(prefix) && full_header_size <= raw_data_size) {
+      status = cnpy_error_to(error_str, CNPY_ERROR_FORMAT, "Header of %zu bytes is larger than CNPY_READER_MAX_HEADER = %d", full_header_size, CNPY_READER_MAX_HEADER);
+    }
+    else if (full_header_size > n_prefix && full_header_size <= raw_data_size) {
+      status = cnpy_pread_full_to(fd, prefix + n_prefix, full_header_size - n_prefix, n_prefix, block_size, error_str);
+    }
+  }
+  if (status == CNPY_SUCCESS) {
+    status = cnpy_parse_to(prefix, raw_data_size, arr, error_str);
+  }
+  if (status == CNPY_SUCCESS) {
+    arr->raw_data = NULL;
+    arr->map_size = 0;
+  }
+  return status;
+}
+
+
+static cnpy_status cnpy_pread_header(int fd, size_t block_size, cnpy_array *arr) {
+  return cnpy_pread_header_to(fd, block_size, arr, NULL);
+}
+
+
+/*
+ * Open the .npy file fn for reading with pread() in blocks of block_size bytes (0: 1 MiB).
+ * On failure, *reader is not changed.
+ */
+cnpy_status cnpy_reader_open(const char * const fn, size_t block_size, cnpy_reader *reader) {
+  assert(fn != NULL);
+  assert(reader != NULL);
+
+  block_size = (block_size > 0)? block_size : (size_t) 1 << 20;
+  block_size = (block_size >= 16)? block_size : 16; /* at least one element */
+
+  int fd = open(fn, O_RDONLY);
+  if (fd == -1) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not open file: %s", strerror(errno));
+  }
+  cnpy_array arr;
+  cnpy_status status = cnpy_pread_header(fd, block_size, &arr);
+  if (status != CNPY_SUCCESS) {
+    close(fd); /* no point in checking for errors */
+    return status;
+  }
+
+  char *buf = (char *) mmap(NULL, block_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED) {
+    close(fd);
+    return cnpy_error(CNPY_ERROR_MMAP, "mmap() of the buffer failed: %s", strerror(errno));
+  }
+
+  reader->fd = fd;
+  reader->arr = arr;
+  reader->block_size = block_size;
+  reader->buf = buf;
+  return CNPY_SUCCESS;
+}
+
+
+/* Close a reader opened with cnpy_reader_open(). */
+cnpy_status cnpy_reader_close(cnpy_reader *reader) {
+  assert(reader != NULL);
+  assert(reader->fd != -1);
+
+  munmap(reader->buf, reader->block_size); /* cannot fail for a mapping we made */
+  reader->buf = NULL;
+  int fd = reader->fd;
+  reader->fd = -1;
+  if (close(fd) != 0) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not close file: %s", strerror(errno));
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/* Read count elements starting at the flat index flat_start into out, in host byte order; the counterpart to cnpy_read_range(). */
+cnpy_status cnpy_reader_read_range(const cnpy_reader *reader, size_t flat_start, size_t count, void *out) {
+  assert(reader != NULL);
+  assert(out != NULL || count == 0);
+  const cnpy_array arr = reader->arr;
+  assert(flat_start <= cnpy_n_elements(arr) && count <= cnpy_n_elements(arr) - flat_start);
+
+  size_t size = cnpy_dtype_sizes[arr.dtype];
+  cnpy_status status = cnpy_pread_full(reader->fd, (char *) out, size * count, arr.data_begin + size * flat_start, reader->block_size);
+  if (status == CNPY_SUCCESS && !cnpy_is_host_byte_order(arr.byte_order)) {
+    size_t width = cnpy_swap_width(arr.dtype);
+    cnpy_cpy_swap_n(width, count * (size / width), (const char *) out, (char *) out);
+  }
+  return status;
+}
+
+
+/*
+ * Read the hyperslab given by start, count, and stride into out; the counterpart to cnpy_read_slab().
+ * Runs of the slab which are contiguous in the file (and need no type conversion) are read directly into out,
+ * others through the bounce buffer of the reader, reading each block of the file once.
+ * Uses the bounce buffer, so a reader must not be used by several threads at once for this.
+ */
+cnpy_status cnpy_reader_read_slab(const cnpy_reader *reader, const size_t * const start, const size_t * const count, const size_t * const stride, void *out, cnpy_dtype out_dtype, cnpy_flat_order out_order) {
+  assert(reader != NULL);
+  assert(start != NULL && count != NULL);
+  assert(out != NULL);
+  const cnpy_array arr = reader->arr;
+
+  size_t n_dim = arr.n_dim;
+  size_t size = cnpy_dtype_sizes[arr.dtype];
+  size_t out_size = cnpy_dtype_sizes[out_dtype];
+
+  /* byte steps in the file and in the buffer per step of k[i], as in cnpy_slab_copy() */
+  size_t arr_step[CNPY_MAX_DIM];
+  size_t out_step[CNPY_MAX_DIM];
+  size_t arr_stride = size;
+  size_t out_stride = out_size;
+  size_t base = arr.data_begin;
+  for (size_t m = 0; m < n_dim; m += 1) {
+    size_t i = (arr.order == CNPY_C_ORDER)? n_dim - 1 - m : m;
+    size_t s = (stride != NULL)? stride[i] : 1;
+    assert(count[i] > 0 && s > 0);
+    assert(start[i] < arr.dims[i] && (count[i] - 1) * s < arr.dims[i] - start[i]);
+    base += start[i] * arr_stride;
+    arr_step[i] = arr_stride * s;
+    arr_stride *= arr.dims[i];
+  }
+  for (size_t m = 0; m < n_dim; m += 1) {
+    size_t i = (out_order == CNPY_C_ORDER)? n_dim - 1 - m : m;
+    out_step[i] = out_stride;
+    out_stride *= count[i];
+  }
+
+  size_t f = (arr.order == CNPY_C_ORDER)? n_dim - 1 : 0;
+  bool bulk = out_dtype == arr.dtype && arr_step[f] == size && out_step[f] == out_size;
+  void (*cpy)(const char *, char *) = cnpy_resolve_cpy(arr.dtype, arr.byte_order);
+  /* elements of a run per read through the bounce buffer */
+  size_t per_read = (arr_step[f] <= reader->block_size - size)? (reader->block_size - size) / arr_step[f] + 1 : 1;
+
+  size_t k[CNPY_MAX_DIM] = { 0 };
+  size_t arr_off = base;
+  char *b = (char *) out;
+  for (;;) {
+    if (bulk) {
+      cnpy_status status = cnpy_pread_full(reader->fd, b, size * count[f], arr_off, reader->block_size);
+      if (status != CNPY_SUCCESS) {
+        return status;
+      }
+      if (!cnpy_is_host_byte_order(arr.byte_order)) {
+        size_t width = cnpy_swap_width(arr.dtype);
+        cnpy_cpy_swap_n(width, count[f] * (size / width), b, b);
+      }
+    }
+    else {
+      char *o = b;
+      for (size_t j0 = 0; j0 < count[f]; j0 += per_read) {
+        size_t n = count[f] - j0;
+        n = (n < per_read)? n : per_read;
+        size_t off = arr_off + j0 * arr_step[f];
+        cnpy_status status = cnpy_pread_full(reader->fd, reader->buf, (n - 1) * arr_step[f] + size, off, reader->block_size);
+        if (status != CNPY_SUCCESS) {
+          return status;
+        }
+        char tmp[16];
+        for (size_t j = 0; j < n; j += 1) {
+          cpy(reader->buf + j * arr_step[f], tmp);
+          cnpy_convert_element(arr.dtype, tmp, out_dtype, o);
+          o += out_step[f];
+        }
+      }
+    }
+
+    /* advance the remaining axes in serialization order of the array */
+    bool done = true;
+    for (size_t m = 1; m < n_dim; m += 1) {
+      size_t i = (arr.order == CNPY_C_ORDER)? n_dim - 1 - m : m;
+      k[i] += 1;
+      arr_off += arr_step[i];
+      b += out_step[i];
+      if (k[i] < count[i]) {
+        done = false;
+        break;
+      }
+      arr_off -= arr_step[i] * count[i];
+      b -= out_step[i] * count[i];
+      k[i] = 0;
+    }
+    if (done) {
+      return CNPY_SUCCESS;
+    }
+  }
+}
+
+
+/*
+ * Asynchronous reads
+ *
+ * A cnpy_async queues reads from a cnpy_reader and completes them in the background, so that a single thread can keep many reads in flight.
+ * On Linux, it uses io_uring, with the file of the reader registered as a fixed file and, optionally, registered buffers.
+ * Where io_uring is not available (other systems, kernels older than Linux 5.6, which lack IORING_OP_READ, or seccomp filters), each read is done with pread() when it is queued.
+ * Either way, callbacks are only called from cnpy_async_wait() (or from cnpy_async_read() and cnpy_async_close(), which may wait).
+ * A read is split into pieces of at most the block size of the reader; its data is converted to host byte order before its callback is called.
+ */
+
+
+#ifndef CNPY_ASYNC_MAX_REQUESTS
+#define CNPY_ASYNC_MAX_REQUESTS 256 /* maximum number of pending reads per cnpy_async; the requests live inside the struct. */
+#endif
+
+
+typedef void (*cnpy_async_callback)(void *user, cnpy_status status);
+
+
+typedef struct {
+  bool used; /* is this slot taken? */
+  bool ready; /* complete, but the callback has not been called yet */
+  char *buf;
+  size_t file_off; /* offset of the first byte in the file */
+  size_t n_bytes;
+  size_t submitted; /* bytes for which pieces have been submitted */
+  size_t n_inflight; /* pieces in flight */
+  int buf_index; /* index of the registered buffer containing buf, or -1 */
+  cnpy_status status;
+  cnpy_async_callback callback;
+  void *user;
+} cnpy_async_request;
+
+
+typedef struct {
+  int fd; /* file of the reader */
+  cnpy_array arr; /* metadata of the reader */
+  size_t block_size;
+  int ring_fd; /* io_uring file descriptor, or -1 if reads are done with pread() */
+  bool fixed_file; /* is fd registered as fixed file 0? */
+  unsigned depth; /* number of submission queue entries */
+  unsigned n_inflight; /* pieces queued or submitted, and not completed yet */
+  unsigned to_submit; /* pieces queued, but not submitted yet */
+  void *sq_ring, *cq_ring, *sqes; /* the mappings of the ring */
+  size_t sq_ring_size, cq_ring_size, sqes_size;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  void *cqes;
+  const struct iovec *buffers; /* registered buffers */
+  size_t n_buffers;
+  size_t n_pending; /* requests which are used */
+  size_t fifo[CNPY_ASYNC_MAX_REQUESTS]; /* requests with pieces left to submit, oldest first */
+  size_t fifo_begin, fifo_size;
+  cnpy_async_request requests[CNPY_ASYNC_MAX_REQUESTS];
+} cnpy_async;
+
+
+#ifdef CNPY_IO_URING
+
+#define CNPY_ASYNC_MAX_LEN ((size_t) UINT32_MAX / 4096 * 4096) /* the length of a submission is 32 bits; longer pieces are read in parts, as after short reads */
+
+
+/* Does the io_uring ring_fd support IORING_OP_READ (Linux 5.6)? Older kernels cannot be probed (IORING_REGISTER_PROBE is as recent). */
+static bool cnpy_async_probe_read(int ring_fd) {
+  uint64_t buf[(sizeof(struct io_uring_probe) + (IORING_OP_READ + 1) * sizeof(struct io_uring_probe_op) + 7) / 8];
+  struct io_uring_probe *probe = (struct io_uring_probe *) buf;
+  memset(buf, 0, sizeof(buf));
+  if (syscall(SYS_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, IORING_OP_READ + 1) != 0) {
+    return false;
+  }
+  return probe->ops_len > IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+}
+
+
+/* Set up an io_uring with depth entries for ring; returns false if io_uring (or its read operation) is not available. */
+static bool cnpy_async_setup_ring(cnpy_async *ring, unsigned depth) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int ring_fd = (int) syscall(SYS_io_uring_setup, depth, &p);
+  if (ring_fd < 0) {
+    return false;
+  }
+  if (!cnpy_async_probe_read(ring_fd)) {
+    close(ring_fd);
+    return false;
+  }
+
+  ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->sq_ring_size = (ring->cq_ring_size > ring->sq_ring_size)? ring->cq_ring_size : ring->sq_ring_size;
+    ring->cq_ring_size = ring->sq_ring_size;
+  }
+  ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+  ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  ring->cq_ring = ring->sq_ring;
+  if (ring->sq_ring != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+  }
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+    /* no point in checking for errors */
+    if (ring->sqes != MAP_FAILED) {
+      munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+      munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != MAP_FAILED) {
+      munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    close(ring_fd);
+    return false;
+  }
+
+  char *sq = (char *) ring->sq_ring;
+  char *cq = (char *) ring->cq_ring;
+  ring->sq_head = (unsigned *) (sq + p.sq_off.head);
+  ring->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+  ring->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned *) (sq + p.sq_off.array);
+  ring->cq_head = (unsigned *) (cq + p.cq_off.head);
+  ring->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+  ring->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+  ring->cqes = cq + p.cq_off.cqes;
+  ring->depth = p.sq_entries; /* the completion queue has at least as many entries, so it cannot overflow */
+  ring->ring_fd = ring_fd;
+
+  /* a fixed file saves looking up the file on every read; without it, reads still work */
+  ring->fixed_file = syscall(SYS_io_uring_register, ring_fd, IORING_REGISTER_FILES, &ring->fd, 1) == 0;
+  return true;
+}
+
+
+static void cnpy_async_teardown_ring(cnpy_async *ring) {
+  munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_ring != ring->sq_ring) {
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  }
+  munmap(ring->sq_ring, ring->sq_ring_size);
+  close(ring->ring_fd);
+  ring->ring_fd = -1;
+}
+
+
+/* Queue the piece of request r starting at byte piece_off and ending at piece_end; at most CNPY_ASYNC_MAX_LEN bytes are read at once. */
+static void cnpy_async_queue_piece(cnpy_async *ring, size_t r, size_t piece_off, size_t piece_end) {
+  cnpy_async_request *req = &ring->requests[r];
+  unsigned tail = *ring->sq_tail;
+  unsigned i = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = (struct io_uring_sqe *) ring->sqes + i;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = (req->buf_index >= 0)? IORING_OP_READ_FIXED : IORING_OP_READ;
+  sqe->fd = ring->fixed_file? 0 : ring->fd;
+  sqe->flags = ring->fixed_file? IOSQE_FIXED_FILE : 0;
+  sqe->off = req->file_off + piece_off;
+  sqe->addr = (uint64_t) (uintptr_t) (req->buf + piece_off);
+  sqe->len = (uint32_t) ((piece_end - piece_off < CNPY_ASYNC_MAX_LEN)? piece_end - piece_off : CNPY_ASYNC_MAX_LEN);
+  sqe->buf_index = (uint16_t) ((req->buf_index >= 0)? req->buf_index : 0);
+  sqe->user_data = (uint64_t) r << 48 | (uint64_t) piece_off;
+  ring->sq_array[i] = i;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ring->n_inflight += 1;
+  ring->to_submit += 1;
+  req->n_inflight += 1;
+}
+
+#endif /* CNPY_IO_URING */
+
+
+/* End of the piece of a request that contains byte off. */
+static size_t cnpy_async_piece_end(const cnpy_async *ring, const cnpy_async_request *req, size_t off) {
+  size_t end = off / ring->block_size * ring->block_size + ring->block_size;
+  return (end < req->n_bytes)? end : req->n_bytes;
+}
+
+
+/* Queue pieces of the requests in the fifo as long as there is room in the ring. */
+static void cnpy_async_fill(cnpy_async *ring) {
+#ifdef CNPY_IO_URING
+  while (ring->fifo_size > 0 && ring->n_inflight < ring->depth) {
+    size_t r = ring->fifo[ring->fifo_begin];
+    cnpy_async_request *req = &ring->requests[r];
+    if (req->submitted < req->n_bytes) {
+      size_t end = cnpy_async_piece_end(ring, req, req->submitted);
+      cnpy_async_queue_piece(ring, r, req->submitted, end);
+      req->submitted = end;
+    }
+    if (req->submitted >= req->n_bytes) {
+      ring->fifo_begin = (ring->fifo_begin + 1) % CNPY_ASYNC_MAX_REQUESTS;
+      ring->fifo_size -= 1;
+    }
+  }
+#else
+  (void) ring;
+#endif
+}
+
+
+/* Submit the queued pieces, and wait until at least min_complete pieces have completed. */
+static cnpy_status cnpy_async_enter(cnpy_async *ring, unsigned min_complete) {
+#ifdef CNPY_IO_URING
+  if (ring->ring_fd == -1 || (ring->to_submit == 0 && min_complete == 0)) {
+    return CNPY_SUCCESS;
+  }
+  for (;;) {
+    unsigned flags = (min_complete > 0)? IORING_ENTER_GETEVENTS : 0;
+    long ret = syscall(SYS_io_uring_enter, ring->ring_fd, ring->to_submit, min_complete, flags, NULL, 0);
+    if (ret >= 0) {
+      ring->to_submit -= (unsigned) ret;
+      if (ring->to_submit == 0 || min_complete > 0) {
+        return CNPY_SUCCESS;
+      }
+    }
+    else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      return cnpy_error(CNPY_ERROR_FILE, "io_uring_enter() failed: %s", strerror(errno));
+    }
+  }
+#else
+  (void) ring;
+  (void) min_complete;
+  return CNPY_SUCCESS;
+#endif
+}
+
+
+/* Call the callback of request r, which is complete, and free it. */
+static void cnpy_async_finish(cnpy_async *ring, size_t r) {
+  cnpy_async_request *req = &ring->requests[r];
+  cnpy_async_callback callback = req->callback;
+  void *user = req->user;
+  cnpy_status status = req->status;
+  req->used = false;
+  req->ready = false;
+  ring->n_pending -= 1;
+  if (callback != NULL) {
+    callback(user, status); /* the slot is free already, so the callback may queue another read */
+  }
+}
+
+
+/* Handle all available completions; returns the number of requests finished. */
+static size_t cnpy_async_reap(cnpy_async *ring) {
+  size_t n_finished = 0;
+
+  /* reads done with pread() */
+  for (size_t r = 0; r < CNPY_ASYNC_MAX_REQUESTS; r += 1) {
+    if (ring->requests[r].used && ring->requests[r].ready) {
+      cnpy_async_finish(ring, r);
+      n_finished += 1;
+    }
+  }
+
+#ifdef CNPY_IO_URING
+  if (ring->ring_fd == -1) {
+    return n_finished;
+  }
+  for (;;) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+    const struct io_uring_cqe *cqe = (const struct io_uring_cqe *) ring->cqes + (head & *ring->cq_mask);
+    size_t r = (size_t) (cqe->user_data >> 48);
+    size_t piece_off = (size_t) (cqe->user_data & (((uint64_t) 1 << 48) - 1));
+    int res = cqe->res;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    cnpy_async_request *req = &ring->requests[r];
+    size_t piece_end = cnpy_async_piece_end(ring, req, piece_off);
+    ring->n_inflight -= 1;
+    req->n_inflight -= 1;
+    if (res < 0 || (res == 0 && piece_off < piece_end)) {
+      if (req->status == CNPY_SUCCESS) {
+        req->status = (res < 0)?
+          cnpy_error(CNPY_ERROR_FILE, "Asynchronous read failed: %s", strerror(-res)) :
+          cnpy_error(CNPY_ERROR_FILE, "Unexpected end of file at offset %zu", req->file_off + piece_off);
+      }
+      req->submitted = req->n_bytes; /* do not submit the rest of a failed request */
+    }
+    else if (piece_off + (size_t) res < piece_end) {
+      /* short read: read the rest of the piece; there is room, as this piece just left the ring */
+      cnpy_async_queue_piece(ring, r, piece_off + (size_t) res, piece_end);
+    }
+
+    if (req->n_inflight == 0 && req->submitted >= req->n_bytes) {
+      if (req->status == CNPY_SUCCESS && !cnpy_is_host_byte_order(ring->arr.byte_order)) {
+        size_t width = cnpy_swap_width(ring->arr.dtype);
+        cnpy_cpy_swap_n(width, req->n_bytes / width, req->buf, req->buf);
+      }
+      cnpy_async_finish(ring, r);
+      n_finished += 1;
+    }
+  }
+#endif
+
+  return n_finished;
+}
+
+
+/*
+ * Prepare *ring for asynchronous reads from *reader, with up to depth pieces in flight (0: 64).
+ * The reader must stay open until cnpy_async_close().
+ * If io_uring is not available, this still succeeds, and reads are done synchronously.
+ */
+cnpy_status cnpy_async_init(cnpy_async *ring, const cnpy_reader *reader, unsigned depth) {
+  assert(ring != NULL);
+  assert(reader != NULL && reader->fd != -1);
+
+  ring->fd = reader->fd;
+  ring->arr = reader->arr;
+  ring->block_size = reader->block_size;
+  ring->ring_fd = -1;
+  ring->fixed_file = false;
+  ring->depth = 0;
+  ring->n_inflight = 0;
+  ring->to_submit = 0;
+  ring->buffers = NULL;
+  ring->n_buffers = 0;
+  ring->n_pending = 0;
+  ring->fifo_begin = 0;
+  ring->fifo_size = 0;
+  for (size_t r = 0; r < CNPY_ASYNC_MAX_REQUESTS; r += 1) {
+    ring->requests[r].used = false;
+    ring->requests[r].ready = false;
+  }
+
+#ifdef CNPY_IO_URING
+  cnpy_async_setup_ring(ring, (depth > 0)? depth : 64);
+#else
+  (void) depth;
+#endif
+  return CNPY_SUCCESS;
+}
+
+
+/* Does ring use io_uring (rather than synchronous pread())? */
+bool cnpy_async_uses_io_uring(const cnpy_async *ring) {
+  assert(ring != NULL);
+  return ring->ring_fd != -1;
+}
+
+
+/*
+ * Register n buffers with the kernel, so that reads into them avoid mapping the pages on every read.
+ * The buffers must stay valid until cnpy_async_close(); reads whose buffer lies within one of them use it automatically.
+ * May only be called once per ring, while no reads are pending.
+ */
+cnpy_status cnpy_async_register_buffers(cnpy_async *ring, const struct iovec *buffers, size_t n) {
+  assert(ring != NULL);
+  assert(buffers != NULL || n == 0);
+  assert(ring->n_buffers == 0 && ring->n_pending == 0);
+#ifdef CNPY_IO_URING
+  if (ring->ring_fd != -1 && syscall(SYS_io_uring_register, ring->ring_fd, IORING_REGISTER_BUFFERS, buffers, (unsigned) n) != 0) {
+    return cnpy_error(CNPY_ERROR_MMAP, "Could not register buffers: %s", strerror(errno));
+  }
+#endif
+  ring->buffers = buffers;
+  ring->n_buffers = n;
+  return CNPY_SUCCESS;
+}
+
+
+/* Number of reads which have been queued and whose callback has not been called yet. */
+size_t cnpy_async_pending(const cnpy_async *ring) {
+  assert(ring != NULL);
+  return ring->n_pending;
+}
+
+
+/*
+ * Handle completed reads and call their callbacks, waiting until at least min_complete reads (but no more than are pending) have completed.
+ * Returns CNPY_ERROR_FILE if io_uring itself fails; the errors of single reads are passed to their callbacks.
+ */
+cnpy_status cnpy_async_wait(cnpy_async *ring, size_t min_complete) {
+  assert(ring != NULL);
+  size_t n_finished = 0;
+  for (;;) {
+    cnpy_async_fill(ring);
+    n_finished += cnpy_async_reap(ring);
+    if (n_finished >= min_complete || ring->n_pending == 0) {
+      break;
+    }
+    cnpy_async_fill(ring);
+    cnpy_status status = cnpy_async_enter(ring, 1);
+    if (status != CNPY_SUCCESS) {
+      return status;
+    }
+  }
+  return cnpy_async_enter(ring, 0);
+}
+
+
+/*
+ * Queue a read of count elements starting at the flat index flat_start into buf, like cnpy_reader_read_range().
+ * callback(user, status) is called once the read has completed; buf must stay valid until then.
+ * If CNPY_ASYNC_MAX_REQUESTS reads are pending, this first waits for one of them to complete.
+ */
+cnpy_status cnpy_async_read(cnpy_async *ring, size_t flat_start, size_t count, void *buf, cnpy_async_callback callback, void *user) {
+  assert(ring != NULL);
+  assert(buf != NULL || count == 0);
+  assert(flat_start <= cnpy_n_elements(ring->arr) && count <= cnpy_n_elements(ring->arr) - flat_start);
+
+  while (ring->n_pending == CNPY_ASYNC_MAX_REQUESTS) {
+    cnpy_status status = cnpy_async_wait(ring, 1);
+    if (status != CNPY_SUCCESS) {
+      return status;
+    }
+  }
+  size_t r = 0;
+  while (ring->requests[r].used) {
+    r += 1;
+  }
+
+  size_t size = cnpy_dtype_sizes[ring->arr.dtype];
+  cnpy_async_request *req = &ring->requests[r];
+  req->used = true;
+  req->ready = false;
+  req->buf = (char *) buf;
+  req->file_off = ring->arr.data_begin + size * flat_start;
+  req->n_bytes = size * count;
+  req->submitted = 0;
+  req->n_inflight = 0;
+  req->buf_index = -1;
+  req->status = CNPY_SUCCESS;
+  req->callback = callback;
+  req->user = user;
+  ring->n_pending += 1;
+  for (size_t i = 0; i < ring->n_buffers; i += 1) {
+    const char *b = (const char *) ring->buffers[i].iov_base;
+    if (req->buf >= b && req->buf + req->n_bytes <= b + ring->buffers[i].iov_len) {
+      req->buf_index = (int) i;
+      break;
+    }
+  }
+
+  if (ring->ring_fd == -1 || req->n_bytes == 0) {
+    cnpy_reader reader;
+    reader.fd = ring->fd;
+    reader.arr = ring->arr;
+    reader.block_size = ring->block_size;
+    reader.buf = NULL;
+    req->status = cnpy_reader_read_range(&reader, flat_start, count, buf);
+    req->ready = true;
+    return CNPY_SUCCESS;
+  }
+
+  ring->fifo[(ring->fifo_begin + ring->fifo_size) % CNPY_ASYNC_MAX_REQUESTS] = r;
+  ring->fifo_size += 1;
+  cnpy_async_fill(ring);
+  return cnpy_async_enter(ring, 0);
+}
+
+
+/* Wait for all pending reads (calling their callbacks), and release the ring. */
+cnpy_status cnpy_async_close(cnpy_async *ring) {
+  assert(ring != NULL);
+  cnpy_status status = cnpy_async_wait(ring, SIZE_MAX);
+#ifdef CNPY_IO_URING
+  if (ring->ring_fd != -1) {
+    cnpy_async_teardown_ring(ring);
+  }
+#endif
+  return status;
+}
+
+
+/*
+ * Direct I/O
+ *
+ * A cnpy_direct reads an array from (or writes a new array to) a file opened with O_DIRECT, bypassing the page cache,
+ * so that a single pass over a huge file does not evict the cached data of other processes.
+ * Data moves in aligned blocks through a few rotating buffers; a background thread reads (or writes) the next blocks while the caller works on the current one.
+ * The header only ends at a 16 byte boundary, so the first block holds the header and the first elements; elements never straddle blocks.
+ * Where O_DIRECT is not supported (e. g. tmpfs), the file is used through the page cache instead, and its pages are dropped with posix_fadvise() after each block
+ * (written blocks are flushed with fdatasync() first, as only clean pages can be dropped).
+ */
+
+
+#ifndef CNPY_DIRECT_MAX_BUFFERS
+#define CNPY_DIRECT_MAX_BUFFERS 8
+#endif
+
+#if defined(O_DIRECT)
+#define CNPY_O_DIRECT O_DIRECT
+#elif defined(__O_DIRECT)
+#define CNPY_O_DIRECT __O_DIRECT /* glibc only defines O_DIRECT with _GNU_SOURCE */
+#endif
+
+#ifndef CNPY_DIRECT_ALIGN
+#define CNPY_DIRECT_ALIGN 4096 /* alignment of file offsets, lengths and buffers for O_DIRECT; a multiple of the logical block size of the device */
+#endif
+
+
+typedef struct {
+  int fd;
+  cnpy_array arr; /* metadata of the array; raw_data is NULL */
+  bool writing;
+  bool direct; /* is O_DIRECT in effect? */
+  size_t block_size; /* a multiple of CNPY_DIRECT_ALIGN */
+  size_t n_buffers;
+  char *buffers; /* n_buffers * block_size bytes (an anonymous mapping) */
+  size_t n_blocks; /* number of blocks of the file */
+  size_t worker_done; /* blocks read (or written) */
+  size_t user_done; /* blocks consumed (or filled) by the caller */
+  size_t user_pos; /* writing: bytes in the block which is being filled */
+  bool held; /* reading: has the caller been handed block user_done? */
+  bool finished; /* no further blocks will be read (or filled) */
+  int error; /* errno of the first failed read (or write), or 0 */
+  size_t error_off; /* file offset of the failed block */
+  bool threaded; /* is a background thread running? */
+#ifdef CNPY_PTHREADS
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+#endif
+} cnpy_direct;
+
+
+/* Lock the state shared with the background thread; no-ops without one. */
+static void cnpy_direct_lock(cnpy_direct *d) {
+#ifdef CNPY_PTHREADS
+  if (d->threaded) {
+    pthread_mutex_lock(&d->mutex);
+  }
+#else
+  (void) d;
+#endif
+}
+
+
+static void cnpy_direct_unlock(cnpy_direct *d) {
+#ifdef CNPY_PTHREADS
+  if (d->threaded) {
+    pthread_mutex_unlock(&d->mutex);
+  }
+#else
+  (void) d;
+#endif
+}
+
+
+/* Wait for the other side to change the shared state; must be called with the lock held, and only if threaded. */
+static void cnpy_direct_wait(cnpy_direct *d) {
+#ifdef CNPY_PTHREADS
+  pthread_cond_wait(&d->cond, &d->mutex);
+#else
+  (void) d;
+#endif
+}
+
+
+static void cnpy_direct_signal(cnpy_direct *d) {
+#ifdef CNPY_PTHREADS
+  if (d->threaded) {
+    pthread_cond_broadcast(&d->cond);
+  }
+#else
+  (void) d;
+#endif
+}
+
+
+/* Byte range [*begin, *end) of the elements in block k (file offsets). */
+static void cnpy_direct_data_range(const cnpy_direct *d, size_t k, size_t *begin, size_t *end) {
+  size_t b = k * d->block_size;
+  size_t e = b + d->block_size;
+  *begin = (b > d->arr.data_begin)? b : d->arr.data_begin;
+  *end = (e < d->arr.raw_data_size)? e : d->arr.raw_data_size;
+}
+
+
+/*
+ * Read (or write) block k through buffer k % n_buffers, converting the byte order of the elements after reading.
+ * Returns 0 or an errno value; touches neither cnpy_error_str nor the shared counters, so the background thread may call it.
+ */
+static int cnpy_direct_transfer(cnpy_direct *d, size_t k) {
+  char *buf = d->buffers + (k % d->n_buffers) * d->block_size;
+  size_t off = k * d->block_size;
+  size_t end = (off + d->block_size < d->arr.raw_data_size)? off + d->block_size : d->arr.raw_data_size;
+  /* O_DIRECT transfers whole aligned blocks; a partial block at the end of the file is padded when writing, and cut short by the end of the file when reading */
+  size_t n = (end - off + CNPY_DIRECT_ALIGN - 1) / CNPY_DIRECT_ALIGN * CNPY_DIRECT_ALIGN;
+
+  size_t done = 0;
+  while (done < end - off) {
+    ssize_t got = d->writing?
+      pwrite(d->fd, buf + done, n - done, (off_t) (off + done)) :
+      pread(d->fd, buf + done, n - done, (off_t) (off + done));
+    if (got < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    if (got == 0) {
+      return EIO; /* the file was truncated */
+    }
+    done += (size_t) got;
+    if (d->direct && done < end - off) {
+      done = done / CNPY_DIRECT_ALIGN * CNPY_DIRECT_ALIGN; /* O_DIRECT cannot continue within a block; transfer the partial block again */
+    }
+  }
+
+#ifdef POSIX_FADV_DONTNEED
+  if (!d->direct) {
+    /* DONTNEED only drops clean pages, so written blocks are flushed first */
+    if (d->writing && fdatasync(d->fd) != 0) {
+      return errno;
+    }
+    posix_fadvise(d->fd, (off_t) off, (off_t) n, POSIX_FADV_DONTNEED);
+  }
+#endif
+
+  if (!d->writing && !cnpy_is_host_byte_order(d->arr.byte_order)) {
+    size_t begin;
+    cnpy_direct_data_range(d, k, &begin, &end);
+    size_t width = cnpy_swap_width(d->arr.dtype);
+    cnpy_cpy_swap_n(width, (end - begin) / width, buf + (begin - off), buf + (begin - off));
+  }
+  return 0;
+}
+
+
+/* Main function of the background thread: read blocks ahead of the caller (or write the blocks it has filled). */
+static void *cnpy_direct_worker(void *arg) {
+  cnpy_direct *d = (cnpy_direct *) arg;
+  cnpy_direct_lock(d);
+  for (size_t k = d->worker_done; k < d->n_blocks && d->error == 0; k += 1) {
+    /* reading: wait for a free buffer; writing: wait for a full one */
+    while (!d->finished && (d->writing? d->user_done <= k : k >= d->user_done + d->n_buffers)) {
+      cnpy_direct_wait(d);
+    }
+    if (d->writing? d->user_done <= k : d->finished) {
+      break;
+    }
+    cnpy_direct_unlock(d);
+    int error = cnpy_direct_transfer(d, k);
+    cnpy_direct_lock(d);
+    if (error != 0) {
+      d->error = error;
+      d->error_off = k * d->block_size;
+    }
+    else {
+      d->worker_done = k + 1;
+    }
+    cnpy_direct_signal(d);
+  }
+  cnpy_direct_unlock(d);
+  return NULL;
+}
+
+
+/* Set up the buffers of *d and start the background thread; without it, blocks are transferred synchronously. */
+static cnpy_status cnpy_direct_start(cnpy_direct *d, size_t block_size, size_t n_buffers) {
+  block_size = (block_size > 0)? block_size : (size_t) 1 << 22;
+  block_size = (block_size + CNPY_DIRECT_ALIGN - 1) / CNPY_DIRECT_ALIGN * CNPY_DIRECT_ALIGN;
+  if (block_size <= d->arr.data_begin) {
+    /* the first block holds the header, and at least one element */
+    block_size = (d->arr.data_begin + CNPY_DIRECT_ALIGN) / CNPY_DIRECT_ALIGN * CNPY_DIRECT_ALIGN;
+  }
+  n_buffers = (n_buffers > 0)? n_buffers : 2;
+  n_buffers = (n_buffers < CNPY_DIRECT_MAX_BUFFERS)? n_buffers : CNPY_DIRECT_MAX_BUFFERS;
+
+  d->block_size = block_size;
+  d->n_buffers = n_buffers;
+  d->n_blocks = (d->arr.raw_data_size + block_size - 1) / block_size;
+  d->worker_done = 0;
+  d->user_done = 0;
+  d->user_pos = 0;
+  d->held = false;
+  d->finished = false;
+  d->error = 0;
+  d->error_off = 0;
+  d->threaded = false;
+
+  d->buffers = (char *) mmap(NULL, n_buffers * block_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (d->buffers == MAP_FAILED) {
+    return cnpy_error(CNPY_ERROR_MMAP, "mmap() of the buffers failed: %s", strerror(errno));
+  }
+
+#ifdef CNPY_PTHREADS
+  if (n_buffers > 1 && pthread_mutex_init(&d->mutex, NULL) == 0) {
+    if (pthread_cond_init(&d->cond, NULL) == 0) {
+      d->threaded = true;
+      if (pthread_create(&d->thread, NULL, cnpy_direct_worker, d) != 0) {
+        d->threaded = false;
+        pthread_cond_destroy(&d->cond);
+      }
+    }
+    if (!d->threaded) {
+      pthread_mutex_destroy(&d->mutex);
+    }
+  }
+#endif
+  return CNPY_SUCCESS;
+}
+
+
+/* Stop the background thread, release the buffers and close the file; returns the first error. */
+static cnpy_status cnpy_direct_stop(cnpy_direct *d) {
+  cnpy_direct_lock(d);
+  d->finished = true;
+  cnpy_direct_signal(d);
+  cnpy_direct_unlock(d);
+#ifdef CNPY_PTHREADS
+  if (d->threaded) {
+    pthread_join(d->thread, NULL);
+    pthread_cond_destroy(&d->cond);
+    pthread_mutex_destroy(&d->mutex);
+    d->threaded = false;
+  }
+#endif
+  /* the background thread has finished, so the remaining blocks are transferred here */
+  while (d->writing && d->error == 0 && d->worker_done < d->user_done) {
+    d->error = cnpy_direct_transfer(d, d->worker_done);
+    d->error_off = d->worker_done * d->block_size;
+    d->worker_done += (d->error == 0);
+  }
+
+  munmap(d->buffers, d->n_buffers * d->block_size); /* cannot fail for a mapping we made */
+  d->buffers = NULL;
+  int error = d->error;
+  if (error == 0 && d->writing && ftruncate(d->fd, (off_t) d->arr.raw_data_size) != 0) {
+    error = errno; /* remove the padding of the last block */
+  }
+  int fd = d->fd;
+  d->fd = -1;
+  if (close(fd) != 0 && error == 0) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not close file: %s", strerror(errno));
+  }
+  if (error != 0) {
+    return cnpy_error(CNPY_ERROR_FILE, "%s of the block at offset %zu failed: %s", d->writing? "Writing" : "Reading", d->error_off, strerror(error));
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/* Switch fd to O_DIRECT, if supported; otherwise, the page cache is used. */
+static bool cnpy_direct_enable(int fd) {
+#ifdef CNPY_O_DIRECT
+  int flags = fcntl(fd, F_GETFL);
+  return flags != -1 && fcntl(fd, F_SETFL, flags | CNPY_O_DIRECT) == 0;
+#else
+  (void) fd;
+  return false;
+#endif
+}
+
+
+/*
+ * Start reading the .npy file fn with O_DIRECT, in blocks of block_size bytes (0: 4 MiB; rounded up to a multiple of CNPY_DIRECT_ALIGN)
+ * through n_buffers buffers (0: 2; at most CNPY_DIRECT_MAX_BUFFERS), which a background thread fills ahead of the caller.
+ * d->arr holds the metadata of the array; its raw_data is NULL.
+ */
+cnpy_status cnpy_direct_scan_begin(const char * const fn, size_t block_size, size_t n_buffers, cnpy_direct *d) {
+  assert(fn != NULL);
+  assert(d != NULL);
+
+  int fd = open(fn, O_RDONLY);
+  if (fd == -1) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not open file: %s", strerror(errno));
+  }
+  /* the header is read through the page cache (as the stack buffer is not aligned), without read-ahead, and dropped again */
+#ifdef POSIX_FADV_RANDOM
+  posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+#endif
+  cnpy_status status = cnpy_pread_header(fd, (size_t) 1 << 20, &d->arr);
+  if (status != CNPY_SUCCESS) {
+    close(fd); /* no point in checking for errors */
+    return status;
+  }
+#ifdef POSIX_FADV_DONTNEED
+  posix_fadvise(fd, 0, CNPY_READER_MAX_HEADER, POSIX_FADV_DONTNEED);
+#endif
+  d->fd = fd;
+  d->writing = false;
+  d->direct = cnpy_direct_enable(fd);
+  status = cnpy_direct_start(d, block_size, n_buffers);
+  if (status != CNPY_SUCCESS) {
+    close(fd);
+  }
+  return status;
+}
+
+
+/*
+ * Store the next chunk in *chunk and return true; return false at the end of the array, or if reading failed (then cnpy_direct_scan_end() reports the error).
+ * Unlike with cnpy_scan_next(), the elements of the chunk are in host byte order.
+ * A chunk is valid until the next call; its elements may be changed, which does not change the file.
+ */
+bool cnpy_direct_scan_next(cnpy_direct *d, cnpy_chunk *chunk) {
+  assert(d != NULL && !d->writing);
+  assert(chunk != NULL);
+
+  cnpy_direct_lock(d);
+  if (d->held) {
+    d->user_done += 1; /* the caller is done with the previous chunk, so its buffer can be refilled */
+    d->held = false;
+    cnpy_direct_signal(d);
+  }
+  size_t k = d->user_done; /* every block holds elements, as the header is smaller than a block */
+  if (k >= d->n_blocks) {
+    cnpy_direct_unlock(d);
+    return false;
+  }
+  if (d->threaded) {
+    while (d->worker_done <= k && d->error == 0) {
+      cnpy_direct_wait(d);
+    }
+  }
+  else if (d->worker_done <= k && d->error == 0) {
+    d->error = cnpy_direct_transfer(d, k);
+    d->error_off = k * d->block_size;
+    d->worker_done += (d->error == 0);
+  }
+  bool ok = d->worker_done > k;
+  cnpy_direct_unlock(d);
+  if (!ok) {
+    return false;
+  }
+
+  size_t begin, end;
+  cnpy_direct_data_range(d, k, &begin, &end);
+  size_t size = cnpy_dtype_sizes[d->arr.dtype];
+  chunk->data = d->buffers + (k % d->n_buffers) * d->block_size + (begin - k * d->block_size);
+  chunk->flat_start = (begin - d->arr.data_begin) / size;
+  chunk->length = (end - begin) / size;
+  d->held = true;
+  return true;
+}
+
+
+/* Finish a scan and close the file; returns CNPY_ERROR_FILE if a read failed. */
+cnpy_status cnpy_direct_scan_end(cnpy_direct *d) {
+  assert(d != NULL && !d->writing);
+  assert(d->fd != -1);
+  return cnpy_direct_stop(d);
+}
+
+
+/*
+ * Create the .npy file fn (which must not exist), with the given metadata as in cnpy_create(), for writing with O_DIRECT.
+ * Elements are appended in serialization order with cnpy_direct_write(); a background thread writes each block once it is full.
+ * Blocks and buffers are as in cnpy_direct_scan_begin(). Elements which are not written are zero.
+ */
+cnpy_status cnpy_direct_write_begin(const char * const fn, cnpy_byte_order byte_order, cnpy_dtype dtype, cnpy_flat_order order, size_t n_dim, const size_t * const dims, size_t block_size, size_t n_buffers, cnpy_direct *d) {
+  assert(fn != NULL);
+  assert(d != NULL);
+  assert(n_dim <= CNPY_MAX_DIM);
+  if (cnpy_dtype_sizes[dtype] == 1) {
+    byte_order = CNPY_NE;
+  }
+
+  cnpy_array arr;
+  arr.byte_order = byte_order;
+  arr.dtype = dtype;
+  arr.order = order;
+  arr.n_dim = n_dim;
+  arr.raw_data = NULL;
+  arr.map_size = 0;
+  arr.fd = -1;
+  arr.read_only = false;
+  arr.data_begin = cnpy_predict_full_header_size(dtype, order, n_dim, dims);
+  size_t data_size = cnpy_dtype_sizes[dtype];
+  for (size_t i = 0; i < n_dim; i += 1) {
+    arr.dims[i] = dims[i];
+    if (__builtin_mul_overflow(data_size, dims[i], &data_size)) {
+      return cnpy_error(CNPY_ERROR_FORMAT, "Overflow when calculating required file size");
+    }
+  }
+  assert(data_size > 0);
+  if (__builtin_add_overflow(arr.data_begin, data_size, &arr.raw_data_size)) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Overflow when calculating required file size");
+  }
+
+  int fd = open(fn, O_RDWR | O_CREAT | O_EXCL, (mode_t) 0644);
+  if (fd == -1) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not open file: %s", strerror(errno));
+  }
+  if (ftruncate(fd, (off_t) arr.raw_data_size) != 0) {
+    close(fd); /* no point in checking for errors */
+    return cnpy_error(CNPY_ERROR_FILE, "Could not resize file: %s", strerror(errno));
+  }
+  d->fd = fd;
+  d->arr = arr;
+  d->writing = true;
+  d->direct = cnpy_direct_enable(fd);
+  cnpy_status status = cnpy_direct_start(d, block_size, n_buffers);
+  if (status != CNPY_SUCCESS) {
+    close(fd);
+    return status;
+  }
+
+  /* the first block begins with the header */
+  cnpy_write_padded_header(d->buffers, arr.data_begin, byte_order, dtype, order, n_dim, dims);
+  d->user_pos = arr.data_begin;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Append count elements (in host byte order) from buf to the array, converting them to its byte order.
+ * At most as many elements as the array has may be written in total.
+ * Blocks until a buffer is free; returns CNPY_ERROR_FILE if writing an earlier block failed.
+ */
+cnpy_status cnpy_direct_write(cnpy_direct *d, const void *buf, size_t count) {
+  assert(d != NULL && d->writing);
+  assert(buf != NULL || count == 0);
+
+  size_t size = cnpy_dtype_sizes[d->arr.dtype];
+  const char *src = (const char *) buf;
+  size_t n_bytes = size * count;
+  assert(d->user_done * d->block_size + d->user_pos + n_bytes <= d->arr.raw_data_size);
+  while (n_bytes > 0) {
+    size_t n = d->block_size - d->user_pos;
+    n = (n < n_bytes)? n : n_bytes;
+    char *dst = d->buffers + (d->user_done % d->n_buffers) * d->block_size + d->user_pos;
+    cnpy_cpy_n(d->arr, n / size, src, dst);
+    src += n;
+    n_bytes -= n;
+    d->user_pos += n;
+
+    if (d->user_pos == d->block_size || d->user_done * d->block_size + d->user_pos == d->arr.raw_data_size) {
+      /* hand the full buffer over, and wait until the next one is free */
+      cnpy_direct_lock(d);
+      d->user_done += 1;
+      d->user_pos = 0;
+      cnpy_direct_signal(d);
+      if (d->threaded) {
+        while (d->user_done >= d->worker_done + d->n_buffers && d->error == 0) {
+          cnpy_direct_wait(d);
+        }
+      }
+      else {
+        while (d->worker_done < d->user_done && d->error == 0) {
+          d->error = cnpy_direct_transfer(d, d->worker_done);
+          d->error_off = d->worker_done * d->block_size;
+          d->worker_done += (d->error == 0);
+        }
+      }
+      int error = d->error;
+      size_t error_off = d->error_off;
+      cnpy_direct_unlock(d);
+      if (error != 0) {
+        return cnpy_error(CNPY_ERROR_FILE, "Writing the block at offset %zu failed: %s", error_off, strerror(error));
+      }
+    }
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/* Write the remaining blocks, and close the file; returns CNPY_ERROR_FILE if writing failed. */
+cnpy_status cnpy_direct_write_end(cnpy_direct *d) {
+  assert(d != NULL && d->writing);
+  assert(d->fd != -1);
+
+  /* the last partial block, if any; buffers are reused, so the elements which were not written have to be cleared */
+  cnpy_direct_lock(d);
+  if (d->user_pos > 0) {
+    memset(d->buffers + (d->user_done % d->n_buffers) * d->block_size + d->user_pos, 0, d->block_size - d->user_pos);
+    d->user_done += 1;
+    d->user_pos = 0;
+  }
+  cnpy_direct_unlock(d);
+  return cnpy_direct_stop(d);
+}
+
+
+/*
+ * Streaming writer
+ *
+ * A cnpy_stream_writer writes a C order array whose first dimension is not known in advance, row by row, with large sequential write() calls.
+ * The header is written first, padded to leave room for any number of rows, and rewritten in place with the final shape on closing,
+ * so the data is never copied. Until then, the file is a .npy file with zero rows (followed by the rows written so far),
+ * which numpy reads, but cnpy_open() rejects, as it does not support empty arrays.
+ */
+
+
+#ifndef CNPY_STREAM_BUFFER_SIZE
+#define CNPY_STREAM_BUFFER_SIZE (1 << 22) /* bytes buffered by a cnpy_stream_writer between write() calls */
+#endif
+
+
+typedef struct {
+  int fd;
+  cnpy_array arr; /* metadata of the array; dims[0] is the number of rows written so far; raw_data is NULL */
+  size_t row_size; /* bytes per row */
+  char *buf; /* CNPY_STREAM_BUFFER_SIZE bytes (an anonymous mapping) */
+  size_t buf_used;
+} cnpy_stream_writer;
+
+
+/* Write exactly n bytes from src to fd at the current position. */
+static cnpy_status cnpy_write_full(int fd, const char *src, size_t n) {
+  while (n > 0) {
+    ssize_t done = write(fd, src, n);
+    if (done < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return cnpy_error(CNPY_ERROR_FILE, "write() failed: %s", strerror(errno));
+    }
+    src += done;
+    n -= (size_t) done;
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Create the .npy file fn (which must not exist) for an array of the given dtype and byte order in C order,
+ * whose rows have the n_trailing dimensions trailing_dims (none for a one-dimensional array).
+ * Rows are appended with cnpy_stream_write_rows(); the number of rows is set by cnpy_stream_writer_close().
+ */
+cnpy_status cnpy_stream_writer_open(const char * const fn, cnpy_dtype dtype, cnpy_byte_order byte_order, size_t n_trailing, const size_t * const trailing_dims, cnpy_stream_writer *w) {
+  assert(fn != NULL);
+  assert(w != NULL);
+  assert(n_trailing < CNPY_MAX_DIM);
+  assert(trailing_dims != NULL || n_trailing == 0);
+  if (cnpy_dtype_sizes[dtype] == 1) {
+    byte_order = CNPY_NE;
+  }
+
+  cnpy_array arr;
+  arr.byte_order = byte_order;
+  arr.dtype = dtype;
+  arr.order = CNPY_C_ORDER;
+  arr.n_dim = n_trailing + 1;
+  arr.raw_data = NULL;
+  arr.map_size = 0;
+  arr.fd = -1;
+  arr.read_only = false;
+  size_t row_size = cnpy_dtype_sizes[dtype];
+  for (size_t i = 0; i < n_trailing; i += 1) {
+    assert(trailing_dims[i] > 0);
+    arr.dims[i + 1] = trailing_dims[i];
+    if (__builtin_mul_overflow(row_size, trailing_dims[i], &row_size)) {
+      return cnpy_error(CNPY_ERROR_FORMAT, "Overflow when calculating the size of a row");
+    }
+  }
+  /* room for the largest possible number of rows */
+  arr.dims[0] = 0;
+  arr.data_begin = cnpy_growable_header_size(dtype, CNPY_C_ORDER, arr.n_dim, arr.dims);
+  arr.raw_data_size = arr.data_begin;
+
+  char *buf = (char *) mmap(NULL, CNPY_STREAM_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED) {
+    return cnpy_error(CNPY_ERROR_MMAP, "mmap() of the buffer failed: %s", strerror(errno));
+  }
+  assert(arr.data_begin < CNPY_STREAM_BUFFER_SIZE);
+  cnpy_write_padded_header(buf, arr.data_begin, byte_order, dtype, CNPY_C_ORDER, arr.n_dim, arr.dims);
+
+  int fd = open(fn, O_WRONLY | O_CREAT | O_EXCL, (mode_t) 0644);
+  if (fd == -1) {
+    munmap(buf, CNPY_STREAM_BUFFER_SIZE);
+    return cnpy_error(CNPY_ERROR_FILE, "Could not open file: %s", strerror(errno));
+  }
+  cnpy_status status = cnpy_write_full(fd, buf, arr.data_begin);
+  if (status != CNPY_SUCCESS) {
+    munmap(buf, CNPY_STREAM_BUFFER_SIZE);
+    close(fd); /* no point in checking for errors */
+    return status;
+  }
+
+  w->fd = fd;
+  w->arr = arr;
+  w->row_size = row_size;
+  w->buf = buf;
+  w->buf_used = 0;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Append n rows (each the product of the trailing dimensions elements, in host byte order) from buf.
+ * Rows are collected in a buffer, converting their byte order, and written once it is full; large writes in host byte order go to the file directly.
+ */
+cnpy_status cnpy_stream_write_rows(cnpy_stream_writer *w, const void *buf, size_t n) {
+  assert(w != NULL && w->fd != -1);
+  assert(buf != NULL || n == 0);
+
+  size_t n_bytes;
+  size_t raw_data_size;
+  if (__builtin_mul_overflow(n, w->row_size, &n_bytes) || __builtin_add_overflow(w->arr.raw_data_size, n_bytes, &raw_data_size)) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Overflow when calculating the size of the data");
+  }
+  size_t size = cnpy_dtype_sizes[w->arr.dtype];
+  const char *src = (const char *) buf;
+
+  if (cnpy_is_host_byte_order(w->arr.byte_order) && w->buf_used + n_bytes >= 2 * CNPY_STREAM_BUFFER_SIZE) {
+    /* no point in copying: write what is buffered, then the rows */
+    cnpy_status status = cnpy_write_full(w->fd, w->buf, w->buf_used);
+    w->buf_used = 0;
+    if (status == CNPY_SUCCESS) {
+      status = cnpy_write_full(w->fd, src, n_bytes);
+    }
+    if (status != CNPY_SUCCESS) {
+      return status;
+    }
+  }
+  else {
+    /* buffer sizes are multiples of the element size, so elements are never split */
+    for (size_t left = n_bytes; left > 0; ) {
+      size_t k = CNPY_STREAM_BUFFER_SIZE / size * size - w->buf_used;
+      k = (k < left)? k : left;
+      cnpy_cpy_n(w->arr, k / size, src, w->buf + w->buf_used);
+      src += k;
+      left -= k;
+      w->buf_used += k;
+      if (w->buf_used + size > CNPY_STREAM_BUFFER_SIZE) {
+        cnpy_status status = cnpy_write_full(w->fd, w->buf, w->buf_used);
+        w->buf_used = 0;
+        if (status != CNPY_SUCCESS) {
+          return status;
+        }
+      }
+    }
+  }
+
+  w->arr.dims[0] += n;
+  w->arr.raw_data_size = raw_data_size;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Write the buffered rows, rewrite the header with the number of rows, and close the file.
+ * If no rows were written, the file is closed all the same, but CNPY_ERROR_FORMAT is returned, as cnpy_open() cannot open it.
+ */
+cnpy_status cnpy_stream_writer_close(cnpy_stream_writer *w) {
+  assert(w != NULL && w->fd != -1);
+
+  cnpy_status status = cnpy_write_full(w->fd, w->buf, w->buf_used);
+  w->buf_used = 0;
+  if (status == CNPY_SUCCESS) {
+    /* the header keeps its size; only the shape and the padding change */
+    cnpy_write_padded_header(w->buf, w->arr.data_begin, w->arr.byte_order, w->arr.dtype, CNPY_C_ORDER, w->arr.n_dim, w->arr.dims);
+    for (size_t done = 0; done < w->arr.data_begin && status == CNPY_SUCCESS; ) {
+      ssize_t n = pwrite(w->fd, w->buf + done, w->arr.data_begin - done, (off_t) done);
+      if (n < 0 && errno != EINTR) {
+        status = cnpy_error(CNPY_ERROR_FILE, "Could not rewrite the header: %s", strerror(errno));
+      }
+      done += (n > 0)? (size_t) n : 0;
+    }
+  }
+
+  munmap(w->buf, CNPY_STREAM_BUFFER_SIZE); /* cannot fail for a mapping we made */
+  w->buf = NULL;
+  int fd = w->fd;
+  w->fd = -1;
+  if (close(fd) != 0 && status == CNPY_SUCCESS) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not close file: %s", strerror(errno));
+  }
+  if (status == CNPY_SUCCESS && w->arr.dims[0] == 0) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "No rows were written; empty arrays are unsupported");
+  }
+  return status;
+}
+
+
+/*
+ * Growing arrays
+ *
+ * C order arrays opened or created with the growable option can grow along the first axis in place:
+ * the file is extended, the mapping is grown (with mremap() where available, without copying), and the shape in the header is rewritten.
+ * The header has to have room for the new shape; cnpy_create() and numpy leave room for any length of the first axis.
+ * The mapping grows geometrically beyond the end of the file, so appending many small batches of rows remaps rarely.
+ */
+
+
+/* Grow the mapping of arr to at least map_size bytes; its address may change. */
+static cnpy_status cnpy_grow_mapping(cnpy_array *arr, size_t map_size) {
+  size_t page = (size_t) sysconf(_SC_PAGESIZE);
+  map_size = (map_size + page - 1) / page * page;
+  if (map_size <= arr->map_size) {
+    return CNPY_SUCCESS;
+  }
+#if defined(MREMAP_MAYMOVE)
+  void *raw_data = mremap(arr->raw_data, arr->map_size, map_size, MREMAP_MAYMOVE);
+  if (raw_data == MAP_FAILED) {
+    return cnpy_error(CNPY_ERROR_MMAP, "mremap() failed: %s", strerror(errno));
+  }
+#else
+  /* the data lives in the file, so mapping it anew copies nothing */
+  void *raw_data = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, arr->fd, 0);
+  if (raw_data == MAP_FAILED) {
+    return cnpy_error(CNPY_ERROR_MMAP, "mmap() failed: %s", strerror(errno));
+  }
+  munmap(arr->raw_data, arr->map_size); /* no point in checking for errors */
+#endif
+  arr->raw_data = (char *) raw_data;
+  arr->map_size = map_size;
+  return CNPY_SUCCESS;
+}
+
+
+/* Bytes per row along the first axis, and the file size with n_rows rows; returns false on overflow. */
+static bool cnpy_grow_size(const cnpy_array *arr, size_t n_rows, size_t *row_size, size_t *raw_data_size) {
+  *row_size = cnpy_dtype_sizes[arr->dtype];
+  for (size_t i = 1; i < arr->n_dim; i += 1) {
+    *row_size *= arr->dims[i]; /* cannot overflow, as the array exists */
+  }
+  size_t tmp;
+  return !__builtin_mul_overflow(*row_size, n_rows, &tmp) && !__builtin_add_overflow(arr->data_begin, tmp, raw_data_size);
+}
+
+
+/*
+ * Make room for n more rows, without changing the shape: the disk space is allocated (where fallocate() can do so without changing the file size),
+ * and the mapping is grown, so that appending them needs neither.
+ */
+cnpy_status cnpy_reserve_rows(cnpy_array *arr, size_t n) {
+  assert(arr != NULL && arr->raw_data != NULL);
+  assert(arr->fd != -1);
+  if (arr->order != CNPY_C_ORDER) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Only C order arrays can grow along the first axis");
+  }
+
+  size_t row_size, raw_data_size;
+  if (n > SIZE_MAX - arr->dims[0] || !cnpy_grow_size(arr, arr->dims[0] + n, &row_size, &raw_data_size)) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Overflow when calculating required file size");
+  }
+#if defined(FALLOC_FL_KEEP_SIZE)
+  if (raw_data_size > arr->raw_data_size) {
+    /* only a hint; file systems without support allocate when the rows are appended */
+    fallocate(arr->fd, FALLOC_FL_KEEP_SIZE, (off_t) arr->raw_data_size, (off_t) (raw_data_size - arr->raw_data_size));
+  }
+#endif
+  return cnpy_grow_mapping(arr, raw_data_size);
+}
+
+
+/*
+ * Append n rows (each the product of all dimensions but the first elements, in host byte order) from rows to the C order array *arr,
+ * which must be opened or created with the growable option.
+ * The rows are written before the shape in the header is, so another process which maps the file never sees a shape without data.
+ * arr->raw_data may change. On failure, the array and the file are unchanged.
+ */
+cnpy_status cnpy_append_rows(cnpy_array *arr, const void *rows, size_t n) {
+  assert(arr != NULL && arr->raw_data != NULL);
+  assert(arr->fd != -1);
+  assert(rows != NULL || n == 0);
+  if (arr->order != CNPY_C_ORDER) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Only C order arrays can grow along the first axis");
+  }
+
+  size_t row_size, raw_data_size;
+  if (n > SIZE_MAX - arr->dims[0] || !cnpy_grow_size(arr, arr->dims[0] + n, &row_size, &raw_data_size)) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Overflow when calculating required file size");
+  }
+  size_t dims[CNPY_MAX_DIM] = { 0 };
+  for (size_t i = 0; i < arr->n_dim; i += 1) {
+    dims[i] = arr->dims[i];
+  }
+  dims[0] += n;
+  if (cnpy_predict_full_header_size(arr->dtype, arr->order, arr->n_dim, dims) > arr->data_begin || arr->data_begin - 10 > 65535) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "The header of %zu bytes has no room for the new shape", arr->data_begin);
+  }
+
+  /* extend the file, allocating the disk space if possible, so that writing to the mapping cannot fail with SIGBUS */
+  if (n == 0) {
+    return CNPY_SUCCESS;
+  }
+  int err = posix_fallocate(arr->fd, (off_t) arr->raw_data_size, (off_t) (raw_data_size - arr->raw_data_size));
+  if (err == EINVAL || err == EOPNOTSUPP) {
+    err = (ftruncate(arr->fd, (off_t) raw_data_size) == 0)? 0 : errno; /* the file system cannot allocate ahead */
+  }
+  if (err != 0) {
+    if (ftruncate(arr->fd, (off_t) arr->raw_data_size) != 0) {
+      /* undo a partial allocation; nothing more can be done if that fails */
+    }
+    return cnpy_error(CNPY_ERROR_FILE, "Could not resize file: %s", strerror(err));
+  }
+
+  /* grow the mapping geometrically */
+  if (raw_data_size > arr->map_size) {
+    size_t map_size = (arr->map_size < SIZE_MAX / 2)? 2 * arr->map_size : SIZE_MAX;
+    cnpy_status status = cnpy_grow_mapping(arr, (map_size > raw_data_size)? map_size : raw_data_size);
+    if (status != CNPY_SUCCESS) {
+      if (ftruncate(arr->fd, (off_t) arr->raw_data_size) != 0) {
+        /* nothing more can be done */
+      }
+      return status;
+    }
+  }
+
+  cnpy_cpy_n(*arr, n * (row_size / cnpy_dtype_sizes[arr->dtype]), (const char *) rows, arr->raw_data + arr->raw_data_size);
+
+  /* the data before the shape; the header is written through a copy, as snprintf() writes a final \0 */
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  char header[65536 + 16];
+  cnpy_write_padded_header(header, arr->data_begin, arr->byte_order, arr->dtype, arr->order, arr->n_dim, dims);
+  memcpy(arr->raw_data, header, arr->data_begin);
+
+  arr->dims[0] = dims[0];
+  arr->raw_data_size = raw_data_size;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Ring buffers
+ *
+ * A cnpy_ring is a C order array of fixed capacity along the first axis which keeps the most recent rows pushed to it.
+ * Pushing writes the new rows in place of the oldest ones and moves nothing.
+ * The position of the oldest row (head) and the number of rows (count) are stored as a comment in the padding of the header,
+ * e. g. "{'descr': '<f8', 'fortran_order': False, 'shape': (100,3,), } # cnpy_ring seq=00000000000000000084 head=00000000000000000042 count=00000000000000000100",
+ * so numpy still sees a valid array of shape (capacity, ...) (with the rows in storage order).
+ * seq is a sequence lock: it is odd while head and count are being written, and readers retry until they read the same even seq before and after them.
+ */
+
+
+#define CNPY_RING_TAG "# cnpy_ring seq="
+#define CNPY_RING_DIGITS 20 /* digits of seq, head and count; enough for SIZE_MAX */
+#define CNPY_RING_META_SIZE (3 * CNPY_RING_DIGITS + 13) /* seq, " head=", head, " count=", count */
+#define CNPY_RING_MAX_TRIES 1000 /* reads of head and count before a writer which stays in the middle of a store (e. g. because it died there) makes them invalid */
+
+
+typedef struct {
+  cnpy_array arr; /* the underlying array; arr.dims[0] is the capacity */
+  size_t meta; /* offset of the digits of seq in the header */
+  size_t row_size; /* bytes per row */
+} cnpy_ring;
+
+
+/* Parse n_digits decimal digits at p. */
+static size_t cnpy_ring_parse_digits(const char *p, size_t n_digits, bool *ok) {
+  size_t r = 0;
+  if (cnpy_atonz(p, n_digits, &r) != n_digits) {
+    *ok = false;
+  }
+  return r;
+}
+
+
+/*
+ * Read head and count from the header of ring; returns false if they are invalid.
+ * A torn read of seq while it becomes even again is harmless, as head and count are complete by then.
+ */
+static bool cnpy_ring_load(const cnpy_ring *ring, size_t *head, size_t *count) {
+  const char *p = ring->arr.raw_data + ring->meta;
+  char seq[CNPY_RING_DIGITS];
+  char values[CNPY_RING_META_SIZE - CNPY_RING_DIGITS]; /* " head=", head, " count=", count */
+  for (size_t tries = 0; tries < CNPY_RING_MAX_TRIES; tries += 1) {
+    memcpy(seq, p, CNPY_RING_DIGITS);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    memcpy(values, p + CNPY_RING_DIGITS, sizeof(values));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (memcmp(seq, p, CNPY_RING_DIGITS) == 0 && (seq[CNPY_RING_DIGITS - 1] - '0') % 2 == 0) {
+      bool ok = true;
+      cnpy_ring_parse_digits(seq, CNPY_RING_DIGITS, &ok);
+      *head = cnpy_ring_parse_digits(values + strlen(" head="), CNPY_RING_DIGITS, &ok);
+      *count = cnpy_ring_parse_digits(values + sizeof(values) - CNPY_RING_DIGITS, CNPY_RING_DIGITS, &ok);
+      return ok && *head < ring->arr.dims[0] && *count <= ring->arr.dims[0];
+    }
+    if (tries >= 10) {
+      struct timespec pause = { 0, 1000 }; /* let a preempted writer finish */
+      nanosleep(&pause, NULL);
+    }
+  }
+  return false;
+}
+
+
+/* Write head and count to the header of ring, after the rows they refer to. */
+static void cnpy_ring_store(cnpy_ring *ring, size_t head, size_t count) {
+  char *p = ring->arr.raw_data + ring->meta;
+  bool ok = true;
+  size_t seq = cnpy_ring_parse_digits(p, CNPY_RING_DIGITS, &ok);
+  assert(ok && seq % 2 == 0);
+  (void) ok;
+
+  /* seq becomes odd by changing its last digit only, so that readers never see a torn odd seq */
+  __atomic_store_n(p + CNPY_RING_DIGITS - 1, (char) (p[CNPY_RING_DIGITS - 1] + 1), __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  char tmp[CNPY_RING_META_SIZE + 1];
+  int n = snprintf(tmp, sizeof(tmp), "%0*zu head=%0*zu count=%0*zu", CNPY_RING_DIGITS, seq + 2, CNPY_RING_DIGITS, head, CNPY_RING_DIGITS, count);
+  assert(n == CNPY_RING_META_SIZE);
+  memcpy(p + CNPY_RING_DIGITS, tmp + CNPY_RING_DIGITS, (size_t) n - CNPY_RING_DIGITS); /* without the final \0 */
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(p, tmp, CNPY_RING_DIGITS);
+}
+
+
+static size_t cnpy_ring_row_size(const cnpy_array arr) {
+  size_t row_size = cnpy_dtype_sizes[arr.dtype];
+  for (size_t i = 1; i < arr.n_dim; i += 1) {
+    row_size *= arr.dims[i];
+  }
+  return row_size;
+}
+
+
+/*
+ * Create the ring buffer fn (NULL for an anonymous one) for rows of the given dtype and byte order;
+ * dims[0] is the capacity, and the other dimensions are those of a row. The ring is empty.
+ * Returns CNPY_ERROR_FORMAT if the capacity is 0.
+ */
+cnpy_status cnpy_ring_create(const char * const fn, cnpy_byte_order byte_order, cnpy_dtype dtype, size_t n_dim, const size_t * const dims, cnpy_ring *ring) {
+  assert(ring != NULL);
+  assert(n_dim >= 1);
+  if (dims[0] == 0) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "The capacity of a ring buffer must be positive");
+  }
+
+  cnpy_open_options opts;
+  cnpy_open_options_init(&opts);
+  size_t slack = strlen(CNPY_RING_TAG) + CNPY_RING_META_SIZE + 2;
+  cnpy_array arr;
+  cnpy_status status = cnpy_create_padded(fn, byte_order, dtype, CNPY_C_ORDER, n_dim, dims, slack, &opts, &arr);
+  if (status != CNPY_SUCCESS) {
+    return status;
+  }
+
+  /* the comment goes right after the dictionary, which contains no other '}' */
+  char *end = (char *) memchr(arr.raw_data, '}', arr.data_begin);
+  assert(end != NULL && (size_t) (end - arr.raw_data) + 2 + slack <= arr.data_begin);
+  memcpy(end + 2, CNPY_RING_TAG, strlen(CNPY_RING_TAG));
+
+  ring->arr = arr;
+  ring->meta = (size_t) (end + 2 - arr.raw_data) + strlen(CNPY_RING_TAG);
+  ring->row_size = cnpy_ring_row_size(arr);
+  char tmp[CNPY_RING_META_SIZE + 1];
+  snprintf(tmp, sizeof(tmp), "%0*d head=%0*d count=%0*d", CNPY_RING_DIGITS, 0, CNPY_RING_DIGITS, 0, CNPY_RING_DIGITS, 0);
+  memcpy(arr.raw_data + ring->meta, tmp, CNPY_RING_META_SIZE);
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Open the existing ring buffer fn; writable rings are mapped shared and writable, others read only (and shared),
+ * so readers see the rows pushed by a writer in another process.
+ * Returns CNPY_ERROR_FORMAT if fn is not a valid ring buffer.
+ */
+cnpy_status cnpy_ring_open(const char * const fn, bool writable, cnpy_ring *ring) {
+  assert(fn != NULL);
+  assert(ring != NULL);
+
+  cnpy_open_options opts;
+  cnpy_open_options_init(&opts);
+  opts.mode = writable? CNPY_MAP_WRITABLE : CNPY_MAP_READ_ONLY;
+  cnpy_ring tmp;
+  cnpy_status status = cnpy_open_ex(fn, &opts, &tmp.arr);
+  if (status != CNPY_SUCCESS) {
+    return status;
+  }
+
+  const char *end = (const char *) memchr(tmp.arr.raw_data, '}', tmp.arr.data_begin);
+  size_t n_tag = strlen(CNPY_RING_TAG);
+  size_t pos = (end != NULL)? (size_t) (end - tmp.arr.raw_data) + 2 : tmp.arr.data_begin;
+  size_t head, count;
+  bool ok = tmp.arr.order == CNPY_C_ORDER && pos + n_tag + CNPY_RING_META_SIZE < tmp.arr.data_begin;
+  ok = ok && memcmp(tmp.arr.raw_data + pos, CNPY_RING_TAG, n_tag) == 0;
+  ok = ok && memcmp(tmp.arr.raw_data + pos + n_tag + CNPY_RING_DIGITS, " head=", strlen(" head=")) == 0;
+  ok = ok && memcmp(tmp.arr.raw_data + pos + n_tag + 2 * CNPY_RING_DIGITS + strlen(" head="), " count=", strlen(" count=")) == 0;
+  if (ok) {
+    tmp.meta = pos + n_tag;
+    tmp.row_size = cnpy_ring_row_size(tmp.arr);
+    ok = cnpy_ring_load(&tmp, &head, &count);
+  }
+  if (!ok) {
+    cnpy_close(&tmp.arr); /* no point in checking for errors */
+    return cnpy_error(CNPY_ERROR_FORMAT, "Not a ring buffer, or its head and count are invalid");
+  }
+  *ring = tmp;
+  return CNPY_SUCCESS;
+}
+
+
+/* Close a ring buffer. */
+cnpy_status cnpy_ring_close(cnpy_ring *ring) {
+  assert(ring != NULL);
+  return cnpy_close(&ring->arr);
+}
+
+
+/* Number of rows in the ring. */
+size_t cnpy_ring_count(const cnpy_ring *ring) {
+  assert(ring != NULL);
+  size_t head, count;
+  return cnpy_ring_load(ring, &head, &count)? count : 0;
+}
+
+
+/*
+ * Push n rows (in host byte order) from rows to the ring, replacing the oldest rows once it is full.
+ * Takes time proportional to the size of the rows pushed (at most the capacity of the ring), not to the size of the ring.
+ */
+void cnpy_ring_push(cnpy_ring *ring, const void *rows, size_t n) {
+  assert(ring != NULL);
+  assert(rows != NULL || n == 0);
+  size_t capacity = ring->arr.dims[0];
+  size_t head, count;
+  bool ok = cnpy_ring_load(ring, &head, &count);
+  assert(ok);
+  (void) ok;
+  if (n == 0) {
+    return;
+  }
+
+  const char *src = (const char *) rows;
+  if (n >= capacity) {
+    /* only the last capacity rows remain */
+    src += (n - capacity) * ring->row_size;
+    n = capacity;
+    head = 0;
+    count = 0;
+  }
+  size_t row_elements = ring->row_size / cnpy_dtype_sizes[ring->arr.dtype];
+  size_t tail = (head + count) % capacity;
+  size_t n_first = (n < capacity - tail)? n : capacity - tail;
+  char *data = ring->arr.raw_data + ring->arr.data_begin;
+  cnpy_cpy_n(ring->arr, n_first * row_elements, src, data + tail * ring->row_size);
+  cnpy_cpy_n(ring->arr, (n - n_first) * row_elements, src + n_first * ring->row_size, data);
+
+  count += n;
+  if (count > capacity) {
+    head = (head + count - capacity) % capacity;
+    count = capacity;
+  }
+  cnpy_ring_store(ring, head, count);
+}
+
+
+/*
+ * Store the rows in the ring, oldest first, as at most two chunks in chunks[0] and chunks[1], and return their number.
+ * flat_start of a chunk is the flat index of its first element in the window (0 for the oldest element); its data is in the byte order of the array.
+ * Chunks point into the mapping, so they may be overwritten by later pushes.
+ */
+size_t cnpy_ring_window(const cnpy_ring *ring, cnpy_chunk *chunks) {
+  assert(ring != NULL);
+  assert(chunks != NULL);
+  size_t head, count;
+  if (!cnpy_ring_load(ring, &head, &count) || count == 0) {
+    return 0;
+  }
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+  size_t capacity = ring->arr.dims[0];
+  size_t row_elements = ring->row_size / cnpy_dtype_sizes[ring->arr.dtype];
+  size_t n_first = (count < capacity - head)? count : capacity - head;
+  char *data = ring->arr.raw_data + ring->arr.data_begin;
+  chunks[0].data = data + head * ring->row_size;
+  chunks[0].flat_start = 0;
+  chunks[0].length = n_first * row_elements;
+  if (n_first == count) {
+    return 1;
+  }
+  chunks[1].data = data;
+  chunks[1].flat_start = chunks[0].length;
+  chunks[1].length = (count - n_first) * row_elements;
+  return 2;
+}
+
+
+/*
+ * Following growing files
+ *
+ * A cnpy_follow watches a C order .npy file which another process grows along the first axis (e. g. with cnpy_append_rows()),
+ * and hands out the rows appended since the last poll.
+ * Only the header is parsed again when the file grows. The file may be larger than its shape says (rows written, but not yet committed to the header).
+ * The mapping lives in an address range reserved at opening, and each poll maps only the pages the file has grown by,
+ * so rows handed out earlier stay where they are (unless the file outgrows the reservation).
+ * Changes are detected with inotify on Linux, and by checking the file size every CNPY_FOLLOW_INTERVAL_MS elsewhere.
+ */
+
+
+#ifndef CNPY_FOLLOW_RESERVE
+#define CNPY_FOLLOW_RESERVE ((sizeof(size_t) >= 8)? (size_t) 1 << 40 : (size_t) 1 << 28) /* address space reserved for the mapping */
+#endif
+
+
+#ifndef CNPY_FOLLOW_INTERVAL_MS
+#define CNPY_FOLLOW_INTERVAL_MS 10 /* interval of checking the file without inotify, or while a header is not committed */
+#endif
+
+
+typedef struct {
+  cnpy_array arr; /* the array up to the rows committed at the last poll; arr.fd is the file, arr.map_size the mapped part of the reservation */
+  size_t reserved; /* bytes of address space reserved at arr.raw_data */
+  size_t file_size; /* size of the file at the last poll */
+  size_t row_size; /* bytes per row */
+  int inotify_fd; /* -1 if inotify is not used */
+} cnpy_follow;
+
+
+/* Reserve reserve bytes of address space, and map the first map_size bytes of fd there. */
+static cnpy_status cnpy_follow_reserve(int fd, size_t reserve, size_t map_size, char **raw_data) {
+  void *p = mmap(NULL, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    return cnpy_error(CNPY_ERROR_MMAP, "Could not reserve address space: %s", strerror(errno));
+  }
+  if (map_size > 0 && mmap(p, map_size, PROT_READ, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    int err = errno;
+    munmap(p, reserve); /* no point in checking for errors */
+    return cnpy_error(CNPY_ERROR_MMAP, "mmap() of file failed: %s", strerror(err));
+  }
+  *raw_data = (char *) p;
+  return CNPY_SUCCESS;
+}
+
+
+/* Map the file of f up to file_size; only the pages it has grown by are mapped, unless it outgrows the reservation. */
+static cnpy_status cnpy_follow_map(cnpy_follow *f, size_t file_size) {
+  size_t page = (size_t) sysconf(_SC_PAGESIZE);
+  if (file_size > SIZE_MAX - page) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "File is too large");
+  }
+  size_t map_size = (file_size + page - 1) / page * page;
+  if (map_size <= f->arr.map_size) {
+    return CNPY_SUCCESS;
+  }
+  if (map_size <= f->reserved) {
+    /* map_size is a multiple of the page size, so the offset is aligned */
+    void *p = mmap(f->arr.raw_data + f->arr.map_size, map_size - f->arr.map_size, PROT_READ, MAP_SHARED | MAP_FIXED, f->arr.fd, (off_t) f->arr.map_size);
+    if (p == MAP_FAILED) {
+      return cnpy_error(CNPY_ERROR_MMAP, "mmap() of file failed: %s", strerror(errno));
+    }
+  }
+  else {
+    size_t reserved = (map_size < SIZE_MAX / 2)? 2 * map_size : map_size;
+    char *raw_data;
+    cnpy_status status = cnpy_follow_reserve(f->arr.fd, reserved, map_size, &raw_data);
+    if (status != CNPY_SUCCESS) {
+      return status;
+    }
+    munmap(f->arr.raw_data, f->reserved); /* no point in checking for errors */
+    f->arr.raw_data = raw_data;
+    f->reserved = reserved;
+  }
+  f->arr.map_size = map_size;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Parse the header in the first file_size bytes of the mapping of f into *arr, through a copy.
+ * The writer may rewrite the header at any time, so the copy is compared to the mapping afterwards;
+ * returns false (with CNPY_SUCCESS in *status) if it changed in between.
+ */
+static bool cnpy_follow_header(const cnpy_follow *f, size_t file_size, cnpy_array *arr, cnpy_status *status) {
+  char header[CNPY_READER_MAX_HEADER];
+  size_t n = (f->arr.data_begin > 0)? f->arr.data_begin : CNPY_READER_MAX_HEADER;
+  n = (n < file_size)? n : file_size;
+  memcpy(header, f->arr.raw_data, n);
+  *status = cnpy_parse_metadata(header, n, arr);
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if (memcmp(header, f->arr.raw_data, n) != 0) {
+    *status = CNPY_SUCCESS;
+    return false;
+  }
+  if (*status != CNPY_SUCCESS) {
+    return false;
+  }
+  arr->raw_data = f->arr.raw_data;
+  arr->map_size = f->arr.map_size;
+  arr->fd = f->arr.fd;
+  arr->read_only = true;
+  if (arr->order != CNPY_C_ORDER) {
+    *status = cnpy_error(CNPY_ERROR_FORMAT, "Only C order arrays can be followed");
+    return false;
+  }
+  size_t row_size, raw_data_size;
+  if (!cnpy_grow_size(arr, arr->dims[0], &row_size, &raw_data_size)) {
+    *status = cnpy_error(CNPY_ERROR_FORMAT, "Size of data overflows");
+    return false;
+  }
+  if (raw_data_size > file_size) {
+    *status = cnpy_error(CNPY_ERROR_FORMAT, "File has %zu bytes, but the header requires %zu", file_size, raw_data_size);
+    return false;
+  }
+  arr->raw_data_size = raw_data_size;
+  return true;
+}
+
+
+/* Current size of the file of f. */
+static cnpy_status cnpy_follow_file_size(const cnpy_follow *f, size_t *file_size) {
+  struct stat st;
+  if (fstat(f->arr.fd, &st) != 0) {
+    return cnpy_error(CNPY_ERROR_FILE, "fstat() failed: %s", strerror(errno));
+  }
+  *file_size = (size_t) st.st_size;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Start following the C order .npy file fn, which must have a valid header; the rows in the file when it is opened are in follow->arr.
+ * On failure, *follow is not changed.
+ */
+cnpy_status cnpy_follow_open(const char * const fn, cnpy_follow *follow) {
+  assert(fn != NULL);
+  assert(follow != NULL);
+
+  cnpy_follow f;
+  f.arr.fd = open(fn, O_RDONLY);
+  if (f.arr.fd == -1) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not open file: %s", strerror(errno));
+  }
+  f.arr.raw_data = NULL;
+  f.arr.data_begin = 0;
+  f.arr.map_size = 0;
+  f.reserved = 0;
+  f.inotify_fd = -1;
+
+  size_t file_size = 0;
+  cnpy_status status = cnpy_follow_file_size(&f, &file_size);
+  if (status == CNPY_SUCCESS) {
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    if (file_size > SIZE_MAX - page) {
+      status = cnpy_error(CNPY_ERROR_FORMAT, "File is too large");
+    }
+    else {
+      /* large files get room to double, as in cnpy_follow_map() */
+      size_t map_size = (file_size + page - 1) / page * page;
+      size_t reserve = (file_size < CNPY_FOLLOW_RESERVE / 2)? CNPY_FOLLOW_RESERVE : ((map_size < SIZE_MAX / 2)? 2 * map_size : map_size);
+      status = cnpy_follow_reserve(f.arr.fd, reserve, map_size, &f.arr.raw_data);
+      f.arr.map_size = map_size;
+      f.reserved = reserve;
+    }
+  }
+  if (status == CNPY_SUCCESS) {
+    /* the writer rewrites the header quickly, so a stable copy is found after a few attempts */
+    cnpy_array arr;
+    bool stable = false;
+    for (int i = 0; i < 1000 && status == CNPY_SUCCESS && !stable; i += 1) {
+      stable = cnpy_follow_header(&f, file_size, &arr, &status);
+    }
+    if (status == CNPY_SUCCESS && !stable) {
+      status = cnpy_error(CNPY_ERROR_FORMAT, "The header keeps changing");
+    }
+    if (status == CNPY_SUCCESS) {
+      f.arr = arr;
+      f.file_size = file_size;
+      size_t raw_data_size;
+      cnpy_grow_size(&arr, 0, &f.row_size, &raw_data_size);
+    }
+  }
+  if (status != CNPY_SUCCESS) {
+    if (f.arr.raw_data != NULL) {
+      munmap(f.arr.raw_data, f.reserved); /* no point in checking for errors */
+    }
+    close(f.arr.fd);
+    return status;
+  }
+
+#ifdef CNPY_INOTIFY
+  /* without inotify, the file is checked periodically */
+  f.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (f.inotify_fd != -1 && inotify_add_watch(f.inotify_fd, fn, IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE) == -1) {
+    close(f.inotify_fd);
+    f.inotify_fd = -1;
+  }
+#endif
+  *follow = f;
+  return CNPY_SUCCESS;
+}
+
+
+/* Check the file of f once; see cnpy_follow_poll(). */
+static cnpy_status cnpy_follow_check(cnpy_follow *f, cnpy_chunk *rows) {
+  size_t row_elements = f->row_size / cnpy_dtype_sizes[f->arr.dtype];
+  rows->data = f->arr.raw_data + f->arr.raw_data_size;
+  rows->flat_start = f->arr.dims[0] * row_elements;
+  rows->length = 0;
+
+  size_t file_size = 0;
+  cnpy_status status = cnpy_follow_file_size(f, &file_size);
+  if (status != CNPY_SUCCESS) {
+    return status;
+  }
+  if (file_size < f->arr.raw_data_size) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "File shrank from %zu to %zu bytes", f->arr.raw_data_size, file_size);
+  }
+  if (file_size == f->arr.raw_data_size) {
+    /* the shape cannot grow without the file */
+    f->file_size = file_size;
+    return CNPY_SUCCESS;
+  }
+  if (file_size != f->file_size) {
+    status = cnpy_follow_map(f, file_size);
+    if (status != CNPY_SUCCESS) {
+      return status;
+    }
+    f->file_size = file_size;
+    rows->data = f->arr.raw_data + f->arr.raw_data_size; /* the mapping moves if the file outgrows the reservation */
+  }
+
+  cnpy_array arr;
+  if (!cnpy_follow_header(f, file_size, &arr, &status)) {
+    return status; /* the header is being rewritten; the next poll sees it */
+  }
+  bool same = arr.byte_order == f->arr.byte_order && arr.dtype == f->arr.dtype && arr.n_dim == f->arr.n_dim && arr.data_begin == f->arr.data_begin;
+  for (size_t i = 1; same && i < arr.n_dim; i += 1) {
+    same = arr.dims[i] == f->arr.dims[i];
+  }
+  if (!same || arr.dims[0] < f->arr.dims[0]) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "The header changed other than by growing along the first axis");
+  }
+
+  rows->length = (arr.dims[0] - f->arr.dims[0]) * row_elements;
+  f->arr.dims[0] = arr.dims[0];
+  f->arr.raw_data_size = arr.raw_data_size;
+  return CNPY_SUCCESS;
+}
+
+
+/* Wait until the file of f may have changed, for at most timeout_ms milliseconds. */
+static void cnpy_follow_sleep(cnpy_follow *f, long timeout_ms) {
+  bool pending = f->file_size > f->arr.raw_data_size; /* rows are written, but the header is not; rewriting it through a mapping raises no event */
+#ifdef CNPY_INOTIFY
+  if (f->inotify_fd != -1 && !pending) {
+    struct pollfd pfd;
+    pfd.fd = f->inotify_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, (timeout_ms < 1000)? (int) timeout_ms : 1000) > 0) {
+      char events[4096];
+      while (read(f->inotify_fd, events, sizeof(events)) > 0) {
+        /* drain the events; which of them arrived does not matter */
+      }
+    }
+    return;
+  }
+#endif
+  (void) pending;
+  long ms = (timeout_ms < CNPY_FOLLOW_INTERVAL_MS)? timeout_ms : CNPY_FOLLOW_INTERVAL_MS;
+  struct timespec ts;
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (ms % 1000) * 1000000;
+  nanosleep(&ts, NULL);
+}
+
+
+static int64_t cnpy_follow_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/*
+ * Store the rows committed to the file since the last poll in *rows, waiting for at most timeout_ms milliseconds (-1: indefinitely) if there are none.
+ * rows->flat_start is the flat index of the first new element in the array, and rows->length is 0 on timeout; the data is in the byte order of the array.
+ * The new rows stay valid until follow is closed, unless the file outgrows the reservation (see CNPY_FOLLOW_RESERVE), which moves follow->arr.raw_data.
+ * Returns an error if the file shrinks, or its header changes other than by growing along the first axis.
+ */
+cnpy_status cnpy_follow_poll(cnpy_follow *follow, long timeout_ms, cnpy_chunk *rows) {
+  assert(follow != NULL && follow->arr.raw_data != NULL);
+  assert(rows != NULL);
+
+  int64_t deadline = (timeout_ms > 0)? cnpy_follow_now_ms() + timeout_ms : 0;
+  for (;;) {
+    cnpy_status status = cnpy_follow_check(follow, rows);
+    if (status != CNPY_SUCCESS || rows->length > 0 || timeout_ms == 0) {
+      return status;
+    }
+    long remaining = (timeout_ms > 0)? (long) (deadline - cnpy_follow_now_ms()) : 1000;
+    if (remaining <= 0) {
+      return CNPY_SUCCESS;
+    }
+    cnpy_follow_sleep(follow, remaining);
+  }
+}
+
+
+/* Stop following; the rows handed out become invalid. */
+cnpy_status cnpy_follow_close(cnpy_follow *follow) {
+  assert(follow != NULL && follow->arr.raw_data != NULL);
+
+#ifdef CNPY_INOTIFY
+  if (follow->inotify_fd != -1) {
+    close(follow->inotify_fd); /* no point in checking for errors */
+    follow->inotify_fd = -1;
+  }
+#endif
+  if (munmap(follow->arr.raw_data, follow->reserved) != 0) {
+    return cnpy_error(CNPY_ERROR_MMAP, "munmap() failed: %s", strerror(errno));
+  }
+  follow->arr.raw_data = NULL;
+  int fd = follow->arr.fd;
+  follow->arr.fd = -1;
+  if (close(fd) != 0) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not close file: %s", strerror(errno));
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Archives
+ *
+ * A cnpy_npz is a .npz archive (as written by numpy.savez()), mapped once; the members are arrays in place in the mapping, so nothing is extracted or copied.
+ * Opening the archive reads the central directory of the zip file into an index (a hash table by name, in an anonymous mapping),
+ * so looking up a member takes constant time. Zip64 archives are supported.
+ * Stored (uncompressed) members are used in place; their data is generally not aligned.
+ * Deflated members (numpy.savez_compressed()) are decompressed once into anonymous mappings owned by the archive, see "Compressed archives" below.
+ */
+
+
+typedef struct {
+  const char *name; /* the name in the central directory; not \0-terminated */
+  size_t name_len;
+  size_t local_offset; /* offset of the local file header */
+  size_t size; /* compressed size */
+  size_t uncompressed_size;
+  uint16_t method; /* compression method; 0 means stored, 8 deflated */
+  uint16_t flags; /* general purpose flags */
+  uint32_t crc; /* CRC-32 of the uncompressed member */
+  char *decoded; /* a deflated member, decompressed into an anonymous mapping of uncompressed_size bytes, or NULL */
+} cnpy_npz_member;
+
+
+typedef struct {
+  char *raw_data; /* the mapped archive */
+  size_t raw_data_size;
+  size_t map_size;
+  size_t n_members; /* number of members */
+  cnpy_npz_member *members; /* the index, in the order of the central directory */
+  size_t *slots; /* hash table of n_slots entries: 1 + the index of a member, or 0 if empty */
+  size_t n_slots; /* a power of two */
+  size_t index_size; /* size of the anonymous mapping at members */
+} cnpy_npz;
+
+
+static uint16_t cnpy_zip_u16(const char *p) {
+  const uint8_t *q = (const uint8_t *) p;
+  return (uint16_t) (q[0] | q[1] << 8);
+}
+
+
+static uint32_t cnpy_zip_u32(const char *p) {
+  const uint8_t *q = (const uint8_t *) p;
+  return (uint32_t) q[0] | (uint32_t) q[1] << 8 | (uint32_t) q[2] << 16 | (uint32_t) q[3] << 24;
+}
+
+
+static uint64_t cnpy_zip_u64(const char *p) {
+  return (uint64_t) cnpy_zip_u32(p) | (uint64_t) cnpy_zip_u32(p + 4) << 32;
+}
+
+
+/* Length of name without a final ".npy", which numpy.savez() appends to the names of the arrays. */
+static size_t cnpy_npz_key_len(const char *name, size_t name_len) {
+  return (name_len >= 4 && memcmp(name + name_len - 4, ".npy", 4) == 0)? name_len - 4 : name_len;
+}
+
+
+/* FNV-1a */
+static size_t cnpy_npz_hash(const char *key, size_t key_len) {
+  uint64_t h = 14695981039346656037u;
+  for (size_t i = 0; i < key_len; i += 1) {
+    h = (h ^ (uint8_t) key[i]) * 1099511628211u;
+  }
+  return (size_t) h;
+}
+
+
+/* Find the central directory of the zip file of size bytes at raw: its offset, size, and number of entries. */
+static cnpy_status cnpy_zip_find_directory(const char *raw, size_t size, size_t *cd_offset, size_t *cd_size, size_t *n_entries) {
+  /* the end of central directory record is at the end, followed by a comment of at most 65535 bytes */
+  if (size < 22) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "File is too short to be a zip archive");
+  }
+  size_t eocd = size - 22;
+  size_t lowest = (size - 22 > 65535)? size - 22 - 65535 : 0;
+  while (cnpy_zip_u32(raw + eocd) != 0x06054b50 || eocd + 22 + cnpy_zip_u16(raw + eocd + 20) != size) {
+    if (eocd == lowest) {
+      return cnpy_error(CNPY_ERROR_FORMAT, "No end of central directory record; not a zip archive");
+    }
+    eocd -= 1;
+  }
+  if (cnpy_zip_u16(raw + eocd + 4) != 0 || cnpy_zip_u16(raw + eocd + 6) != 0) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Multi-disk zip archives are not supported");
+  }
+  uint64_t n = cnpy_zip_u16(raw + eocd + 10);
+  uint64_t cd_sz = cnpy_zip_u32(raw + eocd + 12);
+  uint64_t cd_off = cnpy_zip_u32(raw + eocd + 16);
+
+  /* Zip64: the locator precedes the record, and points to the zip64 end of central directory record */
+  if (eocd >= 20 && cnpy_zip_u32(raw + eocd - 20) == 0x07064b50) {
+    uint64_t off = cnpy_zip_u64(raw + eocd - 20 + 8);
+    if (size < 56 || off > size - 56 || cnpy_zip_u32(raw + off) != 0x06064b50) {
+      return cnpy_error(CNPY_ERROR_FORMAT, "Invalid zip64 end of central directory record");
+    }
+    n = cnpy_zip_u64(raw + off + 32);
+    cd_sz = cnpy_zip_u64(raw + off + 40);
+    cd_off = cnpy_zip_u64(raw + off + 48);
+  }
+  if (cd_off > size || cd_sz > size - cd_off || n > cd_sz / 46) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Central directory out of bounds");
+  }
+  *cd_offset = (size_t) cd_off;
+  *cd_size = (size_t) cd_sz;
+  *n_entries = (size_t) n;
+  return CNPY_SUCCESS;
+}
+
+
+/* Parse the central directory entry at raw[pos, end) into *m, and advance pos past it. */
+static cnpy_status cnpy_zip_parse_entry(const char *raw, size_t *pos, size_t end, cnpy_npz_member *m) {
+  const char *p = raw + *pos;
+  if (end - *pos < 46 || cnpy_zip_u32(p) != 0x02014b50) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Invalid central directory entry at offset %zu", *pos);
+  }
+  size_t name_len = cnpy_zip_u16(p + 28);
+  size_t extra_len = cnpy_zip_u16(p + 30);
+  size_t comment_len = cnpy_zip_u16(p + 32);
+  if (end - *pos - 46 < name_len + extra_len + comment_len) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Central directory entry at offset %zu is truncated", *pos);
+  }
+  uint64_t size = cnpy_zip_u32(p + 20);
+  uint64_t uncompressed_size = cnpy_zip_u32(p + 24);
+  uint64_t local_offset = cnpy_zip_u32(p + 42);
+
+  /* the zip64 extra field holds those of the sizes and the offset which do not fit, in this order */
+  const char *extra = p + 46 + name_len;
+  for (size_t i = 0; i + 4 <= extra_len; ) {
+    size_t id = cnpy_zip_u16(extra + i);
+    size_t len = cnpy_zip_u16(extra + i + 2);
+    if (len > extra_len - i - 4) {
+      break;
+    }
+    if (id == 0x0001) {
+      const char *q = extra + i + 4;
+      const char *q_end = q + len;
+      uint64_t *fields[] = { &uncompressed_size, &size, &local_offset };
+      for (size_t k = 0; k < 3; k += 1) {
+        if (*fields[k] == 0xffffffffu) {
+          if (q_end - q < 8) {
+            return cnpy_error(CNPY_ERROR_FORMAT, "Zip64 extra field too short");
+          }
+          *fields[k] = cnpy_zip_u64(q);
+          q += 8;
+        }
+      }
+    }
+    i += 4 + len;
+  }
+  if (size > SIZE_MAX || uncompressed_size > SIZE_MAX || local_offset > SIZE_MAX) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Member too large");
+  }
+
+  m->name = p + 46;
+  m->name_len = name_len;
+  m->local_offset = (size_t) local_offset;
+  m->size = (size_t) size;
+  m->uncompressed_size = (size_t) uncompressed_size;
+  m->method = cnpy_zip_u16(p + 10);
+  m->flags = cnpy_zip_u16(p + 8);
+  m->crc = cnpy_zip_u32(p + 16);
+  m->decoded = NULL;
+  *pos += 46 + name_len + extra_len + comment_len;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Open the .npz archive fn, and index its members.
+ * As with cnpy_open(fn, false, ...), the archive is mapped privately, so the arrays can be written to without changing the file.
+ * On failure, *npz is not changed.
+ */
+cnpy_status cnpy_npz_open(const char * const fn, cnpy_npz *npz) {
+  assert(fn != NULL);
+  assert(npz != NULL);
+
+  int fd = open(fn, O_RDONLY);
+  if (fd == -1) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not open file: %s", strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    close(fd);
+    return cnpy_error(CNPY_ERROR_FILE, "fstat() failed: %s", strerror(err));
+  }
+  size_t size = (size_t) st.st_size;
+  if (size == 0) {
+    close(fd);
+    return cnpy_error(CNPY_ERROR_FORMAT, "Empty file");
+  }
+  void *raw = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd); /* the mapping keeps the file */
+  if (raw == MAP_FAILED) {
+    return cnpy_error(CNPY_ERROR_MMAP, "mmap() of file failed: %s", strerror(errno));
+  }
+
+  cnpy_npz tmp;
+  tmp.raw_data = (char *) raw;
+  tmp.raw_data_size = size;
+  tmp.map_size = size;
+  tmp.members = NULL;
+  tmp.index_size = 0;
+  size_t cd_offset = 0, cd_size = 0, n = 0;
+  cnpy_status status = cnpy_zip_find_directory(tmp.raw_data, size, &cd_offset, &cd_size, &n);
+
+  if (status == CNPY_SUCCESS) {
+    /* the hash table is at most half full */
+    tmp.n_members = n;
+    tmp.n_slots = 1;
+    while (tmp.n_slots < 2 * n) {
+      tmp.n_slots *= 2;
+    }
+    tmp.index_size = n * sizeof(cnpy_npz_member) + tmp.n_slots * sizeof(size_t);
+    void *index = mmap(NULL, tmp.index_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (index == MAP_FAILED) {
+      status = cnpy_error(CNPY_ERROR_MMAP, "Could not allocate the index: %s", strerror(errno));
+    }
+    else {
+      tmp.members = (cnpy_npz_member *) index;
+      tmp.slots = (size_t *) (tmp.members + n); /* anonymous mappings are zero */
+    }
+  }
+  size_t pos = cd_offset;
+  for (size_t i = 0; status == CNPY_SUCCESS && i < n; i += 1) {
+    cnpy_npz_member *m = &tmp.members[i];
+    status = cnpy_zip_parse_entry(tmp.raw_data, &pos, cd_offset + cd_size, m);
+    if (status == CNPY_SUCCESS) {
+      size_t key_len = cnpy_npz_key_len(m->name, m->name_len);
+      size_t s = cnpy_npz_hash(m->name, key_len) & (tmp.n_slots - 1);
+      while (tmp.slots[s] != 0) {
+        s = (s + 1) & (tmp.n_slots - 1);
+      }
+      tmp.slots[s] = i + 1;
+    }
+  }
+
+  if (status != CNPY_SUCCESS) {
+    if (tmp.members != NULL) {
+      munmap(tmp.members, tmp.index_size); /* no point in checking for errors */
+    }
+    munmap(raw, size);
+    return status;
+  }
+  *npz = tmp;
+  return CNPY_SUCCESS;
+}
+
+
+/* Close an archive; the arrays obtained from it become invalid. */
+cnpy_status cnpy_npz_close(cnpy_npz *npz) {
+  assert(npz != NULL && npz->raw_data != NULL);
+
+  for (size_t i = 0; npz->members != NULL && i < npz->n_members; i += 1) {
+    if (npz->members[i].decoded != NULL) {
+      munmap(npz->members[i].decoded, npz->members[i].uncompressed_size); /* no point in checking for errors */
+    }
+  }
+  if (npz->members != NULL && munmap(npz->members, npz->index_size) != 0) {
+    return cnpy_error(CNPY_ERROR_MMAP, "munmap() failed: %s", strerror(errno));
+  }
+  npz->members = NULL;
+  if (munmap(npz->raw_data, npz->map_size) != 0) {
+    return cnpy_error(CNPY_ERROR_MMAP, "munmap() failed: %s", strerror(errno));
+  }
+  npz->raw_data = NULL;
+  return CNPY_SUCCESS;
+}
+
+
+/* Name of the i-th member of npz (as stored, e. g. "x.npy"), which is not \0-terminated and has *len bytes. */
+const char *cnpy_npz_name(const cnpy_npz *npz, size_t i, size_t *len) {
+  assert(npz != NULL);
+  assert(i < npz->n_members);
+  assert(len != NULL);
+  *len = npz->members[i].name_len;
+  return npz->members[i].name;
+}
+
+
+/* Index of the member called name (with or without ".npy"), or SIZE_MAX if there is none. */
+static size_t cnpy_npz_find(const cnpy_npz *npz, const char *name) {
+  size_t key_len = cnpy_npz_key_len(name, strlen(name));
+  size_t s = cnpy_npz_hash(name, key_len) & (npz->n_slots - 1);
+  for (; npz->slots[s] != 0; s = (s + 1) & (npz->n_slots - 1)) {
+    const cnpy_npz_member *m = &npz->members[npz->slots[s] - 1];
+    if (cnpy_npz_key_len(m->name, m->name_len) == key_len && memcmp(m->name, name, key_len) == 0) {
+      return npz->slots[s] - 1;
+    }
+  }
+  return SIZE_MAX;
+}
+
+
+/* Offset of the data of the member m of npz, after its local file header; false if that is invalid. */
+static bool cnpy_npz_member_data(const cnpy_npz *npz, const cnpy_npz_member *m, size_t *begin) {
+  /* the local file header may have a different extra field than the central directory (e. g. zip64 sizes) */
+  if (npz->raw_data_size < 30 || m->local_offset > npz->raw_data_size - 30 || cnpy_zip_u32(npz->raw_data + m->local_offset) != 0x04034b50) {
+    return false;
+  }
+  const char *p = npz->raw_data + m->local_offset;
+  *begin = m->local_offset + 30 + cnpy_zip_u16(p + 26) + cnpy_zip_u16(p + 28);
+  return *begin <= npz->raw_data_size && m->size <= npz->raw_data_size - *begin;
+}
+
+
+static int cnpy_npz_inflate_member(const cnpy_npz *, size_t);
+
+
+/* Store the i-th member of npz in *arr, decompressing it if necessary; see cnpy_npz_get(). */
+cnpy_status cnpy_npz_get_at(const cnpy_npz *npz, size_t i, cnpy_array *arr) {
+  assert(npz != NULL && npz->raw_data != NULL);
+  assert(i < npz->n_members);
+  assert(arr != NULL);
+
+  const cnpy_npz_member *m = &npz->members[i];
+  if (m->flags & 1) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Encrypted members are not supported");
+  }
+  const char *data;
+  size_t begin;
+  if (m->method == 8) {
+    int err = cnpy_npz_inflate_member(npz, i);
+    if (err != 0) {
+      return (err > 0)? cnpy_error(CNPY_ERROR_MMAP, "Could not map memory for decompression: %s", strerror(err)) : cnpy_error(CNPY_ERROR_FORMAT, "Invalid compressed data");
+    }
+    data = __atomic_load_n(&m->decoded, __ATOMIC_ACQUIRE);
+  }
+  else if (m->method != 0) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Compression method %d is not supported", (int) m->method);
+  }
+  else if (m->size != m->uncompressed_size) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Stored member with different compressed and uncompressed size");
+  }
+  else if (!cnpy_npz_member_data(npz, m, &begin)) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Invalid local file header at offset %zu", m->local_offset);
+  }
+  else {
+    data = npz->raw_data + begin;
+  }
+
+  cnpy_array tmp;
+  cnpy_status status = cnpy_parse(data, m->uncompressed_size, &tmp);
+  if (status != CNPY_SUCCESS) {
+    return status;
+  }
+  *arr = tmp;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Store the member called name (with or without ".npy") of npz in *arr, which points directly at its data in the mapping of the archive
+ * (or, for a deflated member, at the data decompressed by the first call).
+ * The array must not be closed; it is valid until the archive is closed.
+ * Returns CNPY_ERROR_FILE if there is no such member. On failure, *arr is not changed.
+ */
+cnpy_status cnpy_npz_get(const cnpy_npz *npz, const char * const name, cnpy_array *arr) {
+  assert(npz != NULL && npz->raw_data != NULL);
+  assert(name != NULL);
+
+  size_t i = cnpy_npz_find(npz, name);
+  if (i == SIZE_MAX) {
+    return cnpy_error(CNPY_ERROR_FILE, "No member named %s", name);
+  }
+  return cnpy_npz_get_at(npz, i, arr);
+}
+
+
+/*
+ * Compressed archives
+ *
+ * Deflate (RFC 1951) is implemented here, so no compression library is needed.
+ * The decoder is table driven: codes of at most CNPY_INFLATE_FAST_BITS bits are decoded with a single lookup.
+ * Deflated members can be decompressed all at once (into anonymous mappings, several members in parallel), or streamed into caller buffers through a window of bounded size.
+ * The encoder uses a hash table of recent 4-byte sequences for LZ77 matching and the fixed Huffman code;
+ * blocks which would grow are stored instead. It favours speed over the compression ratio.
+ */
+
+
+#define CNPY_INFLATE_FAST_BITS 9
+#define CNPY_DEFLATE_BLOCK (1 << 15) /* input bytes per block written by the encoder */
+#define CNPY_DEFLATE_HASH_BITS 15
+#define CNPY_DEFLATE_STORED_STEP (1 << 13) /* granularity of stored blocks for incompressible data */
+
+
+#ifndef CNPY_NPZ_STREAM_BUFFER
+#define CNPY_NPZ_STREAM_BUFFER (1 << 17) /* window of a cnpy_npz_stream; at least 64 KiB */
+#endif
+#if CNPY_NPZ_STREAM_BUFFER < (1 << 16)
+#error "CNPY_NPZ_STREAM_BUFFER must hold the history of 32 KiB and more"
+#endif
+
+
+static const uint16_t cnpy_deflate_length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t cnpy_deflate_length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t cnpy_deflate_dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t cnpy_deflate_dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+
+/* CRC-32 of each byte, with the reversed polynomial 0xedb88320 */
+static const uint32_t cnpy_crc32_table[256] = {
+  0x00000000u, 0x77073096u, 0xee0e612cu, 0x990951bau, 0x076dc419u, 0x706af48fu, 0xe963a535u, 0x9e6495a3u,
+  0x0edb8832u, 0x79dcb8a4u, 0xe0d5e91eu, 0x97d2d988u, 0x09b64c2bu, 0x7eb17cbdu, 0xe7b82d07u, 0x90bf1d91u,
+  0x1db71064u, 0x6ab020f2u, 0xf3b97148u, 0x84be41deu, 0x1adad47du, 0x6ddde4ebu, 0xf4d4b551u, 0x83d385c7u,
+  0x136c9856u, 0x646ba8c0u, 0xfd62f97au, 0x8a65c9ecu, 0x14015c4fu, 0x63066cd9u, 0xfa0f3d63u, 0x8d080df5u,
+  0x3b6e20c8u, 0x4c69105eu, 0xd56041e4u, 0xa2677172u, 0x3c03e4d1u, 0x4b04d447u, 0xd20d85fdu, 0xa50ab56bu,
+  0x35b5a8fau, 0x42b2986cu, 0xdbbbc9d6u, 0xacbcf940u, 0x32d86ce3u, 0x45df5c75u, 0xdcd60dcfu, 0xabd13d59u,
+  0x26d930acu, 0x51de003au, 0xc8d75180u, 0xbfd06116u, 0x21b4f4b5u, 0x56b3c423u, 0xcfba9599u, 0xb8bda50fu,
+  0x2802b89eu, 0x5f058808u, 0xc60cd9b2u, 0xb10be924u, 0x2f6f7c87u, 0x58684c11u, 0xc1611dabu, 0xb6662d3du,
+  0x76dc4190u, 0x01db7106u, 0x98d220bcu, 0xefd5102au, 0x71b18589u, 0x06b6b51fu, 0x9fbfe4a5u, 0xe8b8d433u,
+  0x7807c9a2u, 0x0f00f934u, 0x9609a88eu, 0xe10e9818u, 0x7f6a0dbbu, 0x086d3d2du, 0x91646c97u, 0xe6635c01u,
+  0x6b6b51f4u, 0x1c6c6162u, 0x856530d8u, 0xf262004eu, 0x6c0695edu, 0x1b01a57bu, 0x8208f4c1u, 0xf50fc457u,
+  0x65b0d9c6u, 0x12b7e950u, 0x8bbeb8eau, 0xfcb9887cu, 0x62dd1ddfu, 0x15da2d49u, 0x8cd37cf3u, 0xfbd44c65u,
+  0x4db26158u, 0x3ab551ceu, 0xa3bc0074u, 0xd4bb30e2u, 0x4adfa541u, 0x3dd895d7u, 0xa4d1c46du, 0xd3d6f4fbu,
+  0x4369e96au, 0x346ed9fcu, 0xad678846u, 0xda60b8d0u, 0x44042d73u, 0x33031de5u, 0xaa0a4c5fu, 0xdd0d7cc9u,
+  0x5005713cu, 0x270241aau, 0xbe0b1010u, 0xc90c2086u, 0x5768b525u, 0x206f85b3u, 0xb966d409u, 0xce61e49fu,
+  0x5edef90eu, 0x29d9c998u, 0xb0d09822u, 0xc7d7a8b4u, 0x59b33d17u, 0x2eb40d81u, 0xb7bd5c3bu, 0xc0ba6cadu,
+  0xedb88320u, 0x9abfb3b6u, 0x03b6e20cu, 0x74b1d29au, 0xead54739u, 0x9dd277afu, 0x04db2615u, 0x73dc1683u,
+  0xe3630b12u, 0x94643b84u, 0x0d6d6a3eu, 0x7a6a5aa8u, 0xe40ecf0bu, 0x9309ff9du, 0x0a00ae27u, 0x7d079eb1u,
+  0xf00f9344u, 0x8708a3d2u, 0x1e01f268u, 0x6906c2feu, 0xf762575du, 0x806567cbu, 0x196c3671u, 0x6e6b06e7u,
+  0xfed41b76u, 0x89d32be0u, 0x10da7a5au, 0x67dd4accu, 0xf9b9df6fu, 0x8ebeeff9u, 0x17b7be43u, 0x60b08ed5u,
+  0xd6d6a3e8u, 0xa1d1937eu, 0x38d8c2c4u, 0x4fdff252u, 0xd1bb67f1u, 0xa6bc5767u, 0x3fb506ddu, 0x48b2364bu,
+  0xd80d2bdau, 0xaf0a1b4cu, 0x36034af6u, 0x41047a60u, 0xdf60efc3u, 0xa867df55u, 0x316e8eefu, 0x4669be79u,
+  0xcb61b38cu, 0xbc66831au, 0x256fd2a0u, 0x5268e236u, 0xcc0c7795u, 0xbb0b4703u, 0x220216b9u, 0x5505262fu,
+  0xc5ba3bbeu, 0xb2bd0b28u, 0x2bb45a92u, 0x5cb36a04u, 0xc2d7ffa7u, 0xb5d0cf31u, 0x2cd99e8bu, 0x5bdeae1du,
+  0x9b64c2b0u, 0xec63f226u, 0x756aa39cu, 0x026d930au, 0x9c0906a9u, 0xeb0e363fu, 0x72076785u, 0x05005713u,
+  0x95bf4a82u, 0xe2b87a14u, 0x7bb12baeu, 0x0cb61b38u, 0x92d28e9bu, 0xe5d5be0du, 0x7cdcefb7u, 0x0bdbdf21u,
+  0x86d3d2d4u, 0xf1d4e242u, 0x68ddb3f8u, 0x1fda836eu, 0x81be16cdu, 0xf6b9265bu, 0x6fb077e1u, 0x18b74777u,
+  0x88085ae6u, 0xff0f6a70u, 0x66063bcau, 0x11010b5cu, 0x8f659effu, 0xf862ae69u, 0x616bffd3u, 0x166ccf45u,
+  0xa00ae278u, 0xd70dd2eeu, 0x4e048354u, 0x3903b3c2u, 0xa7672661u, 0xd06016f7u, 0x4969474du, 0x3e6e77dbu,
+  0xaed16a4au, 0xd9d65adcu, 0x40df0b66u, 0x37d83bf0u, 0xa9bcae53u, 0xdebb9ec5u, 0x47b2cf7fu, 0x30b5ffe9u,
+  0xbdbdf21cu, 0xcabac28au, 0x53b39330u, 0x24b4a3a6u, 0xbad03605u, 0xcdd70693u, 0x54de5729u, 0x23d967bfu,
+  0xb3667a2eu, 0xc4614ab8u, 0x5d681b02u, 0x2a6f2b94u, 0xb40bbe37u, 0xc30c8ea1u, 0x5a05df1bu, 0x2d02ef8du,
+};
+
+
+/* Update the CRC-32 (as used by zip) crc with n bytes at data. */
+static uint32_t cnpy_crc32(uint32_t crc, const char *data, size_t n) {
+  const uint8_t *p = (const uint8_t *) data;
+  crc = ~crc;
+  if (n >= 4096) {
+    /* slicing by 8 bytes; t[k][b] is the CRC of the byte b followed by k zero bytes */
+    uint32_t t[8][256];
+    memcpy(t[0], cnpy_crc32_table, sizeof(t[0]));
+    for (size_t k = 1; k < 8; k += 1) {
+      for (size_t i = 0; i < 256; i += 1) {
+        t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+      }
+    }
+    for (; n >= 8; n -= 8, p += 8) {
+      uint32_t lo = crc ^ ((uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24);
+      uint32_t hi = (uint32_t) p[4] | (uint32_t) p[5] << 8 | (uint32_t) p[6] << 16 | (uint32_t) p[7] << 24;
+      crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    }
+  }
+  for (size_t i = 0; i < n; i += 1) {
+    crc = cnpy_crc32_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+
+/* Reverse the lowest n bits of x. */
+static unsigned cnpy_bit_reverse(unsigned x, unsigned n) {
+  unsigned r = 0;
+  for (unsigned i = 0; i < n; i += 1) {
+    r = (r << 1) | ((x >> i) & 1);
+  }
+  return r;
+}
+
+
+typedef struct {
+  uint16_t fast[1 << CNPY_INFLATE_FAST_BITS]; /* (length << 9) | symbol of the code starting with the next bits, if it is short; 0 otherwise */
+  uint16_t first_code[16];
+  uint16_t first_symbol[16];
+  uint32_t max_code[17]; /* the first code of each length which is too large, shifted to 16 bits */
+  uint8_t size[288];
+  uint16_t value[288];
+} cnpy_huffman;
+
+
+typedef struct {
+  const uint8_t *in;
+  const uint8_t *in_end;
+  uint64_t bits; /* the next n_bits bits of input, least significant first */
+  unsigned n_bits;
+  unsigned pad; /* zero bytes appended to bits after the end of the input; consuming them is an error */
+} cnpy_bit_reader;
+
+
+typedef enum {
+  CNPY_INFLATE_DONE, /* the final block is decoded */
+  CNPY_INFLATE_FULL, /* the output buffer is full */
+  CNPY_INFLATE_ERROR, /* invalid data */
+} cnpy_inflate_result;
+
+
+typedef struct {
+  cnpy_bit_reader br;
+  char *out; /* output buffer; back references reach into the bytes before out_pos */
+  size_t out_pos;
+  size_t out_size;
+  int block; /* 0: at a block header, 1: in a stored block, 2: in a Huffman coded block, 3: after the final block */
+  bool final; /* the current block is the final one */
+  size_t stored_left; /* bytes left in a stored block */
+  cnpy_huffman lit; /* literal / length code */
+  cnpy_huffman dist; /* distance code */
+} cnpy_inflate;
+
+
+/* Build the canonical Huffman code with the code lengths lengths[0, n); returns false if it is oversubscribed. */
+static bool cnpy_huffman_build(cnpy_huffman *h, const uint8_t *lengths, size_t n) {
+  unsigned count[17] = { 0 };
+  unsigned next_code[16];
+  memset(h->fast, 0, sizeof(h->fast));
+  for (size_t i = 0; i < n; i += 1) {
+    count[lengths[i]] += 1;
+  }
+  count[0] = 0;
+  unsigned code = 0, k = 0;
+  for (unsigned i = 1; i < 16; i += 1) {
+    next_code[i] = code;
+    h->first_code[i] = (uint16_t) code;
+    h->first_symbol[i] = (uint16_t) k;
+    code += count[i];
+    if (count[i] > 0 && code - 1 >= (1u << i)) {
+      return false;
+    }
+    h->max_code[i] = code << (16 - i);
+    code <<= 1;
+    k += count[i];
+  }
+  h->max_code[16] = 0x10000;
+  for (size_t i = 0; i < n; i += 1) {
+    unsigned s = lengths[i];
+    if (s == 0) {
+      continue;
+    }
+    unsigned c = next_code[s] - h->first_code[s] + h->first_symbol[s];
+    h->size[c] = (uint8_t) s;
+    h->value[c] = (uint16_t) i;
+    if (s <= CNPY_INFLATE_FAST_BITS) {
+      for (unsigned j = cnpy_bit_reverse(next_code[s], s); j < (1u << CNPY_INFLATE_FAST_BITS); j += 1u << s) {
+        h->fast[j] = (uint16_t) (s << 9 | i);
+      }
+    }
+    next_code[s] += 1;
+  }
+  return true;
+}
+
+
+static inline void cnpy_bits_refill(cnpy_bit_reader *br) {
+  if (br->in_end - br->in >= 8) {
+    /* whole bytes up to 56 or more bits at once; the bits above n_bits are those of the next byte, which is read again */
+    uint64_t v;
+    memcpy(&v, br->in, 8);
+#if BYTE_ORDER == BIG_ENDIAN
+    v = __builtin_bswap64(v);
+#endif
+    br->bits |= v << br->n_bits;
+    br->in += (63 - br->n_bits) >> 3;
+    br->n_bits |= 56;
+    return;
+  }
+  while (br->n_bits <= 56) {
+    if (br->in < br->in_end) {
+      br->bits |= (uint64_t) *br->in << br->n_bits;
+      br->in += 1;
+    }
+    else {
+      br->pad += 1;
+    }
+    br->n_bits += 8;
+  }
+}
+
+
+/* Take the next n <= 32 bits. */
+static inline unsigned cnpy_bits_get(cnpy_bit_reader *br, unsigned n) {
+  if (br->n_bits < n) {
+    cnpy_bits_refill(br);
+  }
+  unsigned v = (unsigned) (br->bits & ((UINT64_C(1) << n) - 1));
+  br->bits >>= n;
+  br->n_bits -= n;
+  return v;
+}
+
+
+/* Whether bits after the end of the input were consumed. */
+static inline bool cnpy_bits_overrun(const cnpy_bit_reader *br) {
+  return br->n_bits < 8 * br->pad;
+}
+
+
+/* Decode a symbol with the code h; -1 if there is none. */
+static inline int cnpy_huffman_decode(cnpy_bit_reader *br, const cnpy_huffman *h) {
+  if (br->n_bits < 16) {
+    cnpy_bits_refill(br);
+  }
+  unsigned b = h->fast[br->bits & ((1u << CNPY_INFLATE_FAST_BITS) - 1)];
+  if (b != 0) {
+    unsigned s = b >> 9;
+    br->bits >>= s;
+    br->n_bits -= s;
+    return (int) (b & 511);
+  }
+  unsigned k = cnpy_bit_reverse((unsigned) (br->bits & 0xffff), 16);
+  unsigned s = CNPY_INFLATE_FAST_BITS + 1;
+  while (k >= h->max_code[s]) {
+    s += 1;
+  }
+  if (s >= 16) {
+    return -1;
+  }
+  unsigned c = (k >> (16 - s)) - h->first_code[s] + h->first_symbol[s];
+  if (c >= 288 || h->size[c] != s) {
+    return -1;
+  }
+  br->bits >>= s;
+  br->n_bits -= s;
+  return h->value[c];
+}
+
+
+static void cnpy_inflate_init(cnpy_inflate *z, const char *in, size_t n, char *out, size_t out_size) {
+  z->br.in = (const uint8_t *) in;
+  z->br.in_end = (const uint8_t *) in + n;
+  z->br.bits = 0;
+  z->br.n_bits = 0;
+  z->br.pad = 0;
+  z->out = out;
+  z->out_pos = 0;
+  z->out_size = out_size;
+  z->block = 0;
+  z->final = false;
+  z->stored_left = 0;
+}
+
+
+/* Read the code lengths of a dynamic block, and build its codes. */
+static bool cnpy_inflate_dynamic(cnpy_inflate *z) {
+  static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+  cnpy_bit_reader *br = &z->br;
+  unsigned n_lit = cnpy_bits_get(br, 5) + 257;
+  unsigned n_dist = cnpy_bits_get(br, 5) + 1;
+  unsigned n_clen = cnpy_bits_get(br, 4) + 4;
+  uint8_t clen[19] = { 0 };
+  for (unsigned i = 0; i < n_clen; i += 1) {
+    clen[order[i]] = (uint8_t) cnpy_bits_get(br, 3);
+  }
+  cnpy_huffman *clen_code = &z->dist; /* not in use yet */
+  if (n_lit > 286 || n_dist > 30 || !cnpy_huffman_build(clen_code, clen, 19)) {
+    return false;
+  }
+  uint8_t lengths[286 + 30];
+  unsigned n = 0;
+  while (n < n_lit + n_dist) {
+    int c = cnpy_huffman_decode(br, clen_code);
+    if (c < 0 || cnpy_bits_overrun(br)) {
+      return false;
+    }
+    if (c < 16) {
+      lengths[n++] = (uint8_t) c;
+      continue;
+    }
+    unsigned repeat = (c == 16)? 3 + cnpy_bits_get(br, 2) : (c == 17)? 3 + cnpy_bits_get(br, 3) : 11 + cnpy_bits_get(br, 7);
+    uint8_t value = 0;
+    if (c == 16) {
+      if (n == 0) {
+        return false;
+      }
+      value = lengths[n - 1];
+    }
+    if (repeat > n_lit + n_dist - n) {
+      return false;
+    }
+    memset(lengths + n, value, repeat);
+    n += repeat;
+  }
+  return lengths[256] != 0 && cnpy_huffman_build(&z->lit, lengths, n_lit) && cnpy_huffman_build(&z->dist, lengths + n_lit, n_dist);
+}
+
+
+/* Read a block header. */
+static bool cnpy_inflate_block_header(cnpy_inflate *z) {
+  cnpy_bit_reader *br = &z->br;
+  z->final = cnpy_bits_get(br, 1) != 0;
+  unsigned type = cnpy_bits_get(br, 2);
+  if (type == 0) {
+    /* stored: give back the whole bytes in the bit buffer, and continue at the next byte boundary */
+    cnpy_bits_get(br, br->n_bits % 8);
+    if (br->n_bits / 8 < br->pad) {
+      return false;
+    }
+    br->in -= br->n_bits / 8 - br->pad;
+    br->bits = 0;
+    br->n_bits = 0;
+    br->pad = 0;
+    if (br->in_end - br->in < 4) {
+      return false;
+    }
+    unsigned len = (unsigned) br->in[0] | (unsigned) br->in[1] << 8;
+    unsigned n_len = (unsigned) br->in[2] | (unsigned) br->in[3] << 8;
+    if (len != (~n_len & 0xffff)) {
+      return false;
+    }
+    br->in += 4;
+    z->stored_left = len;
+    z->block = 1;
+    return true;
+  }
+  if (type == 1) {
+    uint8_t lengths[288 + 30];
+    memset(lengths, 8, 144);
+    memset(lengths + 144, 9, 112);
+    memset(lengths + 256, 7, 24);
+    memset(lengths + 280, 8, 8);
+    memset(lengths + 288, 5, 30);
+    cnpy_huffman_build(&z->lit, lengths, 288);
+    cnpy_huffman_build(&z->dist, lengths + 288, 30);
+  }
+  else if (type != 2 || !cnpy_inflate_dynamic(z)) {
+    return false;
+  }
+  z->block = 2;
+  return !cnpy_bits_overrun(br);
+}
+
+
+/* Decode a Huffman coded block until its end or until the output is full. */
+static cnpy_inflate_result cnpy_inflate_codes(cnpy_inflate *z) {
+  cnpy_bit_reader br = z->br; /* a local copy, which stores to the output cannot alias */
+  char *out = z->out;
+  size_t pos = z->out_pos;
+  size_t out_size = z->out_size;
+  cnpy_inflate_result r = CNPY_INFLATE_ERROR;
+  for (;;) {
+    cnpy_bit_reader saved = br;
+    int sym = cnpy_huffman_decode(&br, &z->lit);
+    if (sym < 256) {
+      if (sym < 0) {
+        break;
+      }
+      if (pos == out_size) {
+        br = saved;
+        r = CNPY_INFLATE_FULL;
+        break;
+      }
+      out[pos++] = (char) sym;
+    }
+    else if (sym == 256) {
+      z->block = 0;
+      r = CNPY_INFLATE_DONE;
+      break;
+    }
+    else {
+      sym -= 257;
+      if (sym >= 29) {
+        break;
+      }
+      size_t len = cnpy_deflate_length_base[sym] + cnpy_bits_get(&br, cnpy_deflate_length_extra[sym]);
+      int d = cnpy_huffman_decode(&br, &z->dist);
+      if (d < 0 || d >= 30) {
+        break;
+      }
+      size_t dist = cnpy_deflate_dist_base[d] + cnpy_bits_get(&br, cnpy_deflate_dist_extra[d]);
+      if (len > out_size - pos) {
+        br = saved;
+        r = CNPY_INFLATE_FULL;
+        break;
+      }
+      if (dist > pos) {
+        break;
+      }
+      const char *src = out + pos - dist;
+      if (dist >= 8 && out_size - pos >= len + 8) {
+        /* in pieces of 8 bytes, which may write up to 7 bytes after the match; those are overwritten later */
+        for (size_t k = 0; k < len; k += 8) {
+          memcpy(out + pos + k, src + k, 8);
+        }
+      }
+      else if (dist == 1) {
+        memset(out + pos, *src, len);
+      }
+      else {
+        /* a repeating pattern if dist < len: copies of at most dist bytes do not overlap */
+        for (size_t k = 0; k < len; k += dist) {
+          memcpy(out + pos + k, src + k, (dist < len - k)? dist : len - k);
+        }
+      }
+      pos += len;
+    }
+    if (cnpy_bits_overrun(&br)) {
+      break;
+    }
+  }
+  z->br = br;
+  z->out_pos = pos;
+  return (r == CNPY_INFLATE_DONE && cnpy_bits_overrun(&br))? CNPY_INFLATE_ERROR : r;
+}
+
+
+/* Decode until the final block is decoded or the output is full. */
+static cnpy_inflate_result cnpy_inflate_run(cnpy_inflate *z) {
+  for (;;) {
+    if (z->block == 3) {
+      return CNPY_INFLATE_DONE;
+    }
+    if (z->block == 0) {
+      if (z->final) {
+        z->block = 3;
+        continue;
+      }
+      if (!cnpy_inflate_block_header(z)) {
+        return CNPY_INFLATE_ERROR;
+      }
+    }
+    if (z->block == 1) {
+      size_t n = z->stored_left;
+      n = (n < z->out_size - z->out_pos)? n : z->out_size - z->out_pos;
+      if (n > (size_t) (z->br.in_end - z->br.in)) {
+        return CNPY_INFLATE_ERROR;
+      }
+      memcpy(z->out + z->out_pos, z->br.in, n);
+      z->br.in += n;
+      z->out_pos += n;
+      z->stored_left -= n;
+      if (z->stored_left > 0) {
+        return CNPY_INFLATE_FULL;
+      }
+      z->block = 0;
+    }
+    else if (z->block == 2) {
+      cnpy_inflate_result r = cnpy_inflate_codes(z);
+      if (r != CNPY_INFLATE_DONE) {
+        return r;
+      }
+    }
+  }
+}
+
+
+/*
+ * Decompress the deflated i-th member of npz into an anonymous mapping, unless that has been done before.
+ * Threads may decompress the same member at once; the first mapping published wins, and the others are dropped.
+ * Returns 0, the errno of a failed mmap(), or -1 if the member is not deflated or its data or CRC-32 is wrong;
+ * cnpy_npz_decompress() turns the first of these into a status, since its worker threads leave cnpy_error_str alone.
+ */
+static int cnpy_npz_inflate_member(const cnpy_npz *npz, size_t i) {
+  cnpy_npz_member *m = &npz->members[i];
+  if (__atomic_load_n(&m->decoded, __ATOMIC_ACQUIRE) != NULL) {
+    return 0;
+  }
+  size_t begin;
+  if (m->method != 8 || m->uncompressed_size == 0 || !cnpy_npz_member_data(npz, m, &begin)) {
+    return -1;
+  }
+  void *out = mmap(NULL, m->uncompressed_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (out == MAP_FAILED) {
+    return errno;
+  }
+  cnpy_inflate z;
+  cnpy_inflate_init(&z, npz->raw_data + begin, m->size, (char *) out, m->uncompressed_size);
+  bool ok = cnpy_inflate_run(&z) == CNPY_INFLATE_DONE && z.out_pos == m->uncompressed_size;
+  if (!ok || cnpy_crc32(0, (const char *) out, m->uncompressed_size) != m->crc) {
+    munmap(out, m->uncompressed_size);
+    return -1;
+  }
+  /* another thread may have decoded the member in the meantime */
+  char *expected = NULL;
+  if (!__atomic_compare_exchange_n(&m->decoded, &expected, (char *) out, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    munmap(out, m->uncompressed_size);
+  }
+  return 0;
+}
+
+
+typedef struct {
+  const cnpy_npz *npz;
+  size_t next; /* index of the next member to look at */
+  int err; /* the first error, as returned by cnpy_npz_inflate_member() */
+  size_t err_member;
+} cnpy_npz_inflate_job;
+
+
+static void cnpy_npz_inflate_worker(void *arg, size_t t, size_t n_threads) {
+  (void) t;
+  (void) n_threads;
+  cnpy_npz_inflate_job *job = (cnpy_npz_inflate_job *) arg;
+  /* members differ in size, so they are handed out one at a time */
+  for (;;) {
+    size_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+    if (i >= job->npz->n_members) {
+      break;
+    }
+    if (job->npz->members[i].method != 8) {
+      continue;
+    }
+    int err = cnpy_npz_inflate_member(job->npz, i);
+    int expected = 0;
+    if (err != 0 && __atomic_compare_exchange_n(&job->err, &expected, err, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      job->err_member = i;
+    }
+  }
+}
+
+
+/*
+ * Decompress all deflated members of npz with n_threads threads (0: one per online CPU), each member in one thread,
+ * so that cnpy_npz_get() returns them without further work.
+ */
+cnpy_status cnpy_npz_decompress(const cnpy_npz *npz, size_t n_threads) {
+  assert(npz != NULL && npz->raw_data != NULL);
+
+  size_t n_deflated = 0;
+  for (size_t i = 0; i < npz->n_members; i += 1) {
+    n_deflated += npz->members[i].method == 8 && npz->members[i].decoded == NULL;
+  }
+  n_threads = cnpy_n_threads(n_threads);
+  n_threads = (n_threads < n_deflated)? n_threads : (n_deflated > 0)? n_deflated : 1;
+  cnpy_npz_inflate_job job;
+  job.npz = npz;
+  job.next = 0;
+  job.err = 0;
+  job.err_member = 0;
+  cnpy_parallel_for(n_threads, cnpy_npz_inflate_worker, &job);
+  if (job.err > 0) {
+    return cnpy_error(CNPY_ERROR_MMAP, "Could not map memory for decompression: %s", strerror(job.err));
+  }
+  if (job.err < 0) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Invalid compressed data in member %zu", job.err_member);
+  }
+  return CNPY_SUCCESS;
+}
+
+
+typedef struct {
+  cnpy_array arr; /* metadata of the member; raw_data is NULL */
+  size_t next; /* flat index of the next element */
+  const char *stored; /* the data of a stored member, or NULL */
+  size_t read_pos; /* offset in the window of the first byte not yet read */
+  uint32_t crc; /* CRC-32 of the bytes read so far */
+  uint32_t expected_crc;
+  cnpy_inflate z; /* the decoder; its output is the window, CNPY_NPZ_STREAM_BUFFER bytes (an anonymous mapping) */
+} cnpy_npz_stream;
+
+
+/* Decode more of the member of s into its window, sliding the window if it is full. */
+static cnpy_status cnpy_npz_stream_fill(cnpy_npz_stream *s) {
+  cnpy_inflate *z = &s->z;
+  size_t history = 1 << 15; /* the maximum distance of back references */
+  if (z->out_pos == z->out_size) {
+    memmove(z->out, z->out + z->out_pos - history, history);
+    s->read_pos -= z->out_pos - history;
+    z->out_pos = history;
+  }
+  size_t before = z->out_pos;
+  cnpy_inflate_result r = cnpy_inflate_run(z);
+  if (r == CNPY_INFLATE_ERROR || (r == CNPY_INFLATE_DONE && z->out_pos == before)) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Invalid compressed data");
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Open the member called name (with or without ".npy") of npz for reading its elements in order into caller buffers with cnpy_npz_stream_read().
+ * A deflated member is decompressed piecewise, with CNPY_NPZ_STREAM_BUFFER bytes of memory; its header has to fit into half of that.
+ * On failure, *s is not changed.
+ */
+cnpy_status cnpy_npz_stream_open(const cnpy_npz *npz, const char * const name, cnpy_npz_stream *s) {
+  assert(npz != NULL && npz->raw_data != NULL);
+  assert(name != NULL);
+  assert(s != NULL);
+
+  size_t i = cnpy_npz_find(npz, name);
+  if (i == SIZE_MAX) {
+    return cnpy_error(CNPY_ERROR_FILE, "No member named %s", name);
+  }
+  const cnpy_npz_member *m = &npz->members[i];
+  size_t begin;
+  if ((m->flags & 1) || (m->method != 0 && m->method != 8) || (m->method == 0 && m->size != m->uncompressed_size)) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Member %s is encrypted or compressed with an unsupported method", name);
+  }
+  if (!cnpy_npz_member_data(npz, m, &begin)) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Invalid local file header at offset %zu", m->local_offset);
+  }
+
+  cnpy_npz_stream tmp;
+  tmp.next = 0;
+  tmp.stored = NULL;
+  tmp.crc = 0;
+  tmp.expected_crc = m->crc;
+  tmp.z.out = NULL;
+  const char *header = npz->raw_data + begin;
+  size_t n_header = m->size;
+  cnpy_status status = CNPY_SUCCESS;
+  if (m->method == 0) {
+    tmp.stored = header;
+  }
+  else {
+    void *window = mmap(NULL, CNPY_NPZ_STREAM_BUFFER, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (window == MAP_FAILED) {
+      return cnpy_error(CNPY_ERROR_MMAP, "Could not map the window: %s", strerror(errno));
+    }
+    cnpy_inflate_init(&tmp.z, header, m->size, (char *) window, CNPY_NPZ_STREAM_BUFFER / 2);
+    tmp.read_pos = 0;
+    status = cnpy_npz_stream_fill(&tmp);
+    tmp.z.out_size = CNPY_NPZ_STREAM_BUFFER;
+    header = tmp.z.out;
+    n_header = tmp.z.out_pos;
+  }
+  if (status == CNPY_SUCCESS) {
+    status = cnpy_parse_metadata(header, n_header, &tmp.arr);
+  }
+  if (status == CNPY_SUCCESS) {
+    tmp.arr.raw_data_size = m->uncompressed_size;
+    status = cnpy_parse_check_data_size(tmp.arr, NULL);
+    tmp.arr.raw_data = NULL;
+    tmp.arr.map_size = 0;
+  }
+  if (status != CNPY_SUCCESS) {
+    if (tmp.z.out != NULL) {
+      munmap(tmp.z.out, CNPY_NPZ_STREAM_BUFFER); /* no point in checking for errors */
+    }
+    return status;
+  }
+  if (tmp.stored == NULL) {
+    tmp.crc = cnpy_crc32(0, header, tmp.arr.data_begin);
+    tmp.read_pos = tmp.arr.data_begin;
+  }
+  *s = tmp;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Read the next (at most) count elements of the member into buf, in host byte order, and store their number in *n_read (0 at the end).
+ * Elements come in serialization order (s->arr.order). The CRC-32 of a deflated member is checked when its last element is read.
+ */
+cnpy_status cnpy_npz_stream_read(cnpy_npz_stream *s, size_t count, void *buf, size_t *n_read) {
+  assert(s != NULL);
+  assert(buf != NULL || count == 0);
+  assert(n_read != NULL);
+
+  size_t total = cnpy_n_elements(s->arr);
+  size_t size = cnpy_dtype_sizes[s->arr.dtype];
+  count = (count < total - s->next)? count : total - s->next;
+  char *dst = (char *) buf;
+  if (s->stored != NULL) {
+    memcpy(dst, s->stored + s->arr.data_begin + s->next * size, count * size);
+  }
+  else {
+    cnpy_inflate *z = &s->z;
+    for (size_t need = count * size; need > 0; ) {
+      if (z->out_pos == s->read_pos) {
+        cnpy_status status = cnpy_npz_stream_fill(s);
+        if (status != CNPY_SUCCESS) {
+          return status;
+        }
+      }
+      size_t n = z->out_pos - s->read_pos;
+      n = (n < need)? n : need;
+      memcpy(dst, z->out + s->read_pos, n);
+      s->crc = cnpy_crc32(s->crc, dst, n);
+      s->read_pos += n;
+      dst += n;
+      need -= n;
+    }
+    if (s->next + count == total && count > 0) {
+      /* the end of the data; the final end of block code may follow */
+      if (z->out_pos != s->read_pos || cnpy_inflate_run(z) != CNPY_INFLATE_DONE || z->out_pos != s->read_pos || s->crc != s->expected_crc) {
+        return cnpy_error(CNPY_ERROR_FORMAT, "Invalid compressed data (trailing data or wrong CRC-32)");
+      }
+    }
+  }
+  if (!cnpy_is_host_byte_order(s->arr.byte_order)) {
+    size_t width = cnpy_swap_width(s->arr.dtype);
+    cnpy_cpy_swap_n(width, count * (size / width), (const char *) buf, (char *) buf);
+  }
+  s->next += count;
+  *n_read = count;
+  return CNPY_SUCCESS;
+}
+
+
+/* Close a stream opened with cnpy_npz_stream_open(). */
+cnpy_status cnpy_npz_stream_close(cnpy_npz_stream *s) {
+  assert(s != NULL);
+  if (s->z.out != NULL && munmap(s->z.out, CNPY_NPZ_STREAM_BUFFER) != 0) {
+    return cnpy_error(CNPY_ERROR_MMAP, "munmap() failed: %s", strerror(errno));
+  }
+  s->z.out = NULL;
+  return CNPY_SUCCESS;
+}
+
+
+typedef struct {
+  uint16_t lit_code[288]; /* the fixed Huffman code, bit reversed, as it is written least significant bit first */
+  uint8_t lit_len[288];
+  uint8_t length_sym[259]; /* by match length */
+  uint8_t dist_sym[512]; /* by distance - 1 up to 256, then by (distance - 1) / 128 */
+} cnpy_deflate_tables;
+
+
+typedef struct {
+  int fd;
+  size_t pos; /* bytes written so far */
+  size_t n_members;
+  cnpy_deflate_tables *tables; /* in the anonymous mapping */
+  size_t *head; /* hash table of the encoder: base + 1 + the position of the last 4-byte sequence with each hash (an anonymous mapping, followed by the output buffer) */
+  size_t base; /* entries of head up to base are from earlier members, so the table is never cleared */
+  char *out; /* output buffer of the encoder */
+  size_t map_size;
+} cnpy_npz_writer;
+
+
+typedef struct {
+  char *out;
+  size_t pos;
+  uint64_t bits;
+  unsigned n_bits;
+} cnpy_bit_writer;
+
+
+/* Put the n <= 32 bits of value; they are written to out in pieces of 32 bits. */
+static inline void cnpy_bits_put(cnpy_bit_writer *bw, uint64_t value, unsigned n) {
+  bw->bits |= value << bw->n_bits;
+  bw->n_bits += n;
+  if (bw->n_bits >= 32) {
+    char *p = bw->out + bw->pos;
+    p[0] = (char) bw->bits;
+    p[1] = (char) (bw->bits >> 8);
+    p[2] = (char) (bw->bits >> 16);
+    p[3] = (char) (bw->bits >> 24);
+    bw->pos += 4;
+    bw->bits >>= 32;
+    bw->n_bits -= 32;
+  }
+}
+
+
+/* Write the whole bytes of the bits put so far to out. */
+static inline void cnpy_bits_flush(cnpy_bit_writer *bw) {
+  while (bw->n_bits >= 8) {
+    bw->out[bw->pos++] = (char) bw->bits;
+    bw->bits >>= 8;
+    bw->n_bits -= 8;
+  }
+}
+
+
+/* Build the tables of the encoder for the fixed Huffman code. */
+static void cnpy_deflate_tables_init(cnpy_deflate_tables *t) {
+  for (unsigned i = 0; i < 288; i += 1) {
+    unsigned code = (i < 144)? 0x30 + i : (i < 256)? 0x190 + i - 144 : (i < 280)? i - 256 : 0xc0 + i - 280;
+    t->lit_len[i] = (uint8_t) ((i < 144)? 8 : (i < 256)? 9 : (i < 280)? 7 : 8);
+    t->lit_code[i] = (uint16_t) cnpy_bit_reverse(code, t->lit_len[i]);
+  }
+  for (unsigned c = 0; c < 29; c += 1) {
+    for (unsigned l = cnpy_deflate_length_base[c]; l < cnpy_deflate_length_base[c] + (1u << cnpy_deflate_length_extra[c]) && l <= 258; l += 1) {
+      t->length_sym[l] = (uint8_t) c;
+    }
+  }
+  for (unsigned c = 0; c < 30; c += 1) {
+    for (unsigned d = cnpy_deflate_dist_base[c]; d < cnpy_deflate_dist_base[c] + (1u << cnpy_deflate_dist_extra[c]); d += 1) {
+      t->dist_sym[(d <= 256)? d - 1 : 256 + ((d - 1) >> 7)] = (uint8_t) c;
+    }
+  }
+}
+
+
+/*
+ * Append a deflate block of the bytes in[start, end) of the n bytes at in to bw, with the bytes before start as history for back references,
+ * and return its end. Positions in head are offset by base (see cnpy_npz_writer), so that entries of earlier inputs are never matched.
+ * Data which the fixed Huffman code makes larger is put into a stored block instead, which ends early (at a multiple of CNPY_DEFLATE_STORED_STEP)
+ * if that is noticed early; then only its header is put into bw, the caller has to append the bytes itself, and *stored is set.
+ */
+static size_t cnpy_deflate_block(const cnpy_deflate_tables *t, size_t *head, size_t base, cnpy_bit_writer *bw, const uint8_t *in, size_t start, size_t end, size_t n, bool *stored) {
+  cnpy_bit_writer saved = *bw;
+  cnpy_bits_put(bw, end == n, 1);
+  cnpy_bits_put(bw, 1, 2);
+  bool grows = false;
+  size_t i = start;
+  while (i < end && !grows) {
+    size_t len = 0, dist = 0;
+    if (end - i >= 4) {
+      uint32_t x;
+      memcpy(&x, in + i, 4);
+      size_t h = (x * 2654435761u) >> (32 - CNPY_DEFLATE_HASH_BITS);
+      size_t candidate = head[h] - base - 1; /* wraps around to a huge value for entries of earlier inputs */
+      head[h] = base + i + 1;
+      if (candidate < i && i - candidate <= 32768) {
+        const uint8_t *a = in + candidate, *b = in + i;
+        size_t max = (end - i < 258)? end - i : 258;
+        while (len + 8 <= max && memcmp(a + len, b + len, 8) == 0) {
+          len += 8;
+        }
+        while (len < max && a[len] == b[len]) {
+          len += 1;
+        }
+        dist = i - candidate;
+      }
+    }
+    if (len >= 4) {
+      unsigned ls = t->length_sym[len];
+      unsigned ds = t->dist_sym[(dist <= 256)? dist - 1 : 256 + ((dist - 1) >> 7)];
+      cnpy_bits_put(bw, t->lit_code[257 + ls], t->lit_len[257 + ls]);
+      cnpy_bits_put(bw, len - cnpy_deflate_length_base[ls], cnpy_deflate_length_extra[ls]);
+      cnpy_bits_put(bw, cnpy_bit_reverse(ds, 5), 5);
+      cnpy_bits_put(bw, dist - cnpy_deflate_dist_base[ds], cnpy_deflate_dist_extra[ds]);
+      i += len;
+    }
+    else {
+      cnpy_bits_put(bw, t->lit_code[in[i]], t->lit_len[in[i]]);
+      i += 1;
+      /* give up early on incompressible data */
+      grows = bw->pos - saved.pos > i - start + 64;
+    }
+  }
+  *stored = false;
+  if (!grows) {
+    cnpy_bits_put(bw, t->lit_code[256], t->lit_len[256]);
+    cnpy_bits_flush(bw);
+    if (bw->pos - saved.pos <= end - start + 5) {
+      return end;
+    }
+  }
+  else {
+    /* the following bytes may well be compressible again */
+    size_t stop = start + ((i - start) / CNPY_DEFLATE_STORED_STEP + 1) * CNPY_DEFLATE_STORED_STEP;
+    end = (stop < end)? stop : end;
+  }
+  /* incompressible: a stored block instead */
+  *stored = true;
+  *bw = saved;
+  cnpy_bits_put(bw, end == n, 1);
+  cnpy_bits_put(bw, 0, 2);
+  cnpy_bits_put(bw, 0, (8 - bw->n_bits) % 8);
+  size_t len = end - start;
+  cnpy_bits_put(bw, len | (~len & 0xffff) << 16, 32);
+  cnpy_bits_flush(bw);
+  return end;
+}
+
+
+/* Compress n bytes at src with deflate to the file of w, and store the compressed size in *written. */
+static cnpy_status cnpy_deflate_write(cnpy_npz_writer *w, const char *src, size_t n, size_t *written) {
+  size_t base = w->base;
+  w->base += n + 1;
+  cnpy_bit_writer bw = { w->out, 0, 0, 0 };
+  *written = 0;
+  size_t start = 0;
+  do {
+    size_t end = (n - start < CNPY_DEFLATE_BLOCK)? n : start + CNPY_DEFLATE_BLOCK;
+    bool stored;
+    end = cnpy_deflate_block(w->tables, w->head, base, &bw, (const uint8_t *) src, start, end, n, &stored);
+    /* the bytes of a stored block are written straight from src */
+    cnpy_status status = cnpy_write_full(w->fd, bw.out, bw.pos);
+    if (status == CNPY_SUCCESS && stored) {
+      status = cnpy_write_full(w->fd, src + start, end - start);
+      *written += end - start;
+    }
+    if (status != CNPY_SUCCESS) {
+      return status;
+    }
+    *written += bw.pos;
+    bw.pos = 0;
+    start = end;
+  } while (start < n);
+  if (bw.n_bits > 0) {
+    cnpy_bits_put(&bw, 0, 8 - bw.n_bits);
+    cnpy_bits_flush(&bw);
+    *written += 1;
+    return cnpy_write_full(w->fd, bw.out, 1);
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/* An upper bound for the size of n bytes compressed by cnpy_deflate_buffer(), including the trial encoding of a block before it is stored. */
+static size_t cnpy_deflate_bound(size_t n) {
+  return n + n / 8 + 5 * (n / CNPY_DEFLATE_BLOCK + 1) + 16;
+}
+
+
+/*
+ * Compress n bytes at src with deflate into dst, which has room for cnpy_deflate_bound(n) bytes, and return the compressed size.
+ * Blocks do not cross multiples of segment (if it is not 0), so that parts of the input which differ (e. g. the planes of a shuffle) are coded separately.
+ */
+static size_t cnpy_deflate_buffer(const cnpy_deflate_tables *t, size_t *head, size_t *base, const char *src, size_t n, size_t segment, char *dst) {
+  size_t b = *base;
+  *base += n + 1;
+  cnpy_bit_writer bw = { dst, 0, 0, 0 };
+  size_t start = 0;
+  do {
+    size_t end = (n - start < CNPY_DEFLATE_BLOCK)? n : start + CNPY_DEFLATE_BLOCK;
+    if (segment > 0 && end > (start / segment + 1) * segment) {
+      end = (start / segment + 1) * segment;
+    }
+    bool stored;
+    end = cnpy_deflate_block(t, head, b, &bw, (const uint8_t *) src, start, end, n, &stored);
+    if (stored) {
+      memcpy(dst + bw.pos, src + start, end - start);
+      bw.pos += end - start;
+    }
+    start = end;
+  } while (start < n);
+  if (bw.n_bits > 0) {
+    cnpy_bits_put(&bw, 0, 8 - bw.n_bits);
+    cnpy_bits_flush(&bw);
+  }
+  return bw.pos;
+}
+
+
+static void cnpy_zip_put16(char *p, uint64_t v) {
+  p[0] = (char) v;
+  p[1] = (char) (v >> 8);
+}
+
+
+static void cnpy_zip_put32(char *p, uint64_t v) {
+  cnpy_zip_put16(p, v);
+  cnpy_zip_put16(p + 2, v >> 16);
+}
+
+
+static void cnpy_zip_put64(char *p, uint64_t v) {
+  cnpy_zip_put32(p, v);
+  cnpy_zip_put32(p + 4, v >> 32);
+}
+
+
+/* Create the .npz archive fn, which must not exist yet; members are added with cnpy_npz_writer_add(). On failure, *w is not changed. */
+cnpy_status cnpy_npz_writer_open(const char * const fn, cnpy_npz_writer *w) {
+  assert(fn != NULL);
+  assert(w != NULL);
+
+  size_t hash_size = ((size_t) 1 << CNPY_DEFLATE_HASH_BITS) * sizeof(size_t);
+  size_t map_size = hash_size + sizeof(cnpy_deflate_tables) + 2 * CNPY_DEFLATE_BLOCK + 64; /* a block of the fixed code is at most 9/8 as large as the input */
+  void *buf = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED) {
+    return cnpy_error(CNPY_ERROR_MMAP, "Could not map the buffers: %s", strerror(errno));
+  }
+  int fd = open(fn, O_RDWR | O_CREAT | O_EXCL, (mode_t) 0644);
+  if (fd == -1) {
+    munmap(buf, map_size);
+    return cnpy_error(CNPY_ERROR_FILE, "Could not create file: %s", strerror(errno));
+  }
+  w->fd = fd;
+  w->pos = 0;
+  w->n_members = 0;
+  w->base = 0;
+  w->head = (size_t *) buf;
+  w->tables = (cnpy_deflate_tables *) ((char *) buf + hash_size);
+  w->out = (char *) (w->tables + 1);
+  w->map_size = map_size;
+  cnpy_deflate_tables_init(w->tables);
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Add the array arr (which must be mapped, e. g. created with cnpy_create(NULL, ...)) to the archive as the member name (".npy" is appended if missing),
+ * deflated if compress is true, and stored otherwise. The local file header always has zip64 sizes, as numpy.savez() writes them.
+ * On failure, the archive is incomplete.
+ */
+cnpy_status cnpy_npz_writer_add(cnpy_npz_writer *w, const char * const name, const cnpy_array arr, bool compress) {
+  assert(w != NULL && w->fd != -1);
+  assert(name != NULL);
+  assert(arr.raw_data != NULL);
+
+  size_t name_len = strlen(name);
+  bool suffix = cnpy_npz_key_len(name, name_len) == name_len;
+  if (name_len > 65535 - 4) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Member name too long");
+  }
+  char local[30 + 65535 + 20]; /* the local file header, the name, and the extra field, written at once */
+  char *header = local;
+  char *extra = local + 30 + name_len + (suffix? 4 : 0);
+  cnpy_zip_put32(header, 0x04034b50);
+  cnpy_zip_put16(header + 4, 45); /* version needed: zip64 */
+  cnpy_zip_put16(header + 6, 0); /* flags */
+  cnpy_zip_put16(header + 8, compress? 8 : 0);
+  cnpy_zip_put16(header + 10, 0); /* time */
+  cnpy_zip_put16(header + 12, 0x21); /* date: 1980-01-01 */
+  cnpy_zip_put32(header + 14, 0); /* CRC-32, written afterwards */
+  cnpy_zip_put32(header + 18, 0xffffffffu); /* sizes in the zip64 extra field */
+  cnpy_zip_put32(header + 22, 0xffffffffu);
+  cnpy_zip_put16(header + 26, name_len + (suffix? 4 : 0));
+  cnpy_zip_put16(header + 28, 20);
+  memcpy(header + 30, name, name_len);
+  memcpy(header + 30 + name_len, ".npy", suffix? 4 : 0);
+  cnpy_zip_put16(extra, 0x0001);
+  cnpy_zip_put16(extra + 2, 16);
+  cnpy_zip_put64(extra + 4, arr.raw_data_size);
+  cnpy_zip_put64(extra + 12, 0); /* compressed size, written afterwards */
+
+  size_t offset = w->pos;
+  size_t data_begin = offset + (size_t) (extra + 20 - local);
+  cnpy_status status = cnpy_write_full(w->fd, local, data_begin - offset);
+  size_t size = arr.raw_data_size;
+  if (status == CNPY_SUCCESS) {
+    status = compress? cnpy_deflate_write(w, arr.raw_data, arr.raw_data_size, &size) : cnpy_write_full(w->fd, arr.raw_data, arr.raw_data_size);
+  }
+  if (status == CNPY_SUCCESS) {
+    cnpy_zip_put32(header + 14, cnpy_crc32(0, arr.raw_data, arr.raw_data_size));
+    cnpy_zip_put64(extra + 12, size);
+    if (pwrite(w->fd, header + 14, 4, (off_t) (offset + 14)) != 4 || pwrite(w->fd, extra + 12, 8, (off_t) (data_begin - 8)) != 8) {
+      status = cnpy_error(CNPY_ERROR_FILE, "pwrite() failed: %s", strerror(errno));
+    }
+  }
+  if (status != CNPY_SUCCESS) {
+    return status;
+  }
+  w->pos = data_begin + size;
+  w->n_members += 1;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Write the central directory (built from the local file headers in the file) and close the archive.
+ * Zip64 records are written if the archive needs them.
+ */
+cnpy_status cnpy_npz_writer_close(cnpy_npz_writer *w) {
+  assert(w != NULL && w->fd != -1);
+
+  size_t cd_offset = w->pos;
+  size_t cd_size = 0;
+  size_t off = 0;
+  cnpy_status status = CNPY_SUCCESS;
+  char entry[46 + 65535 + 28];
+  for (size_t i = 0; i < w->n_members && status == CNPY_SUCCESS; i += 1) {
+    char header[30];
+    status = cnpy_pread_full(w->fd, header, sizeof(header), off, sizeof(header));
+    size_t name_len = cnpy_zip_u16(header + 26);
+    size_t extra_len = cnpy_zip_u16(header + 28);
+    char extra[20];
+    if (status == CNPY_SUCCESS) {
+      status = cnpy_pread_full(w->fd, entry + 46, name_len, off + 30, name_len);
+    }
+    if (status == CNPY_SUCCESS) {
+      assert(extra_len == sizeof(extra));
+      status = cnpy_pread_full(w->fd, extra, sizeof(extra), off + 30 + name_len, sizeof(extra));
+    }
+    if (status != CNPY_SUCCESS) {
+      break;
+    }
+    uint64_t uncompressed_size = cnpy_zip_u64(extra + 4);
+    uint64_t size = cnpy_zip_u64(extra + 12);
+
+    /* the zip64 extra field of the central directory has those of the sizes and the offset which do not fit into 32 bits */
+    char *x = entry + 46 + name_len;
+    size_t n_x = 0;
+    uint64_t fields[] = { uncompressed_size, size, off };
+    for (size_t k = 0; k < 3; k += 1) {
+      if (fields[k] >= 0xffffffffu) {
+        cnpy_zip_put64(x + 4 + n_x, fields[k]);
+        n_x += 8;
+      }
+    }
+    if (n_x > 0) {
+      cnpy_zip_put16(x, 0x0001);
+      cnpy_zip_put16(x + 2, n_x);
+      n_x += 4;
+    }
+    cnpy_zip_put32(entry, 0x02014b50);
+    cnpy_zip_put16(entry + 4, 3 << 8 | 45); /* made by: Unix, zip 4.5 */
+    cnpy_zip_put16(entry + 6, (n_x > 0)? 45 : 20);
+    memcpy(entry + 8, header + 6, 12); /* flags, method, time, date, CRC-32 */
+    cnpy_zip_put32(entry + 20, (size < 0xffffffffu)? size : 0xffffffffu);
+    cnpy_zip_put32(entry + 24, (uncompressed_size < 0xffffffffu)? uncompressed_size : 0xffffffffu);
+    cnpy_zip_put16(entry + 28, name_len);
+    cnpy_zip_put16(entry + 30, n_x);
+    cnpy_zip_put16(entry + 32, 0); /* comment */
+    cnpy_zip_put16(entry + 34, 0); /* disk */
+    cnpy_zip_put16(entry + 36, 0); /* internal attributes */
+    cnpy_zip_put32(entry + 38, (uint64_t) 0100644 << 16); /* external attributes: a regular file, rw-r--r-- */
+    cnpy_zip_put32(entry + 42, (off < 0xffffffffu)? off : 0xffffffffu);
+    status = cnpy_write_full(w->fd, entry, 46 + name_len + n_x);
+    cd_size += 46 + name_len + n_x;
+    off += 30 + name_len + extra_len + size;
+  }
+
+  if (status == CNPY_SUCCESS) {
+    char end[56 + 20 + 22];
+    size_t n_end = 0;
+    if (w->n_members >= 0xffff || cd_size >= 0xffffffffu || cd_offset >= 0xffffffffu) {
+      cnpy_zip_put32(end, 0x06064b50);
+      cnpy_zip_put64(end + 4, 44); /* size of the rest of the record */
+      cnpy_zip_put16(end + 12, 45);
+      cnpy_zip_put16(end + 14, 45);
+      cnpy_zip_put32(end + 16, 0);
+      cnpy_zip_put32(end + 20, 0);
+      cnpy_zip_put64(end + 24, w->n_members);
+      cnpy_zip_put64(end + 32, w->n_members);
+      cnpy_zip_put64(end + 40, cd_size);
+      cnpy_zip_put64(end + 48, cd_offset);
+      cnpy_zip_put32(end + 56, 0x07064b50);
+      cnpy_zip_put32(end + 60, 0);
+      cnpy_zip_put64(end + 64, cd_offset + cd_size);
+      cnpy_zip_put32(end + 72, 1);
+      n_end = 76;
+    }
+    char *e = end + n_end;
+    cnpy_zip_put32(e, 0x06054b50);
+    cnpy_zip_put32(e + 4, 0); /* disks */
+    cnpy_zip_put16(e + 8, (w->n_members < 0xffff)? w->n_members : 0xffff);
+    cnpy_zip_put16(e + 10, (w->n_members < 0xffff)? w->n_members : 0xffff);
+    cnpy_zip_put32(e + 12, (cd_size < 0xffffffffu)? cd_size : 0xffffffffu);
+    cnpy_zip_put32(e + 16, (cd_offset < 0xffffffffu)? cd_offset : 0xffffffffu);
+    cnpy_zip_put16(e + 20, 0); /* comment */
+    status = cnpy_write_full(w->fd, end, n_end + 22);
+  }
+
+  int fd = w->fd;
+  w->fd = -1;
+  munmap(w->head, w->map_size); /* no point in checking for errors */
+  if (close(fd) != 0 && status == CNPY_SUCCESS) {
+    status = cnpy_error(CNPY_ERROR_FILE, "Could not close file: %s", strerror(errno));
+  }
+  return status;
+}
+
+
+/*
+ * Compressed arrays
+ *
+ * A .npc file holds an array compressed in blocks of a fixed number of elements, so that parts of it can be read without decompressing the rest.
+ * Each block is filtered (byte or bit shuffled, which puts the similar bytes or bits of neighbouring scalars next to each other)
+ * and deflated, or kept as filtered bytes if deflate does not make it smaller. The layout is (integers are little endian):
+ *
+ *   0       "\x93CNPYC", major version 1, minor version 0
+ *   8       filter (a cnpy_npc_filter), 7 reserved bytes (zero)
+ *   16      elements per block (u64)
+ *   24      size of the header H (u64)
+ *   32      the header of the array, as it would be in a .npy file
+ *   32 + H  the offsets of the blocks in the file (u64 each), followed by the end of the last block
+ *
+ * Reads decompress only the blocks they touch, several blocks in parallel.
+ * Blocks which are only read in part are kept in a small cache of decoded blocks, which evicts the least recently used one.
+ */
+
+
+#ifndef CNPY_NPC_BLOCK_SIZE
+#define CNPY_NPC_BLOCK_SIZE (1 << 18) /* default size of the data of a block in bytes */
+#endif
+
+
+#ifndef CNPY_NPC_CACHE_BLOCKS
+#define CNPY_NPC_CACHE_BLOCKS 8 /* decoded blocks kept by a cnpy_npc */
+#endif
+#if CNPY_NPC_CACHE_BLOCKS < 2
+#error "CNPY_NPC_CACHE_BLOCKS must be at least 2 (for the first and the last block of a read)"
+#endif
+
+
+#define CNPY_NPC_PREFIX 32 /* bytes before the header */
+#define CNPY_NPC_MAX_BLOCK ((size_t) 1 << 30) /* largest block which is accepted when reading */
+
+
+typedef enum {
+  CNPY_NPC_NO_FILTER,
+  CNPY_NPC_SHUFFLE, /* byte shuffle: the first bytes of all scalars of a block, then the second bytes, and so on */
+  CNPY_NPC_BITSHUFFLE, /* bit shuffle: the lowest bits of all scalars of a block, then the next bits, and so on */
+} cnpy_npc_filter;
+
+
+typedef struct {
+  int fd;
+  cnpy_array arr; /* metadata of the array; raw_data is NULL */
+  cnpy_npc_filter filter;
+  size_t block_elements;
+  size_t n_blocks;
+  size_t n_threads;
+  uint64_t *offsets; /* n_blocks + 1 offsets of the blocks; at the start of an anonymous mapping which also holds the cache and the scratch buffers */
+  char *cache; /* CNPY_NPC_CACHE_BLOCKS decoded blocks, in host byte order */
+  char *scratch; /* two blocks per thread, for the compressed and the filtered data */
+  size_t cached[CNPY_NPC_CACHE_BLOCKS]; /* the block in each slot of the cache, or SIZE_MAX */
+  uint64_t last_use[CNPY_NPC_CACHE_BLOCKS];
+  uint64_t clock;
+  size_t map_size;
+} cnpy_npc;
+
+
+/*
+ * Byte shuffle n scalars of the given width from src to dst: byte j of scalar i goes to j * n + i.
+ * If inverse is true, undo that instead.
+ */
+static inline void cnpy_shuffle_width(size_t width, size_t n, const char *src, char *dst, bool inverse) {
+  for (size_t i = 0; i < n; i += 1) {
+    for (size_t j = 0; j < width; j += 1) {
+      if (inverse) {
+        dst[i * width + j] = src[j * n + i];
+      }
+      else {
+        dst[j * n + i] = src[i * width + j];
+      }
+    }
+  }
+}
+
+
+static void cnpy_shuffle(size_t width, size_t n, const char *src, char *dst, bool inverse) {
+  /* constant widths, so that the inner loop is unrolled */
+  switch (width) {
+    case 2:
+      cnpy_shuffle_width(2, n, src, dst, inverse);
+      break;
+    case 4:
+      cnpy_shuffle_width(4, n, src, dst, inverse);
+      break;
+    case 8:
+      cnpy_shuffle_width(8, n, src, dst, inverse);
+      break;
+    default:
+      cnpy_shuffle_width(width, n, src, dst, inverse);
+  }
+}
+
+
+/* Transpose the 8x8 bit matrix x, whose rows are its bytes: bit k of byte e becomes bit e of byte k. */
+static inline uint64_t cnpy_transpose_8x8(uint64_t x) {
+  uint64_t t;
+  t = (x ^ (x >> 7)) & UINT64_C(0x00aa00aa00aa00aa);
+  x = x ^ t ^ (t << 7);
+  t = (x ^ (x >> 14)) & UINT64_C(0x0000cccc0000cccc);
+  x = x ^ t ^ (t << 14);
+  t = (x ^ (x >> 28)) & UINT64_C(0x00000000f0f0f0f0);
+  x = x ^ t ^ (t << 28);
+  return x;
+}
+
+
+/*
+ * Bit shuffle n scalars of the given width from src to dst, in groups of 8 scalars:
+ * bit k of byte j of scalar i goes to bit i % 8 of byte i / 8 of the plane 8 * j + k (each plane has n / 8 bytes).
+ * The bytes of the last n % 8 scalars are copied. If inverse is true, undo that instead.
+ */
+static void cnpy_bitshuffle(size_t width, size_t n, const char *src, char *dst, bool inverse) {
+  const uint8_t *s = (const uint8_t *) src;
+  uint8_t *d = (uint8_t *) dst;
+  size_t n_groups = n / 8;
+  for (size_t j = 0; j < width; j += 1) {
+    for (size_t g = 0; g < n_groups; g += 1) {
+      uint64_t x = 0;
+      for (size_t e = 0; e < 8; e += 1) {
+        x |= (uint64_t) (inverse? s[(8 * j + e) * n_groups + g] : s[(8 * g + e) * width + j]) << (8 * e);
+      }
+      x = cnpy_transpose_8x8(x);
+      for (size_t k = 0; k < 8; k += 1) {
+        d[inverse? (8 * g + k) * width + j : (8 * j + k) * n_groups + g] = (uint8_t) (x >> (8 * k));
+      }
+    }
+  }
+  memcpy(d + 8 * n_groups * width, s + 8 * n_groups * width, (n - 8 * n_groups) * width);
+}
+
+
+/* Apply the filter to (or, if inverse is true, undo it for) the n bytes of elements of the given dtype at src, writing to dst. */
+static void cnpy_npc_filter_apply(cnpy_npc_filter filter, cnpy_dtype dtype, size_t n, const char *src, char *dst, bool inverse) {
+  size_t width = cnpy_swap_width(dtype);
+  switch (filter) {
+    case CNPY_NPC_NO_FILTER:
+      memcpy(dst, src, n);
+      break;
+    case CNPY_NPC_SHUFFLE:
+      cnpy_shuffle(width, n / width, src, dst, inverse);
+      break;
+    case CNPY_NPC_BITSHUFFLE:
+      cnpy_bitshuffle(width, n / width, src, dst, inverse);
+      break;
+    default:
+      assert(false);
+  }
+}
+
+
+typedef struct {
+  const cnpy_deflate_tables *tables;
+  const char *data; /* the elements of the array */
+  cnpy_dtype dtype;
+  cnpy_npc_filter filter;
+  size_t n_elements;
+  size_t block_elements;
+  size_t first; /* the first block of the batch */
+  size_t n; /* blocks in the batch */
+  size_t next; /* the next block of the batch to hand out */
+  char *scratch; /* per thread: the filtered block, and the hash table of the encoder */
+  size_t scratch_size;
+  size_t *bases; /* per thread: the base of the hash table (see cnpy_npz_writer) */
+  char *out; /* per block of the batch: the compressed block, out_size bytes */
+  size_t out_size;
+  size_t *sizes; /* per block of the batch: the size of the compressed block */
+} cnpy_npc_write_job;
+
+
+static void cnpy_npc_write_worker(void *arg, size_t t, size_t n_threads) {
+  (void) n_threads;
+  cnpy_npc_write_job *job = (cnpy_npc_write_job *) arg;
+  size_t size = cnpy_dtype_sizes[job->dtype];
+  char *filtered = job->scratch + t * job->scratch_size;
+  size_t *head = (size_t *) (filtered + (job->block_elements * size + 63) / 64 * 64);
+  for (;;) {
+    size_t k = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+    if (k >= job->n) {
+      break;
+    }
+    size_t begin = (job->first + k) * job->block_elements;
+    size_t n_elements = (job->n_elements - begin < job->block_elements)? job->n_elements - begin : job->block_elements;
+    size_t n = n_elements * size;
+    const char *src = job->data + begin * size;
+    if (job->filter != CNPY_NPC_NO_FILTER) {
+      cnpy_npc_filter_apply(job->filter, job->dtype, n, src, filtered, false);
+      src = filtered;
+    }
+    /* the planes of the filters (n / width and n / width / 8 bytes) are coded separately, unless they are tiny */
+    size_t width = cnpy_swap_width(job->dtype);
+    size_t segment = (job->filter == CNPY_NPC_SHUFFLE)? n / width : (job->filter == CNPY_NPC_BITSHUFFLE)? n / width / 8 : 0;
+    segment = (segment >= 1024)? segment : 0;
+    char *out = job->out + k * job->out_size;
+    size_t packed = cnpy_deflate_buffer(job->tables, head, &job->bases[t], src, n, segment, out);
+    if (packed >= n) {
+      memcpy(out, src, n);
+      packed = n;
+    }
+    job->sizes[k] = packed;
+  }
+}
+
+
+/*
+ * Write the array arr (which must be mapped) to the new .npc file fn, in blocks of about block_size bytes (0: CNPY_NPC_BLOCK_SIZE),
+ * with the given filter. The blocks are compressed by n_threads threads (0: one per online CPU).
+ * The elements are stored in the byte order of arr. On failure, the file is incomplete.
+ */
+cnpy_status cnpy_npc_write(const char * const fn, const cnpy_array arr, size_t block_size, cnpy_npc_filter filter, size_t n_threads) {
+  assert(fn != NULL);
+  assert(arr.raw_data != NULL);
+  assert(filter == CNPY_NPC_NO_FILTER || filter == CNPY_NPC_SHUFFLE || filter == CNPY_NPC_BITSHUFFLE);
+
+  size_t size = cnpy_dtype_sizes[arr.dtype];
+  block_size = (block_size > 0)? block_size : CNPY_NPC_BLOCK_SIZE;
+  block_size = (block_size < CNPY_NPC_MAX_BLOCK)? block_size : CNPY_NPC_MAX_BLOCK;
+  size_t block_elements = (block_size / size) / 8 * 8; /* whole groups of the bit shuffle */
+  block_elements = (block_elements > 8)? block_elements : 8;
+  size_t n_elements = cnpy_n_elements(arr);
+  size_t n_blocks = (n_elements + block_elements - 1) / block_elements;
+  size_t block_bytes = block_elements * size;
+
+  /* the anonymous mapping holds the offsets, the tables, the bases, the scratch buffers of the threads, and the compressed blocks of a batch */
+  n_threads = cnpy_n_threads(n_threads);
+  size_t batch = 4 * n_threads;
+  cnpy_npc_write_job job;
+  job.data = arr.raw_data + arr.data_begin;
+  job.dtype = arr.dtype;
+  job.filter = filter;
+  job.n_elements = n_elements;
+  job.block_elements = block_elements;
+  job.scratch_size = (block_bytes + 63) / 64 * 64 + ((size_t) 1 << CNPY_DEFLATE_HASH_BITS) * sizeof(size_t);
+  job.out_size = (cnpy_deflate_bound(block_bytes) + 63) / 64 * 64;
+  size_t index_size = (n_blocks + 1) * sizeof(uint64_t);
+  size_t tables_offset = (index_size + 63) / 64 * 64;
+  size_t bases_offset = tables_offset + (sizeof(cnpy_deflate_tables) + 63) / 64 * 64;
+  size_t sizes_offset = bases_offset + n_threads * sizeof(size_t);
+  size_t scratch_offset = (sizes_offset + batch * sizeof(size_t) + 63) / 64 * 64;
+  size_t out_offset = scratch_offset + n_threads * job.scratch_size;
+  size_t map_size = out_offset + batch * job.out_size;
+  char *buf = (char *) mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED) {
+    return cnpy_error(CNPY_ERROR_MMAP, "Could not map the buffers: %s", strerror(errno));
+  }
+  uint64_t *offsets = (uint64_t *) buf;
+  cnpy_deflate_tables_init((cnpy_deflate_tables *) (buf + tables_offset));
+  job.tables = (const cnpy_deflate_tables *) (buf + tables_offset);
+  job.bases = (size_t *) (buf + bases_offset);
+  job.sizes = (size_t *) (buf + sizes_offset);
+  job.scratch = buf + scratch_offset;
+  job.out = buf + out_offset;
+
+  int fd = open(fn, O_RDWR | O_CREAT | O_EXCL, (mode_t) 0644);
+  if (fd == -1) {
+    munmap(buf, map_size);
+    return cnpy_error(CNPY_ERROR_FILE, "Could not create file: %s", strerror(errno));
+  }
+
+  /* the prefix and the header, then the blocks after the space for the index, then the index */
+  char head[CNPY_NPC_PREFIX + 65536 + 16];
+  size_t header_size = cnpy_predict_full_header_size(arr.dtype, arr.order, arr.n_dim, arr.dims);
+  memset(head, 0, CNPY_NPC_PREFIX);
+  memcpy(head, "\x93" "CNPYC\x01\x00", 8);
+  head[8] = (char) filter;
+  cnpy_zip_put64(head + 16, block_elements);
+  cnpy_zip_put64(head + 24, header_size);
+  cnpy_write_header(head + CNPY_NPC_PREFIX, header_size, arr.byte_order, arr.dtype, arr.order, arr.n_dim, arr.dims);
+  size_t pos = CNPY_NPC_PREFIX + header_size + index_size;
+  cnpy_status status = cnpy_write_full(fd, head, CNPY_NPC_PREFIX + header_size);
+  if (status == CNPY_SUCCESS && lseek(fd, (off_t) pos, SEEK_SET) == (off_t) -1) {
+    status = cnpy_error(CNPY_ERROR_FILE, "lseek() failed: %s", strerror(errno));
+  }
+
+  for (size_t first = 0; first < n_blocks && status == CNPY_SUCCESS; first += batch) {
+    job.first = first;
+    job.n = (n_blocks - first < batch)? n_blocks - first : batch;
+    job.next = 0;
+    cnpy_parallel_for((n_threads < job.n)? n_threads : job.n, cnpy_npc_write_worker, &job);
+    for (size_t k = 0; k < job.n && status == CNPY_SUCCESS; k += 1) {
+      offsets[first + k] = pos;
+      status = cnpy_write_full(fd, job.out + k * job.out_size, job.sizes[k]);
+      pos += job.sizes[k];
+    }
+  }
+  offsets[n_blocks] = pos;
+
+  if (status == CNPY_SUCCESS) {
+    for (size_t b = 0; b <= n_blocks; b += 1) {
+      uint64_t v = offsets[b];
+      cnpy_zip_put64((char *) &offsets[b], v);
+    }
+    if (lseek(fd, (off_t) (CNPY_NPC_PREFIX + header_size), SEEK_SET) == (off_t) -1) {
+      status = cnpy_error(CNPY_ERROR_FILE, "lseek() failed: %s", strerror(errno));
+    }
+    else {
+      status = cnpy_write_full(fd, (const char *) offsets, index_size);
+    }
+  }
+
+  munmap(buf, map_size); /* no point in checking for errors */
+  if (close(fd) != 0 && status == CNPY_SUCCESS) {
+    status = cnpy_error(CNPY_ERROR_FILE, "Could not close file: %s", strerror(errno));
+  }
+  return status;
+}
+
+
+/* Number of elements in block b. */
+static size_t cnpy_npc_block_length(const cnpy_npc *npc, size_t b) {
+  size_t begin = b * npc->block_elements;
+  size_t n_elements = cnpy_n_elements(npc->arr);
+  return (n_elements - begin < npc->block_elements)? n_elements - begin : npc->block_elements;
+}
+
+
+/*
+ * Open the .npc file fn for reading with n_threads threads (0: one per online CPU); the header and the index of blocks are read.
+ * On failure, *npc is not changed.
+ */
+cnpy_status cnpy_npc_open(const char * const fn, size_t n_threads, cnpy_npc *npc) {
+  assert(fn != NULL);
+  assert(npc != NULL);
+
+  int fd = open(fn, O_RDONLY);
+  if (fd == -1) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not open file: %s", strerror(errno));
+  }
+  off_t end = lseek(fd, 0, SEEK_END);
+  if (end < 0) {
+    close(fd);
+    return cnpy_error(CNPY_ERROR_FILE, "Could not determine file size: %s", strerror(errno));
+  }
+  size_t file_size = (size_t) end;
+
+  char prefix[CNPY_NPC_PREFIX + CNPY_READER_MAX_HEADER];
+  size_t n_prefix = (file_size < sizeof(prefix))? file_size : sizeof(prefix);
+  cnpy_status status = (n_prefix >= CNPY_NPC_PREFIX)? cnpy_pread_full(fd, prefix, n_prefix, 0, n_prefix) : cnpy_error(CNPY_ERROR_FORMAT, "File too small");
+  if (status == CNPY_SUCCESS && memcmp(prefix, "\x93" "CNPYC", 6) != 0) {
+    status = cnpy_error(CNPY_ERROR_FORMAT, "Not a .npc file");
+  }
+  if (status == CNPY_SUCCESS && (prefix[6] != 1 || prefix[7] != 0)) {
+    status = cnpy_error(CNPY_ERROR_FORMAT, "Unsupported .npc version %d.%d", (int) prefix[6], (int) prefix[7]);
+  }
+  cnpy_npc tmp;
+  size_t header_size = 0;
+  if (status == CNPY_SUCCESS) {
+    uint8_t filter = (uint8_t) prefix[8];
+    tmp.filter = (cnpy_npc_filter) filter;
+    tmp.block_elements = cnpy_zip_u64(prefix + 16);
+    header_size = cnpy_zip_u64(prefix + 24);
+    if (filter > CNPY_NPC_BITSHUFFLE) {
+      status = cnpy_error(CNPY_ERROR_FORMAT, "Unknown filter %d", (int) filter);
+    }
+    else if (header_size > n_prefix - CNPY_NPC_PREFIX) {
+      status = cnpy_error(CNPY_ERROR_FORMAT, "Header of %zu bytes does not fit into the file or CNPY_READER_MAX_HEADER", header_size);
+    }
+  }
+  if (status == CNPY_SUCCESS) {
+    status = cnpy_parse_metadata(prefix + CNPY_NPC_PREFIX, header_size, &tmp.arr);
+  }
+  size_t size = (status == CNPY_SUCCESS)? cnpy_dtype_sizes[tmp.arr.dtype] : 1;
+  size_t n_elements = (status == CNPY_SUCCESS)? cnpy_n_elements(tmp.arr) : 0;
+  size_t data_size = 0;
+  if (status == CNPY_SUCCESS && (tmp.arr.data_begin != header_size || __builtin_mul_overflow(n_elements, size, &data_size))) {
+    status = cnpy_error(CNPY_ERROR_FORMAT, "Invalid header");
+  }
+  if (status == CNPY_SUCCESS && (tmp.block_elements == 0 || tmp.block_elements > CNPY_NPC_MAX_BLOCK / size)) {
+    status = cnpy_error(CNPY_ERROR_FORMAT, "Invalid block length %zu", tmp.block_elements);
+  }
+  tmp.n_blocks = (status == CNPY_SUCCESS)? n_elements / tmp.block_elements + (n_elements % tmp.block_elements > 0) : 0;
+  if (status == CNPY_SUCCESS && tmp.n_blocks >= (file_size - CNPY_NPC_PREFIX - header_size) / sizeof(uint64_t)) {
+    status = cnpy_error(CNPY_ERROR_FORMAT, "The index of %zu blocks does not fit into the file", tmp.n_blocks);
+  }
+  if (status != CNPY_SUCCESS) {
+    close(fd); /* no point in checking for errors */
+    return status;
+  }
+  tmp.arr.raw_data = NULL;
+  tmp.arr.raw_data_size = header_size + data_size; /* as a .npy file */
+  tmp.arr.map_size = 0;
+
+  /* the index, the cache, and two blocks per thread */
+  tmp.n_threads = cnpy_n_threads(n_threads);
+  size_t block_bytes = (tmp.block_elements * size + 63) / 64 * 64;
+  size_t index_size = (tmp.n_blocks + 1) * sizeof(uint64_t);
+  size_t cache_offset = (index_size + 63) / 64 * 64;
+  size_t scratch_offset = cache_offset + CNPY_NPC_CACHE_BLOCKS * block_bytes;
+  tmp.map_size = scratch_offset + 2 * tmp.n_threads * block_bytes;
+  char *buf = (char *) mmap(NULL, tmp.map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED) {
+    close(fd);
+    return cnpy_error(CNPY_ERROR_MMAP, "Could not map the buffers: %s", strerror(errno));
+  }
+  tmp.offsets = (uint64_t *) buf;
+  tmp.cache = buf + cache_offset;
+  tmp.scratch = buf + scratch_offset;
+
+  /* the blocks follow each other after the index, and none is larger than its data */
+  status = cnpy_pread_full(fd, buf, index_size, CNPY_NPC_PREFIX + header_size, (size_t) 1 << 20);
+  for (size_t b = 0; b <= tmp.n_blocks && status == CNPY_SUCCESS; b += 1) {
+    tmp.offsets[b] = cnpy_zip_u64((const char *) &tmp.offsets[b]);
+    bool valid = (b == 0)? tmp.offsets[0] == CNPY_NPC_PREFIX + header_size + index_size :
+      tmp.offsets[b] > tmp.offsets[b - 1] && tmp.offsets[b] - tmp.offsets[b - 1] <= cnpy_npc_block_length(&tmp, b - 1) * size;
+    if (!valid || tmp.offsets[b] > file_size) {
+      status = cnpy_error(CNPY_ERROR_FORMAT, "Invalid index of blocks at block %zu", b);
+    }
+  }
+  if (status != CNPY_SUCCESS) {
+    munmap(buf, tmp.map_size);
+    close(fd);
+    return status;
+  }
+
+  for (size_t i = 0; i < CNPY_NPC_CACHE_BLOCKS; i += 1) {
+    tmp.cached[i] = SIZE_MAX;
+    tmp.last_use[i] = 0;
+  }
+  tmp.clock = 0;
+  tmp.fd = fd;
+  *npc = tmp;
+  return CNPY_SUCCESS;
+}
+
+
+/* Close a file opened with cnpy_npc_open(). */
+cnpy_status cnpy_npc_close(cnpy_npc *npc) {
+  assert(npc != NULL);
+  assert(npc->fd != -1);
+
+  munmap(npc->offsets, npc->map_size); /* cannot fail for a mapping we made */
+  npc->offsets = NULL;
+  int fd = npc->fd;
+  npc->fd = -1;
+  if (close(fd) != 0) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not close file: %s", strerror(errno));
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Read and decode block b of npc into dst, in host byte order, with the scratch buffers of thread t.
+ * Returns 0, the errno of a failed pread(), or -1 if the file ends early or the block does not inflate to its full length;
+ * the read job keeps the first failure and its block for the message of the caller.
+ */
+static int cnpy_npc_decode(const cnpy_npc *npc, size_t b, char *dst, size_t t) {
+  size_t size = cnpy_dtype_sizes[npc->arr.dtype];
+  size_t n = cnpy_npc_block_length(npc, b) * size;
+  size_t block_bytes = (npc->block_elements * size + 63) / 64 * 64;
+  char *packed = npc->scratch + 2 * t * block_bytes;
+  char *filtered = packed + block_bytes;
+
+  size_t n_packed = npc->offsets[b + 1] - npc->offsets[b];
+  for (size_t done = 0; done < n_packed; ) {
+    ssize_t got = pread(npc->fd, packed + done, n_packed - done, (off_t) (npc->offsets[b] + done));
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return (got < 0)? errno : -1;
+    }
+    done += (size_t) got;
+  }
+
+  const char *src = packed;
+  if (n_packed < n) {
+    /* deflated; without a filter, straight into dst */
+    char *target = (npc->filter == CNPY_NPC_NO_FILTER)? dst : filtered;
+    cnpy_inflate z;
+    cnpy_inflate_init(&z, packed, n_packed, target, n);
+    if (cnpy_inflate_run(&z) != CNPY_INFLATE_DONE || z.out_pos != n) {
+      return -1;
+    }
+    src = target;
+  }
+  if (src != dst) {
+    cnpy_npc_filter_apply(npc->filter, npc->arr.dtype, n, src, dst, true);
+  }
+  if (!cnpy_is_host_byte_order(npc->arr.byte_order)) {
+    size_t width = cnpy_swap_width(npc->arr.dtype);
+    cnpy_cpy_swap_n(width, n / width, dst, dst);
+  }
+  return 0;
+}
+
+
+/* The slot of the cache of npc which holds block b, or SIZE_MAX. */
+static size_t cnpy_npc_cache_find(const cnpy_npc *npc, size_t b) {
+  for (size_t i = 0; i < CNPY_NPC_CACHE_BLOCKS; i += 1) {
+    if (npc->cached[i] == b) {
+      return i;
+    }
+  }
+  return SIZE_MAX;
+}
+
+
+typedef struct {
+  const cnpy_npc *npc;
+  size_t flat_start;
+  size_t count;
+  char *out;
+  size_t first; /* the first block touched by the read */
+  size_t last; /* the last block touched by the read */
+  size_t slot[2]; /* the cache slots into which the first and the last block are decoded (if they are read in part), or SIZE_MAX */
+  size_t next; /* the next block to hand out, relative to first */
+  int err; /* the first error, as returned by cnpy_npc_decode() */
+  size_t err_block;
+} cnpy_npc_read_job;
+
+
+static void cnpy_npc_read_worker(void *arg, size_t t, size_t n_threads) {
+  (void) n_threads;
+  cnpy_npc_read_job *job = (cnpy_npc_read_job *) arg;
+  const cnpy_npc *npc = job->npc;
+  size_t size = cnpy_dtype_sizes[npc->arr.dtype];
+  size_t block_bytes = (npc->block_elements * size + 63) / 64 * 64;
+  for (;;) {
+    size_t b = job->first + __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+    if (b > job->last) {
+      break;
+    }
+    size_t begin = b * npc->block_elements;
+    size_t lo = (job->flat_start > begin)? job->flat_start : begin;
+    size_t hi = (job->flat_start + job->count < begin + npc->block_elements)? job->flat_start + job->count : begin + npc->block_elements;
+    size_t slot = (b == job->first)? job->slot[0] : (b == job->last)? job->slot[1] : SIZE_MAX;
+    int err = 0;
+    if (slot != SIZE_MAX) {
+      /* copied to out by the caller */
+      err = cnpy_npc_decode(npc, b, npc->cache + slot * block_bytes, t);
+    }
+    else if ((slot = cnpy_npc_cache_find(npc, b)) != SIZE_MAX) {
+      memcpy(job->out + (lo - job->flat_start) * size, npc->cache + slot * block_bytes + (lo - begin) * size, (hi - lo) * size);
+    }
+    else {
+      /* the whole block is read */
+      err = cnpy_npc_decode(npc, b, job->out + (lo - job->flat_start) * size, t);
+    }
+    int expected = 0;
+    if (err != 0 && __atomic_compare_exchange_n(&job->err, &expected, err, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      job->err_block = b;
+    }
+  }
+}
+
+
+/*
+ * Read count elements starting at the flat index flat_start into out, in host byte order; the counterpart to cnpy_read_range().
+ * Only the blocks which are touched are read and decompressed, with up to npc->n_threads threads.
+ * Uses the cache of npc, so it must not be used by several threads at once.
+ */
+cnpy_status cnpy_npc_read_range(cnpy_npc *npc, size_t flat_start, size_t count, void *out) {
+  assert(npc != NULL && npc->fd != -1);
+  assert(out != NULL || count == 0);
+  assert(flat_start <= cnpy_n_elements(npc->arr) && count <= cnpy_n_elements(npc->arr) - flat_start);
+
+  if (count == 0) {
+    return CNPY_SUCCESS;
+  }
+  cnpy_npc_read_job job;
+  job.npc = npc;
+  job.flat_start = flat_start;
+  job.count = count;
+  job.out = (char *) out;
+  job.first = flat_start / npc->block_elements;
+  job.last = (flat_start + count - 1) / npc->block_elements;
+  job.next = 0;
+  job.err = 0;
+  job.err_block = 0;
+
+  /* the first and the last block go through the cache if they are read in part; the least recently used slots are reused for them */
+  for (size_t k = 0; k < 2; k += 1) {
+    size_t b = (k == 0)? job.first : job.last;
+    size_t begin = b * npc->block_elements;
+    size_t end = begin + cnpy_npc_block_length(npc, b);
+    bool partial = flat_start > begin || flat_start + count < end;
+    size_t slot = cnpy_npc_cache_find(npc, b);
+    job.slot[k] = SIZE_MAX;
+    if (slot == SIZE_MAX && partial && (k == 0 || job.last != job.first)) {
+      slot = 0;
+      for (size_t i = 1; i < CNPY_NPC_CACHE_BLOCKS; i += 1) {
+        slot = (npc->last_use[i] < npc->last_use[slot])? i : slot;
+      }
+      npc->cached[slot] = SIZE_MAX;
+      job.slot[k] = slot;
+    }
+    if (slot != SIZE_MAX) {
+      npc->clock += 1;
+      npc->last_use[slot] = npc->clock;
+    }
+  }
+
+  size_t n_work = job.last - job.first + 1;
+  size_t n_threads = (npc->n_threads < n_work)? npc->n_threads : n_work;
+  cnpy_parallel_for(n_threads, cnpy_npc_read_worker, &job);
+  if (job.err > 0) {
+    return cnpy_error(CNPY_ERROR_FILE, "pread() failed for block %zu: %s", job.err_block, strerror(job.err));
+  }
+  if (job.err < 0) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Invalid data in block %zu", job.err_block);
+  }
+
+  size_t size = cnpy_dtype_sizes[npc->arr.dtype];
+  size_t block_bytes = (npc->block_elements * size + 63) / 64 * 64;
+  for (size_t k = 0; k < 2; k += 1) {
+    if (job.slot[k] == SIZE_MAX) {
+      continue;
+    }
+    size_t b = (k == 0)? job.first : job.last;
+    size_t begin = b * npc->block_elements;
+    size_t lo = (flat_start > begin)? flat_start : begin;
+    size_t hi = (flat_start + count < begin + npc->block_elements)? flat_start + count : begin + npc->block_elements;
+    npc->cached[job.slot[k]] = b;
+    memcpy((char *) out + (lo - flat_start) * size, npc->cache + job.slot[k] * block_bytes + (lo - begin) * size, (hi - lo) * size);
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Probing and opening many files
+ *
+ * cnpy_stat() reads the metadata of a file from its header (with a single pread() for almost all files), without mapping the file.
+ * cnpy_open_many() opens, or only probes, a batch of files on several threads; they are handed out one at a time, since they differ in size.
+ * File names are relative to a directory file descriptor, as for openat() (AT_FDCWD: the working directory).
+ * Errors are reported per file into buffers of the caller, never to cnpy_error_str, so both can be called from any thread.
+ */
+
+
+/*
+ * Read the metadata of the .npy file fn (relative to the directory dir_fd) into *meta, whose raw_data is set to NULL.
+ * On failure, *meta is not changed, and a message is written to error_str (CNPY_ERROR_STR_SIZE bytes) unless it is NULL.
+ */
+cnpy_status cnpy_stat(int dir_fd, const char * const fn, cnpy_array *meta, char *error_str) {
+  assert(fn != NULL);
+  assert(meta != NULL);
+
+  char ignored[CNPY_ERROR_STR_SIZE];
+  error_str = (error_str != NULL)? error_str : ignored;
+  int fd = openat(dir_fd, fn, O_RDONLY);
+  if (fd == -1) {
+    return cnpy_error_to(error_str, CNPY_ERROR_FILE, "Could not open file: %s", strerror(errno));
+  }
+  cnpy_array tmp;
+  cnpy_status status = cnpy_pread_header_to(fd, CNPY_READER_MAX_HEADER, &tmp, error_str);
+  close(fd); /* the file was only read, so there is no point in checking for errors */
+  if (status == CNPY_SUCCESS) {
+    *meta = tmp;
+  }
+  return status;
+}
+
+
+typedef struct {
+  int dir_fd;
+  const char * const *fns;
+  size_t n;
+  const cnpy_open_options *opts; /* NULL: only read the metadata */
+  cnpy_array *arrs;
+  cnpy_status *statuses;
+  char (*error_strs)[CNPY_ERROR_STR_SIZE]; /* may be NULL */
+  size_t next; /* index of the next file */
+} cnpy_open_many_job;
+
+
+static void cnpy_open_many_worker(void *arg, size_t t, size_t n_threads) {
+  (void) t;
+  (void) n_threads;
+  cnpy_open_many_job *job = (cnpy_open_many_job *) arg;
+  char ignored[CNPY_ERROR_STR_SIZE];
+  for (;;) {
+    size_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+    if (i >= job->n) {
+      break;
+    }
+    char *error_str = (job->error_strs != NULL)? job->error_strs[i] : ignored;
+    if (job->opts != NULL) {
+      job->statuses[i] = cnpy_open_to(job->dir_fd, job->fns[i], job->opts, &job->arrs[i], error_str);
+    }
+    else {
+      job->statuses[i] = cnpy_stat(job->dir_fd, job->fns[i], &job->arrs[i], error_str);
+    }
+  }
+}
+
+
+/*
+ * Open the n files fns[i] (relative to the directory dir_fd) into arrs[i] as cnpy_open_ex() with the options *opts does,
+ * or only read their metadata as cnpy_stat() does if opts is NULL, using n_threads threads (0: one per online CPU).
+ * The status of each file is written to statuses[i], and if error_strs is not NULL, the message of a failure to error_strs[i].
+ * arrs[i] is only changed if the file was opened; each such array must be closed with cnpy_close().
+ * Returns CNPY_SUCCESS if all files were opened, and the status of the first file which was not otherwise.
+ */
+cnpy_status cnpy_open_many(int dir_fd, const char * const *fns, size_t n, const cnpy_open_options *opts, cnpy_array *arrs, cnpy_status *statuses, char (*error_strs)[CNPY_ERROR_STR_SIZE], size_t n_threads) {
+  assert(n == 0 || (fns != NULL && arrs != NULL && statuses != NULL));
+
+  n_threads = cnpy_n_threads(n_threads);
+  n_threads = (n_threads < n)? n_threads : (n > 0)? n : 1;
+  cnpy_open_many_job job;
+  job.dir_fd = dir_fd;
+  job.fns = fns;
+  job.n = n;
+  job.opts = opts;
+  job.arrs = arrs;
+  job.statuses = statuses;
+  job.error_strs = error_strs;
+  job.next = 0;
+  cnpy_parallel_for(n_threads, cnpy_open_many_worker, &job);
+  for (size_t i = 0; i < n; i += 1) {
+    if (statuses[i] != CNPY_SUCCESS) {
+      return statuses[i];
+    }
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * cnpy_open_many() without opts, which on failure also gives the index of the first file which failed in *failed and its message in msg.
+ * That file is read again for its message, so that no buffer for n messages is needed.
+ */
+static cnpy_status cnpy_stat_many(int dir_fd, const char * const *fns, size_t n, cnpy_array *arrs, cnpy_status *statuses, size_t n_threads, size_t *failed, char *msg) {
+  cnpy_status status = cnpy_open_many(dir_fd, fns, n, NULL, arrs, statuses, NULL, n_threads);
+  if (status != CNPY_SUCCESS) {
+    size_t i = 0;
+    while (statuses[i] == CNPY_SUCCESS) {
+      i += 1;
+    }
+    cnpy_array meta;
+    msg[0] = '\0';
+    cnpy_stat(dir_fd, fns[i], &meta, msg);
+    *failed = i;
+  }
+  return status;
+}
+
+
+/*
+ * Directory catalogs
+ *
+ * A catalog is an index file of the metadata of all .npy files in a directory, so that a process can learn the shapes and types
+ * of many arrays by mapping one file, instead of opening and parsing each of them.
+ * The entries are sorted by name for binary search; a rebuild reuses the entries of files whose inode, modification time and size did not change.
+ * The layout is (integers are little endian):
+ *
+ *   0       "\x93CNPYI", major version 1, minor version 0
+ *   8       number of entries n (u64)
+ *   16      length of the path of the directory (u64)
+ *   24      size of the file (u64)
+ *   32      reserved (zero) up to 64
+ *   64      the path of the directory, padded with zeros to a multiple of 8
+ *   E       n entries of CNPY_CATALOG_ENTRY bytes, sorted by name (compared bytewise)
+ *   E + 64n the names and the dimensions of the entries, at the offsets given in the entries
+ *
+ * An entry holds the offset (u64) and length (u32) of the name, dtype, byte order, order and number of dimensions (one byte each),
+ * the inode (u64), the modification time (u64 seconds, u32 nanoseconds, u32 reserved), the size of the file (u64),
+ * the offset of the data in the file (u64), and the offset of the dimensions (u64 each).
+ */
+
+
+#define CNPY_CATALOG_PREFIX 64
+#define CNPY_CATALOG_ENTRY 64
+
+
+typedef struct {
+  char *raw_data; /* the mapping of the index file */
+  size_t raw_data_size;
+  size_t n_entries;
+  const char *entries;
+  int dir_fd; /* the directory, or -1 if it could not be opened */
+} cnpy_catalog;
+
+
+/* A file found while building a catalog. */
+typedef struct {
+  const char *name;
+  size_t name_len;
+  uint64_t inode;
+  int64_t mtime_sec;
+  uint32_t mtime_nsec;
+  cnpy_array arr; /* metadata; raw_data_size is the size of the file */
+  cnpy_status status;
+} cnpy_catalog_item;
+
+
+static int cnpy_catalog_cmp(const char *a, size_t a_len, const char *b, size_t b_len) {
+  int c = memcmp(a, b, (a_len < b_len)? a_len : b_len);
+  return (c != 0)? c : (a_len < b_len)? -1 : (a_len > b_len)? 1 : 0;
+}
+
+
+static void cnpy_catalog_sift_down(cnpy_catalog_item *items, size_t i, size_t n) {
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= n) {
+      break;
+    }
+    if (child + 1 < n && cnpy_catalog_cmp(items[child].name, items[child].name_len, items[child + 1].name, items[child + 1].name_len) < 0) {
+      child += 1;
+    }
+    if (cnpy_catalog_cmp(items[i].name, items[i].name_len, items[child].name, items[child].name_len) >= 0) {
+      break;
+    }
+    cnpy_catalog_item tmp = items[i];
+    items[i] = items[child];
+    items[child] = tmp;
+    i = child;
+  }
+}
+
+
+/* Sort the items by name (heapsort, which needs no memory). */
+static void cnpy_catalog_sort(cnpy_catalog_item *items, size_t n) {
+  for (size_t i = n / 2; i > 0; i -= 1) {
+    cnpy_catalog_sift_down(items, i - 1, n);
+  }
+  for (size_t end = n; end > 1; end -= 1) {
+    cnpy_catalog_item tmp = items[0];
+    items[0] = items[end - 1];
+    items[end - 1] = tmp;
+    cnpy_catalog_sift_down(items, 0, end - 1);
+  }
+}
+
+
+static const char *cnpy_catalog_entry(const cnpy_catalog *cat, size_t i) {
+  return cat->entries + i * CNPY_CATALOG_ENTRY;
+}
+
+
+/* The name of the i-th entry, or NULL if the entry is corrupt. */
+static const char *cnpy_catalog_entry_name(const cnpy_catalog *cat, size_t i, size_t *len) {
+  const char *e = cnpy_catalog_entry(cat, i);
+  uint64_t offset = cnpy_zip_u64(e);
+  uint64_t n = cnpy_zip_u32(e + 8);
+  if (offset > cat->raw_data_size || n > cat->raw_data_size - offset) {
+    return NULL;
+  }
+  *len = (size_t) n;
+  return cat->raw_data + offset;
+}
+
+
+/* Binary search for name; returns the index of its entry, or cat->n_entries if there is none. */
+static size_t cnpy_catalog_find(const cnpy_catalog *cat, const char *name, size_t name_len) {
+  size_t lo = 0;
+  size_t hi = cat->n_entries;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    size_t len;
+    const char *entry_name = cnpy_catalog_entry_name(cat, mid, &len);
+    if (entry_name == NULL) {
+      return cat->n_entries;
+    }
+    int c = cnpy_catalog_cmp(entry_name, len, name, name_len);
+    if (c == 0) {
+      return mid;
+    }
+    if (c < 0) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return cat->n_entries;
+}
+
+
+/* Read the i-th entry into *item (except for its name); returns false if it is corrupt or has more than CNPY_MAX_DIM dimensions. */
+static bool cnpy_catalog_read_entry(const cnpy_catalog *cat, size_t i, cnpy_catalog_item *item) {
+  const char *e = cnpy_catalog_entry(cat, i);
+  uint8_t dtype = (uint8_t) e[12];
+  uint8_t byte_order = (uint8_t) e[13];
+  uint8_t order = (uint8_t) e[14];
+  uint8_t n_dim = (uint8_t) e[15];
+  uint64_t dims_offset = cnpy_zip_u64(e + 56);
+  if (dtype > CNPY_C16 || byte_order > CNPY_NE || order > CNPY_FORTRAN_ORDER || n_dim > CNPY_MAX_DIM
+      || dims_offset > cat->raw_data_size || 8 * (uint64_t) n_dim > cat->raw_data_size - dims_offset) {
+    return false;
+  }
+  item->inode = cnpy_zip_u64(e + 16);
+  item->mtime_sec = (int64_t) cnpy_zip_u64(e + 24);
+  item->mtime_nsec = cnpy_zip_u32(e + 32);
+  cnpy_array *arr = &item->arr;
+  arr->dtype = (cnpy_dtype) dtype;
+  arr->byte_order = (cnpy_byte_order) byte_order;
+  arr->order = (cnpy_flat_order) order;
+  arr->n_dim = n_dim;
+  uint64_t data_size = cnpy_dtype_sizes[dtype];
+  for (size_t k = 0; k < n_dim; k += 1) {
+    arr->dims[k] = (size_t) cnpy_zip_u64(cat->raw_data + dims_offset + 8 * k);
+    if (__builtin_mul_overflow(data_size, (uint64_t) arr->dims[k], &data_size)) {
+      return false;
+    }
+  }
+  arr->raw_data = NULL;
+  arr->data_begin = (size_t) cnpy_zip_u64(e + 48);
+  arr->raw_data_size = (size_t) cnpy_zip_u64(e + 40);
+  arr->map_size = 0;
+  arr->fd = -1;
+  arr->read_only = false;
+  /* the same checks as for a header read from the file */
+  return n_dim > 0 && data_size > 0 && arr->data_begin % 16 == 0 && arr->data_begin <= arr->raw_data_size && arr->raw_data_size - arr->data_begin == data_size;
+}
+
+
+/*
+ * Map the catalog index_fn read-only, and open the directory it describes.
+ * Only the prefix is checked here; each entry is checked when it is used.
+ * On failure, *cat is not changed.
+ */
+cnpy_status cnpy_catalog_open(const char * const index_fn, cnpy_catalog *cat) {
+  assert(index_fn != NULL);
+  assert(cat != NULL);
+
+  int fd = open(index_fn, O_RDONLY);
+  if (fd == -1) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not open catalog: %s", strerror(errno));
+  }
+  off_t file_size = lseek(fd, 0, SEEK_END);
+  if (file_size < CNPY_CATALOG_PREFIX) {
+    close(fd);
+    return cnpy_error(CNPY_ERROR_FORMAT, "Catalog is too short");
+  }
+  size_t size = (size_t) file_size;
+  void *raw_data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); /* the mapping keeps the file */
+  if (raw_data == MAP_FAILED) {
+    return cnpy_error(CNPY_ERROR_MMAP, "mmap() of catalog failed: %s", strerror(errno));
+  }
+
+  const char *p = (const char *) raw_data;
+  uint64_t n = cnpy_zip_u64(p + 8);
+  uint64_t dir_len = cnpy_zip_u64(p + 16);
+  uint64_t entries = 0;
+  cnpy_status status = CNPY_SUCCESS;
+  if (memcmp(p, "\x93" "CNPYI\x01\x00", 8) != 0) {
+    status = cnpy_error(CNPY_ERROR_FORMAT, "Not a catalog, or an unsupported version");
+  }
+  else if (cnpy_zip_u64(p + 24) != size || dir_len > size - CNPY_CATALOG_PREFIX
+           || (entries = CNPY_CATALOG_PREFIX + (dir_len + 7) / 8 * 8) > size || n > (size - entries) / CNPY_CATALOG_ENTRY) {
+    status = cnpy_error(CNPY_ERROR_FORMAT, "Catalog is truncated or corrupt");
+  }
+  if (status != CNPY_SUCCESS) {
+    munmap(raw_data, size);
+    return status;
+  }
+
+  /* the path is not terminated in the file */
+  char dir[PATH_MAX];
+  int dir_fd = -1;
+  if (dir_len < sizeof(dir)) {
+    memcpy(dir, p + CNPY_CATALOG_PREFIX, (size_t) dir_len);
+    dir[dir_len] = '\0';
+    dir_fd = open(dir, O_RDONLY);
+  }
+  cat->raw_data = (char *) raw_data;
+  cat->raw_data_size = size;
+  cat->n_entries = (size_t) n;
+  cat->entries = p + entries;
+  cat->dir_fd = dir_fd;
+  return CNPY_SUCCESS;
+}
+
+
+cnpy_status cnpy_catalog_close(cnpy_catalog *cat) {
+  assert(cat != NULL && cat->raw_data != NULL);
+  if (cat->dir_fd != -1) {
+    close(cat->dir_fd);
+  }
+  int err = munmap(cat->raw_data, cat->raw_data_size);
+  cat->raw_data = NULL;
+  if (err != 0) {
+    return cnpy_error(CNPY_ERROR_MMAP, "munmap() of catalog failed: %s", strerror(errno));
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * The name of the i-th entry of cat (in sorted order), which is not terminated; its length is written to *len.
+ * Returns NULL if the entry is corrupt.
+ */
+const char *cnpy_catalog_name(const cnpy_catalog *cat, size_t i, size_t *len) {
+  assert(cat != NULL && cat->raw_data != NULL);
+  assert(i < cat->n_entries);
+  assert(len != NULL);
+  return cnpy_catalog_entry_name(cat, i, len);
+}
+
+
+/* Write the metadata of the i-th entry of cat to *meta (whose raw_data is NULL), as cnpy_stat() would read it from the file. */
+cnpy_status cnpy_catalog_get_at(const cnpy_catalog *cat, size_t i, cnpy_array *meta) {
+  assert(cat != NULL && cat->raw_data != NULL);
+  assert(i < cat->n_entries);
+  assert(meta != NULL);
+  cnpy_catalog_item item;
+  if (!cnpy_catalog_read_entry(cat, i, &item)) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Catalog entry %zu is corrupt or has too many dimensions", i);
+  }
+  *meta = item.arr;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Write the metadata of the file name (relative to the directory of the catalog) to *meta, without reading the file.
+ * Returns CNPY_ERROR_FILE if there is no such entry. On failure, *meta is not changed.
+ */
+cnpy_status cnpy_catalog_lookup(const cnpy_catalog *cat, const char * const name, cnpy_array *meta) {
+  assert(cat != NULL && cat->raw_data != NULL);
+  assert(name != NULL);
+  size_t i = cnpy_catalog_find(cat, name, strlen(name));
+  if (i == cat->n_entries) {
+    return cnpy_error(CNPY_ERROR_FILE, "No entry '%s' in the catalog", name);
+  }
+  return cnpy_catalog_get_at(cat, i, meta);
+}
+
+
+/*
+ * Map the file name of the directory of the catalog as cnpy_open_ex() does with the options *opts, using the metadata of its entry instead of parsing the header.
+ * Fails with CNPY_ERROR_FORMAT if the file was replaced or changed (inode, modification time, or size) since the catalog was built.
+ * On failure, *arr is not changed.
+ */
+cnpy_status cnpy_catalog_map(const cnpy_catalog *cat, const char * const name, const cnpy_open_options *opts, cnpy_array *arr) {
+  assert(cat != NULL && cat->raw_data != NULL);
+  assert(name != NULL);
+  assert(opts != NULL);
+  assert(arr != NULL);
+
+  if (opts->growable && opts->mode != CNPY_MAP_WRITABLE) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Growable arrays need CNPY_MAP_WRITABLE");
+  }
+  size_t i = cnpy_catalog_find(cat, name, strlen(name));
+  if (i == cat->n_entries) {
+    return cnpy_error(CNPY_ERROR_FILE, "No entry '%s' in the catalog", name);
+  }
+  cnpy_catalog_item item;
+  if (!cnpy_catalog_read_entry(cat, i, &item)) {
+    return cnpy_error(CNPY_ERROR_FORMAT, "Catalog entry %zu is corrupt or has too many dimensions", i);
+  }
+  if (cat->dir_fd == -1) {
+    return cnpy_error(CNPY_ERROR_FILE, "The directory of the catalog could not be opened");
+  }
+  int fd = openat(cat->dir_fd, name, (opts->mode == CNPY_MAP_WRITABLE)? O_RDWR : O_RDONLY);
+  if (fd == -1) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not open file: %s", strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return cnpy_error(CNPY_ERROR_FILE, "fstat() failed: %s", strerror(errno));
+  }
+  if ((uint64_t) st.st_ino != item.inode || (int64_t) st.st_mtim.tv_sec != item.mtime_sec || (uint32_t) st.st_mtim.tv_nsec != item.mtime_nsec
+      || (uint64_t) st.st_size != (uint64_t) item.arr.raw_data_size) {
+    close(fd);
+    return cnpy_error(CNPY_ERROR_FORMAT, "File '%s' changed since the catalog was built", name);
+  }
+
+  cnpy_fadvise(fd, opts);
+  size_t map_size = cnpy_map_size(item.arr.raw_data_size, opts);
+  void *raw_data = mmap(
+    NULL,
+    map_size,
+    (opts->mode == CNPY_MAP_READ_ONLY)? PROT_READ : PROT_READ | PROT_WRITE,
+    ((opts->mode == CNPY_MAP_PRIVATE)? MAP_PRIVATE : MAP_SHARED) | cnpy_map_flags(opts),
+    fd,
+    0
+  );
+  if (raw_data == MAP_FAILED) {
+    close(fd);
+    return cnpy_error(CNPY_ERROR_MMAP, "mmap() of file failed: %s", strerror(errno));
+  }
+  bool keep_fd = opts->growable;
+  if (!keep_fd && close(fd) != 0) {
+    munmap(raw_data, map_size);
+    return cnpy_error(CNPY_ERROR_FILE, "Could not close file after mmap(): %s", strerror(errno));
+  }
+  cnpy_status status = cnpy_apply_map_options((char *) raw_data, map_size, opts, NULL);
+  if (status != CNPY_SUCCESS) {
+    munmap(raw_data, map_size);
+    if (keep_fd) {
+      close(fd);
+    }
+    return status;
+  }
+  item.arr.raw_data = (char *) raw_data;
+  item.arr.map_size = map_size;
+  item.arr.fd = keep_fd? fd : -1;
+  item.arr.read_only = opts->mode == CNPY_MAP_READ_ONLY;
+  *arr = item.arr;
+  return CNPY_SUCCESS;
+}
+
+
+static bool cnpy_catalog_is_npy(const char *name, size_t len) {
+  return len > 4 && memcmp(name + len - 4, ".npy", 4) == 0;
+}
+
+
+typedef struct {
+  char *raw_data; /* one anonymous mapping of the arrays below and the names */
+  size_t map_size;
+  size_t n; /* regular .npy files listed */
+  cnpy_catalog_item *items; /* name, name_len and the fstatat() fields; arr.raw_data_size is the file size */
+  const char **fns; /* the names again, as arguments of cnpy_open_many() */
+  cnpy_array *arrs;
+  cnpy_status *statuses;
+  size_t *indices; /* n indices, for the caller */
+  int dir_fd;
+} cnpy_npy_listing;
+
+
+/*
+ * List the regular .npy files in the directory dir into one anonymous mapping, which also holds the arguments of
+ * cnpy_open_many() for them. On success, the caller unmaps listing->raw_data and closes listing->dir_fd.
+ */
+static cnpy_status cnpy_list_npy(const char * const dir, cnpy_npy_listing *listing) {
+  int dir_fd = open(dir, O_RDONLY);
+  if (dir_fd == -1) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not open directory: %s", strerror(errno));
+  }
+  DIR *d = opendir(dir);
+  if (d == NULL) {
+    close(dir_fd);
+    return cnpy_error(CNPY_ERROR_FILE, "Could not read directory: %s", strerror(errno));
+  }
+
+  /* count the files first, so that one anonymous mapping holds the items, their names, and the arguments of cnpy_open_many() */
+  size_t n = 0;
+  size_t names_size = 0;
+  struct dirent *de;
+  while ((de = readdir(d)) != NULL) {
+    size_t len = strlen(de->d_name);
+    if (cnpy_catalog_is_npy(de->d_name, len)) {
+      n += 1;
+      names_size += len + 1;
+    }
+  }
+  size_t items_size = (n * sizeof(cnpy_catalog_item) + 63) / 64 * 64;
+  size_t map_size = items_size + n * (sizeof(cnpy_array) + sizeof(const char *) + sizeof(size_t) + sizeof(cnpy_status)) + names_size + 64;
+  char *buf = (char *) mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED) {
+    closedir(d);
+    close(dir_fd);
+    return cnpy_error(CNPY_ERROR_MMAP, "Could not map memory: %s", strerror(errno));
+  }
+  cnpy_catalog_item *items = (cnpy_catalog_item *) buf;
+  cnpy_array *arrs = (cnpy_array *) (buf + items_size);
+  const char **fns = (const char **) (arrs + n);
+  size_t *indices = (size_t *) (fns + n);
+  cnpy_status *statuses = (cnpy_status *) (indices + n);
+  char *names = (char *) (statuses + n);
+
+  /* the directory may change in between; files beyond the counted space are left out */
+  rewinddir(d);
+  size_t n_items = 0;
+  size_t names_used = 0;
+  while (n_items < n && (de = readdir(d)) != NULL) {
+    size_t len = strlen(de->d_name);
+    if (!cnpy_catalog_is_npy(de->d_name, len) || names_used + len + 1 > names_size) {
+      continue;
+    }
+    memcpy(names + names_used, de->d_name, len + 1);
+    struct stat st;
+    if (fstatat(dir_fd, names + names_used, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    cnpy_catalog_item *item = &items[n_items];
+    item->name = names + names_used;
+    item->name_len = len;
+    item->inode = (uint64_t) st.st_ino;
+    item->mtime_sec = (int64_t) st.st_mtim.tv_sec;
+    item->mtime_nsec = (uint32_t) st.st_mtim.tv_nsec;
+    item->arr.raw_data_size = (size_t) st.st_size;
+    item->status = CNPY_ERROR_FILE;
+    fns[n_items] = item->name;
+    names_used += len + 1;
+    n_items += 1;
+  }
+  closedir(d);
+
+  listing->raw_data = buf;
+  listing->map_size = map_size;
+  listing->n = n_items;
+  listing->items = items;
+  listing->fns = fns;
+  listing->arrs = arrs;
+  listing->statuses = statuses;
+  listing->indices = indices;
+  listing->dir_fd = dir_fd;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Build the catalog index_fn of the .npy files in the directory dir (not in its subdirectories), reading the headers with n_threads threads (0: one per online CPU).
+ * If index_fn is a catalog of dir already, the entries of files whose inode, modification time and size are unchanged are kept without reading the files.
+ * Files which are not valid .npy files are left out. The new catalog replaces index_fn atomically (with rename()), so that readers never see a partial file.
+ * dir is stored as given; if it is relative, cnpy_catalog_open() resolves it relative to the working directory at that time.
+ */
+cnpy_status cnpy_catalog_build(const char * const dir, const char * const index_fn, size_t n_threads) {
+  assert(dir != NULL);
+  assert(index_fn != NULL);
+
+  size_t dir_len = strlen(dir);
+  char tmp_fn[PATH_MAX];
+  if (snprintf(tmp_fn, sizeof(tmp_fn), "%s.%ld.tmp", index_fn, (long) getpid()) >= (int) sizeof(tmp_fn)) {
+    return cnpy_error(CNPY_ERROR_FILE, "File name too long");
+  }
+  cnpy_npy_listing listing;
+  cnpy_status listed = cnpy_list_npy(dir, &listing);
+  if (listed != CNPY_SUCCESS) {
+    return listed;
+  }
+  int dir_fd = listing.dir_fd;
+  size_t n_items = listing.n;
+  cnpy_catalog_item *items = listing.items;
+  cnpy_array *todo_arrs = listing.arrs;
+  const char **todo_fns = listing.fns; /* refilled below; the names stay in the items */
+  size_t *todo_items = listing.indices;
+  cnpy_status *todo_statuses = listing.statuses;
+
+  /* reuse the entries of unchanged files from the previous catalog of the same directory, and read the headers of the others */
+  cnpy_catalog old;
+  bool have_old = cnpy_catalog_open(index_fn, &old) == CNPY_SUCCESS;
+  if (have_old && (cnpy_zip_u64(old.raw_data + 16) != dir_len || memcmp(old.raw_data + CNPY_CATALOG_PREFIX, dir, dir_len) != 0)) {
+    cnpy_catalog_close(&old);
+    have_old = false;
+  }
+  cnpy_error_reset(); /* a missing or foreign catalog is not an error */
+  size_t n_todo = 0;
+  for (size_t i = 0; i < n_items; i += 1) {
+    cnpy_catalog_item *item = &items[i];
+    size_t j = have_old? cnpy_catalog_find(&old, item->name, item->name_len) : 0;
+    cnpy_catalog_item prev;
+    if (have_old && j < old.n_entries && cnpy_catalog_read_entry(&old, j, &prev) && prev.inode == item->inode
+        && prev.mtime_sec == item->mtime_sec && prev.mtime_nsec == item->mtime_nsec && prev.arr.raw_data_size == item->arr.raw_data_size) {
+      item->arr = prev.arr;
+      item->status = CNPY_SUCCESS;
+    }
+    else {
+      todo_fns[n_todo] = item->name;
+      todo_items[n_todo] = i;
+      n_todo += 1;
+    }
+  }
+  if (have_old) {
+    cnpy_catalog_close(&old);
+  }
+  cnpy_open_many(dir_fd, todo_fns, n_todo, NULL, todo_arrs, todo_statuses, NULL, n_threads);
+  close(dir_fd);
+  for (size_t k = 0; k < n_todo; k += 1) {
+    cnpy_catalog_item *item = &items[todo_items[k]];
+    /* the size is the one from fstatat(), which the next build compares against */
+    if (todo_statuses[k] == CNPY_SUCCESS && todo_arrs[k].raw_data_size == item->arr.raw_data_size) {
+      item->arr = todo_arrs[k];
+      item->status = CNPY_SUCCESS;
+    }
+  }
+
+  /* keep the valid files, sorted by name */
+  size_t n_entries = 0;
+  size_t data_size = 0;
+  for (size_t i = 0; i < n_items; i += 1) {
+    if (items[i].status == CNPY_SUCCESS) {
+      data_size += (items[i].name_len + 7) / 8 * 8 + 8 * items[i].arr.n_dim;
+      items[n_entries] = items[i];
+      n_entries += 1;
+    }
+  }
+  cnpy_catalog_sort(items, n_entries);
+
+  size_t entries = CNPY_CATALOG_PREFIX + (dir_len + 7) / 8 * 8;
+  size_t size = entries + n_entries * CNPY_CATALOG_ENTRY + data_size;
+  cnpy_status status = CNPY_SUCCESS;
+  int fd = open(tmp_fn, O_RDWR | O_CREAT | O_TRUNC, (mode_t) 0644);
+  if (fd == -1) {
+    status = cnpy_error(CNPY_ERROR_FILE, "Could not create file: %s", strerror(errno));
+  }
+  else if (ftruncate(fd, (off_t) size) != 0) {
+    status = cnpy_error(CNPY_ERROR_FILE, "ftruncate() failed: %s", strerror(errno));
+  }
+  char *out = NULL;
+  if (status == CNPY_SUCCESS) {
+    out = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (out == MAP_FAILED) {
+      out = NULL;
+      status = cnpy_error(CNPY_ERROR_MMAP, "mmap() failed: %s", strerror(errno));
+    }
+  }
+  if (status == CNPY_SUCCESS) {
+    /* the file is zero-filled by ftruncate() */
+    memcpy(out, "\x93" "CNPYI\x01\x00", 8);
+    cnpy_zip_put64(out + 8, n_entries);
+    cnpy_zip_put64(out + 16, dir_len);
+    cnpy_zip_put64(out + 24, size);
+    memcpy(out + CNPY_CATALOG_PREFIX, dir, dir_len);
+    size_t pos = entries + n_entries * CNPY_CATALOG_ENTRY;
+    for (size_t i = 0; i < n_entries; i += 1) {
+      const cnpy_catalog_item *item = &items[i];
+      char *e = out + entries + i * CNPY_CATALOG_ENTRY;
+      cnpy_zip_put64(e, pos);
+      cnpy_zip_put32(e + 8, item->name_len);
+      memcpy(out + pos, item->name, item->name_len);
+      pos += (item->name_len + 7) / 8 * 8;
+      e[12] = (char) item->arr.dtype;
+      e[13] = (char) item->arr.byte_order;
+      e[14] = (char) item->arr.order;
+      e[15] = (char) item->arr.n_dim;
+      cnpy_zip_put64(e + 16, item->inode);
+      cnpy_zip_put64(e + 24, (uint64_t) item->mtime_sec);
+      cnpy_zip_put32(e + 32, item->mtime_nsec);
+      cnpy_zip_put64(e + 40, item->arr.raw_data_size);
+      cnpy_zip_put64(e + 48, item->arr.data_begin);
+      cnpy_zip_put64(e + 56, pos);
+      for (size_t k = 0; k < item->arr.n_dim; k += 1) {
+        cnpy_zip_put64(out + pos, item->arr.dims[k]);
+        pos += 8;
+      }
+    }
+    assert(pos == size);
+    if (munmap(out, size) != 0) {
+      status = cnpy_error(CNPY_ERROR_MMAP, "munmap() failed: %s", strerror(errno));
+    }
+  }
+  if (fd != -1 && close(fd) != 0 && status == CNPY_SUCCESS) {
+    status = cnpy_error(CNPY_ERROR_FILE, "Could not close file: %s", strerror(errno));
+  }
+  if (status == CNPY_SUCCESS && rename(tmp_fn, index_fn) != 0) {
+    status = cnpy_error(CNPY_ERROR_FILE, "Could not replace the catalog: %s", strerror(errno));
+  }
+  if (status != CNPY_SUCCESS && fd != -1) {
+    unlink(tmp_fn);
+  }
+  munmap(listing.raw_data, listing.map_size);
+  return status;
+}
+
+
+/*
+ * Concatenated arrays
+ *
+ * A cnpy_concat presents several .npy files (shards) as one array, concatenated along the first axis, without copying them.
+ * The shards must have the same dtype, byte order and trailing dimensions, and be in C order (unless they have a single axis),
+ * so that the flat indices of the concatenation run through the rows of the first shard, then those of the second, and so on.
+ *
+ * Opening reads only the headers of the shards. A shard is mapped when it is first accessed, and at most max_mapped shards are
+ * mapped at once: when another one is needed, the least recently used one is unmapped. A global row is resolved to its shard by
+ * binary search in the prefix sums of the numbers of rows, after checking the shard of the previous access.
+ *
+ * A cnpy_concat must not be used by several threads at once.
+ */
+
+
+#ifndef CNPY_CONCAT_MAX_MAPPED
+#define CNPY_CONCAT_MAX_MAPPED 16 /* default number of shards of a cnpy_concat which are mapped at once */
+#endif
+
+
+typedef struct {
+  cnpy_array arr; /* metadata of the concatenation (in C order); raw_data is NULL */
+  size_t n_shards;
+  size_t row_elements; /* elements per row (the product of the trailing dimensions) */
+  size_t *row_starts; /* n_shards + 1 prefix sums of the numbers of rows; at the start of an anonymous mapping which holds all of the following */
+  cnpy_array *shards; /* metadata of each shard; raw_data is not NULL while it is mapped */
+  const char **fns; /* copies of the file names */
+  uint64_t *last_use; /* time of the last access of each shard */
+  size_t *mapped; /* the shards which are mapped */
+  size_t n_mapped;
+  size_t max_mapped;
+  size_t current; /* shard of the last access */
+  uint64_t clock;
+  cnpy_open_options opts;
+  size_t map_size;
+} cnpy_concat;
+
+
+/* Position of a chunk iteration; see cnpy_concat_iter_init(). */
+typedef struct {
+  size_t next; /* flat index of the first element of the next chunk */
+  size_t end; /* flat index after the last element */
+} cnpy_concat_iter;
+
+
+/*
+ * Open the n files fns[0], ..., fns[n - 1] as the shards of a concatenation, reading their headers with n_threads threads
+ * (0: one per online CPU). Shards are mapped with the options *opts, which must not be growable, and at most max_mapped
+ * (at least 1) at once. On failure, *cat is not changed.
+ */
+cnpy_status cnpy_concat_open_ex(const char * const *fns, size_t n, const cnpy_open_options *opts, size_t max_mapped, size_t n_threads, cnpy_concat *cat) {
+  assert(fns != NULL && n > 0);
+  assert(opts != NULL && !opts->growable);
+  assert(max_mapped > 0);
+  assert(cat != NULL);
+
+  max_mapped = (max_mapped < n)? max_mapped : n;
+  size_t names_size = 0;
+  for (size_t i = 0; i < n; i += 1) {
+    names_size += strlen(fns[i]) + 1;
+  }
+  size_t shards_offset = ((n + 1) * sizeof(size_t) + 63) / 64 * 64;
+  size_t fns_offset = shards_offset + n * sizeof(cnpy_array);
+  size_t last_use_offset = fns_offset + n * sizeof(char *);
+  size_t mapped_offset = last_use_offset + n * sizeof(uint64_t);
+  size_t statuses_offset = mapped_offset + max_mapped * sizeof(size_t);
+  size_t names_offset = statuses_offset + (n * sizeof(cnpy_status) + 7) / 8 * 8;
+  size_t map_size = names_offset + names_size;
+  char *buf = (char *) mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED) {
+    return cnpy_error(CNPY_ERROR_MMAP, "Could not map the list of shards: %s", strerror(errno));
+  }
+
+  cnpy_concat tmp;
+  tmp.row_starts = (size_t *) buf;
+  tmp.shards = (cnpy_array *) (buf + shards_offset);
+  tmp.fns = (const char **) (buf + fns_offset);
+  tmp.last_use = (uint64_t *) (buf + last_use_offset);
+  tmp.mapped = (size_t *) (buf + mapped_offset);
+  cnpy_status *statuses = (cnpy_status *) (buf + statuses_offset);
+  char *names = buf + names_offset;
+  for (size_t i = 0; i < n; i += 1) {
+    size_t len = strlen(fns[i]) + 1;
+    memcpy(names, fns[i], len);
+    tmp.fns[i] = names;
+    names += len;
+    tmp.last_use[i] = 0;
+  }
+
+  size_t failed = 0;
+  char msg[CNPY_ERROR_STR_SIZE];
+  cnpy_status status = cnpy_stat_many(AT_FDCWD, tmp.fns, n, tmp.shards, statuses, n_threads, &failed, msg);
+  if (status != CNPY_SUCCESS) {
+    status = cnpy_error(status, "Shard %zu (%s): %s", failed, tmp.fns[failed], msg);
+  }
+
+  const cnpy_array *first = &tmp.shards[0];
+  size_t rows = 0;
+  tmp.row_elements = 1;
+  for (size_t k = 1; status == CNPY_SUCCESS && k < first->n_dim; k += 1) {
+    tmp.row_elements *= first->dims[k]; /* cannot overflow, the first shard was checked when it was read */
+  }
+  for (size_t i = 0; i < n && status == CNPY_SUCCESS; i += 1) {
+    const cnpy_array *s = &tmp.shards[i];
+    bool same = s->n_dim == first->n_dim && s->dtype == first->dtype && s->byte_order == first->byte_order;
+    for (size_t k = 1; same && k < s->n_dim; k += 1) {
+      same = s->dims[k] == first->dims[k];
+    }
+    if (s->n_dim == 0 || (s->order != CNPY_C_ORDER && s->n_dim > 1)) {
+      status = cnpy_error(CNPY_ERROR_FORMAT, "Shard %zu (%s) is a scalar or not in C order", i, tmp.fns[i]);
+    }
+    else if (!same) {
+      status = cnpy_error(CNPY_ERROR_FORMAT, "Shard %zu (%s) differs from the first in dtype, byte order, or trailing dimensions", i, tmp.fns[i]);
+    }
+    else {
+      tmp.row_starts[i] = rows;
+      size_t total;
+      if (__builtin_add_overflow(rows, s->dims[0], &rows) || __builtin_mul_overflow(rows, tmp.row_elements * cnpy_dtype_sizes[s->dtype], &total)) {
+        status = cnpy_error(CNPY_ERROR_FORMAT, "The shards are too large together");
+      }
+    }
+  }
+  if (status != CNPY_SUCCESS) {
+    munmap(buf, map_size);
+    return status;
+  }
+  tmp.row_starts[n] = rows;
+
+  tmp.arr = *first;
+  tmp.arr.order = CNPY_C_ORDER;
+  tmp.arr.dims[0] = rows;
+  tmp.arr.raw_data = NULL;
+  tmp.arr.data_begin = 0;
+  tmp.arr.raw_data_size = 0;
+  tmp.arr.map_size = 0;
+  tmp.arr.fd = -1;
+  tmp.n_shards = n;
+  tmp.n_mapped = 0;
+  tmp.max_mapped = max_mapped;
+  tmp.current = 0;
+  tmp.clock = 0;
+  tmp.opts = *opts;
+  tmp.map_size = map_size;
+  *cat = tmp;
+  return CNPY_SUCCESS;
+}
+
+
+/* cnpy_concat_open_ex() with read-only mappings, at most CNPY_CONCAT_MAX_MAPPED of them, and one thread per online CPU. */
+cnpy_status cnpy_concat_open(const char * const *fns, size_t n, cnpy_concat *cat) {
+  cnpy_open_options opts;
+  cnpy_open_options_init(&opts);
+  opts.mode = CNPY_MAP_READ_ONLY;
+  return cnpy_concat_open_ex(fns, n, &opts, CNPY_CONCAT_MAX_MAPPED, 0, cat);
+}
+
+
+/* Unmap all shards and release cat. */
+cnpy_status cnpy_concat_close(cnpy_concat *cat) {
+  assert(cat != NULL);
+  assert(cat->row_starts != NULL);
+
+  cnpy_status status = CNPY_SUCCESS;
+  for (size_t k = 0; k < cat->n_mapped; k += 1) {
+    cnpy_status s = cnpy_close(&cat->shards[cat->mapped[k]]);
+    status = (status == CNPY_SUCCESS)? s : status;
+  }
+  cat->n_mapped = 0;
+  munmap(cat->row_starts, cat->map_size); /* cannot fail for a mapping we made */
+  cat->row_starts = NULL;
+  return status;
+}
+
+
+/* The shard which holds the given row (< cat->arr.dims[0]). */
+static size_t cnpy_concat_find(const cnpy_concat *cat, size_t row) {
+  size_t s = cat->current;
+  if (cat->row_starts[s] <= row && row < cat->row_starts[s + 1]) {
+    return s;
+  }
+  /* the first shard whose end lies after row */
+  size_t lo = 0;
+  size_t hi = cat->n_shards;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (cat->row_starts[mid + 1] <= row) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+
+/* Map shard s unless it is mapped, unmapping the least recently used shard if max_mapped are mapped. */
+static cnpy_status cnpy_concat_map(cnpy_concat *cat, size_t s) {
+  cat->clock += 1;
+  cat->last_use[s] = cat->clock;
+  cat->current = s;
+  if (cat->shards[s].raw_data != NULL) {
+    return CNPY_SUCCESS;
+  }
+
+  size_t slot = cat->n_mapped;
+  if (slot == cat->max_mapped) {
+    slot = 0;
+    for (size_t k = 1; k < cat->n_mapped; k += 1) {
+      slot = (cat->last_use[cat->mapped[k]] < cat->last_use[cat->mapped[slot]])? k : slot;
+    }
+    cnpy_status status = cnpy_close(&cat->shards[cat->mapped[slot]]);
+    cat->n_mapped -= 1;
+    cat->mapped[slot] = cat->mapped[cat->n_mapped];
+    slot = cat->n_mapped;
+    if (status != CNPY_SUCCESS) {
+      return status;
+    }
+  }
+
+  /* the file may have been replaced since its header was read */
+  const cnpy_array *meta = &cat->shards[s];
+  cnpy_array arr;
+  cnpy_status status = cnpy_open_ex(cat->fns[s], &cat->opts, &arr);
+  if (status != CNPY_SUCCESS) {
+    return status;
+  }
+  bool same = arr.dtype == meta->dtype && arr.byte_order == meta->byte_order && arr.order == meta->order && arr.n_dim == meta->n_dim
+    && arr.data_begin == meta->data_begin;
+  for (size_t k = 0; same && k < arr.n_dim; k += 1) {
+    same = arr.dims[k] == meta->dims[k];
+  }
+  if (!same) {
+    cnpy_close(&arr); /* the error below is more relevant */
+    return cnpy_error(CNPY_ERROR_FORMAT, "Shard %zu (%s) changed since the concatenation was opened", s, cat->fns[s]);
+  }
+  cat->shards[s] = arr;
+  cat->mapped[slot] = s;
+  cat->n_mapped += 1;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Map the shard which holds the element at the flat index flat (< the number of elements), and store the address of the element
+ * in *addr and the number of elements from it to the end of the shard in *available.
+ */
+static cnpy_status cnpy_concat_locate(cnpy_concat *cat, size_t flat, char **addr, size_t *available) {
+  size_t s = cnpy_concat_find(cat, flat / cat->row_elements);
+  cnpy_status status = cnpy_concat_map(cat, s);
+  if (status != CNPY_SUCCESS) {
+    return status;
+  }
+  const cnpy_array *shard = &cat->shards[s];
+  size_t local = flat - cat->row_starts[s] * cat->row_elements;
+  *addr = shard->raw_data + shard->data_begin + local * cnpy_dtype_sizes[shard->dtype];
+  *available = (cat->row_starts[s + 1] - cat->row_starts[s]) * cat->row_elements - local;
+  return CNPY_SUCCESS;
+}
+
+
+/* Shard and row within it of the given global row (< cat->arr.dims[0]); no shard is mapped. */
+void cnpy_concat_resolve(const cnpy_concat *cat, size_t row, size_t *shard, size_t *local_row) {
+  assert(cat != NULL && shard != NULL && local_row != NULL);
+  assert(row < cat->arr.dims[0]);
+  *shard = cnpy_concat_find(cat, row);
+  *local_row = row - cat->row_starts[*shard];
+}
+
+
+/* Read count elements starting at the flat index flat_start into out, in host byte order; shard boundaries may be crossed. */
+cnpy_status cnpy_concat_read_range(cnpy_concat *cat, size_t flat_start, size_t count, void *out) {
+  assert(cat != NULL);
+  assert(out != NULL || count == 0);
+  assert(flat_start <= cnpy_n_elements(cat->arr) && count <= cnpy_n_elements(cat->arr) - flat_start);
+
+  size_t size = cnpy_dtype_sizes[cat->arr.dtype];
+  char *dst = (char *) out;
+  while (count > 0) {
+    char *src;
+    size_t available;
+    cnpy_status status = cnpy_concat_locate(cat, flat_start, &src, &available);
+    if (status != CNPY_SUCCESS) {
+      return status;
+    }
+    size_t n = (count < available)? count : available;
+    cnpy_cpy_n(cat->arr, n, src, dst);
+    dst += n * size;
+    flat_start += n;
+    count -= n;
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/* Read the element at index (of length cat->arr.n_dim, in range) into *x, in host byte order. */
+cnpy_status cnpy_concat_get(cnpy_concat *cat, const size_t * const index, void *x) {
+  assert(cat != NULL);
+  assert(x != NULL);
+  return cnpy_concat_read_range(cat, cnpy_flatten_index(cat->arr, index), 1, x);
+}
+
+
+/*
+ * Type specific accessors of concatenations, which check the dtype with assert().
+ */
+
+#define CNPY_CONCAT_DEFINE(name, type, dtype_value) \
+  cnpy_status cnpy_concat_get_##name(cnpy_concat *cat, const size_t * const index, type *x) { \
+    assert(cat->arr.dtype == dtype_value); \
+    return cnpy_concat_get(cat, index, x); \
+  } \
+  \
+  cnpy_status cnpy_concat_read_##name##_range(cnpy_concat *cat, size_t flat_start, size_t count, type *out) { \
+    assert(cat->arr.dtype == dtype_value); \
+    return cnpy_concat_read_range(cat, flat_start, count, out); \
+  }
+
+CNPY_CONCAT_DEFINE(b, bool, CNPY_B)
+CNPY_CONCAT_DEFINE(i1, int8_t, CNPY_I1)
+CNPY_CONCAT_DEFINE(i2, int16_t, CNPY_I2)
+CNPY_CONCAT_DEFINE(i4, int32_t, CNPY_I4)
+CNPY_CONCAT_DEFINE(i8, int64_t, CNPY_I8)
+CNPY_CONCAT_DEFINE(u1, uint8_t, CNPY_U1)
+CNPY_CONCAT_DEFINE(u2, uint16_t, CNPY_U2)
+CNPY_CONCAT_DEFINE(u4, uint32_t, CNPY_U4)
+CNPY_CONCAT_DEFINE(u8, uint64_t, CNPY_U8)
+CNPY_CONCAT_DEFINE(f4, float, CNPY_F4)
+CNPY_CONCAT_DEFINE(f8, double, CNPY_F8)
+CNPY_CONCAT_DEFINE(c8, cnpy_complex_float, CNPY_C8)
+CNPY_CONCAT_DEFINE(c16, cnpy_complex_double, CNPY_C16)
+
+#undef CNPY_CONCAT_DEFINE
+
+
+/* Prepare it for iterating through the count elements of cat starting at the flat index flat_start. */
+void cnpy_concat_iter_init(const cnpy_concat *cat, size_t flat_start, size_t count, cnpy_concat_iter *it) {
+  assert(cat != NULL);
+  assert(it != NULL);
+  assert(flat_start <= cnpy_n_elements(cat->arr) && count <= cnpy_n_elements(cat->arr) - flat_start);
+  it->next = flat_start;
+  it->end = flat_start + count;
+}
+
+
+/*
+ * Store the next chunk of the iteration in *chunk: the longest run of elements which lies in a single shard, with a length of 0
+ * at the end. The chunk points into the mapping of the shard, so its elements are in the byte order of the array, and it is only
+ * valid until the next call with cat.
+ */
+cnpy_status cnpy_concat_next(cnpy_concat *cat, cnpy_concat_iter *it, cnpy_chunk *chunk) {
+  assert(cat != NULL && it != NULL && chunk != NULL);
+
+  chunk->flat_start = it->next;
+  chunk->length = 0;
+  chunk->data = NULL;
+  if (it->next >= it->end) {
+    return CNPY_SUCCESS;
+  }
+  size_t available;
+  cnpy_status status = cnpy_concat_locate(cat, it->next, &chunk->data, &available);
+  if (status != CNPY_SUCCESS) {
+    return status;
+  }
+  chunk->length = (it->end - it->next < available)? it->end - it->next : available;
+  it->next += chunk->length;
+  return CNPY_SUCCESS;
+}
+
+
+/*
+ * Tables
+ *
+ * A cnpy_table is a directory of one-dimensional .npy files of the same length, the columns of the table, which may have
+ * different dtypes. A column is named by its file name without ".npy". Opening the table reads only the headers;
+ * a scan maps just the columns it projects, and runs through them in batches of the same rows of every column.
+ * Pages of the columns are prefetched a few batches ahead, in step across the columns, and released behind the scan
+ * as for cnpy_scan. The batches of a scan can also be handed to several threads.
+ */
+
+
+#ifndef CNPY_TABLE_MAX_SCAN
+#define CNPY_TABLE_MAX_SCAN 32 /* columns which a scan can project */
+#endif
+
+
+typedef struct {
+  char *raw_data; /* an anonymous mapping of the columns and their names */
+  size_t map_size;
+  size_t n_columns;
+  size_t n_rows;
+  cnpy_catalog_item *columns; /* sorted by name; name_len does not count ".npy", arr is the metadata */
+  int dir_fd; /* the directory, for mapping columns */
+} cnpy_table;
+
+
+typedef struct {
+  size_t batch_rows; /* rows per batch; 0: about 4 MiB of the projected columns together */
+  size_t prefetch_batches; /* batches ahead of the current one which are prefetched */
+  cnpy_release release; /* what happens to the pages of batches which were scanned */
+  size_t n_threads; /* threads for mapping the columns and cnpy_table_scan_parallel() (0: one per online CPU) */
+} cnpy_table_scan_options;
+
+
+typedef struct {
+  cnpy_table_scan_options opts;
+  size_t n_columns;
+  cnpy_array columns[CNPY_TABLE_MAX_SCAN]; /* the projected columns, mapped */
+  size_t n_rows;
+  size_t n_batches;
+  size_t next; /* the next batch */
+  size_t prefetched; /* batches below which the pages have been prefetched */
+  size_t released; /* rows below which the pages have been released */
+  size_t page; /* page size */
+} cnpy_table_scan;
+
+
+typedef struct {
+  size_t index; /* number of the batch */
+  size_t row_start; /* first row of the batch */
+  size_t n_rows; /* number of rows of the batch */
+  char *data[CNPY_TABLE_MAX_SCAN]; /* the first element of the batch in each projected column, in the byte order of the column */
+} cnpy_table_batch;
+
+
+/*
+ * Open the directory dir as a table, reading the headers of its .npy files with n_threads threads (0: one per online CPU).
+ * Fails if a .npy file cannot be read, is not one-dimensional, or differs in length from the others. On failure, *table is not changed.
+ */
+cnpy_status cnpy_table_open(const char * const dir, size_t n_threads, cnpy_table *table) {
+  assert(dir != NULL);
+  assert(table != NULL);
+
+  cnpy_npy_listing listing;
+  cnpy_status status = cnpy_list_npy(dir, &listing);
+  if (status != CNPY_SUCCESS) {
+    return status;
+  }
+  int dir_fd = listing.dir_fd;
+  size_t n_columns = listing.n;
+  cnpy_catalog_item *columns = listing.items;
+  cnpy_array *arrs = listing.arrs;
+  const char **fns = listing.fns;
+  cnpy_status *statuses = listing.statuses;
+
+  size_t failed = 0;
+  char msg[CNPY_ERROR_STR_SIZE];
+  status = cnpy_stat_many(dir_fd, fns, n_columns, arrs, statuses, n_threads, &failed, msg);
+  if (status != CNPY_SUCCESS) {
+    status = cnpy_error(status, "Column '%s': %s", fns[failed], msg);
+  }
+  for (size_t i = 0; i < n_columns && status == CNPY_SUCCESS; i += 1) {
+    if (arrs[i].n_dim != 1 || arrs[i].dims[0] != arrs[0].dims[0]) {
+      status = cnpy_error(CNPY_ERROR_FORMAT, "Column '%s' is not one-dimensional or differs in length from '%s'", fns[i], fns[0]);
+    }
+    columns[i].name = fns[i];
+    columns[i].name_len = strlen(fns[i]) - 4;
+    columns[i].arr = arrs[i];
+    columns[i].status = CNPY_SUCCESS;
+  }
+  if (status != CNPY_SUCCESS) {
+    munmap(listing.raw_data, listing.map_size);
+    close(dir_fd);
+    return status;
+  }
+  cnpy_catalog_sort(columns, n_columns);
+
+  table->raw_data = listing.raw_data;
+  table->map_size = listing.map_size;
+  table->n_columns = n_columns;
+  table->n_rows = (n_columns > 0)? arrs[0].dims[0] : 0;
+  table->columns = columns;
+  table->dir_fd = dir_fd;
+  return CNPY_SUCCESS;
+}
+
+
+/* Close a table opened with cnpy_table_open(); scans of it must have ended. */
+cnpy_status cnpy_table_close(cnpy_table *table) {
+  assert(table != NULL);
+  assert(table->raw_data != NULL);
+
+  munmap(table->raw_data, table->map_size); /* cannot fail for a mapping we made */
+  table->raw_data = NULL;
+  int dir_fd = table->dir_fd;
+  table->dir_fd = -1;
+  if (close(dir_fd) != 0) {
+    return cnpy_error(CNPY_ERROR_FILE, "Could not close directory: %s", strerror(errno));
+  }
+  return CNPY_SUCCESS;
+}
+
+
+/* The index of the column name (without ".npy") by binary search, or table->n_columns if there is none. */
+size_t cnpy_table_find(const cnpy_table *table, const char * const name) {
+  assert(table != NULL);
+  assert(name != NULL);
+
+  size_t len = strlen(name);
+  size_t lo = 0;
+  size_t hi = table->n_columns;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    const cnpy_catalog_item *c = &table->columns[mid];
+    int cmp = cnpy_catalog_cmp(c->name, c->name_len, name, len);
+    if (cmp == 0) {
+      return mid;
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return table->n_columns;
+}
+
+
+/* The name (without ".npy", not terminated; its length is stored in *len) and the metadata of column i, in the order of the names. */
+const char *cnpy_table_column(const cnpy_table *table, size_t i, size_t *len, cnpy_array *meta) {
+  assert(table != NULL);
+  assert(i < table->n_columns);
+  assert(len != NULL && meta != NULL);
+
+  *len = table->columns[i].name_len;
+  *meta = table->columns[i].arr;
+  return table->columns[i].name;
+}
+
+
+/* Set *opts to the defaults: batches of about 4 MiB, prefetching 4 batches ahead, MADV_COLD, and one thread per online CPU. */
+void cnpy_table_scan_options_init(cnpy_table_scan_options *opts) {
+  assert(opts != NULL);
+  opts->batch_rows = 0;
+  opts->prefetch_batches = 4;
+  opts->release = CNPY_RELEASE_COLD;
+  opts->n_threads = 0;
+}
+
+
+/*
+ * Start a scan of the n (1 to CNPY_TABLE_MAX_SCAN) columns names[0], ..., names[n - 1] of table with the options *opts
+ * (NULL for the defaults, see cnpy_table_scan_options_init()); only these columns are mapped, read-only.
+ * Returns CNPY_ERROR_FILE if there is no such column, and CNPY_ERROR_FORMAT if a column changed since the table was opened.
+ */
+cnpy_status cnpy_table_scan_begin(const cnpy_table *table, const char * const *names, size_t n, const cnpy_table_scan_options *opts, cnpy_table_scan *scan) {
+  assert(table != NULL && table->raw_data != NULL);
+  assert(names != NULL && n > 0 && n <= CNPY_TABLE_MAX_SCAN);
+  assert(scan != NULL);
+
+  const char *fns[CNPY_TABLE_MAX_SCAN];
+  const cnpy_array *metas[CNPY_TABLE_MAX_SCAN];
+  size_t row_bytes = 0;
+  for (size_t k = 0; k < n; k += 1) {
+    size_t i = cnpy_table_find(table, names[k]);
+    if (i == table->n_columns) {
+      return cnpy_error(CNPY_ERROR_FILE, "No column '%s' in the table", names[k]);
+    }
+    fns[k] = table->columns[i].name;
+    metas[k] = &table->columns[i].arr;
+    row_bytes += cnpy_dtype_sizes[metas[k]->dtype];
+  }
+
+  cnpy_table_scan tmp;
+  if (opts != NULL) {
+    tmp.opts = *opts;
+  }
+  else {
+    cnpy_table_scan_options_init(&tmp.opts);
+  }
+  cnpy_open_options open_opts;
+  cnpy_open_options_init(&open_opts);
+  open_opts.mode = CNPY_MAP_READ_ONLY;
+  cnpy_status statuses[CNPY_TABLE_MAX_SCAN];
+  char error_strs[CNPY_TABLE_MAX_SCAN][CNPY_ERROR_STR_SIZE];
+  cnpy_status status = cnpy_open_many(table->dir_fd, fns, n, &open_opts, tmp.columns, statuses, error_strs, tmp.opts.n_threads);
+  for (size_t k = 0; k < n && status != CNPY_SUCCESS; k += 1) {
+    if (statuses[k] != CNPY_SUCCESS) {
+      status = cnpy_error(status, "Column '%s': %s", fns[k], error_strs[k]);
+      break;
+    }
+  }
+  for (size_t k = 0; k < n && status == CNPY_SUCCESS; k += 1) {
+    const cnpy_array *a = &tmp.columns[k];
+    if (a->dtype != metas[k]->dtype || a->byte_order != metas[k]->byte_order || a->n_dim != 1 || a->dims[0] != table->n_rows) {
+      status = cnpy_error(CNPY_ERROR_FORMAT, "Column '%s' changed since the table was opened", fns[k]);
+    }
+  }
+  if (status != CNPY_SUCCESS) {
+    for (size_t k = 0; k < n; k += 1) {
+      if (statuses[k] == CNPY_SUCCESS) {
+        cnpy_close(&tmp.columns[k]);
+      }
+    }
+    return status;
+  }
+
+  if (tmp.opts.batch_rows == 0) {
+    tmp.opts.batch_rows = (row_bytes < ((size_t) 1 << 22))? ((size_t) 1 << 22) / row_bytes : 1;
+  }
+  tmp.n_columns = n;
+  tmp.n_rows = table->n_rows;
+  tmp.n_batches = tmp.n_rows / tmp.opts.batch_rows + (tmp.n_rows % tmp.opts.batch_rows > 0);
+  tmp.next = 0;
+  tmp.prefetched = 0;
+  tmp.released = 0;
+  tmp.page = (size_t) sysconf(_SC_PAGESIZE);
+  *scan = tmp;
+  return CNPY_SUCCESS;
+}
+
+
+/* Offset into the mapping of column k of the element in the given row. */
+static size_t cnpy_table_offset(const cnpy_table_scan *scan, size_t k, size_t row) {
+  return scan->columns[k].data_begin + row * cnpy_dtype_sizes[scan->columns[k].dtype];
+}
+
+
+/* Prefetch batches [begin, end) in all projected columns. */
+static void cnpy_table_prefetch(const cnpy_table_scan *scan, size_t begin, size_t end) {
+  end = (end < scan->n_batches)? end : scan->n_batches;
+  if (begin >= end) {
+    return;
+  }
+#ifdef MADV_WILLNEED
+  size_t row_end = (end * scan->opts.batch_rows < scan->n_rows)? end * scan->opts.batch_rows : scan->n_rows;
+  for (size_t k = 0; k < scan->n_columns; k += 1) {
+    size_t from = cnpy_table_offset(scan, k, begin * scan->opts.batch_rows) / scan->page * scan->page;
+    size_t to = cnpy_table_offset(scan, k, row_end);
+    madvise(scan->columns[k].raw_data + from, to - from, MADV_WILLNEED); /* only a hint */
+  }
+#endif
+}
+
+
+/* Release the pages which lie wholly within rows [begin, end) in all projected columns. */
+static void cnpy_table_release(const cnpy_table_scan *scan, size_t begin, size_t end) {
+  if (scan->opts.release == CNPY_RELEASE_NONE) {
+    return;
+  }
+  for (size_t k = 0; k < scan->n_columns; k += 1) {
+    size_t from = (cnpy_table_offset(scan, k, begin) + scan->page - 1) / scan->page * scan->page;
+    size_t to = cnpy_table_offset(scan, k, end);
+    to = (end == scan->n_rows)? scan->columns[k].map_size : to / scan->page * scan->page;
+    if (from < to) {
+      cnpy_release_pages(scan->columns[k].raw_data + from, to - from, scan->opts.release);
+    }
+  }
+}
+
+
+/* Describe batch b of scan in *batch. */
+static void cnpy_table_fill_batch(const cnpy_table_scan *scan, size_t b, cnpy_table_batch *batch) {
+  batch->index = b;
+  batch->row_start = b * scan->opts.batch_rows;
+  batch->n_rows = (scan->n_rows - batch->row_start < scan->opts.batch_rows)? scan->n_rows - batch->row_start : scan->opts.batch_rows;
+  for (size_t k = 0; k < scan->n_columns; k += 1) {
+    batch->data[k] = scan->columns[k].raw_data + cnpy_table_offset(scan, k, batch->row_start);
+  }
+}
+
+
+/*
+ * Store the next batch in *batch and return true, or return false at the end of the table.
+ * Pages of the batches before it are released, and the batches up to opts.prefetch_batches after it are prefetched.
+ */
+bool cnpy_table_scan_next(cnpy_table_scan *scan, cnpy_table_batch *batch) {
+  assert(scan != NULL);
+  assert(batch != NULL);
+
+  if (scan->next >= scan->n_batches) {
+    return false;
+  }
+  cnpy_table_fill_batch(scan, scan->next, batch);
+  cnpy_table_release(scan, scan->released, batch->row_start);
+  scan->released = batch->row_start;
+  /* each batch is prefetched once, prefetch_batches ahead */
+  size_t end = scan->next + 1 + scan->opts.prefetch_batches;
+  if (end > scan->prefetched) {
+    cnpy_table_prefetch(scan, scan->prefetched, end);
+    scan->prefetched = end;
+  }
+  scan->next += 1;
+  return true;
+}
+
+
+typedef struct {
+  const cnpy_table_scan *scan;
+  void (*fn)(const cnpy_table_batch *, void *, size_t);
+  void *arg;
+  size_t next; /* the next batch */
+} cnpy_table_scan_job;
+
+
+static void cnpy_table_scan_worker(void *arg, size_t t, size_t n_threads) {
+  (void) n_threads;
+  cnpy_table_scan_job *job = (cnpy_table_scan_job *) arg;
+  const cnpy_table_scan *scan = job->scan;
+  cnpy_table_batch batch;
+  for (;;) {
+    size_t b = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+    if (b >= scan->n_batches) {
+      break;
+    }
+    /* batches are taken in order, so prefetching the one prefetch_batches ahead keeps the window filled */
+    cnpy_table_prefetch(scan, b + scan->opts.prefetch_batches, b + scan->opts.prefetch_batches + 1);
+    cnpy_table_fill_batch(scan, b, &batch);
+    job->fn(&batch, job->arg, t);
+    cnpy_table_release(scan, batch.row_start, batch.row_start + batch.n_rows);
+  }
+}
+
+
+/*
+ * Call fn(batch, arg, t) for each remaining batch of scan on opts.n_threads threads, where t is the number of the thread;
+ * batches are handed out in order as threads become free. Pages are prefetched and released as by cnpy_table_scan_next(),
+ * except that pages shared by neighbouring batches are not released.
+ */
+void cnpy_table_scan_parallel(cnpy_table_scan *scan, void (*fn)(const cnpy_table_batch *batch, void *arg, size_t t), void *arg) {
+  assert(scan != NULL);
+  assert(fn != NULL);
+
+  size_t remaining = scan->n_batches - scan->next;
+  if (remaining == 0) {
+    return;
+  }
+  size_t n_threads = cnpy_n_threads(scan->opts.n_threads);
+  n_threads = (n_threads < remaining)? n_threads : remaining;
+  size_t end = scan->next + scan->opts.prefetch_batches;
+  if (end > scan->prefetched) {
+    cnpy_table_prefetch(scan, scan->prefetched, end);
+  }
+  cnpy_table_scan_job job;
+  job.scan = scan;
+  job.fn = fn;
+  job.arg = arg;
+  job.next = scan->next;
+  cnpy_parallel_for(n_threads, cnpy_table_scan_worker, &job);
+  scan->next = scan->n_batches;
+  scan->prefetched = scan->n_batches;
+  scan->released = scan->n_rows;
+}
+
+
+/* Finish a scan, unmapping its columns. */
+cnpy_status cnpy_table_scan_end(cnpy_table_scan *scan) {
+  assert(scan != NULL);
+
+  cnpy_status status = CNPY_SUCCESS;
+  for (size_t k = 0; k < scan->n_columns; k += 1) {
+    cnpy_status s = cnpy_close(&scan->columns[k]);
+    status = (status == CNPY_SUCCESS)? s : status;
+  }
+  scan->n_columns = 0;
+  return status;
+}
+
+
 /*
  * Iteration
  */
@@ -0,0 +1,532 @@
+/*
+ * cnpy.hpp - a C++17 header-only interface to cnpy.h.
+ *
+ * Copyright (C) 2018, 2019 Lukas Himbert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License only.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "cnpy.h"
+
+#include <array> /* std::array */
+#include <complex> /* std::complex */
+#include <cstddef> /* std::size_t, std::ptrdiff_t */
+#include <cstdint> /* exact width integers */
+#include <cstring> /* std::memcpy */
+#include <initializer_list> /* std::initializer_list */
+#include <iterator> /* std::random_access_iterator_tag */
+#include <stdexcept> /* std::runtime_error */
+#include <string> /* std::string */
+#include <type_traits> /* std::conditional_t, std::integral_constant */
+#if defined(__has_include)
+#if __has_include(<mdspan>)
+#include <mdspan> /* std::mdspan, std::layout_left, std::layout_right */
+#endif
+#if __has_include(<coroutine>) && __cplusplus >= 202002L
+#include <coroutine> /* std::coroutine_handle */
+#endif
+#endif
+
+#if __cplusplus < 201703L
+#error "cnpy.hpp requires C++17 or newer."
+#endif
+
+
+namespace cnpy {
+
+
+/*
+ * Errors
+ *
+ * Failures are reported as exceptions of type cnpy::error, which carry the cnpy_status.
+ * For failures inside cnpy.h, the message includes cnpy_error_str.
+ */
+
+
+class error : public std::runtime_error {
+ public:
+  error(cnpy_status status, const std::string &what) : std::runtime_error(what), status_(status) {}
+
+  cnpy_status status() const noexcept {
+    return status_;
+  }
+
+ private:
+  cnpy_status status_;
+};
+
+
+namespace detail {
+
+[[noreturn]] inline void throw_cnpy_error(cnpy_status status, const char *context) {
+  std::string what = std::string(context) + ": " + cnpy_error_str;
+  cnpy_error_reset();
+  throw error(status, what);
+}
+
+}  // namespace detail
+
+
+/*
+ * Data types
+ */
+
+
+template <typename T> struct dtype_of;
+template <> struct dtype_of<bool> : std::integral_constant<cnpy_dtype, CNPY_B> {};
+template <> struct dtype_of<std::int8_t> : std::integral_constant<cnpy_dtype, CNPY_I1> {};
+template <> struct dtype_of<std::int16_t> : std::integral_constant<cnpy_dtype, CNPY_I2> {};
+template <> struct dtype_of<std::int32_t> : std::integral_constant<cnpy_dtype, CNPY_I4> {};
+template <> struct dtype_of<std::int64_t> : std::integral_constant<cnpy_dtype, CNPY_I8> {};
+template <> struct dtype_of<std::uint8_t> : std::integral_constant<cnpy_dtype, CNPY_U1> {};
+template <> struct dtype_of<std::uint16_t> : std::integral_constant<cnpy_dtype, CNPY_U2> {};
+template <> struct dtype_of<std::uint32_t> : std::integral_constant<cnpy_dtype, CNPY_U4> {};
+template <> struct dtype_of<std::uint64_t> : std::integral_constant<cnpy_dtype, CNPY_U8> {};
+template <> struct dtype_of<float> : std::integral_constant<cnpy_dtype, CNPY_F4> {};
+template <> struct dtype_of<double> : std::integral_constant<cnpy_dtype, CNPY_F8> {};
+template <> struct dtype_of<std::complex<float>> : std::integral_constant<cnpy_dtype, CNPY_C8> {};
+template <> struct dtype_of<std::complex<double>> : std::integral_constant<cnpy_dtype, CNPY_C16> {};
+
+template <typename T>
+inline constexpr cnpy_dtype dtype_of_v = dtype_of<T>::value;
+
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+inline constexpr cnpy_byte_order host_byte_order = CNPY_LE;
+#elif BYTE_ORDER == BIG_ENDIAN
+inline constexpr cnpy_byte_order host_byte_order = CNPY_BE;
+#else
+#error "Unsupported byte order."
+#endif
+
+/* Is data with byte order BO stored in host byte order? */
+template <cnpy_byte_order BO>
+inline constexpr bool is_host_byte_order_v = (BO == CNPY_NE || BO == host_byte_order);
+
+
+namespace detail {
+
+template <typename T> struct is_complex : std::false_type {};
+template <typename T> struct is_complex<std::complex<T>> : std::true_type {};
+
+template <std::size_t N> struct uint_of_size;
+template <> struct uint_of_size<2> { using type = std::uint16_t; };
+template <> struct uint_of_size<4> { using type = std::uint32_t; };
+template <> struct uint_of_size<8> { using type = std::uint64_t; };
+
+inline std::uint16_t bswap(std::uint16_t x) { return __builtin_bswap16(x); }
+inline std::uint32_t bswap(std::uint32_t x) { return __builtin_bswap32(x); }
+inline std::uint64_t bswap(std::uint64_t x) { return __builtin_bswap64(x); }
+
+/* Reverse the bytes of each scalar of x in place; complex numbers are a pair of scalars. */
+template <typename T>
+inline void swap_bytes(char *x) {
+  constexpr std::size_t width = is_complex<T>::value ? sizeof(T) / 2 : sizeof(T);
+  using U = typename uint_of_size<width>::type;
+  for (std::size_t i = 0; i < sizeof(T); i += width) {
+    U u;
+    std::memcpy(&u, x + i, width);
+    u = bswap(u);
+    std::memcpy(x + i, &u, width);
+  }
+}
+
+template <typename T, cnpy_byte_order BO>
+inline T load(const char *p) {
+  T x;
+  if constexpr (is_host_byte_order_v<BO>) {
+    std::memcpy(&x, p, sizeof(T));
+  }
+  else {
+    char tmp[sizeof(T)];
+    std::memcpy(tmp, p, sizeof(T));
+    swap_bytes<T>(tmp);
+    std::memcpy(&x, tmp, sizeof(T));
+  }
+  return x;
+}
+
+template <typename T, cnpy_byte_order BO>
+inline void store(char *p, T x) {
+  if constexpr (is_host_byte_order_v<BO>) {
+    std::memcpy(p, &x, sizeof(T));
+  }
+  else {
+    char tmp[sizeof(T)];
+    std::memcpy(tmp, &x, sizeof(T));
+    swap_bytes<T>(tmp);
+    std::memcpy(p, tmp, sizeof(T));
+  }
+}
+
+}  // namespace detail
+
+
+/*
+ * Element references and accessor policy
+ *
+ * In host byte order, elements are accessed through plain T& and T*.
+ * Otherwise, element_ref converts on each load and store.
+ */
+
+
+template <typename T, cnpy_byte_order BO>
+class element_ref {
+ public:
+  explicit element_ref(char *p) noexcept : p_(p) {}
+
+  operator T() const noexcept {
+    return detail::load<T, BO>(p_);
+  }
+
+  element_ref &operator=(T x) noexcept {
+    detail::store<T, BO>(p_, x);
+    return *this;
+  }
+
+  element_ref &operator=(const element_ref &other) noexcept {
+    return *this = static_cast<T>(other);
+  }
+
+ private:
+  char *p_;
+};
+
+
+/* std::mdspan-compatible accessor policy for elements of type T with byte order BO. */
+template <typename T, cnpy_byte_order BO>
+struct accessor {
+  using offset_policy = accessor;
+  using element_type = T;
+  using reference = std::conditional_t<is_host_byte_order_v<BO>, T &, element_ref<T, BO>>;
+  using data_handle_type = std::conditional_t<is_host_byte_order_v<BO>, T *, char *>;
+
+  constexpr accessor() noexcept = default;
+
+  reference access(data_handle_type p, std::size_t i) const noexcept {
+    if constexpr (is_host_byte_order_v<BO>) {
+      return p[i];
+    }
+    else {
+      return reference(p + i * sizeof(T));
+    }
+  }
+
+  data_handle_type offset(data_handle_type p, std::size_t i) const noexcept {
+    if constexpr (is_host_byte_order_v<BO>) {
+      return p + i;
+    }
+    else {
+      return p + i * sizeof(T);
+    }
+  }
+};
+
+
+/* Random access iterator over elements with non-host byte order; in host byte order, T* is used instead. */
+template <typename T, cnpy_byte_order BO>
+class swapped_iterator {
+ public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using reference = element_ref<T, BO>;
+  using pointer = void;
+
+  swapped_iterator() noexcept : p_(nullptr) {}
+  explicit swapped_iterator(char *p) noexcept : p_(p) {}
+
+  reference operator*() const noexcept { return reference(p_); }
+  reference operator[](difference_type n) const noexcept { return reference(p_ + n * static_cast<difference_type>(sizeof(T))); }
+
+  swapped_iterator &operator++() noexcept { p_ += sizeof(T); return *this; }
+  swapped_iterator operator++(int) noexcept { swapped_iterator tmp = *this; ++*this; return tmp; }
+  swapped_iterator &operator--() noexcept { p_ -= sizeof(T); return *this; }
+  swapped_iterator operator--(int) noexcept { swapped_iterator tmp = *this; --*this; return tmp; }
+  swapped_iterator &operator+=(difference_type n) noexcept { p_ += n * static_cast<difference_type>(sizeof(T)); return *this; }
+  swapped_iterator &operator-=(difference_type n) noexcept { p_ -= n * static_cast<difference_type>(sizeof(T)); return *this; }
+  friend swapped_iterator operator+(swapped_iterator it, difference_type n) noexcept { return it += n; }
+  friend swapped_iterator operator+(difference_type n, swapped_iterator it) noexcept { return it += n; }
+  friend swapped_iterator operator-(swapped_iterator it, difference_type n) noexcept { return it -= n; }
+  friend difference_type operator-(swapped_iterator a, swapped_iterator b) noexcept { return (a.p_ - b.p_) / static_cast<difference_type>(sizeof(T)); }
+
+  friend bool operator==(swapped_iterator a, swapped_iterator b) noexcept { return a.p_ == b.p_; }
+  friend bool operator!=(swapped_iterator a, swapped_iterator b) noexcept { return a.p_ != b.p_; }
+  friend bool operator<(swapped_iterator a, swapped_iterator b) noexcept { return a.p_ < b.p_; }
+  friend bool operator>(swapped_iterator a, swapped_iterator b) noexcept { return a.p_ > b.p_; }
+  friend bool operator<=(swapped_iterator a, swapped_iterator b) noexcept { return a.p_ <= b.p_; }
+  friend bool operator>=(swapped_iterator a, swapped_iterator b) noexcept { return a.p_ >= b.p_; }
+
+ private:
+  char *p_;
+};
+
+
+/*
+ * Typed views
+ *
+ * array_view<T, Order, ByteOrder, Rank> is a non-owning view of an open cnpy_array whose dtype, serialization order,
+ * byte order and number of dimensions are known at compile time.
+ * Element access compiles down to a dot product and (for non-host byte order) a byte swap; there are no runtime dtype checks.
+ * Iterators run through the elements in serialization order.
+ */
+
+
+template <typename T, cnpy_flat_order Order, cnpy_byte_order ByteOrder, std::size_t Rank>
+class array_view {
+  static_assert(Rank >= 1 && Rank <= CNPY_MAX_DIM, "Rank must be between 1 and CNPY_MAX_DIM");
+  static_assert(sizeof(T) > 1 || ByteOrder == CNPY_NE, "single-byte types have byte order CNPY_NE");
+  static_assert(sizeof(T) == 1 || ByteOrder != CNPY_NE, "multi-byte types need byte order CNPY_LE or CNPY_BE");
+
+ public:
+  using value_type = T;
+  using accessor_type = accessor<T, ByteOrder>;
+  using reference = typename accessor_type::reference;
+  using data_handle_type = typename accessor_type::data_handle_type;
+  using iterator = std::conditional_t<is_host_byte_order_v<ByteOrder>, T *, swapped_iterator<T, ByteOrder>>;
+  using index_type = std::array<std::size_t, Rank>;
+
+  /* Throws cnpy::error if arr does not have the given dtype, order, byte order, and number of dimensions. */
+  explicit array_view(const cnpy_array &arr) {
+    if (arr.raw_data == nullptr) {
+      throw error(CNPY_ERROR_FORMAT, "cnpy::array_view: array is not open");
+    }
+    if (arr.dtype != dtype_of_v<T>) {
+      throw error(CNPY_ERROR_FORMAT, std::string("cnpy::array_view: dtype mismatch, array has ") + cnpy_dtype_str[arr.dtype]);
+    }
+    if (arr.byte_order != ByteOrder) {
+      throw error(CNPY_ERROR_FORMAT, "cnpy::array_view: byte order mismatch");
+    }
+    if (arr.n_dim != Rank) {
+      throw error(CNPY_ERROR_FORMAT, "cnpy::array_view: rank mismatch, array has " + std::to_string(arr.n_dim) + " dimensions");
+    }
+    if (arr.order != Order) {
+      throw error(CNPY_ERROR_FORMAT, "cnpy::array_view: serialization order mismatch");
+    }
+    data_ = arr.raw_data + arr.data_begin;
+    std::size_t stride = 1;
+    for (std::size_t i = 0; i < Rank; i += 1) {
+      std::size_t j = (Order == CNPY_C_ORDER) ? Rank - 1 - i : i;
+      extents_[j] = arr.dims[j];
+      strides_[j] = stride;
+      stride *= arr.dims[j];
+    }
+    size_ = stride;
+  }
+
+  std::size_t size() const noexcept { return size_; }
+  std::size_t extent(std::size_t i) const noexcept { return extents_[i]; }
+  std::size_t stride(std::size_t i) const noexcept { return strides_[i]; }
+  const index_type &extents() const noexcept { return extents_; }
+
+  data_handle_type data_handle() const noexcept {
+    return reinterpret_cast<data_handle_type>(data_);
+  }
+
+  /* element at the multi-index (idx...); no bounds checks */
+  template <typename... Idx>
+  reference operator()(Idx... idx) const noexcept {
+    static_assert(sizeof...(Idx) == Rank, "wrong number of indices");
+    index_type index = { static_cast<std::size_t>(idx)... };
+    return (*this)[index];
+  }
+
+  reference operator[](const index_type &index) const noexcept {
+    std::size_t off = 0;
+    for (std::size_t i = 0; i < Rank; i += 1) {
+      off += index[i] * strides_[i];
+    }
+    return accessor_type().access(data_handle(), off);
+  }
+
+  /* element at flat index i in serialization order */
+  reference flat(std::size_t i) const noexcept {
+    return accessor_type().access(data_handle(), i);
+  }
+
+  iterator begin() const noexcept {
+    return iterator(data_handle());
+  }
+
+  iterator end() const noexcept {
+    return begin() + static_cast<std::ptrdiff_t>(size_);
+  }
+
+#if defined(__cpp_lib_mdspan)
+  using layout_type = std::conditional_t<Order == CNPY_C_ORDER, std::layout_right, std::layout_left>;
+  using mdspan_type = std::mdspan<T, std::dextents<std::size_t, Rank>, layout_type, accessor_type>;
+
+  mdspan_type to_mdspan() const {
+    return mdspan_type(data_handle(), typename mdspan_type::mapping_type(std::dextents<std::size_t, Rank>(extents_)), accessor_type());
+  }
+#endif
+
+ private:
+  char *data_ = nullptr;
+  index_type extents_ = {};
+  index_type strides_ = {};
+  std::size_t size_ = 0;
+};
+
+
+/*
+ * Owning arrays
+ *
+ * cnpy::array owns a cnpy_array and closes it when destroyed.
+ */
+
+
+class array {
+ public:
+  static array open(const std::string &fn, bool writable) {
+    array a;
+    cnpy_status status = cnpy_open(fn.c_str(), writable, &a.arr_);
+    if (status != CNPY_SUCCESS) {
+      detail::throw_cnpy_error(status, ("cnpy::array::open(" + fn + ")").c_str());
+    }
+    return a;
+  }
+
+  static array open(const std::string &fn, const cnpy_open_options &opts) {
+    array a;
+    cnpy_status status = cnpy_open_ex(fn.c_str(), &opts, &a.arr_);
+    if (status != CNPY_SUCCESS) {
+      detail::throw_cnpy_error(status, ("cnpy::array::open(" + fn + ")").c_str());
+    }
+    return a;
+  }
+
+  /* Create a new array; an empty file name creates an anonymous mapping. */
+  static array create(const std::string &fn, cnpy_byte_order byte_order, cnpy_dtype dtype, cnpy_flat_order order, std::initializer_list<std::size_t> dims) {
+    if (dims.size() > CNPY_MAX_DIM) {
+      throw error(CNPY_ERROR_FORMAT, "cnpy::array::create: too many dimensions");
+    }
+    array a;
+    cnpy_status status = cnpy_create(fn.empty() ? nullptr : fn.c_str(), byte_order, dtype, order, dims.size(), dims.begin(), &a.arr_);
+    if (status != CNPY_SUCCESS) {
+      detail::throw_cnpy_error(status, ("cnpy::array::create(" + fn + ")").c_str());
+    }
+    return a;
+  }
+
+  array(const array &) = delete;
+  array &operator=(const array &) = delete;
+
+  array(array &&other) noexcept : arr_(other.arr_) {
+    other.arr_.raw_data = nullptr;
+  }
+
+  array &operator=(array &&other) noexcept {
+    if (this != &other) {
+      reset();
+      arr_ = other.arr_;
+      other.arr_.raw_data = nullptr;
+    }
+    return *this;
+  }
+
+  ~array() {
+    reset();
+  }
+
+  /* the underlying cnpy_array, for use with the C interface */
+  const cnpy_array &get() const noexcept { return arr_; }
+  cnpy_array &get() noexcept { return arr_; }
+
+  template <typename T, cnpy_flat_order Order, cnpy_byte_order ByteOrder, std::size_t Rank>
+  array_view<T, Order, ByteOrder, Rank> view() const {
+    return array_view<T, Order, ByteOrder, Rank>(arr_);
+  }
+
+ private:
+  array() noexcept {
+    arr_.raw_data = nullptr;
+  }
+
+  void reset() noexcept {
+    if (arr_.raw_data != nullptr) {
+      cnpy_close(&arr_); /* nothing sensible to do about errors in a destructor */
+      arr_.raw_data = nullptr;
+    }
+  }
+
+  cnpy_array arr_;
+};
+
+
+/*
+ * Asynchronous reads
+ *
+ * With C++20 coroutines, `co_await cnpy::async_read(ring, flat_start, count, buf)` queues a read on a cnpy_async and suspends the coroutine until it has completed.
+ * The coroutine is resumed from within cnpy_async_wait() (or another call which waits), so someone has to keep waiting on the ring.
+ */
+
+
+#if defined(__cpp_lib_coroutine)
+class async_read_awaitable {
+ public:
+  async_read_awaitable(cnpy_async &ring, std::size_t flat_start, std::size_t count, void *buf) noexcept
+    : ring_(ring), flat_start_(flat_start), count_(count), buf_(buf), status_(CNPY_SUCCESS) {}
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    done_ = false;
+    suspended_ = false;
+    status_ = cnpy_async_read(&ring_, flat_start_, count_, buf_, &async_read_awaitable::complete, this);
+    if (status_ != CNPY_SUCCESS) {
+      return false;
+    }
+    suspended_ = !done_; /* resume right away if the read has completed already */
+    return suspended_;
+  }
+
+  void await_resume() const {
+    if (status_ != CNPY_SUCCESS) {
+      detail::throw_cnpy_error(status_, "cnpy::async_read");
+    }
+  }
+
+ private:
+  static void complete(void *user, cnpy_status status) {
+    async_read_awaitable *self = static_cast<async_read_awaitable *>(user);
+    self->status_ = status;
+    self->done_ = true;
+    if (self->suspended_) {
+      self->handle_.resume();
+    }
+  }
+
+  cnpy_async &ring_;
+  std::size_t flat_start_;
+  std::size_t count_;
+  void *buf_;
+  cnpy_status status_;
+  std::coroutine_handle<> handle_;
+  bool done_ = false;
+  bool suspended_ = false;
+};
+
+/* Read count elements starting at flat_start into buf, converted to host byte order; throws cnpy::error on failure. */
+inline async_read_awaitable async_read(cnpy_async &ring, std::size_t flat_start, std::size_t count, void *buf) noexcept {
+  return async_read_awaitable(ring, flat_start, count, buf);
+}
+#endif
+
+
+}  // namespace cnpy
@@ -12,7 +12,7 @@ else:
     print(f"Usage: {sys.argv[0]} [fast|slow]", file=sys.stderr)
     exit(1)
 
-cc_args = [os.environ.get("CC", default="cc"), "-W", "-Wall", "-Werror", "-Wfatal-errors", "-Wno-unused-function", "-I../../include/", "-lm"]
+cc_args = [os.environ.get("CC", default="cc"), "-W", "-Wall", "-Werror", "-Wfatal-errors", "-Wno-unused-function", "-I../../include/", "-pthread", "-lm"]
 if os.uname().sysname != "OpenBSD":
     cc_args.append("-fsanitize=address,undefined")
 if "CFLAGS" in os.environ.keys():
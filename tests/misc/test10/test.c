@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+#include <unistd.h>
+#include "cnpy.h"
+
+/* Axis reductions, compared to naive loops over the per-element accessors. */
+
+static const cnpy_op ops[] = { CNPY_OP_SUM, CNPY_OP_MEAN, CNPY_OP_MIN, CNPY_OP_MAX, CNPY_OP_ARGMIN, CNPY_OP_ARGMAX };
+
+/* Naive reduction of a along axis at the position out_index (which has a.n_dim - 1 entries). */
+static double naive(const cnpy_array a, size_t axis, cnpy_op op, const size_t *out_index) {
+  size_t index[CNPY_MAX_DIM];
+  for (size_t i = 0, k = 0; i < a.n_dim; i += 1) {
+    index[i] = (i == axis)? 0 : out_index[k++];
+  }
+  double sum = 0, best = 0;
+  size_t arg = 0;
+  for (size_t r = 0; r < a.dims[axis]; r += 1) {
+    index[axis] = r;
+    double x = (a.dtype == CNPY_I4)? cnpy_get_i4(a, index) : cnpy_get_f8(a, index);
+    sum += x;
+    bool better = (op == CNPY_OP_MIN || op == CNPY_OP_ARGMIN)? x < best : x > best;
+    if (r == 0 || better || (isnan(x) && !isnan(best))) {
+      best = x;
+      arg = r;
+    }
+  }
+  switch (op) {
+    case CNPY_OP_SUM: return sum;
+    case CNPY_OP_MEAN: return sum / (double) a.dims[axis];
+    case CNPY_OP_MIN: case CNPY_OP_MAX: return best;
+    default: return (double) arg;
+  }
+}
+
+static double out_get(const cnpy_array out, const size_t *index) {
+  switch (out.dtype) {
+    case CNPY_I4: return cnpy_get_i4(out, index);
+    case CNPY_I8: return (double) cnpy_get_i8(out, index);
+    case CNPY_F8: return cnpy_get_f8(out, index);
+    default: assert(false); return 0;
+  }
+}
+
+static void check_all(const cnpy_array a, size_t n_threads) {
+  for (size_t axis = 0; axis < a.n_dim; axis += 1) {
+    for (size_t k = 0; k < sizeof(ops) / sizeof(ops[0]); k += 1) {
+      cnpy_array out;
+      assert(cnpy_reduce_axis(a, axis, ops[k], NULL, &out, n_threads) == CNPY_SUCCESS);
+      assert(out.n_dim == a.n_dim - 1 && out.order == a.order);
+      size_t index[CNPY_MAX_DIM];
+      cnpy_reset_index(out, index);
+      do {
+        double expected = naive(a, axis, ops[k], index);
+        double got = out_get(out, index);
+        assert(got == expected || fabs(got - expected) <= 1e-9 * fabs(expected) || (isnan(got) && isnan(expected)));
+      } while (cnpy_next_index(out, index));
+      assert(cnpy_close(&out) == CNPY_SUCCESS);
+    }
+  }
+}
+
+int main(void) {
+  cnpy_flat_order orders[] = { CNPY_C_ORDER, CNPY_FORTRAN_ORDER };
+
+  for (size_t o = 0; o < 2; o += 1) {
+    printf(" order %d\n", orders[o]);
+
+    /* rows longer than one segment, and short rows */
+    size_t dims[] = { 7, 1100, 3 };
+    cnpy_array a;
+    assert(cnpy_create(NULL, CNPY_BE, CNPY_I4, orders[o], 3, dims, &a) == CNPY_SUCCESS);
+    size_t index[CNPY_MAX_DIM];
+    size_t i = 0;
+    cnpy_reset_index(a, index);
+    do {
+      cnpy_set_i4(a, index, (int32_t) ((i * 7919) % 10007) - 5000);
+      i += 1;
+    } while (cnpy_next_index(a, index));
+    check_all(a, 0);
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+    /* doubles with NaNs, split across threads */
+    size_t dims2[] = { 1500, 400 };
+    assert(cnpy_create(NULL, CNPY_LE, CNPY_F8, orders[o], 2, dims2, &a) == CNPY_SUCCESS);
+    i = 0;
+    cnpy_reset_index(a, index);
+    do {
+      cnpy_set_f8(a, index, (i % 9973 == 17)? NAN : sin((double) i));
+      i += 1;
+    } while (cnpy_next_index(a, index));
+    check_all(a, 4);
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+  }
+
+  /* result in a file, with a one-dimensional result */
+  printf(" file\n");
+  size_t dims[] = { 300, 2 };
+  cnpy_array a, out;
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_U1, CNPY_C_ORDER, 2, dims, &a) == CNPY_SUCCESS);
+  for (size_t i = 0; i < 300; i += 1) {
+    size_t index[] = { i, i % 2 };
+    cnpy_set_u1(a, index, 200);
+  }
+  assert(cnpy_reduce_axis(a, 0, CNPY_OP_SUM, "sums.npy", &out, 0) == CNPY_SUCCESS);
+  assert(cnpy_close(&out) == CNPY_SUCCESS);
+  assert(cnpy_open("sums.npy", false, &out) == CNPY_SUCCESS);
+  assert(out.dtype == CNPY_U8 && out.n_dim == 1 && out.dims[0] == 2);
+  size_t index[] = { 1 };
+  assert(cnpy_get_u8(out, index) == 150 * 200);
+  assert(cnpy_close(&out) == CNPY_SUCCESS);
+  unlink("sums.npy");
+
+  /* one-dimensional arrays are rejected, and no file is created */
+  size_t dims1[] = { 300 };
+  cnpy_array b;
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_U1, CNPY_C_ORDER, 1, dims1, &b) == CNPY_SUCCESS);
+  assert(cnpy_reduce_axis(b, 0, CNPY_OP_SUM, "sums.npy", &out, 0) == CNPY_ERROR_FORMAT);
+  assert(access("sums.npy", F_OK) != 0);
+  assert(cnpy_close(&b) == CNPY_SUCCESS);
+
+  /* complex means */
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+  assert(cnpy_create(NULL, CNPY_BE, CNPY_C16, CNPY_FORTRAN_ORDER, 2, dims, &a) == CNPY_SUCCESS);
+  for (size_t i = 0; i < 300; i += 1) {
+    size_t index2[] = { i, 0 };
+    cnpy_set_c16(a, index2, (double) i + 1.0 * I);
+    index2[1] = 1;
+    cnpy_set_c16(a, index2, 2.0 * I);
+  }
+  assert(cnpy_reduce_axis(a, 0, CNPY_OP_MEAN, NULL, &out, 0) == CNPY_SUCCESS);
+  index[0] = 0;
+  assert(cnpy_get_c16(out, index) == 149.5 + 1.0 * I);
+  index[0] = 1;
+  assert(cnpy_get_c16(out, index) == 2.0 * I);
+  assert(cnpy_close(&out) == CNPY_SUCCESS);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  /* integer means do not wrap around, along runs and across rows */
+  printf(" large integers\n");
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_I8, CNPY_C_ORDER, 2, dims, &a) == CNPY_SUCCESS);
+  for (size_t i = 0; i < 300; i += 1) {
+    size_t index2[] = { i, 0 };
+    cnpy_set_i8(a, index2, INT64_MAX);
+    index2[1] = 1;
+    cnpy_set_i8(a, index2, INT64_MAX / 2);
+  }
+  for (size_t axis = 0; axis < 2; axis += 1) {
+    assert(cnpy_reduce_axis(a, axis, CNPY_OP_MEAN, NULL, &out, 0) == CNPY_SUCCESS);
+    index[0] = 0;
+    assert(cnpy_get_f8(out, index) == ((axis == 0)? (double) INT64_MAX : 0.75 * (double) INT64_MAX));
+    assert(cnpy_close(&out) == CNPY_SUCCESS);
+  }
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  printf("done.\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "cnpy.h"
+
+/* Opening and creating arrays with mapping options. */
+
+int main(void) {
+  const char *fn = "options.npy";
+  unlink(fn);
+  size_t dims[] = { 300, 70 };
+  size_t index[] = { 299, 69 };
+
+  printf(" create with hints\n");
+  cnpy_open_options opts;
+  cnpy_open_options_init(&opts);
+  opts.advice = CNPY_ADVICE_SEQUENTIAL;
+  opts.populate = true;
+  opts.huge_pages = CNPY_HUGE_PAGES_TRANSPARENT;
+  cnpy_array a;
+  assert(cnpy_create_ex(fn, CNPY_LE, CNPY_I4, CNPY_C_ORDER, 2, dims, &opts, &a) == CNPY_SUCCESS);
+  assert(a.map_size == a.raw_data_size);
+  cnpy_set_i4(a, index, 42);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  printf(" read only\n");
+  cnpy_open_options_init(&opts);
+  opts.mode = CNPY_MAP_READ_ONLY;
+  opts.advice = CNPY_ADVICE_RANDOM;
+  assert(cnpy_open_ex(fn, &opts, &a) == CNPY_SUCCESS);
+  assert(cnpy_get_i4(a, index) == 42);
+  /* writing to a read only mapping must not silently succeed */
+  fflush(stdout);
+  pid_t pid = fork();
+  assert(pid != -1);
+  if (pid == 0) {
+    int null = open("/dev/null", O_WRONLY); /* silence the crash report of sanitizers */
+    dup2(null, STDERR_FILENO);
+    cnpy_set_i4(a, index, 43);
+    _exit(EXIT_SUCCESS);
+  }
+  int wstatus;
+  assert(waitpid(pid, &wstatus, 0) == pid);
+  assert(!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != EXIT_SUCCESS);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  printf(" private and writable\n");
+  opts.mode = CNPY_MAP_PRIVATE;
+  opts.advice = CNPY_ADVICE_WILLNEED;
+  assert(cnpy_open_ex(fn, &opts, &a) == CNPY_SUCCESS);
+  cnpy_set_i4(a, index, 44);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+  opts.mode = CNPY_MAP_WRITABLE;
+  opts.lock = true;
+  /* locking may exceed RLIMIT_MEMLOCK, which is not an error of the library */
+  cnpy_status status = cnpy_open_ex(fn, &opts, &a);
+  assert(status == CNPY_SUCCESS || status == CNPY_ERROR_MMAP);
+  if (status == CNPY_SUCCESS) {
+    assert(cnpy_get_i4(a, index) == 42);
+    cnpy_set_i4(a, index, 45);
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+    assert(cnpy_open(fn, false, &a) == CNPY_SUCCESS);
+    assert(cnpy_get_i4(a, index) == 45);
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+  }
+  unlink(fn);
+
+  /* explicit huge pages need reserved huge pages, which may not be available */
+  printf(" huge pages\n");
+  cnpy_open_options_init(&opts);
+  opts.huge_pages = CNPY_HUGE_PAGES_EXPLICIT;
+  status = cnpy_create_ex(NULL, CNPY_BE, CNPY_F8, CNPY_FORTRAN_ORDER, 2, dims, &opts, &a);
+  assert(status == CNPY_SUCCESS || status == CNPY_ERROR_MMAP);
+  if (status == CNPY_SUCCESS) {
+    assert(a.map_size % CNPY_HUGE_PAGE_SIZE == 0 && a.map_size >= a.raw_data_size);
+    cnpy_set_f8(a, index, 1.5);
+    assert(cnpy_get_f8(a, index) == 1.5);
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+  }
+  else {
+    cnpy_error_reset();
+  }
+
+  printf("done.\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include "cnpy.h"
+
+/* Streaming scans: chunks cover the array in order, end at page boundaries, and releasing pages never loses data where it must not. */
+
+static void check_scan(const cnpy_array a, const cnpy_scan_options *opts) {
+  size_t page = (size_t) sysconf(_SC_PAGESIZE);
+  cnpy_scan scan;
+  cnpy_chunk chunk;
+  assert(cnpy_scan_begin(a, opts, &scan) == CNPY_SUCCESS);
+  size_t next = 0, n_chunks = 0;
+  while (cnpy_scan_next(&scan, &chunk)) {
+    assert(chunk.flat_start == next && chunk.length > 0);
+    assert(chunk.data == a.raw_data + a.data_begin + 8 * next);
+    if (next + chunk.length < cnpy_n_elements(a)) {
+      assert((uintptr_t) (chunk.data + 8 * chunk.length) % page == 0);
+    }
+    for (size_t i = 0; i < chunk.length; i += 1) {
+      int64_t x;
+      cnpy_read_i8_range(a, next + i, 1, &x);
+      assert(x == (int64_t) (next + i) * 3);
+    }
+    next += chunk.length;
+    n_chunks += 1;
+  }
+  assert(next == cnpy_n_elements(a));
+  assert(n_chunks > 1);
+  assert(!cnpy_scan_next(&scan, &chunk));
+  assert(cnpy_scan_end(&scan) == CNPY_SUCCESS);
+}
+
+int main(void) {
+  const char *fn = "scan.npy";
+  unlink(fn);
+  size_t dims[] = { 1 << 20 };
+
+  cnpy_array a;
+  assert(cnpy_create(fn, CNPY_LE, CNPY_I8, CNPY_C_ORDER, 1, dims, &a) == CNPY_SUCCESS);
+  for (size_t i = 0; i < dims[0]; i += 1) {
+    int64_t x = (int64_t) i * 3;
+    cnpy_write_i8_range(a, i, 1, &x);
+  }
+
+  cnpy_scan_options opts;
+  cnpy_scan_options_init(&opts);
+  opts.chunk_size = 100000; /* not a multiple of the page size */
+  opts.budget = 1 << 20;
+
+  /* on an anonymous array, cold and pageout keep the data */
+  printf(" anonymous\n");
+  cnpy_array b;
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_I8, CNPY_C_ORDER, 1, dims, &b) == CNPY_SUCCESS);
+  memcpy(b.raw_data + b.data_begin, a.raw_data + a.data_begin, 8 * dims[0]);
+  opts.release = CNPY_RELEASE_COLD;
+  check_scan(b, &opts);
+  opts.release = CNPY_RELEASE_PAGEOUT;
+  check_scan(b, &opts);
+  check_scan(b, &opts);
+  assert(cnpy_close(&b) == CNPY_SUCCESS);
+
+  /* on a shared file mapping, even dontneed keeps the data (including changes) */
+  printf(" file\n");
+  opts.release = CNPY_RELEASE_DONTNEED;
+  opts.fn = fn;
+  check_scan(a, &opts);
+  check_scan(a, &opts);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  printf(" read only\n");
+  cnpy_open_options open_opts;
+  cnpy_open_options_init(&open_opts);
+  open_opts.mode = CNPY_MAP_READ_ONLY;
+  assert(cnpy_open_ex(fn, &open_opts, &a) == CNPY_SUCCESS);
+  check_scan(a, &opts);
+  check_scan(a, NULL);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  /* a missing file is reported */
+  opts.fn = "does_not_exist.npy";
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_I8, CNPY_C_ORDER, 1, dims, &a) == CNPY_SUCCESS);
+  cnpy_scan scan;
+  assert(cnpy_scan_begin(a, &opts, &scan) == CNPY_ERROR_FILE);
+  cnpy_error_reset();
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  unlink(fn);
+  printf("done.\n");
+  return EXIT_SUCCESS;
+}
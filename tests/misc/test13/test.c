@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include "cnpy.h"
+
+/* The pread() reader returns the same data as the mmap() accessors. */
+
+int main(void) {
+  const char *fn = "reader.npy";
+  cnpy_flat_order orders[] = { CNPY_C_ORDER, CNPY_FORTRAN_ORDER };
+  cnpy_byte_order byte_orders[] = { CNPY_LE, CNPY_BE };
+  size_t block_sizes[] = { 0, 16, 100, 4096 };
+
+  for (size_t o = 0; o < 4; o += 1) {
+    printf(" order %d, byte order %d\n", orders[o % 2], byte_orders[o / 2]);
+    unlink(fn);
+    size_t dims[] = { 13, 40, 7 };
+    size_t n = 13 * 40 * 7;
+    cnpy_array a;
+    assert(cnpy_create(fn, byte_orders[o / 2], CNPY_I4, orders[o % 2], 3, dims, &a) == CNPY_SUCCESS);
+    for (size_t i = 0; i < n; i += 1) {
+      int32_t x = (int32_t) (i * 31 % 1000) - 500;
+      cnpy_write_i4_range(a, i, 1, &x);
+    }
+
+    for (size_t bs = 0; bs < sizeof(block_sizes) / sizeof(block_sizes[0]); bs += 1) {
+      cnpy_reader r;
+      assert(cnpy_reader_open(fn, block_sizes[bs], &r) == CNPY_SUCCESS);
+      assert(r.arr.dtype == CNPY_I4 && r.arr.order == orders[o % 2] && r.arr.n_dim == 3);
+      assert(r.arr.dims[0] == 13 && r.arr.dims[1] == 40 && r.arr.dims[2] == 7);
+
+      /* ranges */
+      int32_t x[13 * 40 * 7], y[13 * 40 * 7];
+      assert(cnpy_reader_read_range(&r, 0, n, x) == CNPY_SUCCESS);
+      cnpy_read_i4_range(a, 0, n, y);
+      assert(memcmp(x, y, sizeof(x)) == 0);
+      assert(cnpy_reader_read_range(&r, 101, 55, x) == CNPY_SUCCESS);
+      assert(memcmp(x, y + 101, 55 * sizeof(int32_t)) == 0);
+
+      /* slabs: contiguous, strided, and with conversion */
+      size_t start[] = { 2, 3, 1 };
+      size_t count[] = { 5, 12, 6 };
+      size_t stride[] = { 2, 3, 1 };
+      assert(cnpy_reader_read_slab(&r, start, count, NULL, x, CNPY_I4, orders[o % 2]) == CNPY_SUCCESS);
+      cnpy_read_slab(a, start, count, NULL, y, CNPY_I4, orders[o % 2]);
+      assert(memcmp(x, y, 5 * 12 * 6 * sizeof(int32_t)) == 0);
+      assert(cnpy_reader_read_slab(&r, start, count, stride, x, CNPY_I4, CNPY_C_ORDER) == CNPY_SUCCESS);
+      cnpy_read_slab(a, start, count, stride, y, CNPY_I4, CNPY_C_ORDER);
+      assert(memcmp(x, y, 5 * 12 * 6 * sizeof(int32_t)) == 0);
+      double dx[5 * 12 * 6], dy[5 * 12 * 6];
+      assert(cnpy_reader_read_slab(&r, start, count, stride, dx, CNPY_F8, CNPY_FORTRAN_ORDER) == CNPY_SUCCESS);
+      cnpy_read_slab(a, start, count, stride, dy, CNPY_F8, CNPY_FORTRAN_ORDER);
+      assert(memcmp(dx, dy, sizeof(dx)) == 0);
+
+      assert(cnpy_reader_close(&r) == CNPY_SUCCESS);
+    }
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+  }
+
+  /* errors */
+  cnpy_reader r;
+  assert(cnpy_reader_open("does_not_exist.npy", 0, &r) == CNPY_ERROR_FILE);
+  assert(truncate(fn, 100) == 0);
+  assert(cnpy_reader_open(fn, 0, &r) == CNPY_ERROR_FORMAT);
+  cnpy_error_reset();
+  unlink(fn);
+
+  printf("done.\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include "cnpy.h"
+
+/* Asynchronous reads return the same data as the mmap() accessors, with and without registered buffers. */
+
+typedef struct {
+  size_t n_done;
+  size_t n_failed;
+} counter;
+
+static void count_done(void *user, cnpy_status status) {
+  counter *c = (counter *) user;
+  c->n_done += 1;
+  c->n_failed += (status != CNPY_SUCCESS);
+}
+
+int main(void) {
+  const char *fn = "async.npy";
+  cnpy_byte_order byte_orders[] = { CNPY_LE, CNPY_BE };
+  size_t block_sizes[] = { 0, 100, 4096 };
+  enum { N = 40000, N_READS = 500 };
+  static double x[N], y[N];
+
+  for (size_t o = 0; o < 2; o += 1) {
+    unlink(fn);
+    size_t dims[] = { 200, 200 };
+    cnpy_array a;
+    assert(cnpy_create(fn, byte_orders[o], CNPY_F8, CNPY_C_ORDER, 2, dims, &a) == CNPY_SUCCESS);
+    for (size_t i = 0; i < N; i += 1) {
+      cnpy_write_f8_range(a, i, 1, &(double){ (double) i * 0.5 - 7 });
+    }
+    cnpy_read_f8_range(a, 0, N, y);
+
+    for (size_t bs = 0; bs < sizeof(block_sizes) / sizeof(block_sizes[0]); bs += 1) {
+      for (int registered = 0; registered < 2; registered += 1) {
+        printf(" byte order %d, block size %zu, registered buffers %d\n", byte_orders[o], block_sizes[bs], registered);
+        cnpy_reader r;
+        assert(cnpy_reader_open(fn, block_sizes[bs], &r) == CNPY_SUCCESS);
+        static cnpy_async ring;
+        assert(cnpy_async_init(&ring, &r, 16) == CNPY_SUCCESS);
+        printf("  io_uring: %d\n", cnpy_async_uses_io_uring(&ring));
+        struct iovec iov = { x, sizeof(x) };
+        if (registered) {
+          assert(cnpy_async_register_buffers(&ring, &iov, 1) == CNPY_SUCCESS);
+        }
+
+        /* more reads than fit into the ring or the request table, in pieces of different lengths */
+        memset(x, 0, sizeof(x));
+        counter c = { 0, 0 };
+        size_t start = 0;
+        for (size_t k = 0; k < N_READS && start < N; k += 1) {
+          size_t count = 1 + (k * 37) % 150;
+          count = (count < N - start)? count : N - start;
+          assert(cnpy_async_read(&ring, start, count, x + start, count_done, &c) == CNPY_SUCCESS);
+          start += count;
+        }
+        assert(cnpy_async_wait(&ring, SIZE_MAX) == CNPY_SUCCESS);
+        assert(cnpy_async_pending(&ring) == 0);
+        assert(c.n_done == N_READS && c.n_failed == 0);
+        assert(memcmp(x, y, start * sizeof(double)) == 0);
+
+        /* the rest in one large read */
+        assert(cnpy_async_read(&ring, start, N - start, x + start, count_done, &c) == CNPY_SUCCESS);
+        assert(cnpy_async_read(&ring, 0, 0, x, count_done, &c) == CNPY_SUCCESS);
+        assert(cnpy_async_close(&ring) == CNPY_SUCCESS);
+        assert(c.n_done == N_READS + 2 && c.n_failed == 0);
+        assert(memcmp(x, y, sizeof(x)) == 0);
+
+        assert(cnpy_reader_close(&r) == CNPY_SUCCESS);
+      }
+    }
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+  }
+
+  unlink(fn);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+#include <cassert>
+#include <coroutine>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include "cnpy.hpp"
+
+/* co_await cnpy::async_read() reads the same data as the mmap() accessors, and reports errors as exceptions. */
+
+/* A minimal coroutine type which starts right away and is never awaited itself. */
+struct task {
+  struct promise_type {
+    task get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() { std::abort(); }
+  };
+};
+
+static task read_all(cnpy_async &ring, std::size_t first, std::size_t n, std::size_t step, double *out, std::size_t &n_done) {
+  for (std::size_t i = first; i < n; i += step) {
+    std::size_t count = (step < n - i)? step : n - i;
+    co_await cnpy::async_read(ring, i, count, out + i);
+  }
+  n_done += 1;
+}
+
+int main() {
+  const char *fn = "async.npy";
+  unlink(fn);
+  constexpr std::size_t n = 10000;
+  {
+    cnpy::array a = cnpy::array::create(fn, CNPY_BE, CNPY_F8, CNPY_C_ORDER, { n });
+    for (std::size_t i = 0; i < n; i += 1) {
+      double x = static_cast<double>(i) * 3 - 11;
+      cnpy_write_f8_range(a.get(), i, 1, &x);
+    }
+  }
+
+  cnpy_reader r;
+  assert(cnpy_reader_open(fn, 256, &r) == CNPY_SUCCESS);
+  static cnpy_async ring;
+  assert(cnpy_async_init(&ring, &r, 8) == CNPY_SUCCESS);
+
+  /* several coroutines, each with one read in flight at a time */
+  std::vector<double> x(n, 0.0);
+  std::size_t n_done = 0;
+  for (std::size_t k = 0; k < 4; k += 1) {
+    read_all(ring, k * n / 4, (k + 1) * n / 4, 97, x.data(), n_done);
+  }
+  assert(cnpy_async_close(&ring) == CNPY_SUCCESS);
+  assert(n_done == 4);
+  for (std::size_t i = 0; i < n; i += 1) {
+    assert(x[i] == static_cast<double>(i) * 3 - 11);
+  }
+
+  /* a read past the end of the file fails */
+  assert(cnpy_async_init(&ring, &r, 8) == CNPY_SUCCESS);
+  assert(truncate(fn, static_cast<off_t>(r.arr.data_begin + 8 * 100)) == 0);
+  bool caught = false;
+  [&]() -> task {
+    try {
+      co_await cnpy::async_read(ring, 50, 100, x.data());
+    }
+    catch (const cnpy::error &e) {
+      caught = (e.status() == CNPY_ERROR_FILE);
+    }
+  }();
+  assert(cnpy_async_close(&ring) == CNPY_SUCCESS);
+  assert(caught);
+
+  assert(cnpy_reader_close(&r) == CNPY_SUCCESS);
+  unlink(fn);
+  std::printf("ok\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include "cnpy.h"
+
+/* Arrays written with cnpy_direct_write() read back the same through the mapping and through cnpy_direct_scan_next(). */
+
+int main(void) {
+  const char *fn = "direct.npy";
+  cnpy_byte_order byte_orders[] = { CNPY_LE, CNPY_BE };
+  size_t block_sizes[] = { 0, 1, 8192, 3 * 4096 + 5 };
+  size_t n_buffers[] = { 0, 1, 3 };
+  enum { N = 123457 };
+  static int64_t x[N], y[N];
+  for (size_t i = 0; i < N; i += 1) {
+    x[i] = (int64_t) (i * 2654435761u) - (int64_t) i;
+  }
+
+  for (size_t o = 0; o < 2; o += 1) {
+    for (size_t bs = 0; bs < sizeof(block_sizes) / sizeof(block_sizes[0]); bs += 1) {
+      for (size_t nb = 0; nb < sizeof(n_buffers) / sizeof(n_buffers[0]); nb += 1) {
+        printf(" byte order %d, block size %zu, buffers %zu\n", byte_orders[o], block_sizes[bs], n_buffers[nb]);
+        unlink(fn);
+        size_t dims[] = { N };
+        cnpy_direct d;
+        assert(cnpy_direct_write_begin(fn, byte_orders[o], CNPY_I8, CNPY_C_ORDER, 1, dims, block_sizes[bs], n_buffers[nb], &d) == CNPY_SUCCESS);
+        assert(d.block_size % CNPY_DIRECT_ALIGN == 0 && d.block_size > d.arr.data_begin);
+        if (o == 0 && bs == 0 && nb == 0) {
+          printf("  O_DIRECT: %d\n", d.direct);
+        }
+        /* pieces of different sizes, leaving the last 1000 elements unwritten */
+        size_t pos = 0;
+        for (size_t k = 1; pos < N - 1000; k += 1) {
+          size_t count = (k * 7919) % 20000;
+          count = (count < N - 1000 - pos)? count : N - 1000 - pos;
+          assert(cnpy_direct_write(&d, x + pos, count) == CNPY_SUCCESS);
+          pos += count;
+        }
+        assert(cnpy_direct_write_end(&d) == CNPY_SUCCESS);
+
+        cnpy_array a;
+        assert(cnpy_open(fn, false, &a) == CNPY_SUCCESS);
+        assert(a.dtype == CNPY_I8 && a.byte_order == byte_orders[o] && a.n_dim == 1 && a.dims[0] == N);
+        cnpy_read_i8_range(a, 0, N, y);
+        assert(memcmp(x, y, (N - 1000) * sizeof(int64_t)) == 0);
+        for (size_t i = N - 1000; i < N; i += 1) {
+          assert(y[i] == 0);
+        }
+        assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+        /* read everything back in chunks, and stop early */
+        for (int early = 0; early < 2; early += 1) {
+          assert(cnpy_direct_scan_begin(fn, block_sizes[bs], n_buffers[nb], &d) == CNPY_SUCCESS);
+          memset(y, 0xff, sizeof(y));
+          size_t next = 0;
+          cnpy_chunk c;
+          while (cnpy_direct_scan_next(&d, &c)) {
+            assert(c.flat_start == next && c.length > 0);
+            memcpy(y + c.flat_start, c.data, c.length * sizeof(int64_t));
+            next += c.length;
+            if (early && next > N / 2) {
+              break;
+            }
+          }
+          assert(cnpy_direct_scan_end(&d) == CNPY_SUCCESS);
+          assert(early || next == N);
+          assert(memcmp(x, y, ((early && next < N - 1000)? next : N - 1000) * sizeof(int64_t)) == 0);
+        }
+      }
+    }
+  }
+
+  /* a truncated file fails */
+  cnpy_direct d;
+  assert(cnpy_direct_scan_begin(fn, 8192, 2, &d) == CNPY_SUCCESS);
+  assert(truncate(fn, 8192 * 3) == 0);
+  cnpy_chunk c;
+  size_t next = 0;
+  while (cnpy_direct_scan_next(&d, &c)) {
+    next += c.length;
+  }
+  assert(next < N);
+  assert(cnpy_direct_scan_end(&d) == CNPY_ERROR_FILE);
+
+  unlink(fn);
+  return EXIT_SUCCESS;
+}
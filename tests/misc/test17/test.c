@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include "cnpy.h"
+
+/* Arrays written row by row with a cnpy_stream_writer have the right shape and data. */
+
+int main(void) {
+  const char *fn = "stream.npy";
+  cnpy_byte_order byte_orders[] = { CNPY_LE, CNPY_BE };
+  enum { COLS = 3, ROWS = 400000 };
+  static float x[ROWS][COLS], y[ROWS][COLS];
+  for (size_t i = 0; i < ROWS; i += 1) {
+    for (size_t j = 0; j < COLS; j += 1) {
+      x[i][j] = (float) i - 0.25f * (float) j;
+    }
+  }
+
+  for (size_t o = 0; o < 2; o += 1) {
+    printf(" byte order %d\n", byte_orders[o]);
+    unlink(fn);
+    size_t trailing[] = { COLS };
+    cnpy_stream_writer w;
+    assert(cnpy_stream_writer_open(fn, CNPY_F4, byte_orders[o], 1, trailing, &w) == CNPY_SUCCESS);
+    size_t data_begin = w.arr.data_begin;
+
+    /* the header (with zero rows) is written right away */
+    FILE *f = fopen(fn, "rb");
+    assert(f != NULL);
+    char header[256];
+    assert(fread(header, 1, sizeof(header) - 1, f) == data_begin);
+    fclose(f);
+    header[data_begin] = '\0';
+    assert(strstr(header + 10, "'shape': (0,3,)") != NULL);
+
+    /* small writes, one huge write (which bypasses the buffer in host byte order), and more small writes */
+    size_t pos = 0;
+    for (size_t k = 1; pos < 1000; k += 1) {
+      assert(cnpy_stream_write_rows(&w, x[pos], k) == CNPY_SUCCESS);
+      pos += k;
+    }
+    assert(cnpy_stream_write_rows(&w, x[pos], 390000 - pos) == CNPY_SUCCESS);
+    pos = 390000;
+    assert(cnpy_stream_write_rows(&w, x[pos], 0) == CNPY_SUCCESS);
+    for (; pos < ROWS; pos += 2500) {
+      assert(cnpy_stream_write_rows(&w, x[pos], 2500) == CNPY_SUCCESS);
+    }
+    assert(w.arr.dims[0] == ROWS);
+    assert(cnpy_stream_writer_close(&w) == CNPY_SUCCESS);
+
+    cnpy_array a;
+    assert(cnpy_open(fn, false, &a) == CNPY_SUCCESS);
+    assert(a.dtype == CNPY_F4 && a.byte_order == byte_orders[o] && a.order == CNPY_C_ORDER);
+    assert(a.n_dim == 2 && a.dims[0] == ROWS && a.dims[1] == COLS);
+    assert(a.data_begin == data_begin);
+    cnpy_read_f4_range(a, 0, ROWS * COLS, &y[0][0]);
+    assert(memcmp(x, y, sizeof(x)) == 0);
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+  }
+
+  /* one-dimensional arrays, and a writer which is closed without rows: its file is only valid for numpy */
+  unlink(fn);
+  cnpy_stream_writer w;
+  assert(cnpy_stream_writer_open(fn, CNPY_U1, CNPY_LE, 0, NULL, &w) == CNPY_SUCCESS);
+  assert(cnpy_stream_writer_close(&w) == CNPY_ERROR_FORMAT);
+  assert(w.fd == -1);
+  FILE *f = fopen(fn, "rb");
+  char header[256];
+  size_t n = fread(header, 1, sizeof(header) - 1, f);
+  fclose(f);
+  header[n] = '\0';
+  assert(n % 16 == 0 && header[n - 1] == '\n' && strstr(header + 10, "'shape': (0,)") != NULL);
+  cnpy_array a;
+  assert(cnpy_open(fn, false, &a) == CNPY_ERROR_FORMAT);
+
+  unlink(fn);
+  assert(cnpy_stream_writer_open(fn, CNPY_I2, CNPY_BE, 0, NULL, &w) == CNPY_SUCCESS);
+  for (int16_t i = 0; i < 1000; i += 1) {
+    assert(cnpy_stream_write_rows(&w, &i, 1) == CNPY_SUCCESS);
+  }
+  assert(cnpy_stream_writer_close(&w) == CNPY_SUCCESS);
+  assert(cnpy_open(fn, false, &a) == CNPY_SUCCESS);
+  assert(a.n_dim == 1 && a.dims[0] == 1000 && a.byte_order == CNPY_BE);
+  for (size_t i = 0; i < 1000; i += 1) {
+    assert(cnpy_get_i2(a, &i) == (int16_t) i);
+  }
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  unlink(fn);
+  return EXIT_SUCCESS;
+}
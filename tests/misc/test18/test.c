@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include "cnpy.h"
+
+/* Rows appended in place to growable arrays are in the file, with the right shape, and the header keeps its size. */
+
+int main(void) {
+  const char *fn = "grow.npy";
+  cnpy_byte_order byte_orders[] = { CNPY_LE, CNPY_BE };
+  enum { COLS = 5, ROWS = 100000 };
+  static int32_t x[ROWS][COLS], y[ROWS][COLS];
+  for (size_t i = 0; i < ROWS; i += 1) {
+    for (size_t j = 0; j < COLS; j += 1) {
+      x[i][j] = (int32_t) (i * COLS + j) * 7 - 3;
+    }
+  }
+
+  for (size_t o = 0; o < 2; o += 1) {
+    printf(" byte order %d\n", byte_orders[o]);
+    unlink(fn);
+    cnpy_open_options opts;
+    cnpy_open_options_init(&opts);
+    opts.growable = true;
+    size_t dims[] = { 3, COLS };
+    cnpy_array a;
+    assert(cnpy_create_ex(fn, byte_orders[o], CNPY_I4, CNPY_C_ORDER, 2, dims, &opts, &a) == CNPY_SUCCESS);
+    assert(a.fd != -1);
+    cnpy_write_i4_range(a, 0, 3 * COLS, &x[0][0]);
+    size_t data_begin = a.data_begin;
+
+    /* batches of different sizes, with a reservation in between */
+    size_t pos = 3;
+    for (size_t k = 1; pos < ROWS / 2; k += 1) {
+      size_t count = (k * 37) % 1000;
+      count = (count < ROWS / 2 - pos)? count : ROWS / 2 - pos;
+      assert(cnpy_append_rows(&a, x[pos], count) == CNPY_SUCCESS);
+      pos += count;
+      assert(a.dims[0] == pos && a.data_begin == data_begin);
+    }
+    assert(cnpy_reserve_rows(&a, ROWS - pos) == CNPY_SUCCESS);
+    assert(a.map_size >= data_begin + sizeof(x) && a.dims[0] == pos);
+    char *reserved = a.raw_data;
+    assert(cnpy_append_rows(&a, x[pos], ROWS - pos) == CNPY_SUCCESS);
+    assert(a.raw_data == reserved);
+    assert(cnpy_append_rows(&a, NULL, 0) == CNPY_SUCCESS);
+    cnpy_read_i4_range(a, 0, ROWS * COLS, &y[0][0]);
+    assert(memcmp(x, y, sizeof(x)) == 0);
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+    /* the file on disk, reopened, and grown once more */
+    assert(cnpy_open(fn, false, &a) == CNPY_SUCCESS);
+    assert(a.fd == -1 && a.n_dim == 2 && a.dims[0] == ROWS && a.dims[1] == COLS && a.data_begin == data_begin);
+    memset(y, 0, sizeof(y));
+    cnpy_read_i4_range(a, 0, ROWS * COLS, &y[0][0]);
+    assert(memcmp(x, y, sizeof(x)) == 0);
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+    opts.mode = CNPY_MAP_WRITABLE;
+    assert(cnpy_open_ex(fn, &opts, &a) == CNPY_SUCCESS);
+    assert(cnpy_append_rows(&a, x, 2) == CNPY_SUCCESS);
+    assert(a.dims[0] == ROWS + 2);
+    size_t index[] = { ROWS + 1, COLS - 1 };
+    assert(cnpy_get_i4(a, index) == x[1][COLS - 1]);
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+  }
+
+  /* Fortran order arrays cannot grow along the first axis */
+  unlink(fn);
+  cnpy_open_options opts;
+  cnpy_open_options_init(&opts);
+  opts.growable = true;
+  size_t dims[] = { 4, 4 };
+  cnpy_array a;
+  assert(cnpy_create_ex(fn, CNPY_LE, CNPY_F8, CNPY_FORTRAN_ORDER, 2, dims, &opts, &a) == CNPY_SUCCESS);
+  double row[4] = { 0 };
+  assert(cnpy_append_rows(&a, row, 1) == CNPY_ERROR_FORMAT);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  /* only growable arrays get a padded header */
+  cnpy_array b;
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_F8, CNPY_C_ORDER, 2, dims, &b) == CNPY_SUCCESS);
+  assert(b.data_begin == cnpy_predict_full_header_size(CNPY_F8, CNPY_C_ORDER, 2, dims) && b.data_begin < a.data_begin);
+  assert(cnpy_close(&b) == CNPY_SUCCESS);
+
+  /* growable arrays must be writable */
+  opts.mode = CNPY_MAP_READ_ONLY;
+  assert(cnpy_open_ex(fn, &opts, &a) == CNPY_ERROR_FORMAT);
+  opts.mode = CNPY_MAP_PRIVATE;
+  assert(cnpy_open_ex(fn, &opts, &a) == CNPY_ERROR_FORMAT);
+
+  unlink(fn);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include "cnpy.h"
+
+/* A ring buffer keeps the most recent rows, which its window returns oldest first, and is a valid .npy file. */
+
+enum { CAP = 10, COLS = 3 };
+
+/* Check that the window of ring holds the rows first, ..., last - 1 (row i is { i, i + 0.5, i + 0.25 }). */
+static void check_window(const cnpy_ring *ring, size_t first, size_t last) {
+  cnpy_chunk chunks[2];
+  size_t n_chunks = cnpy_ring_window(ring, chunks);
+  assert(cnpy_ring_count(ring) == last - first);
+  double rows[CAP * COLS];
+  size_t n = 0;
+  for (size_t c = 0; c < n_chunks; c += 1) {
+    assert(chunks[c].flat_start == n && chunks[c].length > 0);
+    cnpy_array a = ring->arr;
+    if (!cnpy_is_host_byte_order(a.byte_order)) {
+      cnpy_cpy_swap_n(8, chunks[c].length, chunks[c].data, (char *) (rows + n));
+    }
+    else {
+      memcpy(rows + n, chunks[c].data, chunks[c].length * sizeof(double));
+    }
+    n += chunks[c].length;
+  }
+  assert(n == (last - first) * COLS);
+  for (size_t i = first; i < last; i += 1) {
+    assert(rows[(i - first) * COLS] == (double) i);
+    assert(rows[(i - first) * COLS + 1] == (double) i + 0.5);
+    assert(rows[(i - first) * COLS + 2] == (double) i + 0.25);
+  }
+}
+
+int main(void) {
+  const char *fn = "ring.npy";
+  double x[100][COLS];
+  for (size_t i = 0; i < 100; i += 1) {
+    x[i][0] = (double) i;
+    x[i][1] = (double) i + 0.5;
+    x[i][2] = (double) i + 0.25;
+  }
+  cnpy_byte_order byte_orders[] = { CNPY_LE, CNPY_BE };
+
+  for (size_t o = 0; o < 2; o += 1) {
+    printf(" byte order %d\n", byte_orders[o]);
+    unlink(fn);
+    size_t dims[] = { CAP, COLS };
+    cnpy_ring w;
+    assert(cnpy_ring_create(fn, byte_orders[o], CNPY_F8, 2, dims, &w) == CNPY_SUCCESS);
+    cnpy_ring r;
+    assert(cnpy_ring_open(fn, false, &r) == CNPY_SUCCESS);
+    check_window(&r, 0, 0);
+
+    /* fill, wrap around, and push more than the capacity at once; the reader sees every push */
+    size_t pushed = 0;
+    size_t counts[] = { 3, 4, 0, 2, 5, 1, 9, 13, 10, 7 };
+    for (size_t k = 0; k < sizeof(counts) / sizeof(counts[0]); k += 1) {
+      cnpy_ring_push(&w, x[pushed], counts[k]);
+      pushed += counts[k];
+      size_t first = (pushed > CAP)? pushed - CAP : 0;
+      check_window(&w, first, pushed);
+      check_window(&r, first, pushed);
+    }
+    assert(cnpy_ring_close(&r) == CNPY_SUCCESS);
+    assert(cnpy_ring_close(&w) == CNPY_SUCCESS);
+
+    /* the file is a valid array of shape (CAP, COLS), and reopens as the same ring */
+    cnpy_array a;
+    assert(cnpy_open(fn, false, &a) == CNPY_SUCCESS);
+    assert(a.n_dim == 2 && a.dims[0] == CAP && a.dims[1] == COLS && a.dtype == CNPY_F8);
+    assert(memchr(a.raw_data, '#', a.data_begin) != NULL && a.raw_data[a.data_begin - 1] == '\n');
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+    assert(cnpy_ring_open(fn, true, &w) == CNPY_SUCCESS);
+    check_window(&w, pushed - CAP, pushed);
+    cnpy_ring_push(&w, x[pushed], 1);
+    check_window(&w, pushed + 1 - CAP, pushed + 1);
+    assert(cnpy_ring_close(&w) == CNPY_SUCCESS);
+  }
+
+  /* a ring needs room for at least one row */
+  size_t dims0[] = { 0, COLS };
+  cnpy_ring z;
+  assert(cnpy_ring_create(NULL, CNPY_LE, CNPY_F8, 2, dims0, &z) == CNPY_ERROR_FORMAT);
+
+  /* a push in progress (odd seq) is not read; the ring is invalid if it never finishes */
+  size_t dims1[] = { CAP, COLS };
+  assert(cnpy_ring_create(NULL, CNPY_LE, CNPY_F8, 2, dims1, &z) == CNPY_SUCCESS);
+  cnpy_ring_push(&z, x[0], 3);
+  char *seq = (char *) memchr(z.arr.raw_data, '#', z.arr.data_begin) + strlen(CNPY_RING_TAG);
+  assert(seq[19] == '2');
+  seq[19] = '3';
+  assert(cnpy_ring_count(&z) == 0);
+  seq[19] = '2';
+  check_window(&z, 0, 3);
+  assert(cnpy_ring_close(&z) == CNPY_SUCCESS);
+
+  /* plain arrays are not rings */
+  unlink(fn);
+  size_t dims[] = { 4 };
+  cnpy_array a;
+  assert(cnpy_create(fn, CNPY_LE, CNPY_I4, CNPY_C_ORDER, 1, dims, &a) == CNPY_SUCCESS);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+  cnpy_ring r;
+  assert(cnpy_ring_open(fn, false, &r) == CNPY_ERROR_FORMAT);
+
+  unlink(fn);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "cnpy.h"
+
+/* Round trip through the bulk range accessors for every width and both byte orders. */
+
+int main(void) {
+  cnpy_byte_order byte_orders[] = { CNPY_LE, CNPY_BE };
+  cnpy_flat_order orders[] = { CNPY_C_ORDER, CNPY_FORTRAN_ORDER };
+  size_t dims[] = { 3, 5, 7 };
+
+  for (size_t bo = 0; bo < 2; bo += 1) {
+    for (size_t o = 0; o < 2; o += 1) {
+      printf(" byte order %d, order %d\n", byte_orders[bo], orders[o]);
+
+      cnpy_array a2, a4, a8, a16;
+      assert(cnpy_create(NULL, byte_orders[bo], CNPY_U2, orders[o], 3, dims, &a2) == CNPY_SUCCESS);
+      assert(cnpy_create(NULL, byte_orders[bo], CNPY_I4, orders[o], 3, dims, &a4) == CNPY_SUCCESS);
+      assert(cnpy_create(NULL, byte_orders[bo], CNPY_F8, orders[o], 3, dims, &a8) == CNPY_SUCCESS);
+      assert(cnpy_create(NULL, byte_orders[bo], CNPY_C16, orders[o], 3, dims, &a16) == CNPY_SUCCESS);
+      size_t n = cnpy_n_elements(a2);
+      assert(n == 3 * 5 * 7);
+
+      uint16_t in2[3 * 5 * 7], out2[3 * 5 * 7];
+      int32_t in4[3 * 5 * 7], out4[3 * 5 * 7];
+      double in8[3 * 5 * 7], out8[3 * 5 * 7];
+      complex double in16[3 * 5 * 7], out16[3 * 5 * 7];
+      for (size_t i = 0; i < n; i += 1) {
+        in2[i] = (uint16_t) (i * 258);
+        in4[i] = -(int32_t) (i * 65537);
+        in8[i] = (double) i / 3.0;
+        in16[i] = (double) i - 0.5 * (double) i * I;
+      }
+
+      /* write everything at once, read back element by element */
+      cnpy_write_u2_range(a2, 0, n, in2);
+      cnpy_write_i4_range(a4, 0, n, in4);
+      cnpy_write_f8_range(a8, 0, n, in8);
+      cnpy_write_c16_range(a16, 0, n, in16);
+      size_t index[CNPY_MAX_DIM];
+      cnpy_reset_index(a2, index);
+      size_t i = 0;
+      do {
+        assert(cnpy_get_u2(a2, index) == in2[i]);
+        assert(cnpy_get_i4(a4, index) == in4[i]);
+        assert(cnpy_get_f8(a8, index) == in8[i]);
+        assert(cnpy_get_c16(a16, index) == in16[i]);
+        i += 1;
+      } while (cnpy_next_index(a2, index));
+      assert(i == n);
+
+      /* the first element is stored in the requested byte order */
+      const uint8_t *raw = (const uint8_t *) a2.raw_data + a2.data_begin + 2;
+      if (byte_orders[bo] == CNPY_LE) {
+        assert(raw[0] == 2 && raw[1] == 1);
+      }
+      else {
+        assert(raw[0] == 1 && raw[1] == 2);
+      }
+      raw = (const uint8_t *) a4.raw_data + a4.data_begin + 4;
+      assert(raw[(byte_orders[bo] == CNPY_LE)? 0 : 3] == 0xff);
+      assert(raw[(byte_orders[bo] == CNPY_LE)? 2 : 1] == 0xfe);
+
+      /* partial ranges */
+      memset(out2, 0, sizeof(out2));
+      cnpy_read_u2_range(a2, 10, 20, out2);
+      cnpy_read_i4_range(a4, 10, 20, out4);
+      cnpy_read_f8_range(a8, 10, 20, out8);
+      cnpy_read_c16_range(a16, 10, 20, out16);
+      for (size_t j = 0; j < 20; j += 1) {
+        assert(out2[j] == in2[10 + j]);
+        assert(out4[j] == in4[10 + j]);
+        assert(out8[j] == in8[10 + j]);
+        assert(out16[j] == in16[10 + j]);
+      }
+      cnpy_read_f8_range(a8, n, 0, out8);
+
+      assert(cnpy_close(&a2) == CNPY_SUCCESS);
+      assert(cnpy_close(&a4) == CNPY_SUCCESS);
+      assert(cnpy_close(&a8) == CNPY_SUCCESS);
+      assert(cnpy_close(&a16) == CNPY_SUCCESS);
+      printf("  ok.\n");
+    }
+  }
+}
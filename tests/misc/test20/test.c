@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#define CNPY_FOLLOW_RESERVE ((size_t) 1 << 16) /* small, so that the file outgrows it */
+#include "cnpy.h"
+
+/* A follower sees exactly the rows which another process appends, in order, and nothing which is not committed to the header. */
+
+enum { COLS = 3, ROWS = 20000 };
+
+static int32_t value(size_t i) {
+  return (int32_t) (i * 13 + 5);
+}
+
+static void writer(const char *fn, cnpy_byte_order byte_order) {
+  cnpy_open_options opts;
+  cnpy_open_options_init(&opts);
+  opts.growable = true;
+  opts.mode = CNPY_MAP_WRITABLE;
+  cnpy_array a;
+  assert(cnpy_open_ex(fn, &opts, &a) == CNPY_SUCCESS);
+  assert(a.byte_order == byte_order);
+  static int32_t rows[ROWS][COLS];
+  for (size_t i = 0; i < ROWS * COLS; i += 1) {
+    rows[i / COLS][i % COLS] = value(i);
+  }
+  size_t pos = a.dims[0];
+  for (size_t k = 1; pos < ROWS; k += 1) {
+    size_t count = (k * 131) % 700 + 1;
+    count = (count < ROWS - pos)? count : ROWS - pos;
+    assert(cnpy_append_rows(&a, rows[pos], count) == CNPY_SUCCESS);
+    pos += count;
+    usleep(500);
+  }
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+}
+
+int main(void) {
+  const char *fn = "follow.npy";
+  cnpy_byte_order byte_orders[] = { CNPY_LE, CNPY_BE };
+
+  for (size_t o = 0; o < 2; o += 1) {
+    printf(" byte order %d\n", byte_orders[o]);
+    unlink(fn);
+    size_t dims[] = { 2, COLS };
+    cnpy_open_options opts;
+    cnpy_open_options_init(&opts);
+    opts.growable = true;
+    cnpy_array a;
+    assert(cnpy_create_ex(fn, byte_orders[o], CNPY_I4, CNPY_C_ORDER, 2, dims, &opts, &a) == CNPY_SUCCESS);
+    for (size_t i = 0; i < 2 * COLS; i += 1) {
+      int32_t v = value(i);
+      cnpy_write_i4_range(a, i, 1, &v);
+    }
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+    cnpy_follow f;
+    assert(cnpy_follow_open(fn, &f) == CNPY_SUCCESS);
+    assert(f.arr.dims[0] == 2 && f.arr.dims[1] == COLS && f.arr.byte_order == byte_orders[o]);
+    assert(cnpy_get_i4(f.arr, (size_t[]) { 1, 2 }) == value(5));
+    cnpy_chunk rows;
+    assert(cnpy_follow_poll(&f, 0, &rows) == CNPY_SUCCESS);
+    assert(rows.length == 0 && rows.flat_start == 2 * COLS);
+
+    pid_t pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+      writer(fn, byte_orders[o]);
+      _exit(0);
+    }
+
+    char *raw_data = f.arr.raw_data;
+    size_t seen = 2 * COLS;
+    size_t n_polls = 0;
+    static int32_t buf[ROWS * COLS];
+    while (seen < ROWS * COLS) {
+      assert(cnpy_follow_poll(&f, 5000, &rows) == CNPY_SUCCESS);
+      assert(rows.length > 0 && rows.length % COLS == 0);
+      assert(rows.flat_start == seen && f.arr.dims[0] * COLS == seen + rows.length);
+      assert((char *) rows.data == f.arr.raw_data + f.arr.data_begin + seen * sizeof(int32_t));
+      cnpy_read_i4_range(f.arr, rows.flat_start, rows.length, buf);
+      for (size_t i = 0; i < rows.length; i += 1) {
+        assert(buf[i] == value(seen + i));
+      }
+      seen += rows.length;
+      n_polls += 1;
+    }
+    printf("  %zu polls\n", n_polls);
+    assert(f.arr.raw_data != raw_data); /* moved when the file outgrew the reservation */
+    int wstatus;
+    assert(waitpid(pid, &wstatus, 0) == pid && WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+    assert(f.arr.dims[0] == ROWS && f.arr.raw_data_size == f.arr.data_begin + ROWS * COLS * 4);
+
+    /* a file larger than half the reservation gets twice its size */
+    cnpy_follow g;
+    assert(cnpy_follow_open(fn, &g) == CNPY_SUCCESS);
+    assert(g.arr.dims[0] == ROWS && g.reserved >= 2 * g.arr.raw_data_size);
+    assert(cnpy_get_i4(g.arr, (size_t[]) { ROWS - 1, COLS - 1 }) == value(ROWS * COLS - 1));
+    assert(cnpy_follow_close(&g) == CNPY_SUCCESS);
+
+    /* rows in the file without a header which mentions them are not handed out */
+    assert(truncate(fn, (off_t) (f.arr.raw_data_size + 2 * COLS * 4)) == 0);
+    assert(cnpy_follow_poll(&f, 30, &rows) == CNPY_SUCCESS);
+    assert(rows.length == 0 && f.arr.dims[0] == ROWS);
+
+    /* shrinking below the rows already handed out is an error */
+    assert(truncate(fn, (off_t) (f.arr.data_begin + 4)) == 0);
+    assert(cnpy_follow_poll(&f, 0, &rows) == CNPY_ERROR_FORMAT);
+    assert(cnpy_follow_close(&f) == CNPY_SUCCESS);
+  }
+
+  /* Fortran order arrays cannot be followed */
+  unlink(fn);
+  size_t dims[] = { 4, 4 };
+  cnpy_array a;
+  assert(cnpy_create(fn, CNPY_LE, CNPY_F8, CNPY_FORTRAN_ORDER, 2, dims, &a) == CNPY_SUCCESS);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+  cnpy_follow f;
+  assert(cnpy_follow_open(fn, &f) == CNPY_ERROR_FORMAT);
+  unlink(fn);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "cnpy.h"
+
+/* Members of stored .npz archives are arrays pointing into the mapped archive; missing names are errors. */
+
+static void check_members(const cnpy_npz *npz) {
+  cnpy_array a, b;
+  assert(cnpy_npz_get(npz, "a", &a) == CNPY_SUCCESS);
+  assert(a.dtype == CNPY_F8 && a.order == CNPY_C_ORDER && a.n_dim == 2 && a.dims[0] == 3 && a.dims[1] == 4);
+  for (size_t i = 0; i < 12; i += 1) {
+    size_t index[] = { i / 4, i % 4 };
+    assert(cnpy_get_f8(a, index) == (double) i * 0.5 - 1);
+  }
+  cnpy_reduction r;
+  cnpy_reduce(a, CNPY_OP_SUM | CNPY_OP_MAX, &r, 0);
+  assert(r.sum == 21.0 && r.max == 4.5 && r.argmax == 11);
+
+  /* with or without the suffix */
+  assert(cnpy_npz_get(npz, "b.npy", &b) == CNPY_SUCCESS);
+  assert(b.dtype == CNPY_I4 && b.byte_order == CNPY_BE && b.n_dim == 1 && b.dims[0] == 5);
+  int32_t y[5];
+  cnpy_read_i4_range(b, 0, 5, y);
+  for (size_t i = 0; i < 5; i += 1) {
+    assert(y[i] == (int32_t) i - 2);
+  }
+}
+
+int main(void) {
+  cnpy_npz npz;
+  assert(cnpy_npz_open("stored.npz", &npz) == CNPY_SUCCESS);
+  assert(npz.n_members == 43);
+  size_t len;
+  const char *name = cnpy_npz_name(&npz, 2, &len);
+  assert(len == 5 && memcmp(name, "c.npy", 5) == 0);
+  check_members(&npz);
+  cnpy_array a;
+  assert(cnpy_npz_get(&npz, "a", &a) == CNPY_SUCCESS);
+  assert(a.raw_data > npz.raw_data && a.raw_data + a.raw_data_size <= npz.raw_data + npz.raw_data_size);
+
+  cnpy_array c;
+  assert(cnpy_npz_get(&npz, "c", &c) == CNPY_SUCCESS);
+  assert(c.dtype == CNPY_U1 && c.order == CNPY_FORTRAN_ORDER && c.dims[0] == 2 && c.dims[1] == 3);
+  size_t index[] = { 1, 2 };
+  assert(cnpy_get_u1(c, index) == 6);
+  for (int64_t i = 0; i < 40; i += 1) {
+    char member[16];
+    snprintf(member, sizeof(member), "x%d", (int) i);
+    cnpy_array x;
+    assert(cnpy_npz_get(&npz, member, &x) == CNPY_SUCCESS);
+    size_t zero[] = { 0 };
+    assert(cnpy_get_i8(x, zero) == i);
+  }
+
+  /* the mapping is private */
+  cnpy_set_u1(c, index, 7);
+  assert(cnpy_get_u1(c, index) == 7);
+
+  cnpy_array missing = c;
+  assert(cnpy_npz_get(&npz, "d", &missing) == CNPY_ERROR_FILE);
+  assert(cnpy_npz_get(&npz, "x40", &missing) == CNPY_ERROR_FILE);
+  assert(cnpy_npz_get(&npz, "", &missing) == CNPY_ERROR_FILE);
+  assert(missing.raw_data == c.raw_data);
+  assert(cnpy_npz_close(&npz) == CNPY_SUCCESS);
+
+  /* reopening does not see the change */
+  assert(cnpy_npz_open("stored.npz", &npz) == CNPY_SUCCESS);
+  assert(cnpy_npz_get(&npz, "c", &c) == CNPY_SUCCESS);
+  assert(cnpy_get_u1(c, index) == 6);
+  assert(cnpy_npz_close(&npz) == CNPY_SUCCESS);
+
+  /* zip64 end of central directory and zip64 sizes and offsets in the central directory */
+  assert(cnpy_npz_open("zip64.npz", &npz) == CNPY_SUCCESS);
+  assert(npz.n_members == 2);
+  check_members(&npz);
+  assert(cnpy_npz_close(&npz) == CNPY_SUCCESS);
+
+  /* deflated members are decompressed */
+  assert(cnpy_npz_open("deflated.npz", &npz) == CNPY_SUCCESS);
+  assert(npz.n_members == 43);
+  check_members(&npz);
+  assert(cnpy_npz_close(&npz) == CNPY_SUCCESS);
+
+  /* a .npy file is not an archive */
+  assert(cnpy_npz_open("../test1/f8-le-c.npy", &npz) == CNPY_ERROR_FORMAT);
+  assert(cnpy_npz_open("does-not-exist.npz", &npz) == CNPY_ERROR_FILE);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include "cnpy.h"
+
+/* Deflated archives round trip through cnpy_npz_writer, whole (in parallel) and streamed, and corrupted data is detected. */
+
+enum { N = 1 << 20, N_MEMBERS = 5 };
+static const char *names[N_MEMBERS] = { "smooth", "noise", "runs", "small", "tiny" };
+
+static void check_equal(const cnpy_array a, const cnpy_array b) {
+  assert(a.dtype == b.dtype && a.byte_order == b.byte_order && a.order == b.order && a.n_dim == b.n_dim);
+  for (size_t i = 0; i < a.n_dim; i += 1) {
+    assert(a.dims[i] == b.dims[i]);
+  }
+  assert(a.raw_data_size - a.data_begin == b.raw_data_size - b.data_begin);
+  assert(memcmp(a.raw_data + a.data_begin, b.raw_data + b.data_begin, a.raw_data_size - a.data_begin) == 0);
+}
+
+int main(void) {
+  const char *fn = "test.npz";
+  cnpy_array arrs[N_MEMBERS];
+  size_t dims_smooth[] = { N / 4, 4 };
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_F8, CNPY_C_ORDER, 2, dims_smooth, &arrs[0]) == CNPY_SUCCESS);
+  for (size_t i = 0; i < N; i += 1) {
+    double x = (double) (i / 64);
+    cnpy_write_f8_range(arrs[0], i, 1, &x);
+  }
+  size_t dims_noise[] = { N };
+  assert(cnpy_create(NULL, CNPY_BE, CNPY_U4, CNPY_C_ORDER, 1, dims_noise, &arrs[1]) == CNPY_SUCCESS);
+  uint32_t state = 12345;
+  for (size_t i = 0; i < N; i += 1) {
+    state = state * 1664525u + 1013904223u;
+    cnpy_write_u4_range(arrs[1], i, 1, &state);
+  }
+  size_t dims_runs[] = { 1000, 300 };
+  assert(cnpy_create(NULL, CNPY_NE, CNPY_U1, CNPY_FORTRAN_ORDER, 2, dims_runs, &arrs[2]) == CNPY_SUCCESS);
+  for (size_t i = 0; i < 300000; i += 1) {
+    uint8_t x = (uint8_t) ((i / 777) % 3);
+    cnpy_write_u1_range(arrs[2], i, 1, &x);
+  }
+  size_t dims_small[] = { 3 };
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_I2, CNPY_C_ORDER, 1, dims_small, &arrs[3]) == CNPY_SUCCESS);
+  int16_t small[] = { -1, 0, 1 };
+  cnpy_write_i2_range(arrs[3], 0, 3, small);
+  size_t dims_tiny[] = { 1, 5 };
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_C16, CNPY_C_ORDER, 2, dims_tiny, &arrs[4]) == CNPY_SUCCESS);
+
+  unlink(fn);
+  cnpy_npz_writer w;
+  assert(cnpy_npz_writer_open(fn, &w) == CNPY_SUCCESS);
+  for (size_t i = 0; i < N_MEMBERS; i += 1) {
+    assert(cnpy_npz_writer_add(&w, names[i], arrs[i], i != 3) == CNPY_SUCCESS);
+  }
+  assert(cnpy_npz_writer_close(&w) == CNPY_SUCCESS);
+  assert(cnpy_npz_writer_open(fn, &w) == CNPY_ERROR_FILE);
+
+  /* decompressed on demand */
+  cnpy_npz npz;
+  assert(cnpy_npz_open(fn, &npz) == CNPY_SUCCESS);
+  assert(npz.n_members == N_MEMBERS);
+  printf(" archive of %zu bytes for %zu bytes of arrays\n", npz.raw_data_size, arrs[0].raw_data_size + arrs[1].raw_data_size + arrs[2].raw_data_size);
+  assert(npz.raw_data_size < arrs[0].raw_data_size / 10 + arrs[1].raw_data_size + arrs[1].raw_data_size / 100 + arrs[2].raw_data_size / 10);
+  for (size_t i = 0; i < N_MEMBERS; i += 1) {
+    size_t len;
+    const char *name = cnpy_npz_name(&npz, i, &len);
+    assert(len == strlen(names[i]) + 4 && memcmp(name, names[i], len - 4) == 0 && memcmp(name + len - 4, ".npy", 4) == 0);
+    cnpy_array a, b;
+    assert(cnpy_npz_get(&npz, names[i], &a) == CNPY_SUCCESS);
+    check_equal(a, arrs[i]);
+    assert(cnpy_npz_get_at(&npz, i, &b) == CNPY_SUCCESS);
+    assert(b.raw_data == a.raw_data); /* decompressed only once */
+  }
+  assert(cnpy_npz_close(&npz) == CNPY_SUCCESS);
+
+  /* decompressed in parallel */
+  assert(cnpy_npz_open(fn, &npz) == CNPY_SUCCESS);
+  assert(cnpy_npz_decompress(&npz, 4) == CNPY_SUCCESS);
+  for (size_t i = 0; i < N_MEMBERS; i += 1) {
+    assert(i == 3 || npz.members[i].decoded != NULL);
+    cnpy_array a;
+    assert(cnpy_npz_get(&npz, names[i], &a) == CNPY_SUCCESS);
+    assert(i == 3 || a.raw_data == npz.members[i].decoded);
+    check_equal(a, arrs[i]);
+  }
+
+  /* streamed in pieces which do not line up with the window */
+  static double buf[N];
+  for (size_t i = 0; i < N_MEMBERS; i += 1) {
+    cnpy_npz_stream s;
+    assert(cnpy_npz_stream_open(&npz, names[i], &s) == CNPY_SUCCESS);
+    assert(s.arr.dtype == arrs[i].dtype && s.arr.n_dim == arrs[i].n_dim && s.arr.dims[0] == arrs[i].dims[0]);
+    size_t size = cnpy_dtype_sizes[s.arr.dtype];
+    size_t total = cnpy_n_elements(s.arr);
+    size_t pos = 0, n_read;
+    for (size_t k = 1; ; k += 1) {
+      assert(cnpy_npz_stream_read(&s, (k * 7919) % 50000 + 1, (char *) buf + pos * size, &n_read) == CNPY_SUCCESS);
+      if (n_read == 0) {
+        break;
+      }
+      pos += n_read;
+    }
+    assert(pos == total);
+    static double expected[N];
+    cnpy_read_range(arrs[i], 0, total, expected);
+    assert(memcmp(buf, expected, total * size) == 0);
+    assert(cnpy_npz_stream_close(&s) == CNPY_SUCCESS);
+  }
+  assert(cnpy_npz_close(&npz) == CNPY_SUCCESS);
+
+  /* an archive written by Python's zipfile (dynamic Huffman codes) */
+  assert(cnpy_npz_open("../test21/deflated.npz", &npz) == CNPY_SUCCESS);
+  cnpy_npz_stream s;
+  assert(cnpy_npz_stream_open(&npz, "a", &s) == CNPY_SUCCESS);
+  double a[12];
+  size_t n_read;
+  assert(cnpy_npz_stream_read(&s, 100, a, &n_read) == CNPY_SUCCESS && n_read == 12);
+  for (size_t i = 0; i < 12; i += 1) {
+    assert(a[i] == (double) i * 0.5 - 1);
+  }
+  assert(cnpy_npz_stream_close(&s) == CNPY_SUCCESS);
+  assert(cnpy_npz_decompress(&npz, 0) == CNPY_SUCCESS);
+  assert(cnpy_npz_close(&npz) == CNPY_SUCCESS);
+
+  /* a corrupted member is detected (by its code or its CRC-32), also when streaming */
+  assert(cnpy_npz_open(fn, &npz) == CNPY_SUCCESS);
+  size_t begin;
+  assert(cnpy_npz_member_data(&npz, &npz.members[0], &begin) && npz.members[0].size > 100000 + 8);
+  assert(cnpy_npz_close(&npz) == CNPY_SUCCESS);
+  /* several bytes, since a single flipped bit may decode to the same data in a repetitive stream */
+  FILE *f = fopen(fn, "r+b");
+  unsigned char bytes[8];
+  assert(f != NULL && fseek(f, (long) begin + 100000, SEEK_SET) == 0 && fread(bytes, 1, 8, f) == 8);
+  for (size_t i = 0; i < 8; i += 1) {
+    bytes[i] ^= 0xff;
+  }
+  assert(fseek(f, (long) begin + 100000, SEEK_SET) == 0 && fwrite(bytes, 1, 8, f) == 8 && fclose(f) == 0);
+  assert(cnpy_npz_open(fn, &npz) == CNPY_SUCCESS);
+  cnpy_array broken;
+  assert(cnpy_npz_get(&npz, "smooth", &broken) == CNPY_ERROR_FORMAT);
+  assert(cnpy_npz_decompress(&npz, 2) == CNPY_ERROR_FORMAT);
+  assert(cnpy_npz_stream_open(&npz, "smooth", &s) == CNPY_SUCCESS);
+  cnpy_status status = CNPY_SUCCESS;
+  do {
+    status = cnpy_npz_stream_read(&s, 4096, buf, &n_read);
+  } while (status == CNPY_SUCCESS && n_read > 0);
+  assert(status == CNPY_ERROR_FORMAT);
+  assert(cnpy_npz_stream_close(&s) == CNPY_SUCCESS);
+  cnpy_array runs;
+  assert(cnpy_npz_get(&npz, "runs", &runs) == CNPY_SUCCESS);
+  assert(cnpy_npz_close(&npz) == CNPY_SUCCESS);
+
+  for (size_t i = 0; i < N_MEMBERS; i += 1) {
+    assert(cnpy_close(&arrs[i]) == CNPY_SUCCESS);
+  }
+  unlink(fn);
+  return EXIT_SUCCESS;
+}
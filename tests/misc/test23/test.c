@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "cnpy.h"
+
+/* Arrays round trip through .npc files with each filter; reads of ranges decompress only the blocks they touch, and corrupted files are rejected. */
+
+enum { N = 300000 };
+
+static size_t file_size(const char *fn) {
+  FILE *f = fopen(fn, "rb");
+  assert(f != NULL);
+  fseek(f, 0, SEEK_END);
+  size_t n = (size_t) ftell(f);
+  fclose(f);
+  return n;
+}
+
+/* Compare ranges read from the .npc file fn with those read from arr, in host byte order. */
+static void check_ranges(const char *fn, const cnpy_array arr, size_t n_threads) {
+  cnpy_npc npc;
+  assert(cnpy_npc_open(fn, n_threads, &npc) == CNPY_SUCCESS);
+  assert(npc.arr.dtype == arr.dtype && npc.arr.byte_order == arr.byte_order && npc.arr.order == arr.order && npc.arr.n_dim == arr.n_dim);
+  for (size_t i = 0; i < arr.n_dim; i += 1) {
+    assert(npc.arr.dims[i] == arr.dims[i]);
+  }
+  size_t n = cnpy_n_elements(arr);
+  size_t size = cnpy_dtype_sizes[arr.dtype];
+  char *expected = (char *) malloc(n * size);
+  char *got = (char *) malloc(n * size);
+  assert(expected != NULL && got != NULL);
+  cnpy_read_range(arr, 0, n, expected);
+
+  assert(cnpy_npc_read_range(&npc, 0, n, got) == CNPY_SUCCESS);
+  assert(memcmp(expected, got, n * size) == 0);
+
+  /* within a block, across blocks, and repeatedly (from the cache) */
+  size_t b = npc.block_elements;
+  size_t starts[] = { 0, 1, b - 1, b, b + 3, 5 * b - 7, n - 1, n / 2, 3, 1 };
+  size_t counts[] = { 1, b - 2, 2, b, 4 * b, 9, 1, n / 2, b + 1, 1 };
+  uint32_t state = 1;
+  for (size_t k = 0; k < 200; k += 1) {
+    size_t start, count;
+    if (k < sizeof(starts) / sizeof(starts[0])) {
+      start = starts[k] % n;
+      count = (counts[k] > 0)? counts[k] : 1;
+    }
+    else {
+      state = state * 1664525u + 1013904223u;
+      start = state % n;
+      state = state * 1664525u + 1013904223u;
+      count = 1 + state % (3 * b);
+    }
+    count = (count < n - start)? count : n - start;
+    memset(got, 0, count * size);
+    assert(cnpy_npc_read_range(&npc, start, count, got) == CNPY_SUCCESS);
+    assert(memcmp(expected + start * size, got, count * size) == 0);
+  }
+  free(expected);
+  free(got);
+  assert(cnpy_npc_close(&npc) == CNPY_SUCCESS);
+}
+
+int main(void) {
+  const char *fn = "test.npc";
+  cnpy_array smooth, ints, cplx, bytes;
+  size_t dims_smooth[] = { N };
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_F8, CNPY_C_ORDER, 1, dims_smooth, &smooth) == CNPY_SUCCESS);
+  for (size_t i = 0; i < N; i += 1) {
+    double x = sin((double) i * 1e-4);
+    cnpy_write_f8_range(smooth, i, 1, &x);
+  }
+  size_t dims_ints[] = { 1000, 301 };
+  assert(cnpy_create(NULL, CNPY_BE, CNPY_I4, CNPY_FORTRAN_ORDER, 2, dims_ints, &ints) == CNPY_SUCCESS);
+  uint32_t state = 12345;
+  for (size_t i = 0; i < 301000; i += 1) {
+    state = state * 1664525u + 1013904223u;
+    int32_t x = (int32_t) (state >> 24) % 50 - 20;
+    cnpy_write_i4_range(ints, i, 1, &x);
+  }
+  size_t dims_complex[] = { 37, 3 };
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_C16, CNPY_C_ORDER, 2, dims_complex, &cplx) == CNPY_SUCCESS);
+  for (size_t i = 0; i < 111; i += 1) {
+    complex double x = (double) i + 0.5 * I * (double) i;
+    cnpy_write_c16_range(cplx, i, 1, &x);
+  }
+  size_t dims_bytes[] = { 12345 };
+  assert(cnpy_create(NULL, CNPY_NE, CNPY_U1, CNPY_C_ORDER, 1, dims_bytes, &bytes) == CNPY_SUCCESS);
+  for (size_t i = 0; i < 12345; i += 1) {
+    uint8_t x = (uint8_t) (i * i);
+    cnpy_write_u1_range(bytes, i, 1, &x);
+  }
+
+  const cnpy_npc_filter filters[] = { CNPY_NPC_NO_FILTER, CNPY_NPC_SHUFFLE, CNPY_NPC_BITSHUFFLE };
+  size_t sizes[3][2];
+  for (size_t f = 0; f < 3; f += 1) {
+    unlink(fn);
+    assert(cnpy_npc_write(fn, smooth, 1 << 14, filters[f], 0) == CNPY_SUCCESS);
+    sizes[f][0] = file_size(fn);
+    check_ranges(fn, smooth, 0);
+    check_ranges(fn, smooth, 1);
+
+    unlink(fn);
+    assert(cnpy_npc_write(fn, ints, 1000, filters[f], 3) == CNPY_SUCCESS);
+    sizes[f][1] = file_size(fn);
+    check_ranges(fn, ints, 4);
+
+    unlink(fn);
+    assert(cnpy_npc_write(fn, cplx, 100, filters[f], 2) == CNPY_SUCCESS);
+    check_ranges(fn, cplx, 2);
+
+    unlink(fn);
+    assert(cnpy_npc_write(fn, bytes, 0, filters[f], 1) == CNPY_SUCCESS);
+    check_ranges(fn, bytes, 1);
+  }
+  /* the filters make similar bytes (or bits) of neighbouring elements adjacent */
+  printf(" smooth f8: %zu / %zu / %zu bytes, small i4: %zu / %zu / %zu bytes\n", sizes[0][0], sizes[1][0], sizes[2][0], sizes[0][1], sizes[1][1], sizes[2][1]);
+  assert(sizes[1][0] < sizes[0][0] / 5 * 4 && sizes[2][0] < sizes[0][0] / 5 * 4);
+  assert(sizes[2][1] < sizes[0][1] && sizes[2][1] < 301000 * 4 / 4);
+
+  /* the file must not exist */
+  assert(cnpy_npc_write(fn, bytes, 0, CNPY_NPC_SHUFFLE, 1) == CNPY_ERROR_FILE);
+
+  /* an invalid block type in the first block */
+  unlink(fn);
+  assert(cnpy_npc_write(fn, smooth, 1 << 14, CNPY_NPC_SHUFFLE, 0) == CNPY_SUCCESS);
+  cnpy_npc npc;
+  assert(cnpy_npc_open(fn, 0, &npc) == CNPY_SUCCESS);
+  uint64_t first = npc.offsets[0];
+  assert(npc.offsets[1] - first < (1 << 14));
+  assert(cnpy_npc_close(&npc) == CNPY_SUCCESS);
+  int fd = open(fn, O_RDWR);
+  assert(fd != -1);
+  char c = 0x07;
+  assert(pwrite(fd, &c, 1, (off_t) first) == 1);
+  double x[3];
+  assert(cnpy_npc_open(fn, 0, &npc) == CNPY_SUCCESS);
+  assert(cnpy_npc_read_range(&npc, 10, 3, x) == CNPY_ERROR_FORMAT);
+  assert(cnpy_npc_read_range(&npc, N - 3, 3, x) == CNPY_SUCCESS);
+  assert(cnpy_npc_close(&npc) == CNPY_SUCCESS);
+
+  /* a broken index, and a truncated file */
+  char index[8] = { 0 };
+  assert(pwrite(fd, index, 8, (off_t) first - 8) == 8);
+  assert(cnpy_npc_open(fn, 0, &npc) == CNPY_ERROR_FORMAT);
+  assert(ftruncate(fd, 100) == 0);
+  assert(cnpy_npc_open(fn, 0, &npc) == CNPY_ERROR_FORMAT);
+  close(fd);
+  unlink(fn);
+
+  /* not a .npc file */
+  assert(cnpy_npc_open("test.c", 0, &npc) == CNPY_ERROR_FORMAT);
+
+  cnpy_close(&smooth);
+  cnpy_close(&ints);
+  cnpy_close(&cplx);
+  cnpy_close(&bytes);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "cnpy.h"
+
+/* cnpy_stat() and cnpy_open_many() read headers in the forms numpy and this library write, and others; errors are reported per file. */
+
+typedef struct {
+  const char *name;
+  const char *dict; /* NULL: the file is not written */
+  unsigned version;
+  size_t padding; /* spaces after the dictionary, at least */
+  size_t data_size;
+  cnpy_status status;
+  cnpy_byte_order byte_order;
+  cnpy_dtype dtype;
+  cnpy_flat_order order;
+  size_t n_dim;
+  size_t dims[CNPY_MAX_DIM];
+} file;
+
+
+static const file files[] = {
+  { "numpy_c.npy", "{'descr': '<f8', 'fortran_order': False, 'shape': (3, 4), }", 1, 0, 96, CNPY_SUCCESS, CNPY_LE, CNPY_F8, CNPY_C_ORDER, 2, { 3, 4 } },
+  { "numpy_1d.npy", "{'descr': '|u1', 'fortran_order': False, 'shape': (5,), }", 1, 0, 5, CNPY_SUCCESS, CNPY_NE, CNPY_U1, CNPY_C_ORDER, 1, { 5 } },
+  { "numpy_f.npy", "{'descr': '>i2', 'fortran_order': True, 'shape': (2, 3, 4), }", 1, 0, 48, CNPY_SUCCESS, CNPY_BE, CNPY_I2, CNPY_FORTRAN_ORDER, 3, { 2, 3, 4 } },
+  { "bool.npy", "{'descr': '|b1', 'fortran_order': False, 'shape': (7,), }", 1, 0, 7, CNPY_SUCCESS, CNPY_NE, CNPY_B, CNPY_C_ORDER, 1, { 7 } },
+  { "cnpy.npy", "{'descr': '<c16', 'fortran_order': False, 'shape': (2,1,3,), }", 1, 0, 96, CNPY_SUCCESS, CNPY_LE, CNPY_C16, CNPY_C_ORDER, 3, { 2, 1, 3 } },
+  { "ring.npy", "{'descr': '<u4', 'fortran_order': False, 'shape': (10,), } # head=3", 1, 0, 40, CNPY_SUCCESS, CNPY_LE, CNPY_U4, CNPY_C_ORDER, 1, { 10 } },
+  { "other.npy", "{\"shape\": [2, 2], \"descr\": \"<c8\", \"fortran_order\": True}", 1, 0, 32, CNPY_SUCCESS, CNPY_LE, CNPY_C8, CNPY_FORTRAN_ORDER, 2, { 2, 2 } },
+  { "spaces.npy", "{ 'descr' : '<i8' , 'fortran_order' : False , 'shape' : (2 , 2) }", 1, 0, 32, CNPY_SUCCESS, CNPY_LE, CNPY_I8, CNPY_C_ORDER, 2, { 2, 2 } },
+  { "long_header.npy", "{'descr': '<f4', 'fortran_order': False, 'shape': (3,), }", 1, 10000, 12, CNPY_SUCCESS, CNPY_LE, CNPY_F4, CNPY_C_ORDER, 1, { 3 } },
+  { "version2.npy", "{'descr': '>u8', 'fortran_order': False, 'shape': (1, 2), }", 2, 20000, 16, CNPY_SUCCESS, CNPY_BE, CNPY_U8, CNPY_C_ORDER, 2, { 1, 2 } },
+  { "short.npy", "{'descr': '<f8', 'fortran_order': False, 'shape': (3, 4), }", 1, 0, 95, CNPY_ERROR_FORMAT, CNPY_LE, CNPY_B, CNPY_C_ORDER, 0, { 0 } },
+  { "bad_dtype.npy", "{'descr': '<f3', 'fortran_order': False, 'shape': (3,), }", 1, 0, 9, CNPY_ERROR_FORMAT, CNPY_LE, CNPY_B, CNPY_C_ORDER, 0, { 0 } },
+  { "many_dims.npy", "{'descr': '<f8', 'fortran_order': False, 'shape': (1, 1, 1, 1, 1), }", 1, 0, 8, CNPY_ERROR_FORMAT, CNPY_LE, CNPY_B, CNPY_C_ORDER, 0, { 0 } },
+  { "missing.npy", NULL, 1, 0, 0, CNPY_ERROR_FILE, CNPY_LE, CNPY_B, CNPY_C_ORDER, 0, { 0 } },
+};
+enum { N_FILES = sizeof(files) / sizeof(files[0]) };
+
+
+/* Write the file f into the directory dir_fd, with the data bytes counting up from 1. */
+static void write_file(int dir_fd, const file *f) {
+  size_t prefix = (f->version == 1)? 10 : 12;
+  size_t full_header_size = (prefix + strlen(f->dict) + f->padding + 1 + 15) / 16 * 16;
+  size_t size = full_header_size + f->data_size;
+  char *buf = (char *) malloc(size);
+  assert(buf != NULL);
+  memcpy(buf, "\x93NUMPY", 6);
+  buf[6] = (char) f->version;
+  buf[7] = 0;
+  size_t header_size = full_header_size - prefix;
+  for (size_t i = 0; i < prefix - 8; i += 1) {
+    buf[8 + i] = (char) (header_size >> (8 * i));
+  }
+  memset(buf + prefix, ' ', header_size);
+  memcpy(buf + prefix, f->dict, strlen(f->dict));
+  buf[full_header_size - 1] = '\n';
+  for (size_t i = 0; i < f->data_size; i += 1) {
+    buf[full_header_size + i] = (char) (i + 1);
+  }
+  int fd = openat(dir_fd, f->name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  assert(fd != -1);
+  assert(write(fd, buf, size) == (ssize_t) size);
+  assert(close(fd) == 0);
+  free(buf);
+}
+
+
+static void check_meta(const file *f, const cnpy_array *arr) {
+  assert(arr->byte_order == f->byte_order && arr->dtype == f->dtype && arr->order == f->order && arr->n_dim == f->n_dim);
+  for (size_t i = 0; i < f->n_dim; i += 1) {
+    assert(arr->dims[i] == f->dims[i]);
+  }
+  assert(arr->data_begin % 16 == 0 && arr->raw_data_size == arr->data_begin + f->data_size);
+}
+
+
+int main(void) {
+  assert(mkdir("files", 0755) == 0);
+  int dir_fd = open("files", O_RDONLY);
+  assert(dir_fd != -1);
+  for (size_t i = 0; i < N_FILES; i += 1) {
+    if (files[i].dict != NULL) {
+      write_file(dir_fd, &files[i]);
+    }
+  }
+  cnpy_error_reset();
+
+  /* single files, relative to the directory and to the working directory */
+  for (size_t i = 0; i < N_FILES; i += 1) {
+    cnpy_array meta;
+    memset(&meta, 0xff, sizeof(meta));
+    char error_str[CNPY_ERROR_STR_SIZE] = "";
+    assert(cnpy_stat(dir_fd, files[i].name, &meta, error_str) == files[i].status);
+    if (files[i].status == CNPY_SUCCESS) {
+      check_meta(&files[i], &meta);
+      assert(meta.raw_data == NULL && meta.fd == -1);
+      char path[64];
+      snprintf(path, sizeof(path), "files/%s", files[i].name);
+      cnpy_array arr;
+      assert(cnpy_stat(AT_FDCWD, path, &arr, NULL) == CNPY_SUCCESS);
+      check_meta(&files[i], &arr);
+      assert(cnpy_open(path, false, &arr) == CNPY_SUCCESS);
+      check_meta(&files[i], &arr);
+      assert(arr.data_begin == meta.data_begin);
+      assert(cnpy_close(&arr) == CNPY_SUCCESS);
+    }
+    else {
+      assert(meta.n_dim == SIZE_MAX); /* not changed */
+      assert(error_str[0] != '\0');
+    }
+  }
+  char error_str[CNPY_ERROR_STR_SIZE] = "";
+  cnpy_array meta;
+  assert(cnpy_stat(dir_fd, "missing.npy", &meta, error_str) == CNPY_ERROR_FILE);
+  assert(strstr(error_str, "Could not open file") != NULL);
+  assert(cnpy_stat(dir_fd, "many_dims.npy", &meta, error_str) == CNPY_ERROR_FORMAT);
+  assert(strstr(error_str, "too many dimensions") != NULL);
+  assert(cnpy_stat(dir_fd, "short.npy", &meta, error_str) == CNPY_ERROR_FORMAT);
+  assert(strstr(error_str, "does not match") != NULL);
+
+  /* batches, with each file several times */
+  enum { N = 5 * N_FILES };
+  const char *fns[N];
+  for (size_t i = 0; i < N; i += 1) {
+    fns[i] = files[i % N_FILES].name;
+  }
+  cnpy_open_options opts;
+  cnpy_open_options_init(&opts);
+  opts.mode = CNPY_MAP_READ_ONLY;
+  size_t thread_counts[] = { 1, 3, 0 };
+  for (size_t k = 0; k < 3; k += 1) {
+    static cnpy_array arrs[N];
+    cnpy_status statuses[N];
+    static char error_strs[N][CNPY_ERROR_STR_SIZE];
+    memset(arrs, 0, sizeof(arrs));
+    memset(error_strs, 0, sizeof(error_strs));
+    assert(cnpy_open_many(dir_fd, fns, N, &opts, arrs, statuses, error_strs, thread_counts[k]) == CNPY_ERROR_FORMAT);
+    for (size_t i = 0; i < N; i += 1) {
+      const file *f = &files[i % N_FILES];
+      assert(statuses[i] == f->status);
+      if (f->status == CNPY_SUCCESS) {
+        check_meta(f, &arrs[i]);
+        for (size_t j = 0; j < f->data_size; j += 1) {
+          assert(arrs[i].raw_data[arrs[i].data_begin + j] == (char) (j + 1));
+        }
+        assert(error_strs[i][0] == '\0');
+        assert(cnpy_close(&arrs[i]) == CNPY_SUCCESS);
+      }
+      else {
+        assert(arrs[i].raw_data == NULL);
+        assert(error_strs[i][0] != '\0');
+      }
+    }
+
+    /* only the metadata, without messages */
+    assert(cnpy_open_many(dir_fd, fns, N, NULL, arrs, statuses, NULL, thread_counts[k]) == CNPY_ERROR_FORMAT);
+    for (size_t i = 0; i < N; i += 1) {
+      const file *f = &files[i % N_FILES];
+      assert(statuses[i] == f->status);
+      if (f->status == CNPY_SUCCESS) {
+        check_meta(f, &arrs[i]);
+        assert(arrs[i].raw_data == NULL);
+      }
+    }
+  }
+  cnpy_array arrs[4];
+  cnpy_status statuses[4];
+  assert(cnpy_open_many(dir_fd, fns, 4, &opts, arrs, statuses, NULL, 0) == CNPY_SUCCESS);
+  for (size_t i = 0; i < 4; i += 1) {
+    assert(cnpy_close(&arrs[i]) == CNPY_SUCCESS);
+  }
+  assert(cnpy_open_many(dir_fd, fns, 0, &opts, arrs, statuses, NULL, 0) == CNPY_SUCCESS);
+
+  /* the messages only went to the buffers */
+  assert(strcmp(cnpy_error_str, "cnpy successful") == 0);
+
+  for (size_t i = 0; i < N_FILES; i += 1) {
+    unlinkat(dir_fd, files[i].name, 0);
+  }
+  close(dir_fd);
+  assert(rmdir("files") == 0);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "cnpy.h"
+
+/* A catalog of a directory holds the metadata of its .npy files; rebuilds keep the entries of unchanged files. */
+
+static void create(const char *fn, cnpy_byte_order byte_order, cnpy_dtype dtype, cnpy_flat_order order, size_t n_dim, const size_t *dims) {
+  cnpy_array arr;
+  unlink(fn);
+  assert(cnpy_create(fn, byte_order, dtype, order, n_dim, dims, &arr) == CNPY_SUCCESS);
+  for (size_t i = 0; i < arr.raw_data_size - arr.data_begin; i += 1) {
+    arr.raw_data[arr.data_begin + i] = (char) (i * 7);
+  }
+  assert(cnpy_close(&arr) == CNPY_SUCCESS);
+}
+
+
+static void write_text(const char *fn, const char *text) {
+  FILE *f = fopen(fn, "w");
+  assert(f != NULL);
+  fputs(text, f);
+  fclose(f);
+}
+
+
+/* The entries of cat are those of cnpy_stat() for the names, in this order. */
+static void check_catalog(const cnpy_catalog *cat, const char **names, size_t n) {
+  assert(cat->n_entries == n);
+  for (size_t i = 0; i < n; i += 1) {
+    size_t len;
+    const char *name = cnpy_catalog_name(cat, i, &len);
+    assert(name != NULL && len == strlen(names[i]) && memcmp(name, names[i], len) == 0);
+    char path[64];
+    snprintf(path, sizeof(path), "dir/%s", names[i]);
+    cnpy_array expected, got;
+    assert(cnpy_stat(AT_FDCWD, path, &expected, NULL) == CNPY_SUCCESS);
+    assert(cnpy_catalog_lookup(cat, names[i], &got) == CNPY_SUCCESS);
+    assert(got.dtype == expected.dtype && got.byte_order == expected.byte_order && got.order == expected.order && got.n_dim == expected.n_dim);
+    for (size_t k = 0; k < got.n_dim; k += 1) {
+      assert(got.dims[k] == expected.dims[k]);
+    }
+    assert(got.data_begin == expected.data_begin && got.raw_data_size == expected.raw_data_size && got.raw_data == NULL);
+  }
+}
+
+
+/* Set the modification time of fn to t seconds. */
+static void set_mtime(const char *fn, time_t t) {
+  struct timespec times[2];
+  times[0].tv_sec = times[1].tv_sec = t;
+  times[0].tv_nsec = times[1].tv_nsec = 0;
+  assert(utimensat(AT_FDCWD, fn, times, 0) == 0);
+}
+
+
+int main(void) {
+  const char *index_fn = "catalog.idx";
+  unlink(index_fn);
+  assert(mkdir("dir", 0755) == 0);
+  assert(mkdir("dir/sub.npy", 0755) == 0);
+  size_t dims_a[] = { 3, 4 };
+  size_t dims_b[] = { 5 };
+  size_t dims_c[] = { 1000, 3 };
+  create("dir/a.npy", CNPY_LE, CNPY_F8, CNPY_C_ORDER, 2, dims_a);
+  create("dir/b.npy", CNPY_BE, CNPY_I2, CNPY_FORTRAN_ORDER, 1, dims_b);
+  create("dir/c.npy", CNPY_NE, CNPY_U1, CNPY_C_ORDER, 2, dims_c);
+  write_text("dir/bad.npy", "not an array\n");
+  write_text("dir/notes.txt", "not an array either\n");
+
+  cnpy_catalog cat;
+  assert(cnpy_catalog_open(index_fn, &cat) == CNPY_ERROR_FILE);
+  assert(cnpy_catalog_build("dir", index_fn, 2) == CNPY_SUCCESS);
+  assert(cnpy_catalog_open(index_fn, &cat) == CNPY_SUCCESS);
+  const char *names1[] = { "a.npy", "b.npy", "c.npy" };
+  check_catalog(&cat, names1, 3);
+  cnpy_array meta;
+  assert(cnpy_catalog_lookup(&cat, "bad.npy", &meta) == CNPY_ERROR_FILE);
+  assert(cnpy_catalog_lookup(&cat, "d.npy", &meta) == CNPY_ERROR_FILE);
+  assert(cnpy_catalog_lookup(&cat, "", &meta) == CNPY_ERROR_FILE);
+
+  /* mapping through the catalog */
+  cnpy_open_options opts;
+  cnpy_open_options_init(&opts);
+  opts.mode = CNPY_MAP_READ_ONLY;
+  cnpy_array arr;
+  assert(cnpy_catalog_map(&cat, "c.npy", &opts, &arr) == CNPY_SUCCESS);
+  assert(arr.dtype == CNPY_U1 && arr.dims[0] == 1000 && arr.raw_data != NULL);
+  for (size_t i = 0; i < 3000; i += 1) {
+    size_t index[] = { i / 3, i % 3 };
+    assert(cnpy_get_u1(arr, index) == (uint8_t) (i * 7));
+  }
+  assert(cnpy_close(&arr) == CNPY_SUCCESS);
+  set_mtime("dir/c.npy", 1000000000);
+  assert(cnpy_catalog_map(&cat, "c.npy", &opts, &arr) == CNPY_ERROR_FORMAT);
+
+  /* an unchanged file (same inode, modification time and size) is not read again: change its header, but not its time */
+  struct stat st;
+  assert(stat("dir/b.npy", &st) == 0);
+  int fd = open("dir/b.npy", O_RDWR);
+  assert(fd != -1);
+  assert(cnpy_stat(AT_FDCWD, "dir/b.npy", &meta, NULL) == CNPY_SUCCESS);
+  char header[256] = { 0 };
+  assert(meta.data_begin < sizeof(header) && pread(fd, header, meta.data_begin, 0) == (ssize_t) meta.data_begin);
+  char *descr = strstr(header + 10, "'>i2'");
+  assert(descr != NULL);
+  descr[1] = '<';
+  assert(pwrite(fd, header, meta.data_begin, 0) == (ssize_t) meta.data_begin);
+  close(fd);
+  struct timespec times[2] = { st.st_atim, st.st_mtim };
+  assert(utimensat(AT_FDCWD, "dir/b.npy", times, 0) == 0);
+
+  /* replace one file, remove one, and add one */
+  size_t dims_d[] = { 2, 2, 2 };
+  create("dir/a.npy", CNPY_LE, CNPY_C16, CNPY_FORTRAN_ORDER, 1, dims_b);
+  unlink("dir/c.npy");
+  create("dir/d.npy", CNPY_BE, CNPY_F4, CNPY_C_ORDER, 3, dims_d);
+  assert(cnpy_catalog_build("dir", index_fn, 0) == CNPY_SUCCESS);
+
+  /* the old catalog stays valid while it is mapped */
+  assert(cat.n_entries == 3);
+  assert(cnpy_catalog_lookup(&cat, "a.npy", &meta) == CNPY_SUCCESS && meta.dtype == CNPY_F8);
+  assert(cnpy_catalog_lookup(&cat, "c.npy", &meta) == CNPY_SUCCESS && meta.dims[0] == 1000);
+  assert(cnpy_catalog_close(&cat) == CNPY_SUCCESS);
+
+  assert(cnpy_catalog_open(index_fn, &cat) == CNPY_SUCCESS);
+  assert(cat.n_entries == 3);
+  assert(cnpy_catalog_lookup(&cat, "a.npy", &meta) == CNPY_SUCCESS && meta.dtype == CNPY_C16 && meta.order == CNPY_FORTRAN_ORDER && meta.dims[0] == 5);
+  assert(cnpy_catalog_lookup(&cat, "b.npy", &meta) == CNPY_SUCCESS && meta.byte_order == CNPY_BE); /* the entry was kept */
+  assert(cnpy_catalog_lookup(&cat, "c.npy", &meta) == CNPY_ERROR_FILE);
+  const char *names2[] = { "a.npy", "b.npy", "d.npy" };
+  assert(cnpy_catalog_lookup(&cat, "d.npy", &meta) == CNPY_SUCCESS && meta.n_dim == 3);
+  assert(cnpy_catalog_close(&cat) == CNPY_SUCCESS);
+
+  /* after a change of the time, the header is read again */
+  set_mtime("dir/b.npy", 1000000000);
+  assert(cnpy_catalog_build("dir", index_fn, 1) == CNPY_SUCCESS);
+  assert(cnpy_catalog_open(index_fn, &cat) == CNPY_SUCCESS);
+  check_catalog(&cat, names2, 3);
+  assert(cnpy_catalog_lookup(&cat, "b.npy", &meta) == CNPY_SUCCESS && meta.byte_order == CNPY_LE);
+  assert(cnpy_catalog_close(&cat) == CNPY_SUCCESS);
+
+  /* corrupt catalogs */
+  assert(truncate(index_fn, 100) == 0);
+  assert(cnpy_catalog_open(index_fn, &cat) == CNPY_ERROR_FORMAT);
+  assert(cnpy_catalog_open("test.c", &cat) == CNPY_ERROR_FORMAT);
+  /* a broken catalog is rebuilt from scratch */
+  assert(cnpy_catalog_build("dir", index_fn, 1) == CNPY_SUCCESS);
+  assert(cnpy_catalog_open(index_fn, &cat) == CNPY_SUCCESS);
+  check_catalog(&cat, names2, 3);
+  assert(cnpy_catalog_close(&cat) == CNPY_SUCCESS);
+
+  /* an empty directory */
+  unlink("dir/a.npy");
+  unlink("dir/b.npy");
+  unlink("dir/d.npy");
+  unlink("dir/bad.npy");
+  unlink("dir/notes.txt");
+  assert(cnpy_catalog_build("dir", index_fn, 1) == CNPY_SUCCESS);
+  assert(cnpy_catalog_open(index_fn, &cat) == CNPY_SUCCESS);
+  assert(cat.n_entries == 0);
+  assert(cnpy_catalog_lookup(&cat, "a.npy", &meta) == CNPY_ERROR_FILE);
+  assert(cnpy_catalog_close(&cat) == CNPY_SUCCESS);
+
+  assert(cnpy_catalog_build("missing", index_fn, 1) == CNPY_ERROR_FILE);
+  unlink(index_fn);
+  rmdir("dir/sub.npy");
+  assert(rmdir("dir") == 0);
+  return EXIT_SUCCESS;
+}
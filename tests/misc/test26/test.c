@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "cnpy.h"
+
+/* Shards of different lengths read as one array: getters, ranges and chunks cross shard boundaries with a bounded number of mappings. */
+
+enum { N_SHARDS = 6 };
+
+static const char *fns[N_SHARDS] = { "s0.npy", "s1.npy", "s2.npy", "s3.npy", "s4.npy", "s5.npy" };
+static const size_t rows[N_SHARDS] = { 3, 5, 1, 7, 1, 1 };
+
+/* Write shard i with dims (rows[i], 2, 3) in the given order; its elements are their flat indices in the concatenation. */
+static void write_shard(size_t i, cnpy_byte_order byte_order, cnpy_flat_order order, size_t last_dim) {
+  size_t first = 0;
+  for (size_t k = 0; k < i; k += 1) {
+    first += rows[k] * 6;
+  }
+  unlink(fns[i]);
+  cnpy_array arr;
+  size_t dims[] = { rows[i], 2, last_dim };
+  assert(cnpy_create(fns[i], byte_order, CNPY_F8, order, 3, dims, &arr) == CNPY_SUCCESS);
+  for (size_t j = 0; j < cnpy_n_elements(arr); j += 1) {
+    double x = (double) (first + j);
+    cnpy_write_f8_range(arr, j, 1, &x);
+  }
+  assert(cnpy_close(&arr) == CNPY_SUCCESS);
+}
+
+int main(void) {
+  for (size_t i = 0; i < N_SHARDS; i += 1) {
+    write_shard(i, CNPY_BE, CNPY_C_ORDER, 3);
+  }
+  size_t n = 18 * 6;
+
+  cnpy_open_options opts;
+  cnpy_open_options_init(&opts);
+  opts.mode = CNPY_MAP_READ_ONLY;
+  cnpy_concat cat;
+  assert(cnpy_concat_open_ex(fns, N_SHARDS, &opts, 2, 3, &cat) == CNPY_SUCCESS);
+  assert(cat.arr.dtype == CNPY_F8 && cat.arr.byte_order == CNPY_BE && cat.arr.n_dim == 3);
+  assert(cat.arr.dims[0] == 18 && cat.arr.dims[1] == 2 && cat.arr.dims[2] == 3 && cnpy_n_elements(cat.arr) == n);
+  assert(cat.n_mapped == 0);
+
+  /* rows resolve to shards without mapping them */
+  size_t shard, local;
+  const size_t expected_shard[] = { 0, 0, 0, 1, 1, 1, 1, 1, 2, 3, 3, 3, 3, 3, 3, 3, 4, 5 };
+  for (size_t row = 0; row < 18; row += 1) {
+    cnpy_concat_resolve(&cat, row, &shard, &local);
+    assert(shard == expected_shard[row] && local < rows[shard]);
+  }
+  assert(cat.n_mapped == 0);
+
+  /* every element, in random order, which maps and unmaps shards all the time */
+  uint32_t state = 7;
+  for (size_t k = 0; k < 1000; k += 1) {
+    state = state * 1664525u + 1013904223u;
+    size_t flat = state % n;
+    size_t index[] = { flat / 6, flat / 3 % 2, flat % 3 };
+    double x = -1.0;
+    assert(cnpy_concat_get_f8(&cat, index, &x) == CNPY_SUCCESS);
+    assert(x == (double) flat);
+    assert(cat.n_mapped <= 2);
+  }
+
+  /* ranges across one or several boundaries */
+  double all[18 * 6];
+  assert(cnpy_concat_read_f8_range(&cat, 0, n, all) == CNPY_SUCCESS);
+  for (size_t j = 0; j < n; j += 1) {
+    assert(all[j] == (double) j);
+  }
+  double some[40];
+  assert(cnpy_concat_read_range(&cat, 17, 2, some) == CNPY_SUCCESS);
+  assert(some[0] == 17.0 && some[1] == 18.0);
+  assert(cnpy_concat_read_f8_range(&cat, 50, 40, some) == CNPY_SUCCESS);
+  for (size_t j = 0; j < 40; j += 1) {
+    assert(some[j] == (double) (50 + j));
+  }
+  assert(cnpy_concat_read_range(&cat, n, 0, some) == CNPY_SUCCESS);
+
+  /* one chunk per shard touched */
+  cnpy_concat_iter it;
+  cnpy_chunk chunk;
+  cnpy_concat_iter_init(&cat, 10, 90, &it);
+  const size_t lengths[] = { 8, 30, 6, 42, 4 };
+  size_t n_chunks = 0;
+  size_t next = 10;
+  while (cnpy_concat_next(&cat, &it, &chunk) == CNPY_SUCCESS && chunk.length > 0) {
+    assert(n_chunks < 5 && chunk.length == lengths[n_chunks] && chunk.flat_start == next);
+    double x[42];
+    cnpy_cpy_n(cat.arr, chunk.length, chunk.data, (char *) x);
+    for (size_t j = 0; j < chunk.length; j += 1) {
+      assert(x[j] == (double) (next + j));
+    }
+    next += chunk.length;
+    n_chunks += 1;
+  }
+  assert(n_chunks == 5 && next == 100);
+  assert(cnpy_concat_close(&cat) == CNPY_SUCCESS);
+
+  /* a shard which changes after opening is noticed when it is mapped */
+  assert(cnpy_concat_open(fns, N_SHARDS, &cat) == CNPY_SUCCESS);
+  assert(cat.max_mapped == N_SHARDS);
+  write_shard(3, CNPY_BE, CNPY_C_ORDER, 4);
+  double x;
+  size_t index[] = { 0, 0, 0 };
+  assert(cnpy_concat_get_f8(&cat, index, &x) == CNPY_SUCCESS && x == 0.0);
+  index[0] = 9;
+  assert(cnpy_concat_get_f8(&cat, index, &x) == CNPY_ERROR_FORMAT);
+  assert(cat.n_mapped == 1);
+  assert(cnpy_concat_close(&cat) == CNPY_SUCCESS);
+
+  /* shards which do not fit together, or are missing */
+  assert(cnpy_concat_open(fns, N_SHARDS, &cat) == CNPY_ERROR_FORMAT);
+  write_shard(3, CNPY_LE, CNPY_C_ORDER, 3);
+  assert(cnpy_concat_open(fns, N_SHARDS, &cat) == CNPY_ERROR_FORMAT);
+  write_shard(3, CNPY_BE, CNPY_FORTRAN_ORDER, 3);
+  assert(cnpy_concat_open(fns, N_SHARDS, &cat) == CNPY_ERROR_FORMAT);
+  unlink(fns[3]);
+  assert(cnpy_concat_open(fns, N_SHARDS, &cat) == CNPY_ERROR_FILE);
+  assert(strstr(cnpy_error_str, "s3.npy") != NULL);
+  assert(cnpy_concat_open(fns, 3, &cat) == CNPY_SUCCESS);
+  assert(cat.arr.dims[0] == 9);
+  assert(cnpy_concat_close(&cat) == CNPY_SUCCESS);
+
+  for (size_t i = 0; i < N_SHARDS; i += 1) {
+    unlink(fns[i]);
+  }
+  return EXIT_SUCCESS;
+}
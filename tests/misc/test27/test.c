@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cnpy.h"
+
+/* A directory of columns is scanned in batches, sequentially and on several threads; only the projected columns are mapped. */
+
+enum { N_ROWS = 100003 };
+
+static void write_column(const char *fn, cnpy_dtype dtype, size_t n_rows) {
+  unlink(fn);
+  cnpy_array arr;
+  size_t dims[] = { n_rows };
+  assert(cnpy_create(fn, CNPY_LE, dtype, CNPY_C_ORDER, 1, dims, &arr) == CNPY_SUCCESS);
+  for (size_t i = 0; i < n_rows; i += 1) {
+    if (dtype == CNPY_F8) {
+      double x = 0.5 * (double) i;
+      cnpy_write_f8_range(arr, i, 1, &x);
+    }
+    else if (dtype == CNPY_I4) {
+      int32_t x = -(int32_t) i;
+      cnpy_write_i4_range(arr, i, 1, &x);
+    }
+    else {
+      uint8_t x = (uint8_t) i;
+      cnpy_write_u1_range(arr, i, 1, &x);
+    }
+  }
+  assert(cnpy_close(&arr) == CNPY_SUCCESS);
+}
+
+typedef struct {
+  const cnpy_table_scan *scan;
+  size_t rows[64]; /* rows seen per thread */
+  unsigned char seen[N_ROWS / 1000 + 1]; /* batches seen */
+} job;
+
+/* Check a batch of the columns "c" and "a". */
+static void check_batch(const cnpy_table_batch *batch, void *arg, size_t t) {
+  job *j = (job *) arg;
+  assert(batch->row_start == batch->index * 1000 && batch->n_rows <= 1000);
+  double a[1000];
+  cnpy_read_f8_range(j->scan->columns[1], batch->row_start, batch->n_rows, a);
+  for (size_t i = 0; i < batch->n_rows; i += 1) {
+    size_t row = batch->row_start + i;
+    assert((uint8_t) batch->data[0][i] == (uint8_t) row);
+    assert(a[i] == 0.5 * (double) row);
+  }
+  assert(t < 64);
+  j->rows[t] += batch->n_rows;
+  __atomic_add_fetch(&j->seen[batch->index], 1, __ATOMIC_RELAXED);
+}
+
+int main(void) {
+  mkdir("table", 0755);
+  write_column("table/a.npy", CNPY_F8, N_ROWS);
+  write_column("table/b.npy", CNPY_I4, N_ROWS);
+  write_column("table/c.npy", CNPY_U1, N_ROWS);
+  FILE *f = fopen("table/notes.txt", "w");
+  assert(f != NULL && fputs("not a column\n", f) >= 0 && fclose(f) == 0);
+
+  cnpy_table table;
+  assert(cnpy_table_open("table", 2, &table) == CNPY_SUCCESS);
+  assert(table.n_columns == 3 && table.n_rows == N_ROWS);
+  size_t len;
+  cnpy_array meta;
+  const char *name = cnpy_table_column(&table, 1, &len, &meta);
+  assert(len == 1 && name[0] == 'b' && meta.dtype == CNPY_I4 && meta.raw_data == NULL);
+  assert(cnpy_table_find(&table, "c") == 2 && cnpy_table_find(&table, "c.npy") == 3 && cnpy_table_find(&table, "notes") == 3);
+
+  /* column b is broken after opening; scans which do not project it do not notice */
+  write_column("table/b.npy", CNPY_I4, 10);
+
+  const char *projection[] = { "c", "a" };
+  cnpy_table_scan_options opts;
+  cnpy_table_scan_options_init(&opts);
+  opts.batch_rows = 1000;
+  opts.prefetch_batches = 3;
+  opts.release = CNPY_RELEASE_DONTNEED;
+  opts.n_threads = 3;
+  cnpy_table_scan scan;
+  assert(cnpy_table_scan_begin(&table, projection, 2, &opts, &scan) == CNPY_SUCCESS);
+  assert(scan.n_columns == 2 && scan.n_batches == N_ROWS / 1000 + 1);
+  cnpy_table_batch batch;
+  job j;
+  memset(&j, 0, sizeof(j));
+  j.scan = &scan;
+  size_t n_batches = 0;
+  while (n_batches < 40 && cnpy_table_scan_next(&scan, &batch)) {
+    assert(batch.index == n_batches);
+    check_batch(&batch, &j, 0);
+    n_batches += 1;
+  }
+  /* the rest on three threads */
+  cnpy_table_scan_parallel(&scan, check_batch, &j);
+  assert(!cnpy_table_scan_next(&scan, &batch));
+  size_t total = 0;
+  for (size_t t = 0; t < 64; t += 1) {
+    total += j.rows[t];
+  }
+  assert(total == N_ROWS);
+  for (size_t b = 0; b < scan.n_batches; b += 1) {
+    assert(j.seen[b] == 1);
+  }
+  assert(cnpy_table_scan_end(&scan) == CNPY_SUCCESS);
+
+  /* default options; the last batch is short */
+  assert(cnpy_table_scan_begin(&table, projection, 1, NULL, &scan) == CNPY_SUCCESS);
+  assert(scan.n_batches == 1 && cnpy_table_scan_next(&scan, &batch) && batch.n_rows == N_ROWS);
+  assert(!cnpy_table_scan_next(&scan, &batch));
+  assert(cnpy_table_scan_end(&scan) == CNPY_SUCCESS);
+
+  const char *with_b[] = { "a", "b" };
+  assert(cnpy_table_scan_begin(&table, with_b, 2, NULL, &scan) == CNPY_ERROR_FORMAT);
+  const char *missing[] = { "a", "x" };
+  assert(cnpy_table_scan_begin(&table, missing, 2, NULL, &scan) == CNPY_ERROR_FILE);
+  assert(cnpy_table_close(&table) == CNPY_SUCCESS);
+
+  /* lengths are checked when the table is opened */
+  assert(cnpy_table_open("table", 0, &table) == CNPY_ERROR_FORMAT);
+  assert(strstr(cnpy_error_str, "differs in length") != NULL);
+  f = fopen("table/b.npy", "w");
+  assert(f != NULL && fputs("garbage", f) >= 0 && fclose(f) == 0);
+  assert(cnpy_table_open("table", 0, &table) == CNPY_ERROR_FORMAT);
+  assert(strstr(cnpy_error_str, "b.npy") != NULL);
+  unlink("table/b.npy");
+  assert(cnpy_table_open("table", 0, &table) == CNPY_SUCCESS);
+  assert(table.n_columns == 2 && cnpy_table_find(&table, "c") == 1);
+  assert(cnpy_table_close(&table) == CNPY_SUCCESS);
+  assert(cnpy_table_open("no_such_table", 0, &table) == CNPY_ERROR_FILE);
+
+  unlink("table/a.npy");
+  unlink("table/c.npy");
+  unlink("table/notes.txt");
+  rmdir("table");
+  return EXIT_SUCCESS;
+}
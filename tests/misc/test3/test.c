@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "cnpy.h"
+
+/* In-place byte order conversion of whole arrays. */
+
+static void check_descr(const cnpy_array a, char c) {
+  const char *descr = strstr(a.raw_data + 10, "'descr': '");
+  assert(descr != NULL);
+  assert(descr[10] == c);
+}
+
+int main(void) {
+  const char *fn = "converted.npy";
+  unlink(fn);
+
+  /* big enough to be split across several threads */
+  size_t dims[] = { 1 << 10, 1 << 11 };
+  size_t n = dims[0] * dims[1];
+
+  printf(" f8\n");
+  cnpy_array a;
+  assert(cnpy_create(fn, CNPY_BE, CNPY_F8, CNPY_C_ORDER, 2, dims, &a) == CNPY_SUCCESS);
+  for (size_t i = 0; i < n; i += 1) {
+    double x = (double) i * 0.25;
+    cnpy_write_f8_range(a, i, 1, &x);
+  }
+  check_descr(a, '>');
+  assert(cnpy_convert_byte_order(&a, CNPY_LE) == CNPY_SUCCESS);
+  assert(a.byte_order == CNPY_LE);
+  check_descr(a, '<');
+  for (size_t i = 0; i < n; i += 1) {
+    double x;
+    cnpy_read_f8_range(a, i, 1, &x);
+    assert(x == (double) i * 0.25);
+  }
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  /* the file itself was converted */
+  assert(cnpy_open(fn, true, &a) == CNPY_SUCCESS);
+  assert(a.byte_order == CNPY_LE);
+  size_t index[] = { 3, 5 };
+  assert(cnpy_get_f8(a, index) == (double) (3 * dims[1] + 5) * 0.25);
+  assert(cnpy_convert_byte_order(&a, CNPY_LE) == CNPY_SUCCESS);
+  assert(cnpy_convert_byte_order(&a, CNPY_BE) == CNPY_SUCCESS);
+  assert(cnpy_get_f8(a, index) == (double) (3 * dims[1] + 5) * 0.25);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  /* a read-only mapping cannot be converted */
+  cnpy_open_options opts;
+  cnpy_open_options_init(&opts);
+  opts.mode = CNPY_MAP_READ_ONLY;
+  assert(cnpy_open_ex(fn, &opts, &a) == CNPY_SUCCESS);
+  assert(a.read_only);
+  assert(cnpy_convert_byte_order(&a, CNPY_LE) == CNPY_ERROR_MMAP);
+  assert(a.byte_order == CNPY_BE);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  assert(cnpy_open(fn, false, &a) == CNPY_SUCCESS);
+  assert(!a.read_only);
+  assert(a.byte_order == CNPY_BE);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+  unlink(fn);
+  printf("  ok.\n");
+
+  /* complex numbers: real and imaginary part are converted separately; odd sizes exercise the kernel tails */
+  printf(" c8, c16, i2\n");
+  size_t dims_odd[] = { 37, 3 };
+  cnpy_array c8, c16, i2;
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_C8, CNPY_FORTRAN_ORDER, 2, dims_odd, &c8) == CNPY_SUCCESS);
+  assert(cnpy_create(NULL, CNPY_BE, CNPY_C16, CNPY_FORTRAN_ORDER, 2, dims_odd, &c16) == CNPY_SUCCESS);
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_I2, CNPY_C_ORDER, 2, dims_odd, &i2) == CNPY_SUCCESS);
+  size_t m = dims_odd[0] * dims_odd[1];
+  for (size_t i = 0; i < m; i += 1) {
+    complex float x = (float) i + (float) (2 * i) * I;
+    complex double y = (double) i - (double) (3 * i) * I;
+    int16_t z = (int16_t) (1000 - 7 * (int) i);
+    cnpy_write_c8_range(c8, i, 1, &x);
+    cnpy_write_c16_range(c16, i, 1, &y);
+    cnpy_write_i2_range(i2, i, 1, &z);
+  }
+  assert(cnpy_convert_byte_order(&c8, CNPY_BE) == CNPY_SUCCESS);
+  assert(cnpy_convert_byte_order(&c16, CNPY_LE) == CNPY_SUCCESS);
+  assert(cnpy_convert_byte_order(&i2, CNPY_BE) == CNPY_SUCCESS);
+  check_descr(c8, '>');
+  check_descr(c16, '<');
+  check_descr(i2, '>');
+  for (size_t i = 0; i < m; i += 1) {
+    complex float x;
+    complex double y;
+    int16_t z;
+    cnpy_read_c8_range(c8, i, 1, &x);
+    cnpy_read_c16_range(c16, i, 1, &y);
+    cnpy_read_i2_range(i2, i, 1, &z);
+    assert(x == (float) i + (float) (2 * i) * I);
+    assert(y == (double) i - (double) (3 * i) * I);
+    assert(z == (int16_t) (1000 - 7 * (int) i));
+  }
+  assert(cnpy_close(&c8) == CNPY_SUCCESS);
+  assert(cnpy_close(&c16) == CNPY_SUCCESS);
+  assert(cnpy_close(&i2) == CNPY_SUCCESS);
+  printf("  ok.\n");
+}
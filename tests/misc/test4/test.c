@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "cnpy.h"
+
+/* Accessors must agree with the by-value getters and setters. */
+
+int main(void) {
+  cnpy_byte_order byte_orders[] = { CNPY_LE, CNPY_BE };
+  cnpy_flat_order orders[] = { CNPY_C_ORDER, CNPY_FORTRAN_ORDER };
+  size_t dims[] = { 2, 3, 5, 7 };
+
+  for (size_t bo = 0; bo < 2; bo += 1) {
+    for (size_t o = 0; o < 2; o += 1) {
+      printf(" byte order %d, order %d\n", byte_orders[bo], orders[o]);
+      cnpy_array a4, a8, a16, a1;
+      assert(cnpy_create(NULL, byte_orders[bo], CNPY_U4, orders[o], 4, dims, &a4) == CNPY_SUCCESS);
+      assert(cnpy_create(NULL, byte_orders[bo], CNPY_F8, orders[o], 4, dims, &a8) == CNPY_SUCCESS);
+      assert(cnpy_create(NULL, byte_orders[bo], CNPY_C16, orders[o], 4, dims, &a16) == CNPY_SUCCESS);
+      assert(cnpy_create(NULL, byte_orders[bo], CNPY_I1, orders[o], 4, dims, &a1) == CNPY_SUCCESS);
+      cnpy_accessor acc4, acc8, acc16, acc1;
+      cnpy_acc_init(&a4, &acc4);
+      cnpy_acc_init(&a8, &acc8);
+      cnpy_acc_init(&a16, &acc16);
+      cnpy_acc_init(&a1, &acc1);
+
+      size_t index[CNPY_MAX_DIM];
+      cnpy_reset_index(a4, index);
+      uint32_t i = 0;
+      do {
+        cnpy_acc_set_u4(&acc4, index, i * 65539u);
+        cnpy_acc_set_f8_unchecked(&acc8, index, i * 0.5);
+        cnpy_acc_set_c16(&acc16, index, i - 2.0 * i * I);
+        cnpy_acc_set_i1_unchecked(&acc1, index, (int8_t) -i);
+        i += 1;
+      } while (cnpy_next_index(a4, index));
+
+      /* elements were written in serialization order, so the flat index is i */
+      cnpy_reset_index(a4, index);
+      i = 0;
+      do {
+        assert(cnpy_get_u4(a4, index) == i * 65539u);
+        assert(cnpy_acc_get_u4_unchecked(&acc4, index) == i * 65539u);
+        assert(cnpy_get_f8(a8, index) == i * 0.5);
+        assert(cnpy_acc_get_f8(&acc8, index) == i * 0.5);
+        assert(cnpy_get_c16(a16, index) == i - 2.0 * i * I);
+        assert(cnpy_acc_get_c16_unchecked(&acc16, index) == i - 2.0 * i * I);
+        assert(cnpy_get_i1(a1, index) == (int8_t) -i);
+        assert(cnpy_acc_get_i1(&acc1, index) == (int8_t) -i);
+        uint32_t x;
+        cnpy_read_u4_range(a4, i, 1, &x);
+        assert(x == i * 65539u);
+        i += 1;
+      } while (cnpy_next_index(a4, index));
+
+      assert(cnpy_close(&a4) == CNPY_SUCCESS);
+      assert(cnpy_close(&a8) == CNPY_SUCCESS);
+      assert(cnpy_close(&a16) == CNPY_SUCCESS);
+      assert(cnpy_close(&a1) == CNPY_SUCCESS);
+      printf("  ok.\n");
+    }
+  }
+}
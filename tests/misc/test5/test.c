@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "cnpy.h"
+
+/* Strided views: slicing, reversing, transposing, and dropping axes. */
+
+int main(void) {
+  cnpy_flat_order orders[] = { CNPY_C_ORDER, CNPY_FORTRAN_ORDER };
+  size_t dims[] = { 6, 8, 3 };
+
+  for (size_t o = 0; o < 2; o += 1) {
+    printf(" order %d\n", orders[o]);
+    cnpy_array a;
+    assert(cnpy_create(NULL, CNPY_BE, CNPY_I4, orders[o], 3, dims, &a) == CNPY_SUCCESS);
+    size_t index[CNPY_MAX_DIM];
+    cnpy_reset_index(a, index);
+    do {
+      cnpy_set_i4(a, index, (int32_t) (index[0] * 100 + index[1] * 10 + index[2]));
+    } while (cnpy_next_index(a, index));
+
+    cnpy_view full, v;
+    cnpy_view_init(&a, &full);
+    assert(cnpy_view_n_elements(&full) == 6 * 8 * 3);
+
+    /* rows 1, 3, 5; columns 2, 5; everything along the last axis */
+    cnpy_view_slice(&full, 0, 1, 6, 2, &v);
+    cnpy_view_slice(&v, 1, 2, 7, 3, &v);
+    assert(v.n_dim == 3 && v.dims[0] == 3 && v.dims[1] == 2 && v.dims[2] == 3);
+    size_t n = 0;
+    cnpy_view_reset_index(&v, index);
+    do {
+      int32_t expected = (int32_t) ((1 + 2 * index[0]) * 100 + (2 + 3 * index[1]) * 10 + index[2]);
+      assert(cnpy_view_get_i4(&v, index) == expected);
+      n += 1;
+    } while (cnpy_view_next_index(&v, index));
+    assert(n == cnpy_view_n_elements(&v));
+
+    /* reversed last axis, transposed, and with the middle axis dropped */
+    cnpy_view_reverse(&v, 2, &v);
+    size_t perm[] = { 2, 0, 1 };
+    cnpy_view_transpose(&v, perm, &v);
+    assert(v.dims[0] == 3 && v.dims[1] == 3 && v.dims[2] == 2);
+    cnpy_view_drop(&v, 2, 1, &v);
+    assert(v.n_dim == 2 && v.dims[0] == 3 && v.dims[1] == 3);
+    cnpy_view_reset_index(&v, index);
+    do {
+      int32_t expected = (int32_t) ((1 + 2 * index[1]) * 100 + 5 * 10 + (2 - index[0]));
+      assert(cnpy_view_get_i4(&v, index) == expected);
+    } while (cnpy_view_next_index(&v, index));
+
+    /* writes go to the array */
+    size_t vi[] = { 0, 2 };
+    cnpy_view_set_i4(&v, vi, -1);
+    size_t ai[] = { 5, 5, 2 };
+    assert(cnpy_get_i4(a, ai) == -1);
+
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+    printf("  ok.\n");
+  }
+}
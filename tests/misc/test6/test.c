@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+#include "cnpy.h"
+
+/* Hyperslab reads and writes with layout and dtype conversion. */
+
+static int32_t value(size_t i, size_t j, size_t k) {
+  return (int32_t) (i * 100 + j * 10 + k);
+}
+
+int main(void) {
+  cnpy_flat_order orders[] = { CNPY_C_ORDER, CNPY_FORTRAN_ORDER };
+  size_t dims[] = { 5, 6, 7 };
+
+  for (size_t o = 0; o < 2; o += 1) {
+    for (size_t oo = 0; oo < 2; oo += 1) {
+      printf(" array order %d, buffer order %d\n", orders[o], orders[oo]);
+      cnpy_array a;
+      assert(cnpy_create(NULL, CNPY_BE, CNPY_F8, orders[o], 3, dims, &a) == CNPY_SUCCESS);
+      size_t index[CNPY_MAX_DIM];
+      cnpy_reset_index(a, index);
+      do {
+        cnpy_set_f8(a, index, value(index[0], index[1], index[2]));
+      } while (cnpy_next_index(a, index));
+
+      /* strided slab, converted to int32 */
+      size_t start[] = { 1, 0, 2 };
+      size_t count[] = { 2, 3, 2 };
+      size_t stride[] = { 2, 2, 3 };
+      int32_t out[2 * 3 * 2];
+      cnpy_read_slab(a, start, count, stride, out, CNPY_I4, orders[oo]);
+      for (size_t i = 0; i < count[0]; i += 1) {
+        for (size_t j = 0; j < count[1]; j += 1) {
+          for (size_t k = 0; k < count[2]; k += 1) {
+            size_t flat = (orders[oo] == CNPY_C_ORDER)? (i * count[1] + j) * count[2] + k : (k * count[1] + j) * count[0] + i;
+            assert(out[flat] == value(1 + 2 * i, 2 * j, 2 + 3 * k));
+          }
+        }
+      }
+
+      /* dense slab without conversion (bulk copies along the fastest axis) */
+      size_t start2[] = { 0, 1, 0 };
+      size_t count2[] = { 5, 4, 7 };
+      double out2[5 * 4 * 7];
+      cnpy_read_slab(a, start2, count2, NULL, out2, CNPY_F8, orders[oo]);
+      for (size_t i = 0; i < count2[0]; i += 1) {
+        for (size_t j = 0; j < count2[1]; j += 1) {
+          for (size_t k = 0; k < count2[2]; k += 1) {
+            size_t flat = (orders[oo] == CNPY_C_ORDER)? (i * count2[1] + j) * count2[2] + k : (k * count2[1] + j) * count2[0] + i;
+            assert(out2[flat] == value(i, 1 + j, k));
+          }
+        }
+      }
+
+      /* write a converted slab back and read it element by element */
+      float in[2 * 3 * 2];
+      for (size_t i = 0; i < 12; i += 1) {
+        in[i] = -0.5f * (float) i;
+      }
+      cnpy_write_slab(a, start, count, stride, in, CNPY_F4, orders[oo]);
+      for (size_t i = 0; i < count[0]; i += 1) {
+        for (size_t j = 0; j < count[1]; j += 1) {
+          for (size_t k = 0; k < count[2]; k += 1) {
+            size_t flat = (orders[oo] == CNPY_C_ORDER)? (i * count[1] + j) * count[2] + k : (k * count[1] + j) * count[0] + i;
+            size_t idx[] = { 1 + 2 * i, 2 * j, 2 + 3 * k };
+            assert(cnpy_get_f8(a, idx) == -0.5 * (double) flat);
+          }
+        }
+      }
+      size_t untouched[] = { 2, 0, 2 };
+      assert(cnpy_get_f8(a, untouched) == value(2, 0, 2));
+
+      assert(cnpy_close(&a) == CNPY_SUCCESS);
+      printf("  ok.\n");
+    }
+  }
+
+  /* floating-point values saturate in integer buffers, and NaN becomes 0 */
+  cnpy_array f;
+  size_t dims_f[] = { 5 };
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_F8, CNPY_C_ORDER, 1, dims_f, &f) == CNPY_SUCCESS);
+  double special[] = { NAN, 1e300, -1e300, -2.7, INFINITY };
+  cnpy_write_f8_range(f, 0, 5, special);
+  size_t start_f[] = { 0 };
+  int8_t i1[5];
+  cnpy_read_slab(f, start_f, dims_f, NULL, i1, CNPY_I1, CNPY_C_ORDER);
+  assert(i1[0] == 0 && i1[1] == INT8_MAX && i1[2] == INT8_MIN && i1[3] == -2 && i1[4] == INT8_MAX);
+  uint64_t u8[5];
+  cnpy_read_slab(f, start_f, dims_f, NULL, u8, CNPY_U8, CNPY_C_ORDER);
+  assert(u8[0] == 0 && u8[1] == UINT64_MAX && u8[2] == 0 && u8[3] == 0 && u8[4] == UINT64_MAX);
+  int64_t i8[5];
+  cnpy_read_slab(f, start_f, dims_f, NULL, i8, CNPY_I8, CNPY_C_ORDER);
+  assert(i8[0] == 0 && i8[1] == INT64_MAX && i8[2] == INT64_MIN && i8[3] == -2 && i8[4] == INT64_MAX);
+  assert(cnpy_close(&f) == CNPY_SUCCESS);
+  printf(" saturation ok.\n");
+}
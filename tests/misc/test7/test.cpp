@@ -0,0 +1,83 @@
+#include <cstdio>
+#include <cassert>
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include "cnpy.hpp"
+
+/* The C++ interface: typed views, iterators, and standard algorithms over mapped arrays.
+ * (No execution policies here, because <execution> needs TBB with libstdc++.) */
+
+template <cnpy_byte_order BO>
+static void test_byte_order() {
+  std::printf(" byte order %d\n", BO);
+  cnpy::array a = cnpy::array::create("", BO, CNPY_F8, CNPY_C_ORDER, {4, 5, 6});
+  auto v = a.view<double, CNPY_C_ORDER, BO, 3>();
+  assert(v.size() == 4 * 5 * 6);
+  assert(v.extent(1) == 5);
+
+  for (std::size_t i = 0; i < 4; i += 1) {
+    for (std::size_t j = 0; j < 5; j += 1) {
+      for (std::size_t k = 0; k < 6; k += 1) {
+        v(i, j, k) = static_cast<double>(i * 100 + j * 10 + k);
+      }
+    }
+  }
+
+  /* the C accessors see the same values */
+  std::size_t index[] = {3, 2, 1};
+  assert(cnpy_get_f8(a.get(), index) == 321.0);
+
+  /* iteration runs in serialization order */
+  double expected = 0.0;
+  for (std::size_t i = 0; i < 4; i += 1) {
+    for (std::size_t j = 0; j < 5; j += 1) {
+      for (std::size_t k = 0; k < 6; k += 1) {
+        expected += static_cast<double>(i * 100 + j * 10 + k);
+      }
+    }
+  }
+  double sum = std::transform_reduce(v.begin(), v.end(), 0.0, std::plus<>(), [](double x) { return x; });
+  assert(sum == expected);
+  assert(static_cast<double>(*(v.begin() + 7)) == 11.0);
+  assert(v.end() - v.begin() == 120);
+
+  std::fill(v.begin(), v.begin() + 6, -1.0);
+  assert(static_cast<double>(v(0, 0, 5)) == -1.0);
+  assert(static_cast<double>(v(0, 1, 0)) == 10.0);
+  std::printf("  ok.\n");
+}
+
+int main() {
+  test_byte_order<CNPY_LE>();
+  test_byte_order<CNPY_BE>();
+
+  std::printf(" complex, fortran order\n");
+  cnpy::array c = cnpy::array::create("", CNPY_BE, CNPY_C16, CNPY_FORTRAN_ORDER, {3, 2});
+  auto cv = c.view<std::complex<double>, CNPY_FORTRAN_ORDER, CNPY_BE, 2>();
+  cv(2, 1) = std::complex<double>(1.5, -2.5);
+  assert(static_cast<std::complex<double>>(cv.flat(5)) == std::complex<double>(1.5, -2.5));
+  std::size_t index[] = {2, 1};
+  assert(cnpy_get_c16(c.get(), index) == std::complex<double>(1.5, -2.5));
+
+  /* mismatches are reported as exceptions */
+  bool thrown = false;
+  try {
+    c.view<double, CNPY_FORTRAN_ORDER, CNPY_BE, 2>();
+  }
+  catch (const cnpy::error &e) {
+    thrown = true;
+    assert(e.status() == CNPY_ERROR_FORMAT);
+  }
+  assert(thrown);
+  thrown = false;
+  try {
+    cnpy::array::open("does-not-exist.npy", false);
+  }
+  catch (const cnpy::error &e) {
+    thrown = true;
+    assert(e.status() == CNPY_ERROR_FILE);
+  }
+  assert(thrown);
+  std::printf("  ok.\n");
+}
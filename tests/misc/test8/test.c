@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "cnpy.h"
+
+/* Span iteration over arrays and views. */
+
+/* Check that the spans of v cover each element of v exactly once; return the number of spans. */
+static size_t check_spans(const cnpy_view *v) {
+  static bool seen[1000];
+  memset(seen, 0, sizeof(seen));
+  int32_t buf[6 * 8 * 3];
+  size_t n_spans = 0, n = 0;
+  cnpy_span_iter it;
+  cnpy_span span;
+  cnpy_span_iter_init(v, &it);
+  while (cnpy_span_next(&it, &span)) {
+    cnpy_span_read(&it, &span, buf);
+    assert(buf[0] == cnpy_view_get_i4(v, span.index));
+    for (size_t i = 0; i < span.length; i += 1) {
+      assert(buf[i] >= 0 && buf[i] < 1000 && !seen[buf[i]]);
+      seen[buf[i]] = true;
+    }
+    n += span.length;
+    n_spans += 1;
+  }
+  assert(n == cnpy_view_n_elements(v));
+  return n_spans;
+}
+
+int main(void) {
+  cnpy_flat_order orders[] = { CNPY_C_ORDER, CNPY_FORTRAN_ORDER };
+  size_t dims[] = { 6, 8, 3 };
+
+  for (size_t o = 0; o < 2; o += 1) {
+    printf(" order %d\n", orders[o]);
+    cnpy_array a;
+    assert(cnpy_create(NULL, CNPY_BE, CNPY_I4, orders[o], 3, dims, &a) == CNPY_SUCCESS);
+    size_t index[CNPY_MAX_DIM];
+    cnpy_reset_index(a, index);
+    do {
+      cnpy_set_i4(a, index, (int32_t) (index[0] * 100 + index[1] * 10 + index[2]));
+    } while (cnpy_next_index(a, index));
+
+    cnpy_view full, v;
+    cnpy_view_init(&a, &full);
+
+    /* a dense array is a single span */
+    assert(check_spans(&full) == 1);
+
+    /* leading rows (C order) or trailing planes (Fortran order) stay contiguous */
+    cnpy_view_slice(&full, (orders[o] == CNPY_C_ORDER)? 0 : 2, 1, 3, 1, &v);
+    assert(check_spans(&v) == 1);
+
+    /* a slice of the middle axis is contiguous only within each outer index */
+    cnpy_view_slice(&full, 1, 2, 6, 1, &v);
+    assert(check_spans(&v) == ((orders[o] == CNPY_C_ORDER)? 6 : 3));
+
+    /* strided and reversed axes give single elements, but are still covered */
+    cnpy_view_slice(&full, 1, 0, 8, 3, &v);
+    check_spans(&v);
+    cnpy_view_reverse(&full, 0, &v);
+    check_spans(&v);
+
+    /* transposing does not change storage order, so it is still a single span */
+    size_t perm[] = { 2, 0, 1 };
+    cnpy_view_transpose(&full, perm, &v);
+    assert(check_spans(&v) == 1);
+
+    assert(cnpy_close(&a) == CNPY_SUCCESS);
+    printf("  ok.\n");
+  }
+
+  printf("done.\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+#include "cnpy.h"
+
+/* Whole-array reductions, compared to naive loops. */
+
+static const unsigned all_ops = CNPY_OP_SUM | CNPY_OP_MIN | CNPY_OP_MAX | CNPY_OP_MEAN | CNPY_OP_ARGMIN | CNPY_OP_ARGMAX;
+
+static void test_i4(cnpy_byte_order byte_order) {
+  size_t dims[] = { 101, 99 };
+  cnpy_array a;
+  assert(cnpy_create(NULL, byte_order, CNPY_I4, CNPY_C_ORDER, 2, dims, &a) == CNPY_SUCCESS);
+  size_t n = cnpy_n_elements(a);
+  int64_t sum = 0;
+  for (size_t i = 0; i < n; i += 1) {
+    int32_t x = (int32_t) ((i * 7919) % 10007) - 5000;
+    x = (i == 8000 || i == 9000)? -7000 : x;
+    x = (i == 3 || i == 9001)? 7000 : x;
+    cnpy_write_range(a, i, 1, &x);
+    sum += x;
+  }
+  cnpy_reduction r;
+  cnpy_reduce(a, all_ops, &r, 0);
+  assert(r.count == n);
+  assert(r.sum_i == sum && r.sum == (double) sum);
+  assert(r.mean == (double) sum / (double) n);
+  assert(r.min == -7000 && r.argmin == 8000);
+  assert(r.max == 7000 && r.argmax == 3);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+}
+
+static void test_f8(cnpy_byte_order byte_order) {
+  /* large enough to be split across several threads */
+  size_t dims[] = { 3 << 20 };
+  cnpy_array a;
+  assert(cnpy_create(NULL, byte_order, CNPY_F8, CNPY_C_ORDER, 1, dims, &a) == CNPY_SUCCESS);
+  size_t n = dims[0];
+  long double sum = 0;
+  double lo = INFINITY, hi = -INFINITY;
+  size_t argmin = 0, argmax = 0;
+  for (size_t i = 0; i < n; i += 1) {
+    double x = sin((double) i) * (double) (i % 1000);
+    cnpy_write_range(a, i, 1, &x);
+    sum += x;
+    if (x < lo) { lo = x; argmin = i; }
+    if (x > hi) { hi = x; argmax = i; }
+  }
+  cnpy_reduction r1, r8;
+  cnpy_reduce(a, all_ops, &r1, 1);
+  cnpy_reduce(a, all_ops, &r8, 8);
+  assert(fabs(r1.sum - (double) sum) <= 1e-9 * fabsl(sum) + 1e-6);
+  assert(fabs(r8.sum - (double) sum) <= 1e-9 * fabsl(sum) + 1e-6);
+  assert(r1.min == lo && r8.min == lo && r1.argmin == argmin && r8.argmin == argmin);
+  assert(r1.max == hi && r8.max == hi && r1.argmax == argmax && r8.argmax == argmax);
+
+  /* NaNs propagate to the extrema */
+  double nan = NAN;
+  cnpy_write_range(a, n - 5, 1, &nan);
+  cnpy_write_range(a, n - 2, 1, &nan);
+  cnpy_reduce(a, CNPY_OP_MIN | CNPY_OP_ARGMAX, &r8, 8);
+  assert(isnan(r8.min) && r8.argmax == n - 5);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+}
+
+static void test_small_types(void) {
+  size_t dims[] = { 5000 };
+  cnpy_array a;
+
+  /* unsigned sums wrap around */
+  assert(cnpy_create(NULL, CNPY_BE, CNPY_U8, CNPY_C_ORDER, 1, dims, &a) == CNPY_SUCCESS);
+  uint64_t usum = 0;
+  for (size_t i = 0; i < dims[0]; i += 1) {
+    uint64_t x = UINT64_MAX - i * 12345;
+    cnpy_write_range(a, i, 1, &x);
+    usum += x;
+  }
+  cnpy_reduction r;
+  cnpy_reduce(a, CNPY_OP_SUM | CNPY_OP_ARGMIN, &r, 0);
+  assert(r.sum_u == usum && r.argmin == dims[0] - 1);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  /* booleans count */
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_B, CNPY_FORTRAN_ORDER, 1, dims, &a) == CNPY_SUCCESS);
+  for (size_t i = 0; i < dims[0]; i += 1) {
+    cnpy_set_b(a, &i, i % 3 == 0);
+  }
+  cnpy_reduce(a, CNPY_OP_SUM | CNPY_OP_MAX | CNPY_OP_ARGMIN, &r, 0);
+  assert(r.sum_u == 1667 && r.sum_i == 1667 && r.max == 1 && r.argmin == 1);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  /* complex numbers only have sums */
+  assert(cnpy_create(NULL, CNPY_BE, CNPY_C8, CNPY_C_ORDER, 1, dims, &a) == CNPY_SUCCESS);
+  for (size_t i = 0; i < dims[0]; i += 1) {
+    cnpy_set_c8(a, &i, (float) i + 2.0f * (float) i * I);
+  }
+  cnpy_reduce(a, CNPY_OP_SUM | CNPY_OP_MEAN, &r, 0);
+  assert(r.sum == 4999.0 * 5000 / 2 && r.sum_imag == 4999.0 * 5000);
+  assert(r.mean == 4999.0 / 2 && r.mean_imag == 4999.0);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+}
+
+static void test_large_integers(void) {
+  /* the means of integers do not wrap around with their sums */
+  size_t dims[] = { 3000 };
+  cnpy_array a;
+  assert(cnpy_create(NULL, CNPY_LE, CNPY_I8, CNPY_C_ORDER, 1, dims, &a) == CNPY_SUCCESS);
+  for (size_t i = 0; i < dims[0]; i += 1) {
+    int64_t x = INT64_MAX - (int64_t) i;
+    cnpy_write_range(a, i, 1, &x);
+  }
+  cnpy_reduction r;
+  cnpy_reduce(a, CNPY_OP_SUM | CNPY_OP_MEAN, &r, 0);
+  assert(fabs(r.mean - (double) INT64_MAX) <= 1e-12 * (double) INT64_MAX);
+  assert(fabs(r.sum - 3000.0 * (double) INT64_MAX) <= 1e-12 * 3000.0 * (double) INT64_MAX);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+
+  assert(cnpy_create(NULL, CNPY_BE, CNPY_U8, CNPY_C_ORDER, 1, dims, &a) == CNPY_SUCCESS);
+  for (size_t i = 0; i < dims[0]; i += 1) {
+    uint64_t x = UINT64_MAX;
+    cnpy_write_range(a, i, 1, &x);
+  }
+  cnpy_reduce(a, CNPY_OP_MEAN, &r, 0);
+  assert(r.mean == (double) UINT64_MAX);
+  assert(cnpy_close(&a) == CNPY_SUCCESS);
+}
+
+int main(void) {
+  printf(" integers\n");
+  test_i4(CNPY_LE);
+  test_i4(CNPY_BE);
+  printf(" floats\n");
+  test_f8(CNPY_LE);
+  test_f8(CNPY_BE);
+  printf(" other types\n");
+  test_small_types();
+  test_large_integers();
+  printf("done.\n");
+  return EXIT_SUCCESS;
+}